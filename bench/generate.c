@@ -0,0 +1,326 @@
+/* Writes a valid Crom program of about LINES lines to stdout, for measuring
+ * how the compiler scales (bench/throughput.sh).
+ *
+ *   generate LINES [--seed=N] [--mix=F,S,E,X,L] [--depth=N] [--reuse=PERCENT]
+ *
+ * The program is built from units picked at random, with weights given by
+ * --mix, in order: functions, structs, enums, deep expressions and lists of
+ * statements. Every unit declares names of its own, so the symbol table
+ * grows with the program, and uses names declared before it, which a
+ * statement picks from all of those so far unless --reuse percent of the
+ * time it takes one of the last few. Expressions nest --depth deep.
+ *
+ * The same arguments always give the same program, on any machine: the
+ * random numbers come from a generator of our own, seeded by --seed. */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h> // for strtol, exit
+#include <string.h> // for strncmp
+
+typedef enum {
+  UNIT_FUNCTION,
+  UNIT_STRUCT,
+  UNIT_ENUM,
+  UNIT_EXPRESSION,
+  UNIT_STATEMENTS,
+  UNIT_COUNT,
+} UnitKind;
+
+static struct {
+  long lines;
+  uint64_t state;
+  int weights[UNIT_COUNT];
+  int depth;
+  int reuse;
+
+  long written;
+  long globals;   // v0, v1, ...: every unit's results, all i64
+  long functions; // F0, F1, ...: all (i64, i64) :: i64
+  long structs;
+  long enums;
+} Gen = {
+  .lines = 0,
+  .state = 1,
+  .weights = {
+    [UNIT_FUNCTION]   = 30,
+    [UNIT_STRUCT]     = 10,
+    [UNIT_ENUM]       = 5,
+    [UNIT_EXPRESSION] = 15,
+    [UNIT_STATEMENTS] = 40,
+  },
+  .depth = 8,
+  .reuse = 50,
+};
+
+static void Usage() {
+  fprintf(stderr, "Usage: generate LINES [--seed=N] [--mix=F,S,E,X,L] [--depth=N] [--reuse=PERCENT]\n");
+  exit(2);
+}
+
+// xorshift64*, which is plenty for picking what to write next
+static uint64_t Next() {
+  Gen.state ^= Gen.state >> 12;
+  Gen.state ^= Gen.state << 25;
+  Gen.state ^= Gen.state >> 27;
+  return Gen.state * 0x2545F4914F6CDD1DULL;
+}
+
+static long Below(long n) {
+  return (n <= 1) ? 0 : (long)((Next() >> 1) % (uint64_t)n);
+}
+
+static bool Chance(int percent) {
+  return Below(100) < percent;
+}
+
+static void Line(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static void Line(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+
+  putchar('\n');
+  Gen.written++;
+}
+
+/* === Names === */
+static long SomeGlobal() {
+  if (Chance(Gen.reuse)) return Gen.globals - 1 - Below((Gen.globals < 8) ? Gen.globals : 8);
+  return Below(Gen.globals);
+}
+
+static long NewGlobal(const char *value) {
+  Line("i64 v%ld = %s;", Gen.globals, value);
+  return Gen.globals++;
+}
+
+/* === Expressions === */
+static const char *Operators[] = {"+", "-", "*"};
+
+// Writes to `out` an expression nesting `depth` deep, of what `leaf` gives
+static int Expression(char *out, int size, int depth, const char *(*leaf)(void *), void *context) {
+  if (depth == 0) return snprintf(out, size, "%s", leaf(context));
+
+  const char *op = Operators[Below(3)];
+  char inner[2048];
+  Expression(inner, sizeof(inner), depth - 1, leaf, context);
+
+  // Now and then both sides nest, but never so often that the line gets long
+  if (depth <= 3 && Chance(30)) {
+    char other[2048];
+    Expression(other, sizeof(other), depth - 1, leaf, context);
+    return snprintf(out, size, "(%s %s %s)", inner, op, other);
+  }
+
+  if (Chance(50)) return snprintf(out, size, "(%s %s %s)", inner, op, leaf(context));
+  return snprintf(out, size, "(%s %s %s)", leaf(context), op, inner);
+}
+
+static const char *GlobalLeaf(void *context) {
+  (void)context;
+  static char leaf[32];
+  if (Gen.globals == 0 || Chance(25)) {
+    snprintf(leaf, sizeof(leaf), "%ld", 1 + Below(100));
+  } else {
+    snprintf(leaf, sizeof(leaf), "v%ld", SomeGlobal());
+  }
+  return leaf;
+}
+
+// Within function `*(long *)context`: its parameters, its locals and the globals
+static const char *LocalLeaf(void *context) {
+  static char leaf[48];
+  long f = *(long *)context;
+  switch (Below(4)) {
+    case 0: snprintf(leaf, sizeof(leaf), "f%ld_a", f); break;
+    case 1: snprintf(leaf, sizeof(leaf), "f%ld_b", f); break;
+    case 2: snprintf(leaf, sizeof(leaf), "f%ld_l", f); break;
+    default: return GlobalLeaf(NULL);
+  }
+  return leaf;
+}
+
+/* === Units === */
+static void Function() {
+  long f = Gen.functions++;
+  char expr[8192];
+
+  Line("F%ld(i64 f%ld_a, i64 f%ld_b) :: i64 {", f, f, f);
+  Line("  i64 f%ld_l = f%ld_a;", f, f);
+
+  for (long i = 2 + Below(6); i > 0; i--) {
+    switch (Below(4)) {
+      case 0:
+        Line("  if (f%ld_l < %ld) {", f, Below(1000));
+        Line("    f%ld_l += f%ld_b;", f, f);
+        Line("  }");
+        break;
+      case 1:
+        Line("  for (i64 f%ld_i%ld = 0; f%ld_i%ld < %ld; f%ld_i%ld++) {", f, i, f, i, 2 + Below(4), f, i);
+        Line("    f%ld_l = f%ld_l + f%ld_i%ld;", f, f, f, i);
+        Line("  }");
+        break;
+      default:
+        Expression(expr, sizeof(expr), 1 + Below(Gen.depth), LocalLeaf, &f);
+        Line("  f%ld_l = %s;", f, expr);
+        break;
+    }
+  }
+
+  Line("  return f%ld_l - f%ld_b;", f, f);
+  Line("}");
+
+  // Arguments are names or literals, like most calls
+  char call[64];
+  if (Gen.globals == 0) {
+    snprintf(call, sizeof(call), "F%ld(%ld, %ld)", f, Below(100), Below(100));
+  } else {
+    snprintf(call, sizeof(call), "F%ld(v%ld, %ld)", f, SomeGlobal(), Below(100));
+  }
+  NewGlobal(call);
+}
+
+static void Struct() {
+  long s = Gen.structs++;
+  long members = 2 + Below(6);
+
+  Line("struct S%ld {", s);
+  for (long i = 0; i < members; i++) Line("  i64 s%ld_m%ld;", s, i);
+  Line("}");
+
+  char list[1024];
+  int length = 0;
+  for (long i = 0; i < members; i++) {
+    length += snprintf(list + length, sizeof(list) - length, "%s%ld", (i > 0) ? ", " : "", Below(100));
+  }
+  Line("struct S%ld s%ld = {%s};", s, s, list);
+
+  char sum[128];
+  snprintf(sum, sizeof(sum), "s%ld.s%ld_m%ld * s%ld.s%ld_m%ld", s, s, Below(members), s, s, Below(members));
+  NewGlobal(sum);
+}
+
+static void Enum() {
+  long e = Gen.enums++;
+  long members = 3 + Below(10);
+
+  Line("enum E%ld {", e);
+  for (long i = 0; i < members; i++) {
+    if (Chance(20)) {
+      Line("  E%ld_M%ld = %ld,", e, i, Below(50));
+    } else {
+      Line("  E%ld_M%ld,", e, i);
+    }
+  }
+  Line("};");
+
+  char use[64];
+  snprintf(use, sizeof(use), "E%ld_M%ld + %ld", e, Below(members), Below(10));
+  NewGlobal(use);
+}
+
+static void DeepExpression() {
+  char expr[8192];
+  Expression(expr, sizeof(expr), Gen.depth, GlobalLeaf, NULL);
+  NewGlobal(expr);
+}
+
+static void Statements() {
+  char expr[8192];
+
+  for (long i = 4 + Below(12); i > 0 && Gen.written < Gen.lines; i--) {
+    if (Gen.globals == 0 || Chance(40)) {
+      Expression(expr, sizeof(expr), 1 + Below(3), GlobalLeaf, NULL);
+      NewGlobal(expr);
+      continue;
+    }
+
+    long target = SomeGlobal();
+    switch (Below(4)) {
+      case 0:
+        Line("v%ld += v%ld;", target, SomeGlobal());
+        break;
+      case 1:
+        Line("if (v%ld > %ld) {", SomeGlobal(), Below(1000));
+        Line("  v%ld = v%ld - %ld;", target, target, 1 + Below(10));
+        Line("}");
+        break;
+      default:
+        Expression(expr, sizeof(expr), 1 + Below(3), GlobalLeaf, NULL);
+        Line("v%ld = %s;", target, expr);
+        break;
+    }
+  }
+}
+
+static void (*Units[UNIT_COUNT])() = {
+  [UNIT_FUNCTION]   = Function,
+  [UNIT_STRUCT]     = Struct,
+  [UNIT_ENUM]       = Enum,
+  [UNIT_EXPRESSION] = DeepExpression,
+  [UNIT_STATEMENTS] = Statements,
+};
+
+static UnitKind PickUnit() {
+  int total = 0;
+  for (int i = 0; i < UNIT_COUNT; i++) total += Gen.weights[i];
+
+  long pick = Below(total);
+  for (int i = 0; i < UNIT_COUNT; i++) {
+    if (pick < Gen.weights[i]) return i;
+    pick -= Gen.weights[i];
+  }
+  return UNIT_STATEMENTS;
+}
+
+/* === Options === */
+static long Number(const char *s, long min, long max) {
+  char *end;
+  long n = strtol(s, &end, 10);
+  if (*s == '\0' || *end != '\0' || n < min || n > max) Usage();
+  return n;
+}
+
+static void ParseMix(const char *s) {
+  int total = 0;
+  for (int i = 0; i < UNIT_COUNT; i++) {
+    char *end;
+    long weight = strtol(s, &end, 10);
+    if (end == s || weight < 0 || weight > 1000) Usage();
+    if (*end != ((i < UNIT_COUNT - 1) ? ',' : '\0')) Usage();
+
+    Gen.weights[i] = weight;
+    total += weight;
+    s = end + 1;
+  }
+
+  if (total == 0) Usage();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) Usage();
+  Gen.lines = Number(argv[1], 1, 1L << 40);
+
+  for (int i = 2; i < argc; i++) {
+    if (strncmp(argv[i], "--seed=", 7) == 0) {
+      Gen.state = Number(argv[i] + 7, 0, 1L << 62) * 2 + 1;
+    } else if (strncmp(argv[i], "--mix=", 6) == 0) {
+      ParseMix(argv[i] + 6);
+    } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+      Gen.depth = Number(argv[i] + 8, 1, 64);
+    } else if (strncmp(argv[i], "--reuse=", 8) == 0) {
+      Gen.reuse = Number(argv[i] + 8, 0, 100);
+    } else {
+      Usage();
+    }
+  }
+
+  Line("// Generated by bench/generate %ld", Gen.lines);
+  while (Gen.written < Gen.lines) Units[PickUnit()]();
+
+  return 0;
+}
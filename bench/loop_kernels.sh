@@ -0,0 +1,44 @@
+#!/bin/bash
+# Run time of the loop kernels in bench/kernels, built with loop
+# optimizations (the default) versus without them (-fno-loop-opt). Both
+# builds must print the same result.
+#
+#   bench/loop_kernels.sh [rounds]
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+ROUNDS="${1:-3}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -w "$ROOT"/src/*.c -o "$WORK/cromc"
+
+now_ns() { date +%s%N; }
+
+time_runs() {
+  local start end
+  start=$(now_ns)
+  for round in $(seq "$ROUNDS"); do
+    "$1" > /dev/null
+  done
+  end=$(now_ns)
+  echo $(( (end - start) / 1000 ))
+}
+
+printf "%-20s %12s %12s %8s\n" "kernel" "-fno-loop-opt" "optimized" "speedup"
+for kernel in "$ROOT"/bench/kernels/*.crom; do
+  name=$(basename "$kernel" .crom)
+  "$WORK/cromc" -fno-loop-opt -o "$WORK/$name.base" "$kernel" > /dev/null
+  "$WORK/cromc" -o "$WORK/$name.opt" "$kernel" > /dev/null
+
+  if [ "$("$WORK/$name.base")" != "$("$WORK/$name.opt")" ]; then
+    echo "$name: optimized build prints a different result" >&2
+    exit 1
+  fi
+
+  base_us=$(time_runs "$WORK/$name.base")
+  opt_us=$(time_runs "$WORK/$name.opt")
+  awk -v name="$name" -v n="$ROUNDS" -v base="$base_us" -v opt="$opt_us" 'BEGIN {
+    printf "%-20s %9.1f ms %9.1f ms %7.2fx\n", name, base / n / 1000, opt / n / 1000, base / opt
+  }'
+done
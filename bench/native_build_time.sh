@@ -0,0 +1,39 @@
+#!/bin/bash
+# End-to-end build time of every OK test program, in-process (the default)
+# versus the external toolchain (--external-toolchain: cc assembles and links).
+#
+#   bench/native_build_time.sh [rounds]
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+ROUNDS="${1:-3}"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -w "$ROOT"/src/*.c -o "$WORK/cromc"
+TESTS=$(grep -l "^// OK" "$ROOT"/tests/*/*.crom)
+
+now_ns() { date +%s%N; }
+
+time_builds() {
+  local start end
+  start=$(now_ns)
+  for round in $(seq "$ROUNDS"); do
+    for test in $TESTS; do
+      "$WORK/cromc" "$@" -o "$WORK/program" "$test" > /dev/null
+    done
+  done
+  end=$(now_ns)
+  echo $(( (end - start) / 1000 ))
+}
+
+count=$(( $(echo "$TESTS" | wc -l) * ROUNDS ))
+internal_us=$(time_builds)
+external_us=$(time_builds --external-toolchain)
+
+awk -v n="$count" -v in_us="$internal_us" -v ex_us="$external_us" 'BEGIN {
+  printf "%d builds\n", n
+  printf "in-process:         %8.2f ms/build\n", in_us / n / 1000
+  printf "external toolchain: %8.2f ms/build\n", ex_us / n / 1000
+  printf "speedup:            %8.1fx\n", ex_us / in_us
+}'
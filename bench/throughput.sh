@@ -0,0 +1,154 @@
+#!/bin/bash
+# Compiler throughput on generated programs (bench/generate.c) of growing
+# size: lines and tokens per second, peak RSS and the phases taking the
+# most time, from the compiler's own -ftime-report.
+#
+#   bench/throughput.sh [options] [lines...] [-- compiler flags]
+#
+#   --update          store this run as the baseline
+#   --baseline=FILE   bench/baselines/throughput.tsv by default
+#   --tolerance=PCT   slower or bigger than the baseline by more is a regression (20)
+#   --max-scaling=N   time per line N times that of the smallest program is a regression (3)
+#   --timeout=SECS    per compile, after which larger programs aren't tried (120)
+#   --seed=N, --mix=F,S,E,X,L, --depth=N, --reuse=PCT   passed to the generator
+#
+# Programs are 1000, 10000, 100000 and 1000000 lines unless given. Compiles
+# that take much more than linear time are flagged whatever the baseline
+# says, as that holds on any machine. Throughput depends on the machine,
+# so no baseline ships with the repository: store one with --update on the
+# machine that will run the benchmark, and later runs with the same
+# generator options and compiler flags are compared with it. Exits 1 if
+# anything regressed.
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BASELINE="$ROOT/bench/baselines/throughput.tsv"
+TOLERANCE=20
+MAX_SCALING=3
+TIMEOUT=120
+UPDATE=false
+GENERATOR_FLAGS=()
+SIZES=()
+COMPILER_FLAGS=()
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    --update) UPDATE=true ;;
+    --baseline=*) BASELINE="${1#*=}" ;;
+    --tolerance=*) TOLERANCE="${1#*=}" ;;
+    --max-scaling=*) MAX_SCALING="${1#*=}" ;;
+    --timeout=*) TIMEOUT="${1#*=}" ;;
+    --seed=*|--mix=*|--depth=*|--reuse=*) GENERATOR_FLAGS+=("$1") ;;
+    --) shift; COMPILER_FLAGS=("$@"); break ;;
+    [0-9]*) SIZES+=("$1") ;;
+    *) echo "throughput.sh: Unknown option '$1'" >&2; exit 2 ;;
+  esac
+  shift
+done
+[ ${#SIZES[@]} -gt 0 ] || SIZES=(1000 10000 100000 1000000)
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -w "$ROOT"/src/*.c -o "$WORK/cromc"
+gcc -O2 -w "$ROOT"/bench/generate.c -o "$WORK/generate"
+
+# Baselines are only comparable between runs of the same programs and flags
+CONFIG="generator: ${GENERATOR_FLAGS[*]:-defaults}; compiler: ${COMPILER_FLAGS[*]:-none}"
+baseline_config=""
+[ -f "$BASELINE" ] && baseline_config=$(head -1 "$BASELINE" | sed 's/^# //')
+if [ -f "$BASELINE" ] && [ "$baseline_config" != "$CONFIG" ] && ! $UPDATE; then
+  echo "Baseline is of '$baseline_config', not compared" >&2
+fi
+
+json_number() {
+  grep -o "\"$1\": [0-9.]*" "$2" | head -1 | sed 's/.*: //'
+}
+
+# The three phases taking the most time, as "symbols 92% dead_code 5% lex 1%"
+top_phases() {
+  grep -o '"phases": {[^}]*}' "$1" | sed 's/"phases": {//; s/}//; s/"//g' | tr ',' '\n' |
+    awk -F': ' '{ print $2, $1 }' | sort -g -r | head -3 |
+    awk -v total="$2" '{ printf "%s%s %.0f%%", (NR > 1) ? " " : "", $2, (total > 0) ? 100 * $1 / total : 0 }'
+}
+
+results="$WORK/results.tsv"
+echo "# $CONFIG" > "$results"
+regressions=0
+smallest_us_per_line=""
+timed_out=false
+
+printf "%10s %10s %10s %12s %12s %10s  %s\n" "lines" "tokens" "ms" "lines/s" "tokens/s" "RSS MiB" "phases"
+for lines in "${SIZES[@]}"; do
+  if $timed_out; then
+    printf "%10s  skipped after a timeout\n" "$lines"
+    continue
+  fi
+
+  program="$WORK/program_$lines.crom"
+  "$WORK/generate" "$lines" "${GENERATOR_FLAGS[@]}" > "$program"
+  actual_lines=$(wc -l < "$program")
+
+  status=0
+  timeout "$TIMEOUT" "$WORK/cromc" -ftime-report="$WORK/report.json" "${COMPILER_FLAGS[@]}" "$program" \
+    > /dev/null 2> "$WORK/stderr" || status=$?
+
+  if [ $status -eq 124 ]; then
+    printf "%10s  REGRESSION: took longer than %ss\n" "$lines" "$TIMEOUT"
+    regressions=$((regressions + 1))
+    timed_out=true
+    continue
+  elif [ $status -ne 0 ]; then
+    echo "Compiling the $lines line program failed with exit code $status:" >&2
+    tail -5 "$WORK/stderr" >&2
+    exit 1
+  fi
+
+  total_ms=$(json_number total_ms "$WORK/report.json")
+  rss_kb=$(json_number peak_rss_kb "$WORK/report.json")
+  tokens=$(json_number tokens "$WORK/report.json")
+  phases=$(top_phases "$WORK/report.json" "$total_ms")
+
+  read -r lines_per_s tokens_per_s us_per_line <<< "$(awk -v l="$actual_lines" -v t="$tokens" -v ms="$total_ms" 'BEGIN {
+    s = (ms > 0) ? ms / 1000 : 1e-6
+    printf "%.0f %.0f %.6f\n", l / s, t / s, 1e6 * s / l
+  }')"
+  printf "%10s %10s %10.1f %12s %12s %10.1f  %s\n" "$actual_lines" "$tokens" "$total_ms" "$lines_per_s" "$tokens_per_s" \
+    "$(awk -v kb="$rss_kb" 'BEGIN { print kb / 1024 }')" "$phases"
+  printf "%s\t%s\t%s\t%s\n" "$lines" "$lines_per_s" "$tokens_per_s" "$rss_kb" >> "$results"
+
+  # Against the smallest program, on this machine
+  if [ -z "$smallest_us_per_line" ]; then
+    smallest_us_per_line=$us_per_line
+  elif awk -v a="$us_per_line" -v b="$smallest_us_per_line" -v n="$MAX_SCALING" 'BEGIN { exit !(a > n * b) }'; then
+    printf "%10s  REGRESSION: %.1fx the time per line of %s lines\n" "" \
+      "$(awk -v a="$us_per_line" -v b="$smallest_us_per_line" 'BEGIN { print a / b }')" "${SIZES[0]}"
+    regressions=$((regressions + 1))
+  fi
+
+  # Against the baseline
+  if [ -f "$BASELINE" ] && [ "$baseline_config" = "$CONFIG" ] && ! $UPDATE; then
+    read -r base_lines_per_s base_rss_kb <<< "$(awk -F'\t' -v l="$lines" '$1 == l { print $2, $4 }' "$BASELINE")"
+    if [ -n "$base_lines_per_s" ]; then
+      if awk -v now="$lines_per_s" -v base="$base_lines_per_s" -v tol="$TOLERANCE" 'BEGIN { exit !(now < base * (1 - tol / 100)) }'; then
+        printf "%10s  REGRESSION: %s lines/s, the baseline is %s\n" "" "$lines_per_s" "$base_lines_per_s"
+        regressions=$((regressions + 1))
+      fi
+      if awk -v now="$rss_kb" -v base="$base_rss_kb" -v tol="$TOLERANCE" 'BEGIN { exit !(now > base * (1 + tol / 100)) }'; then
+        printf "%10s  REGRESSION: peak RSS of %s KiB, the baseline is %s KiB\n" "" "$rss_kb" "$base_rss_kb"
+        regressions=$((regressions + 1))
+      fi
+    fi
+  fi
+done
+
+if $UPDATE; then
+  mkdir -p "$(dirname "$BASELINE")"
+  cp "$results" "$BASELINE"
+  echo "Stored the baseline in $BASELINE"
+fi
+
+if [ $regressions -gt 0 ]; then
+  echo "$regressions regression(s)"
+  exit 1
+fi
@@ -0,0 +1,84 @@
+#ifndef CROM_RUNTIME_H
+#define CROM_RUNTIME_H
+
+/* Support code for C translations of Crom programs (crom --emit=c).
+ * Everything is static inline so a translated program needs only this
+ * header and libc. Output formats match the native backend's print. */
+
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef char *crom_string;
+
+// Matches ERR_ARRAY_OUT_OF_BOUNDS in src/error.h
+#define CROM_ERR_ARRAY_OUT_OF_BOUNDS 13
+
+static inline int64_t crom_check_index(int64_t index, int64_t length) {
+  if (index < 0 || index >= length) {
+    fflush(NULL);
+    fputs("Array index out of bounds\n", stderr);
+    exit(CROM_ERR_ARRAY_OUT_OF_BOUNDS);
+  }
+
+  return index;
+}
+
+// Integer division faults the way the native idiv does, rather than being undefined
+static inline void crom_division_fault(void) {
+  fflush(NULL);
+  raise(SIGFPE);
+  abort();
+}
+
+static inline int64_t crom_div_i64(int64_t a, int64_t b) {
+  if (b == 0 || (a == INT64_MIN && b == -1)) crom_division_fault();
+  return a / b;
+}
+
+static inline int64_t crom_mod_i64(int64_t a, int64_t b) {
+  if (b == 0 || (a == INT64_MIN && b == -1)) crom_division_fault();
+  return a % b;
+}
+
+static inline uint64_t crom_div_u64(uint64_t a, uint64_t b) {
+  if (b == 0) crom_division_fault();
+  return a / b;
+}
+
+static inline uint64_t crom_mod_u64(uint64_t a, uint64_t b) {
+  if (b == 0) crom_division_fault();
+  return a % b;
+}
+
+// x /= y and x %= y, evaluating x once
+#define CROM_DIVISION_ASSIGN(T, S) \
+  static inline T crom_div_assign_##T(T *x, T y) { return *x = (T)crom_div_##S(*x, y); } \
+  static inline T crom_mod_assign_##T(T *x, T y) { return *x = (T)crom_mod_##S(*x, y); }
+
+CROM_DIVISION_ASSIGN(int8_t, i64)
+CROM_DIVISION_ASSIGN(int16_t, i64)
+CROM_DIVISION_ASSIGN(int32_t, i64)
+CROM_DIVISION_ASSIGN(int64_t, i64)
+CROM_DIVISION_ASSIGN(uint8_t, u64)
+CROM_DIVISION_ASSIGN(uint16_t, u64)
+CROM_DIVISION_ASSIGN(uint32_t, u64)
+CROM_DIVISION_ASSIGN(uint64_t, u64)
+
+static inline int64_t crom_string_length(crom_string s) {
+  return (int64_t)strlen(s);
+}
+
+static inline void crom_print_i64(int64_t value)      { printf("%" PRId64 "\n", value); }
+static inline void crom_print_u64(uint64_t value)     { printf("%" PRIu64 "\n", value); }
+static inline void crom_print_f64(double value)       { printf("%g\n", value); }
+static inline void crom_print_char(char value)        { printf("%c\n", value); }
+static inline void crom_print_bool(bool value)        { printf("%s\n", value ? "true" : "false"); }
+static inline void crom_print_string(crom_string value) { printf("%s\n", value); }
+
+#endif
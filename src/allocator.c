@@ -0,0 +1,198 @@
+#include <malloc.h> // for malloc_usable_size
+#include <stdint.h>
+#include <stdio.h>  // for fprintf, snprintf
+#include <stdlib.h> // for malloc, atexit
+
+#include "allocator.h"
+#include "error.h"
+#include "time_report.h"
+
+static const char *TagNames[MEM_TAG_COUNT] = {
+  [MEM_SOURCE]  = "source",
+  [MEM_AST]     = "ast",
+  [MEM_SYMBOLS] = "symbols",
+  [MEM_TYPES]   = "types",
+  [MEM_STRINGS] = "strings",
+  [MEM_IR]      = "ir",
+  [MEM_OTHER]   = "other",
+};
+
+typedef struct {
+  uint64_t allocations;
+  uint64_t bytes;
+  int64_t live; // goes below zero for memory from malloc() given to Release()
+  int64_t peak;
+} MemoryStats;
+
+/* Each thread counts its own allocations, so that threads allocating at
+ * once, like the test runner's workers, don't race on the counts. The
+ * compiler allocates on one thread only, whose counts the report and the
+ * leak check see. */
+static _Thread_local struct {
+  MemoryStats tags[MEM_TAG_COUNT];
+  MemoryStats phases[PHASE_COUNT + 1]; // live is that of all tags, while the phase ran
+  int64_t live;
+  int64_t peak;
+
+  bool leak_check;
+  bool checking;
+  int64_t live_at_start[MEM_TAG_COUNT];
+  int64_t marked[MEM_TAG_COUNT];
+
+  // Marked blocks, by open addressing
+  uintptr_t *marks;
+  int mark_count;
+  int mark_capacity;
+} Memory;
+
+static void Count(MemoryTag tag, size_t old_size, size_t new_size) {
+  MemoryStats *t = &Memory.tags[tag];
+  MemoryStats *phase = &Memory.phases[CurrentPhase()];
+  int64_t growth = (int64_t)new_size - (int64_t)old_size;
+
+  if (growth > 0) {
+    t->allocations++;
+    t->bytes += growth;
+    phase->allocations++;
+    phase->bytes += growth;
+  }
+
+  t->live += growth;
+  Memory.live += growth;
+  if (t->live > t->peak) t->peak = t->live;
+  if (Memory.live > Memory.peak) Memory.peak = Memory.live;
+  if (Memory.live > phase->peak) phase->peak = Memory.live;
+}
+
+void *Allocate(MemoryTag tag, size_t size) {
+  void *p = malloc(size);
+  if (p == NULL && size > 0) COMPILER_ERROR("Allocate(): Out of memory");
+
+  Count(tag, 0, malloc_usable_size(p));
+  return p;
+}
+
+void *AllocateZeroed(MemoryTag tag, size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (p == NULL && count > 0 && size > 0) COMPILER_ERROR("AllocateZeroed(): Out of memory");
+
+  Count(tag, 0, malloc_usable_size(p));
+  return p;
+}
+
+void *Reallocate(MemoryTag tag, void *p, size_t size) {
+  size_t old_size = malloc_usable_size(p);
+  p = realloc(p, size);
+  if (p == NULL && size > 0) COMPILER_ERROR("Reallocate(): Out of memory");
+
+  Count(tag, old_size, malloc_usable_size(p));
+  return p;
+}
+
+void Release(MemoryTag tag, void *p) {
+  if (p == NULL) return;
+
+  Count(tag, malloc_usable_size(p), 0);
+  free(p);
+}
+
+/* === Report === */
+static void PrintStats(const char *name, MemoryStats s, bool live) {
+  fprintf(stderr, "  %-16s %12llu %14llu", name, (unsigned long long)s.allocations, (unsigned long long)s.bytes);
+  if (live) fprintf(stderr, " %14lld", (long long)s.live);
+  fprintf(stderr, " %14lld\n", (long long)s.peak);
+}
+
+// Runs at exit
+static void Report() {
+  MemoryStats total = {.live = Memory.live, .peak = Memory.peak};
+
+  fprintf(stderr, "Memory report:\n");
+  fprintf(stderr, "  %-16s %12s %14s %14s %14s\n", "tag", "allocations", "bytes", "live", "peak");
+  for (int i = 0; i < MEM_TAG_COUNT; i++) {
+    total.allocations += Memory.tags[i].allocations;
+    total.bytes += Memory.tags[i].bytes;
+    PrintStats(TagNames[i], Memory.tags[i], true);
+  }
+  PrintStats("total", total, true);
+
+  fprintf(stderr, "  %-16s %12s %14s %14s\n", "phase", "allocations", "bytes", "peak");
+  for (int i = 0; i <= PHASE_COUNT; i++) {
+    if (Memory.phases[i].allocations > 0) PrintStats(PhaseName(i), Memory.phases[i], false);
+  }
+}
+
+void UseMemoryReport() {
+  TrackPhases();
+  atexit(Report);
+}
+
+/* === Leak check === */
+void UseLeakCheck() {
+  Memory.leak_check = true;
+}
+
+bool CheckingLeaks() {
+  return Memory.checking;
+}
+
+void BeginLeakCheck() {
+  if (!Memory.leak_check) return;
+
+  Memory.checking = true;
+  for (int i = 0; i < MEM_TAG_COUNT; i++) {
+    Memory.live_at_start[i] = Memory.tags[i].live;
+    Memory.marked[i] = 0;
+  }
+}
+
+static int MarkSlot(uintptr_t *marks, int capacity, uintptr_t p) {
+  int slot = (int)(((p >> 4) * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+  while (marks[slot] != 0 && marks[slot] != p) slot = (slot + 1) & (capacity - 1);
+  return slot;
+}
+
+bool MarkReachable(MemoryTag tag, const void *p) {
+  if (!Memory.checking || p == NULL) return false;
+
+  if (2 * (Memory.mark_count + 1) > Memory.mark_capacity) {
+    int capacity = (Memory.mark_capacity == 0) ? 1024 : 2 * Memory.mark_capacity;
+    uintptr_t *marks = calloc(capacity, sizeof(uintptr_t));
+    for (int i = 0; i < Memory.mark_capacity; i++) {
+      if (Memory.marks[i] != 0) marks[MarkSlot(marks, capacity, Memory.marks[i])] = Memory.marks[i];
+    }
+
+    free(Memory.marks);
+    Memory.marks = marks;
+    Memory.mark_capacity = capacity;
+  }
+
+  int slot = MarkSlot(Memory.marks, Memory.mark_capacity, (uintptr_t)p);
+  if (Memory.marks[slot] != 0) return false;
+
+  Memory.marks[slot] = (uintptr_t)p;
+  Memory.mark_count++;
+  Memory.marked[tag] += malloc_usable_size((void *)p);
+  return true;
+}
+
+void EndLeakCheck() {
+  if (!Memory.checking) return;
+
+  Memory.checking = false;
+  free(Memory.marks);
+  Memory.marks = NULL;
+  Memory.mark_count = Memory.mark_capacity = 0;
+
+  char leaks[256] = "";
+  int length = 0;
+  for (int i = 0; i < MEM_TAG_COUNT; i++) {
+    int64_t leaked = Memory.tags[i].live - Memory.live_at_start[i] - Memory.marked[i];
+    if (leaked > 0 && length < (int)sizeof(leaks)) {
+      length += snprintf(leaks + length, sizeof(leaks) - length, "%s%lld bytes of %s",
+                         (length > 0) ? ", " : "", (long long)leaked, TagNames[i]);
+    }
+  }
+
+  if (length > 0) COMPILER_ERROR_FMTMSG("Leak check: The compile lost %s", leaks);
+}
@@ -0,0 +1,55 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stddef.h> // for size_t
+
+/* Allocation accounting (-fmem-report, -fleak-check).
+ *
+ * The front end allocates through the functions below, each allocation
+ * tagged with the part of the compiler it belongs to. Sizes are what
+ * malloc_usable_size() says, so memory from Allocate() may still be given
+ * to free(), it just stays counted as live. Allocations are counted
+ * whether or not a report was asked for.
+ *
+ * -fmem-report prints, when the compiler exits, how many allocations and
+ * bytes every tag and every phase (time_report.h) made, what was still
+ * live at exit and the most that ever was, in total and while each phase
+ * ran.
+ *
+ * -fleak-check makes CompileProgram() fail if the compile lost track of
+ * memory. The AST and the symbol table are what a compile leaves behind,
+ * so its allocations can't all be released by its end; instead, every
+ * block they reach is marked, and what the compile allocated, still holds
+ * and didn't mark is reported as leaked:
+ *
+ *   leaked = live at the end - live at the start - marked
+ *
+ * Only blocks from Allocate() may be marked, and the memory allocated
+ * before the compile mustn't be among them. */
+typedef enum {
+  MEM_SOURCE,  // source text, which tokens point into
+  MEM_AST,
+  MEM_SYMBOLS,
+  MEM_TYPES,   // function parameters and struct members
+  MEM_STRINGS,
+  MEM_IR,      // arena chunks, which hold the IR
+  MEM_OTHER,
+  MEM_TAG_COUNT,
+} MemoryTag;
+
+void *Allocate(MemoryTag tag, size_t size);
+void *AllocateZeroed(MemoryTag tag, size_t count, size_t size);
+void *Reallocate(MemoryTag tag, void *p, size_t size);
+void Release(MemoryTag tag, void *p);
+
+void UseMemoryReport();
+void UseLeakCheck();
+
+bool CheckingLeaks();
+void BeginLeakCheck();
+// Returns false for blocks marked before, so that walks over shared data stop there
+bool MarkReachable(MemoryTag tag, const void *p);
+void EndLeakCheck();
+
+#endif
@@ -0,0 +1,106 @@
+#include <stdbool.h>
+#include <string.h> // for memcpy
+
+#include "allocator.h"
+#include "arena.h"
+#include "error.h"
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct ArenaChunk {
+  ArenaChunk *next;
+  size_t used;
+  size_t capacity;
+  _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+};
+
+static ArenaChunk *NewChunk(size_t min_size, ArenaChunk *next) {
+  size_t capacity = (min_size > ARENA_CHUNK_SIZE) ? min_size : ARENA_CHUNK_SIZE;
+  ArenaChunk *chunk = Allocate(MEM_IR, sizeof(ArenaChunk) + capacity);
+  if (chunk == NULL) COMPILER_ERROR("NewChunk(): Out of memory");
+
+  chunk->next = next;
+  chunk->used = 0;
+  chunk->capacity = capacity;
+
+  return chunk;
+}
+
+static size_t AlignSize(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+Arena *NewArena() {
+  Arena *arena = AllocateZeroed(MEM_IR, 1, sizeof(Arena));
+  arena->head = NewChunk(ARENA_CHUNK_SIZE, NULL);
+
+  return arena;
+}
+
+void DeleteArena(Arena *arena) {
+  ArenaChunk *chunk = arena->head;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    Release(MEM_IR, chunk);
+    chunk = next;
+  }
+
+  Release(MEM_IR, arena);
+}
+
+void *ArenaAlloc(Arena *arena, size_t size) {
+  size = AlignSize(size);
+
+  if (arena->head->used + size > arena->head->capacity) {
+    arena->head = NewChunk(size, arena->head);
+  }
+
+  void *p = &arena->head->data[arena->head->used];
+  arena->head->used += size;
+  arena->bytes_allocated += size;
+
+  memset(p, 0, size);
+  return p;
+}
+
+void *ArenaGrowArray(Arena *arena, void *array, int *capacity, size_t element_size) {
+  #define MIN_ARRAY_CAPACITY 8
+
+  int old_capacity = *capacity;
+  int new_capacity = (old_capacity < MIN_ARRAY_CAPACITY) ? MIN_ARRAY_CAPACITY : old_capacity * 2;
+
+  ArenaChunk *head = arena->head;
+  size_t old_size = (size_t)old_capacity * element_size;
+  size_t new_size = (size_t)new_capacity * element_size;
+
+  /* If the array is the most recent allocation in the current chunk,
+   * grow it in place instead of copying */
+  bool is_last_allocation = array != NULL &&
+                            (unsigned char *)array + AlignSize(old_size) == &head->data[head->used];
+  size_t growth = AlignSize(new_size) - AlignSize(old_size);
+
+  if (is_last_allocation && head->used + growth <= head->capacity) {
+    memset(&head->data[head->used], 0, growth);
+    head->used += growth;
+    arena->bytes_allocated += growth;
+    *capacity = new_capacity;
+    return array;
+  }
+
+  void *new_array = ArenaAlloc(arena, new_size);
+  if (array != NULL) memcpy(new_array, array, old_size);
+
+  *capacity = new_capacity;
+  return new_array;
+
+  #undef MIN_ARRAY_CAPACITY
+}
+
+char *ArenaCopyString(Arena *arena, const char *s, int length) {
+  char *copy = ArenaAlloc(arena, length + 1);
+  memcpy(copy, s, length);
+  copy[length] = '\0';
+
+  return copy;
+}
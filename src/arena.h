@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h> // for size_t
+
+/* A bump allocator. Everything allocated from an arena is released
+ * at once by DeleteArena(), so long-lived compiler data structures
+ * (like the IR) don't need per-object bookkeeping. */
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+  ArenaChunk *head;
+  size_t bytes_allocated;
+} Arena;
+
+Arena *NewArena();
+void DeleteArena(Arena *arena);
+
+void *ArenaAlloc(Arena *arena, size_t size);
+void *ArenaGrowArray(Arena *arena, void *array, int *capacity, size_t element_size);
+char *ArenaCopyString(Arena *arena, const char *s, int length);
+
+/* Appends `value` to an arena-backed array described by `array`, `count`
+ * and `capacity`, doubling the backing storage when it runs out. */
+#define ARENA_PUSH(arena, array, count, capacity, value)                          \
+  do {                                                                            \
+    if ((count) >= (capacity)) {                                                  \
+      (array) = ArenaGrowArray((arena), (array), &(capacity), sizeof(*(array)));  \
+    }                                                                             \
+    (array)[(count)++] = (value);                                                 \
+  } while (0)
+
+#endif
@@ -1,8 +1,8 @@
-#include <stdlib.h> // for calloc
-
+#include "allocator.h"
 #include "ast.h"
 #include "common.h"
 #include "error.h"
+#include "time_report.h"
 
 static const char* const _NodeTypeTranslation[] =
 {
@@ -59,7 +59,8 @@ const char *NodeTypeTranslation(NodeType t) {
 }
 
 AST_Node *NewNode(NodeType node_type, AST_Node *left, AST_Node *middle, AST_Node *right, Type type) {
-  AST_Node *n = calloc(1, sizeof(AST_Node));
+  AST_Node *n = AllocateZeroed(MEM_AST, 1, sizeof(AST_Node));
+  CountEvents(COUNTER_AST_NODES, 1);
 
   n->node_type = node_type;
   SetNodeDataType(n, type);
@@ -72,7 +73,8 @@ AST_Node *NewNode(NodeType node_type, AST_Node *left, AST_Node *middle, AST_Node
 }
 
 AST_Node *NewNodeFromToken(NodeType node_type, AST_Node *left, AST_Node *middle, AST_Node *right, Token token, Type type) {
-  AST_Node *n = calloc(1, sizeof(AST_Node));
+  AST_Node *n = AllocateZeroed(MEM_AST, 1, sizeof(AST_Node));
+  CountEvents(COUNTER_AST_NODES, 1);
 
   n->token = token;
   n->node_type = node_type;
@@ -86,7 +88,8 @@ AST_Node *NewNodeFromToken(NodeType node_type, AST_Node *left, AST_Node *middle,
 }
 
 AST_Node *NewNodeFromSymbol(NodeType node_type, AST_Node *left, AST_Node *middle, AST_Node *right, Symbol symbol) {
-  AST_Node *n = calloc(1, sizeof(AST_Node));
+  AST_Node *n = AllocateZeroed(MEM_AST, 1, sizeof(AST_Node));
+  CountEvents(COUNTER_AST_NODES, 1);
 
   n->token = symbol.token;
   n->node_type = node_type;
@@ -99,6 +102,15 @@ AST_Node *NewNodeFromSymbol(NodeType node_type, AST_Node *left, AST_Node *middle
   return n;
 }
 
+// Down the chain of statements by iteration, as it can be long
+void MarkAST(AST_Node *n) {
+  for (; n != NULL && MarkReachable(MEM_AST, n); n = n->right) {
+    MarkType(n->data_type);
+    MarkAST(n->left);
+    MarkAST(n->middle);
+  }
+}
+
 void SetNodeDataType(AST_Node *n, Type t) {
   n->data_type = t;
 }
@@ -275,6 +287,10 @@ bool NodeIs_PostfixDecrement(AST_Node *n) {
   return n->node_type == POSTFIX_DECREMENT_NODE;
 }
 
+bool NodeIs_TailRecursive(AST_Node *n) {
+  return NodeIs_Function(n) && n->right != NULL && n->right->token.type == TAILREC;
+}
+
 bool NodeIs_DeadEnd(AST_Node *n) {
   return (n == NULL) ||
          (NodeIs_Chain(n)        &&
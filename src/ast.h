@@ -78,6 +78,9 @@ AST_Node *NewNodeFromSymbol(NodeType node_type, AST_Node *left, AST_Node *middle
 
 void SetNodeDataType(AST_Node *n, Type t);
 
+// Marks every node and type for the leak check (allocator.h)
+void MarkAST(AST_Node *root);
+
 const char *NodeTypeTranslation(NodeType t);
 
 void PrintAST(AST_Node *root);
@@ -101,6 +104,7 @@ bool NodeIs_For(AST_Node *n);
 bool NodeIs_While(AST_Node *n);
 bool NodeIs_Function(AST_Node *n);
 bool NodeIs_Return(AST_Node *n);
+bool NodeIs_TailRecursive(AST_Node *n); // declared 'tailrec', every tail call must be optimized
 bool NodeIs_PrefixIncrement(AST_Node *n);
 bool NodeIs_PrefixDecrement(AST_Node *n);
 bool NodeIs_PostfixIncrement(AST_Node *n);
@@ -0,0 +1,1345 @@
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "codegen_c.h"
+#include "common.h"
+#include "error.h"
+
+/* The translation follows the AST closely: every Crom statement becomes
+ * one C statement and every binary expression is fully parenthesized.
+ *
+ * Crom's typing rules differ from C's in two places the emitter has to
+ * paper over. Numeric literals take the type their context asks for, so
+ * the expression types are worked out the same way the IR lowering does
+ * and passed down as hints. And integer arithmetic wraps, where C promotes
+ * 8 and 16 bit integers to int and leaves signed overflow undefined: those
+ * narrow results are cast back, and signed 32 and 64 bit + - * << are done
+ * on the unsigned type of the same width. Division goes through the
+ * runtime, which faults on a zero divisor like the native backend does.
+ *
+ * Top level variables become C globals, so functions can refer to them.
+ * Globals with constant initializers are initialized statically, all
+ * other top level code runs in main(). String literals become writable
+ * static arrays, since Crom allows assigning to a string's characters.
+ *
+ * Returns of recursive calls, including those in either branch of a
+ * returned ternary, assign the parameters and jump back to the top of the
+ * function, so they don't depend on the C compiler to run in constant
+ * stack space. */
+
+typedef struct {
+  Token name;
+  Type type;
+  Token struct_name; // for struct variables
+  int depth;
+} CVariable;
+
+typedef struct {
+  Token name;
+  int64_t value;
+} CEnumMember;
+
+static struct {
+  Arena *scratch;
+  FILE *out;
+  SymbolTable *st;
+  int indent;
+  int depth;
+  bool in_entry;
+  bool outermost;
+  AST_Node *function; // being emitted, NULL in main()
+
+  CVariable *vars;
+  int var_count, var_capacity;
+
+  CEnumMember *enum_members;
+  int enum_count, enum_capacity;
+
+  AST_Node **functions;
+  int function_count, function_capacity;
+
+  AST_Node **structs;
+  int struct_count, struct_capacity;
+
+  Token *strings;
+  int string_count, string_capacity;
+} C;
+
+static void EmitExpression(AST_Node *node, enum TypeSpecifier hint);
+static void EmitTopExpression(AST_Node *node, enum TypeSpecifier hint);
+static void EmitStatement(AST_Node *node);
+static void EmitChain(AST_Node *chain);
+
+/* === Output === */
+static void Out(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(C.out, fmt, args);
+  va_end(args);
+}
+
+static void Indent() {
+  for (int i = 0; i < C.indent; i++) fputs("  ", C.out);
+}
+
+static const char *ReservedNames[] = {
+  "auto", "break", "case", "char", "const", "continue", "default", "do",
+  "double", "else", "enum", "extern", "float", "for", "goto", "if",
+  "inline", "int", "long", "register", "restrict", "return", "short",
+  "signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+  "unsigned", "void", "volatile", "while", "bool", "true", "false", "main",
+  "errno", "exit", "fflush", "fmod", "fmodf", "fputs", "memcpy", "printf",
+  "stderr", "stdout", "strlen", "NULL", "abort", "raise", "SIGFPE",
+  NULL,
+};
+
+static bool IsReservedName(Token t) {
+  for (int i = 0; ReservedNames[i] != NULL; i++) {
+    if ((int)strlen(ReservedNames[i]) == t.length &&
+        memcmp(ReservedNames[i], t.position_in_source, t.length) == 0) return true;
+  }
+
+  return t.length > 5 && memcmp(t.position_in_source, "crom_", 5) == 0;
+}
+
+// Crom names that collide with C keywords or the runtime get a trailing '_'
+static void EmitName(Token t) {
+  Out("%.*s%s", t.length, t.position_in_source, IsReservedName(t) ? "_" : "");
+}
+
+/* === Types === */
+static const char *ScalarCType(enum TypeSpecifier s) {
+  switch (s) {
+    case T_I8:     return "int8_t";
+    case T_I16:    return "int16_t";
+    case T_I32:    return "int32_t";
+    case T_I64:    return "int64_t";
+    case T_U8:     return "uint8_t";
+    case T_U16:    return "uint16_t";
+    case T_U32:    return "uint32_t";
+    case T_U64:    return "uint64_t";
+    case T_F32:    return "float";
+    case T_F64:    return "double";
+    case T_CHAR:   return "char";
+    case T_STRING: return "crom_string";
+    case T_BOOL:   return "bool";
+    case T_ENUM:   return "int64_t";
+    default:       return "void";
+  }
+}
+
+static bool IsFloatSpec(enum TypeSpecifier s) {
+  return s == T_F32 || s == T_F64;
+}
+
+static bool IsUnsignedSpec(enum TypeSpecifier s) {
+  return s >= T_U8 && s <= T_U64;
+}
+
+static bool IsNumericSpec(enum TypeSpecifier s) {
+  return s >= T_I8 && s <= T_F64;
+}
+
+// Integer types narrower than int, whose arithmetic C would widen
+static bool IsNarrowSpec(enum TypeSpecifier s) {
+  return s == T_I8 || s == T_I16 || s == T_U8 || s == T_U16;
+}
+
+static bool IsIntegerSpec(enum TypeSpecifier s) {
+  return (s >= T_I8 && s <= T_U64) || s == T_ENUM;
+}
+
+// Signed types whose overflow C leaves undefined, and which aren't cast back like narrow ones
+static bool IsOverflowingSpec(enum TypeSpecifier s) {
+  return s == T_I32 || s == T_I64 || s == T_ENUM;
+}
+
+static const char *UnsignedCType(enum TypeSpecifier s) {
+  return (s == T_I32) ? "uint32_t" : "uint64_t";
+}
+
+static int SpecSize(enum TypeSpecifier s) {
+  switch (s) {
+    case T_I8:  case T_U8:  case T_CHAR: case T_BOOL: return 1;
+    case T_I16: case T_U16:                           return 2;
+    case T_I32: case T_U32: case T_F32:               return 4;
+    default:                                          return 8;
+  }
+}
+
+static enum TypeSpecifier WiderSpec(enum TypeSpecifier a, enum TypeSpecifier b) {
+  if (IsFloatSpec(a) || IsFloatSpec(b)) {
+    return (a == T_F64 || b == T_F64 || !IsFloatSpec(a) || !IsFloatSpec(b)) ? T_F64 : T_F32;
+  }
+
+  return (SpecSize(b) > SpecSize(a)) ? b : a;
+}
+
+static Token StructNameOf(Token variable_name) {
+  Symbol s = RetrieveFrom(C.st, variable_name);
+  if (IN_SYMBOL_TABLE(s)) {
+    Symbol definition = GetSymbolById(C.st, s.parent_struct_symbol_guid_ref);
+    if (IN_SYMBOL_TABLE(definition)) return definition.token;
+  }
+
+  COMPILER_ERROR_FMTMSG("EmitC(): No struct definition for '%.*s'", variable_name.length, variable_name.position_in_source);
+  return variable_name;
+}
+
+static Type StructDefinitionOf(Token struct_name) {
+  for (int i = 0; i < C.struct_count; i++) {
+    if (TokenValuesMatch(C.structs[i]->token, struct_name)) return C.structs[i]->data_type;
+  }
+
+  return NoType();
+}
+
+// Writes "T name", "T name[N]", or for array parameters "T *name"
+static void EmitDeclarator(Type type, Token name, Token struct_name) {
+  if (TypeIs_Struct(type)) {
+    Out("struct ");
+    EmitName(struct_name);
+  } else {
+    Out("%s", ScalarCType(type.specifier));
+  }
+
+  bool is_array = TypeIs_Array(type) && !TypeIs_String(type);
+  Out((is_array && type.array_size == 0) ? " *" : " ");
+  EmitName(name);
+
+  if (is_array && type.array_size > 0) Out("[%d]", type.array_size);
+}
+
+/* === Scopes === */
+static CVariable *FindVariable(Token name) {
+  for (int i = C.var_count - 1; i >= 0; i--) {
+    if (TokenValuesMatch(C.vars[i].name, name)) return &C.vars[i];
+  }
+
+  return NULL;
+}
+
+static CVariable *DeclareVariable(Token name, Type type) {
+  CVariable var = {name, type, {0}, C.depth};
+  if (TypeIs_Struct(type)) var.struct_name = StructNameOf(name);
+
+  ARENA_PUSH(C.scratch, C.vars, C.var_count, C.var_capacity, var);
+  return &C.vars[C.var_count - 1];
+}
+
+static void EnterScope() {
+  C.depth++;
+}
+
+static void LeaveScope() {
+  C.depth--;
+  while (C.var_count > 0 && C.vars[C.var_count - 1].depth > C.depth) C.var_count--;
+}
+
+static CEnumMember *FindEnumMember(Token name) {
+  for (int i = 0; i < C.enum_count; i++) {
+    if (TokenValuesMatch(C.enum_members[i].name, name)) return &C.enum_members[i];
+  }
+
+  return NULL;
+}
+
+static AST_Node *FindFunction(Token name) {
+  for (int i = 0; i < C.function_count; i++) {
+    if (TokenValuesMatch(C.functions[i]->token, name)) return C.functions[i];
+  }
+
+  return NULL;
+}
+
+static Type MemberTypeOf(CVariable *var, Token member_name) {
+  if (var == NULL || !TypeIs_Struct(var->type)) return NoType();
+
+  StructMember *m = GetStructMember(StructDefinitionOf(var->struct_name), member_name);
+  return (m != NULL) ? m->type : NoType();
+}
+
+/* === Expression types ===
+ * These mirror NaturalType() and friends in ir_lower.c, so that C gives
+ * every operation the same type the native backend does. T_NONE marks
+ * expressions built only from numeric literals. */
+static uint64_t ParseUnsigned(Token t) {
+  char buffer[128];
+  int n = 0;
+  for (int i = 0; i < t.length && n < (int)sizeof(buffer) - 1; i++) {
+    if (t.position_in_source[i] != ' ') buffer[n++] = t.position_in_source[i];
+  }
+  buffer[n] = '\0';
+
+  switch (t.type) {
+    case HEX_LITERAL:    return strtoull(buffer, NULL, 16);
+    case BINARY_LITERAL: return strtoull(buffer, NULL, 2);
+    default:             return strtoull(buffer, NULL, 10);
+  }
+}
+
+static bool LiteralIsFlexible(Token t) {
+  return t.type == INT_LITERAL || t.type == HEX_LITERAL ||
+         t.type == BINARY_LITERAL || t.type == FLOAT_LITERAL;
+}
+
+static enum TypeSpecifier LiteralSpec(Token t) {
+  switch (t.type) {
+    case INT_LITERAL:    return T_I64;
+    case HEX_LITERAL:
+    case BINARY_LITERAL: return T_U64;
+    case FLOAT_LITERAL:  return T_F64;
+    case CHAR_LITERAL:   return T_CHAR;
+    case BOOL_LITERAL:   return T_BOOL;
+    case STRING_LITERAL: return T_STRING;
+    default:             return T_NONE;
+  }
+}
+
+static enum TypeSpecifier ElementOrValueSpec(Type t, bool subscripted) {
+  if (subscripted && TypeIs_String(t)) return T_CHAR;
+  return t.specifier;
+}
+
+static enum TypeSpecifier NameSpec(Token name, bool subscripted) {
+  CVariable *var = FindVariable(name);
+  if (var != NULL) return ElementOrValueSpec(var->type, subscripted);
+
+  return (FindEnumMember(name) != NULL) ? T_I64 : T_NONE;
+}
+
+static enum TypeSpecifier NaturalSpec(AST_Node *node) {
+  if (node == NULL) return T_NONE;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+      return LiteralIsFlexible(node->token) ? T_NONE : LiteralSpec(node->token);
+    case IDENTIFIER_NODE:
+      return NameSpec(node->token, node->middle != NULL);
+    case FUNCTION_ARGUMENT_NODE:
+      if (node->left != NULL) return NaturalSpec(node->left);
+      if (node->token.type == IDENTIFIER) return NameSpec(node->token, false);
+      return LiteralIsFlexible(node->token) ? T_NONE : LiteralSpec(node->token);
+    case UNARY_OP_NODE:
+      return (node->token.type == LOGICAL_NOT) ? T_BOOL : NaturalSpec(node->left);
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE: {
+      enum TypeSpecifier l = NaturalSpec(node->left);
+      enum TypeSpecifier r = NaturalSpec(node->right);
+      if (l == T_NONE) return r;
+      if (r == T_NONE || l == r) return l;
+      return WiderSpec(l, r);
+    }
+    case BINARY_LOGICAL_NODE:
+      return T_BOOL;
+    case TERSE_ASSIGNMENT_NODE:
+      if (node->token.type == LOGICAL_NOT_EQUALS) return T_BOOL;
+      return NaturalSpec(node->left);
+    case ASSIGNMENT_NODE:
+      return NameSpec(node->token, node->middle != NULL);
+    case TERNARY_IF_NODE: {
+      enum TypeSpecifier t = NaturalSpec(node->middle);
+      return (t != T_NONE) ? t : NaturalSpec(node->right);
+    }
+    case FUNCTION_CALL_NODE: {
+      AST_Node *f = FindFunction(node->token);
+      return (f == NULL) ? T_NONE : f->left->data_type.specifier;
+    }
+    case STRUCT_IDENTIFIER_NODE: {
+      if (node->left == NULL) return T_NONE;
+      Type member_type = MemberTypeOf(FindVariable(node->token), node->left->token);
+      return ElementOrValueSpec(member_type, node->left->middle != NULL);
+    }
+    case PREFIX_INCREMENT_NODE:
+    case PREFIX_DECREMENT_NODE:
+      return NaturalSpec(node->left);
+    case POSTFIX_INCREMENT_NODE:
+    case POSTFIX_DECREMENT_NODE:
+      return NameSpec(node->token, node->middle != NULL);
+    default:
+      return T_NONE;
+  }
+}
+
+static enum TypeSpecifier DefaultLiteralSpec(AST_Node *node) {
+  if (node == NULL) return T_I64;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+    case FUNCTION_ARGUMENT_NODE:
+      if (node->left != NULL) return DefaultLiteralSpec(node->left);
+      return LiteralIsFlexible(node->token) ? LiteralSpec(node->token) : T_I64;
+    case UNARY_OP_NODE:
+      return DefaultLiteralSpec(node->left);
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE: {
+      enum TypeSpecifier l = DefaultLiteralSpec(node->left);
+      enum TypeSpecifier r = DefaultLiteralSpec(node->right);
+      return (IsFloatSpec(r) && !IsFloatSpec(l)) ? r : l;
+    }
+    case TERNARY_IF_NODE:
+      return DefaultLiteralSpec(node->middle);
+    default:
+      return T_I64;
+  }
+}
+
+static enum TypeSpecifier OperandSpec(AST_Node *left, AST_Node *right, enum TypeSpecifier hint) {
+  enum TypeSpecifier l = NaturalSpec(left);
+  enum TypeSpecifier r = NaturalSpec(right);
+
+  if (l == T_NONE && r == T_NONE) {
+    if (IsNumericSpec(hint)) return hint;
+
+    l = DefaultLiteralSpec(left);
+    r = DefaultLiteralSpec(right);
+    return IsFloatSpec(r) ? r : l;
+  }
+
+  if (l == T_NONE) return r;
+  if (r == T_NONE || l == r) return l;
+
+  return IsNumericSpec(hint) ? hint : WiderSpec(l, r);
+}
+
+// The type a value is printed as, or used as when nothing constrains it
+static enum TypeSpecifier ValueSpec(AST_Node *node) {
+  enum TypeSpecifier t = NaturalSpec(node);
+  return (t != T_NONE) ? t : DefaultLiteralSpec(node);
+}
+
+/* === Expressions === */
+static int StringIndex(Token t) {
+  for (int i = 0; i < C.string_count; i++) {
+    if (C.strings[i].position_in_source == t.position_in_source) return i;
+  }
+
+  COMPILER_ERROR_FMTMSG("EmitC(): Unregistered string literal on line %d", t.on_line);
+  return -1;
+}
+
+static void EmitLiteral(Token t, enum TypeSpecifier hint) {
+  switch (t.type) {
+    case INT_LITERAL:
+    case HEX_LITERAL:
+    case BINARY_LITERAL: {
+      uint64_t u = ParseUnsigned(t);
+
+      if (IsFloatSpec(hint)) {
+        Out("%" PRIu64 ".0%s", u, (hint == T_F32) ? "f" : "");
+      } else if (t.type == INT_LITERAL) {
+        Out("%" PRIu64 "%s", u, (u > INT64_MAX) ? "ULL" : (u > INT32_MAX) ? "LL" : "");
+      } else {
+        Out("0x%" PRIx64 "%s", u, IsNumericSpec(hint) ? "" : "ULL");
+      }
+      break;
+    }
+    case FLOAT_LITERAL:
+      Out("%.*s%s", t.length, t.position_in_source, (hint == T_F32) ? "f" : "");
+      break;
+    case CHAR_LITERAL:
+      Out("'%.*s'", t.length, t.position_in_source);
+      break;
+    case STRING_LITERAL:
+      Out("crom_str%d", StringIndex(t));
+      break;
+    default:
+      Out("%.*s", t.length, t.position_in_source);
+      break;
+  }
+}
+
+static void EmitIndex(AST_Node *subscript) {
+  Token t = subscript->token;
+  if (t.type == INT_LITERAL) {
+    Out("%" PRIu64, ParseUnsigned(t));
+    return;
+  }
+
+  CEnumMember *e = FindEnumMember(t);
+  if (FindVariable(t) == NULL && e != NULL) Out("%" PRId64, e->value);
+  else EmitName(t);
+}
+
+// Indices the checker could not prove in range are checked at run time
+static void EmitSubscript(Type array_type, AST_Node *subscript) {
+  bool has_length = TypeIs_Array(array_type) && !TypeIs_String(array_type) && array_type.array_size > 0;
+  bool is_constant = subscript->token.type == INT_LITERAL;
+
+  if (!has_length || (is_constant && ParseUnsigned(subscript->token) < (uint64_t)array_type.array_size)) {
+    Out("[");
+    EmitIndex(subscript);
+    Out("]");
+    return;
+  }
+
+  Out("[crom_check_index(");
+  EmitIndex(subscript);
+  Out(", %d)]", array_type.array_size);
+}
+
+static void EmitNameAccess(Token name, AST_Node *subscript) {
+  CVariable *var = FindVariable(name);
+  CEnumMember *e = FindEnumMember(name);
+
+  if (var == NULL && e != NULL) {
+    EmitName(name);
+    return;
+  }
+
+  EmitName(name);
+  if (subscript != NULL) EmitSubscript((var != NULL) ? var->type : NoType(), subscript);
+}
+
+static void EmitMemberAccess(AST_Node *node, bool outermost) {
+  AST_Node *member = node->left;
+  Type member_type = MemberTypeOf(FindVariable(node->token), member->token);
+  bool parenthesize = member->left != NULL && !outermost;
+
+  if (parenthesize) Out("(");
+
+  EmitName(node->token);
+  Out(".");
+  EmitName(member->token);
+  if (member->middle != NULL) EmitSubscript(member_type, member->middle);
+
+  if (member->left != NULL) {
+    Out(" = ");
+    EmitExpression(member->left, ElementOrValueSpec(member_type, member->middle != NULL));
+  }
+
+  if (parenthesize) Out(")");
+}
+
+static const char *OperatorText(TokenType t) {
+  switch (t) {
+    case PLUS:                       return "+";
+    case MINUS:                      return "-";
+    case ASTERISK:                   return "*";
+    case DIVIDE:                     return "/";
+    case MODULO:                     return "%";
+    case BITWISE_AND:                return "&";
+    case BITWISE_OR:                 return "|";
+    case BITWISE_XOR:                return "^";
+    case BITWISE_LEFT_SHIFT:         return "<<";
+    case BITWISE_RIGHT_SHIFT:        return ">>";
+    case EQUALITY:                   return "==";
+    case LOGICAL_NOT_EQUALS:         return "!=";
+    case LESS_THAN:                  return "<";
+    case LESS_THAN_EQUALS:           return "<=";
+    case GREATER_THAN:               return ">";
+    case GREATER_THAN_EQUALS:        return ">=";
+    case LOGICAL_AND:                return "&&";
+    case LOGICAL_OR:                 return "||";
+    case PLUS_EQUALS:                return "+=";
+    case MINUS_EQUALS:               return "-=";
+    case TIMES_EQUALS:               return "*=";
+    case DIVIDE_EQUALS:              return "/=";
+    case MODULO_EQUALS:              return "%=";
+    case BITWISE_AND_EQUALS:         return "&=";
+    case BITWISE_OR_EQUALS:          return "|=";
+    case BITWISE_XOR_EQUALS:         return "^=";
+    case BITWISE_LEFT_SHIFT_EQUALS:  return "<<=";
+    case BITWISE_RIGHT_SHIFT_EQUALS: return ">>=";
+    default:
+      COMPILER_ERROR_FMTMSG("EmitC(): Unhandled operator '%s'", TokenTypeTranslation(t));
+      return "";
+  }
+}
+
+static void EmitBinary(AST_Node *node, enum TypeSpecifier hint, bool outermost) {
+  enum TypeSpecifier type = OperandSpec(node->left, node->right, hint);
+  bool is_shift = node->token.type == BITWISE_LEFT_SHIFT || node->token.type == BITWISE_RIGHT_SHIFT;
+  if (is_shift && NaturalSpec(node->left) != T_NONE) type = NaturalSpec(node->left);
+
+  if (node->token.type == MODULO && IsFloatSpec(type)) {
+    Out((type == T_F32) ? "fmodf(" : "fmod(");
+    EmitExpression(node->left, type);
+    Out(", ");
+    EmitExpression(node->right, type);
+    Out(")");
+    return;
+  }
+
+  TokenType op = node->token.type;
+  if ((op == DIVIDE || op == MODULO) && IsIntegerSpec(type)) {
+    if (SpecSize(type) < 8) Out("((%s)", ScalarCType(type));
+    Out("crom_%s_%s(", (op == DIVIDE) ? "div" : "mod", IsUnsignedSpec(type) ? "u64" : "i64");
+    EmitExpression(node->left, type);
+    Out(", ");
+    EmitExpression(node->right, type);
+    Out(")");
+    if (SpecSize(type) < 8) Out(")");
+    return;
+  }
+
+  if (IsOverflowingSpec(type) && (op == PLUS || op == MINUS || op == ASTERISK || op == BITWISE_LEFT_SHIFT)) {
+    const char *unsigned_type = UnsignedCType(type);
+    Out("((%s)((%s)", ScalarCType(type), unsigned_type);
+    EmitExpression(node->left, type);
+    Out(" %s (%s)", OperatorText(op), unsigned_type);
+    EmitExpression(node->right, type);
+    Out("))");
+    return;
+  }
+
+  // Literal-only operands would otherwise be computed in C's int
+  bool literals_only = NaturalSpec(node->left) == T_NONE && NaturalSpec(node->right) == T_NONE;
+  bool needs_width = literals_only && !IsFloatSpec(type) && SpecSize(type) == 8;
+
+  bool narrow = IsNarrowSpec(type);
+
+  if (narrow) Out("%s(%s)", outermost ? "" : "(", ScalarCType(type));
+  if (narrow || !outermost) Out("(");
+  if (needs_width) Out("(%s)", ScalarCType(type));
+  EmitExpression(node->left, type);
+  Out(" %s ", OperatorText(node->token.type));
+  EmitExpression(node->right, type);
+  if (narrow || !outermost) Out(")");
+  if (narrow && !outermost) Out(")");
+}
+
+static void EmitComparison(AST_Node *left, TokenType op, AST_Node *right, bool outermost) {
+  enum TypeSpecifier type = OperandSpec(left, right, T_NONE);
+
+  if (!outermost) Out("(");
+  EmitExpression(left, type);
+  Out(" %s ", OperatorText(op));
+  EmitExpression(right, type);
+  if (!outermost) Out(")");
+}
+
+static void EmitLogical(AST_Node *node, bool outermost) {
+  if (node->token.type == LOGICAL_AND || node->token.type == LOGICAL_OR) {
+    if (!outermost) Out("(");
+    EmitExpression(node->left, T_BOOL);
+    Out(" %s ", OperatorText(node->token.type));
+    EmitExpression(node->right, T_BOOL);
+    if (!outermost) Out(")");
+    return;
+  }
+
+  EmitComparison(node->left, node->token.type, node->right, outermost);
+}
+
+static void EmitUnary(AST_Node *node, enum TypeSpecifier hint) {
+  if (node->token.type == LOGICAL_NOT) {
+    Out("!");
+    EmitExpression(node->left, T_BOOL);
+    return;
+  }
+
+  enum TypeSpecifier type = NaturalSpec(node->left);
+  if (type == T_NONE) type = IsNumericSpec(hint) ? hint : DefaultLiteralSpec(node->left);
+
+  const char *op = (node->token.type == MINUS) ? "-" : "~";
+  if (node->token.type == MINUS && IsOverflowingSpec(type)) {
+    Out("((%s)-(%s)", ScalarCType(type), UnsignedCType(type));
+    EmitExpression(node->left, type);
+    Out(")");
+    return;
+  }
+
+  if (IsNarrowSpec(type)) Out("((%s)", ScalarCType(type));
+  Out("(%s", op);
+  EmitExpression(node->left, type);
+  Out(")");
+  if (IsNarrowSpec(type)) Out(")");
+}
+
+static void EmitTernary(AST_Node *node, enum TypeSpecifier hint, bool outermost) {
+  enum TypeSpecifier type = NaturalSpec(node);
+  if (type == T_NONE) type = IsNumericSpec(hint) ? hint : DefaultLiteralSpec(node);
+
+  if (!outermost) Out("(");
+  EmitExpression(node->left, T_BOOL);
+  Out(" ? ");
+  EmitExpression(node->middle, type);
+  Out(" : ");
+  EmitExpression(node->right, type);
+  if (!outermost) Out(")");
+}
+
+static void EmitArgument(AST_Node *arg, enum TypeSpecifier hint) {
+  if (arg->node_type != FUNCTION_ARGUMENT_NODE) EmitTopExpression(arg, hint);
+  else if (arg->left != NULL) EmitTopExpression(arg->left, hint);
+  else if (arg->token.type == IDENTIFIER) EmitNameAccess(arg->token, NULL);
+  else EmitLiteral(arg->token, hint);
+}
+
+static void EmitCall(AST_Node *node) {
+  AST_Node *function = FindFunction(node->token);
+  AST_Node *param = (function != NULL) ? function->middle : NULL;
+
+  EmitName(node->token);
+  Out("(");
+
+  bool first = true;
+  for (AST_Node *arg = node->middle; arg != NULL; arg = arg->right) {
+    if (arg->node_type == CHAIN_NODE) continue;
+
+    while (param != NULL && param->token.type != IDENTIFIER) param = param->left;
+    enum TypeSpecifier hint = (param != NULL) ? param->data_type.specifier : T_NONE;
+    if (param != NULL) param = param->left;
+
+    if (!first) Out(", ");
+    EmitArgument(arg, hint);
+    first = false;
+  }
+
+  Out(")");
+}
+
+static void EmitIncDec(AST_Node *node, bool outermost) {
+  bool is_prefix = node->node_type == PREFIX_INCREMENT_NODE || node->node_type == PREFIX_DECREMENT_NODE;
+  bool is_increment = node->node_type == PREFIX_INCREMENT_NODE || node->node_type == POSTFIX_INCREMENT_NODE;
+  AST_Node *target = (is_prefix) ? node->left : node;
+  const char *op = (is_increment) ? "++" : "--";
+
+  // Signed overflow steps through the unsigned type, then the result is read back signed
+  enum TypeSpecifier type = NameSpec(target->token, target->middle != NULL);
+  bool wraps = IsOverflowingSpec(type);
+
+  if (!outermost) Out((wraps) ? "((%s)(" : "(", ScalarCType(type));
+  if (is_prefix) Out("%s", op);
+  if (wraps) Out("(*(%s *)&", UnsignedCType(type));
+  EmitNameAccess(target->token, target->middle);
+  if (wraps) Out(")");
+  if (!is_prefix) Out("%s", op);
+  if (!outermost) Out((wraps) ? "))" : ")");
+}
+
+static void EmitTerseAssignment(AST_Node *node, bool outermost) {
+  AST_Node *target = node->left;
+
+  // "x != y" parses as a terse assignment when x is an identifier
+  if (node->token.type == LOGICAL_NOT_EQUALS) {
+    EmitComparison(target, LOGICAL_NOT_EQUALS, node->right, outermost);
+    return;
+  }
+
+  enum TypeSpecifier type = NameSpec(target->token, target->middle != NULL);
+  TokenType op = node->token.type;
+
+  if ((op == DIVIDE_EQUALS || op == MODULO_EQUALS) && IsIntegerSpec(type)) {
+    Out("crom_%s_assign_%s(&", (op == DIVIDE_EQUALS) ? "div" : "mod", ScalarCType(type));
+    EmitNameAccess(target->token, target->middle);
+    Out(", ");
+    EmitExpression(node->right, type);
+    Out(")");
+    return;
+  }
+
+  bool wraps = IsOverflowingSpec(type) &&
+    (op == PLUS_EQUALS || op == MINUS_EQUALS || op == TIMES_EQUALS || op == BITWISE_LEFT_SHIFT_EQUALS);
+
+  if (wraps) {
+    const char *unsigned_type = UnsignedCType(type);
+    if (!outermost) Out("((%s)", ScalarCType(type));
+    Out("(*(%s *)&", unsigned_type);
+    EmitNameAccess(target->token, target->middle);
+    Out(" %s (%s)", OperatorText(op), unsigned_type);
+    EmitExpression(node->right, type);
+    Out(")");
+    if (!outermost) Out(")");
+    return;
+  }
+
+  if (!outermost) Out("(");
+  EmitNameAccess(target->token, target->middle);
+  Out(" %s ", OperatorText(op));
+  EmitExpression(node->right, type);
+  if (!outermost) Out(")");
+}
+
+static void EmitPlainAssignment(AST_Node *node) {
+  CVariable *var = FindVariable(node->token);
+  enum TypeSpecifier type = (var != NULL) ? ElementOrValueSpec(var->type, node->middle != NULL) : T_NONE;
+
+  Out("(");
+  EmitNameAccess(node->token, node->middle);
+  Out(" = ");
+  EmitExpression(node->left, type);
+  Out(")");
+}
+
+/* Operators are parenthesized unless they are the outermost operation of
+ * a statement or a condition, which EmitTopExpression() marks */
+static void EmitExpression(AST_Node *node, enum TypeSpecifier hint) {
+  bool outermost = C.outermost;
+  C.outermost = false;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:           EmitLiteral(node->token, hint); break;
+    case IDENTIFIER_NODE:        EmitNameAccess(node->token, node->middle); break;
+    case UNARY_OP_NODE:          EmitUnary(node, hint); break;
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE:    EmitBinary(node, hint, outermost); break;
+    case BINARY_LOGICAL_NODE:    EmitLogical(node, outermost); break;
+    case TERSE_ASSIGNMENT_NODE:  EmitTerseAssignment(node, outermost); break;
+    case ASSIGNMENT_NODE:        EmitPlainAssignment(node); break;
+    case TERNARY_IF_NODE:        EmitTernary(node, hint, outermost); break;
+    case FUNCTION_CALL_NODE:     EmitCall(node); break;
+    case FUNCTION_ARGUMENT_NODE: EmitArgument(node, hint); break;
+    case STRUCT_IDENTIFIER_NODE: EmitMemberAccess(node, outermost); break;
+    case PREFIX_INCREMENT_NODE:
+    case PREFIX_DECREMENT_NODE:
+    case POSTFIX_INCREMENT_NODE:
+    case POSTFIX_DECREMENT_NODE: EmitIncDec(node, outermost); break;
+    default:
+      COMPILER_ERROR_FMTMSG("EmitC(): Unhandled node type '%s'", NodeTypeTranslation(node->node_type));
+  }
+}
+
+static void EmitTopExpression(AST_Node *node, enum TypeSpecifier hint) {
+  C.outermost = true;
+  EmitExpression(node, hint);
+}
+
+/* === Declarations and assignments === */
+static bool IsConstant(AST_Node *node) {
+  if (node == NULL) return true;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+      return true;
+    case UNARY_OP_NODE:
+      return node->token.type != LOGICAL_NOT && IsConstant(node->left);
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE:
+      return node->token.type != MODULO && IsConstant(node->left) && IsConstant(node->right);
+    case INITIALIZER_LIST_NODE:
+      for (AST_Node *entry = node; entry != NULL; entry = entry->right) {
+        if (entry->left != NULL && !IsConstant(entry->left)) return false;
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Emits "{a, b, c}" with each entry typed like the element or member it fills
+static void EmitInitializerList(CVariable *var, AST_Node *list) {
+  StructMember *member = NULL;
+  if (TypeIs_Struct(var->type)) member = StructDefinitionOf(var->struct_name).members.next;
+
+  Out("{");
+  bool first = true;
+  for (AST_Node *entry = list; entry != NULL; entry = entry->right) {
+    if (entry->left == NULL) continue;
+
+    enum TypeSpecifier hint = (member != NULL) ? member->type.specifier : var->type.specifier;
+    if (member != NULL) member = member->next;
+
+    if (!first) Out(", ");
+    EmitTopExpression(entry->left, hint);
+    first = false;
+  }
+  Out("}");
+}
+
+static void EmitInitializer(CVariable *var, AST_Node *value) {
+  if (value->node_type == INITIALIZER_LIST_NODE) EmitInitializerList(var, value);
+  else EmitTopExpression(value, ElementOrValueSpec(var->type, false));
+}
+
+// "T x = value", without the semicolon
+static void EmitDefinition(AST_Node *node) {
+  CVariable *var = DeclareVariable(node->token, node->right->data_type);
+
+  EmitDeclarator(var->type, var->name, var->struct_name);
+  Out(" = ");
+  EmitInitializer(var, node->left);
+}
+
+// Assignment to an existing variable, without the semicolon
+static void EmitAssignment(AST_Node *node) {
+  CVariable *var = FindVariable(node->token);
+  if (var == NULL) {
+    COMPILER_ERROR_FMTMSG("EmitC(): Unknown variable '%.*s' on line %d",
+                          node->token.length, node->token.position_in_source, node->token.on_line);
+  }
+
+  if (node->left->node_type != INITIALIZER_LIST_NODE) {
+    EmitNameAccess(node->token, node->middle);
+    Out(" = ");
+    EmitTopExpression(node->left, ElementOrValueSpec(var->type, node->middle != NULL));
+    return;
+  }
+
+  // Reassigning a whole aggregate: elements or members not listed become zero
+  if (TypeIs_Struct(var->type)) {
+    EmitName(node->token);
+    Out(" = (struct ");
+    EmitName(var->struct_name);
+    Out(")");
+    EmitInitializerList(var, node->left);
+    return;
+  }
+
+  Out("memcpy(");
+  EmitName(node->token);
+  Out(", (%s[%d])", ScalarCType(var->type.specifier), var->type.array_size);
+  EmitInitializerList(var, node->left);
+  Out(", sizeof(%s[%d]))", ScalarCType(var->type.specifier), var->type.array_size);
+}
+
+static bool IsDefinition(AST_Node *node) {
+  return node->node_type == ASSIGNMENT_NODE && node->right != NULL && node->right->node_type == DECLARATION_NODE;
+}
+
+static bool IsVariableDeclaration(AST_Node *node) {
+  return node->node_type == DECLARATION_NODE && !TypeIs_Function(node->data_type);
+}
+
+// The first clause of a for loop, or a whole simple statement
+static void EmitSimpleStatement(AST_Node *node) {
+  if (IsDefinition(node)) {
+    EmitDefinition(node);
+  } else if (IsVariableDeclaration(node)) {
+    CVariable *var = DeclareVariable(node->token, node->data_type);
+    EmitDeclarator(var->type, var->name, var->struct_name);
+    Out(" = {0}");
+  } else if (node->node_type == ASSIGNMENT_NODE) {
+    EmitAssignment(node);
+  } else {
+    EmitTopExpression(node, T_NONE);
+  }
+}
+
+/* === Statements === */
+static void EmitBlock(AST_Node *chain) {
+  Out("{\n");
+  C.indent++;
+  EnterScope();
+  EmitChain(chain);
+  LeaveScope();
+  C.indent--;
+  Indent();
+  Out("}");
+}
+
+static void EmitIf(AST_Node *node) {
+  Out("if (");
+  EmitTopExpression(node->left, T_BOOL);
+  Out(") ");
+  EmitBlock(node->middle);
+
+  if (node->right != NULL) {
+    Out(" else ");
+    if (node->right->node_type == IF_NODE) EmitIf(node->right);
+    else EmitBlock(node->right);
+  }
+}
+
+static void EmitFor(AST_Node *node) {
+  AST_Node *loop = node->right;
+  AST_Node *last = loop->right;
+  while (last != NULL && last->right != NULL) last = last->right;
+  AST_Node *increment = (last != NULL) ? last->left : NULL;
+
+  EnterScope();
+  Out("for (");
+  if (node->left != NULL) EmitSimpleStatement(node->left);
+  Out("; ");
+  EmitTopExpression(loop->left, T_BOOL);
+  Out("; ");
+  if (increment != NULL) EmitSimpleStatement(increment);
+  Out(") {\n");
+
+  C.indent++;
+  EnterScope();
+  for (AST_Node *chain = loop->right; chain != NULL; chain = chain->right) {
+    if (chain != last && chain->left != NULL) EmitStatement(chain->left);
+  }
+  LeaveScope();
+  C.indent--;
+
+  Indent();
+  Out("}");
+  LeaveScope();
+}
+
+static bool IsSelfCall(AST_Node *node) {
+  return node != NULL && node->node_type == FUNCTION_CALL_NODE && C.function != NULL &&
+         TokenValuesMatch(node->token, C.function->token);
+}
+
+static bool HasSelfTailCall(AST_Node *value) {
+  if (IsSelfCall(value)) return true;
+
+  return value != NULL && NodeIs_TernaryIf(value) &&
+         (HasSelfTailCall(value->middle) || HasSelfTailCall(value->right));
+}
+
+static bool ContainsSelfTailCall(AST_Node *node) {
+  if (node == NULL) return false;
+  if (node->node_type == RETURN_NODE && HasSelfTailCall(node->left)) return true;
+
+  return ContainsSelfTailCall(node->left) || ContainsSelfTailCall(node->middle) || ContainsSelfTailCall(node->right);
+}
+
+// Every argument is evaluated before any parameter is overwritten
+static void EmitSelfTailCall(AST_Node *call) {
+  Out("{\n");
+  C.indent++;
+
+  AST_Node *param = C.function->middle;
+  int count = 0;
+  for (AST_Node *arg = call->middle; arg != NULL; arg = arg->right) {
+    if (arg->node_type == CHAIN_NODE) continue;
+
+    while (param->token.type != IDENTIFIER) param = param->left;
+    bool is_array = TypeIs_Array(param->data_type) && !TypeIs_String(param->data_type);
+
+    Indent();
+    Out("%s %scrom_tail%d = ", ScalarCType(param->data_type.specifier), is_array ? "*" : "", count++);
+    EmitArgument(arg, param->data_type.specifier);
+    Out(";\n");
+    param = param->left;
+  }
+
+  count = 0;
+  for (param = C.function->middle; param != NULL; param = param->left) {
+    if (param->token.type != IDENTIFIER) continue;
+
+    Indent();
+    EmitName(param->token);
+    Out(" = crom_tail%d;\n", count++);
+  }
+
+  Indent();
+  Out("goto crom_tail_call;\n");
+  C.indent--;
+  Indent();
+  Out("}");
+}
+
+static void EmitReturnValue(AST_Node *value) {
+  if (IsSelfCall(value)) {
+    EmitSelfTailCall(value);
+    return;
+  }
+
+  if (HasSelfTailCall(value)) {
+    Out("if (");
+    EmitTopExpression(value->left, T_BOOL);
+    Out(") {\n");
+    C.indent++;
+    Indent();
+    EmitReturnValue(value->middle);
+    C.indent--;
+    Out("\n");
+    Indent();
+    Out("} else {\n");
+    C.indent++;
+    Indent();
+    EmitReturnValue(value->right);
+    C.indent--;
+    Out("\n");
+    Indent();
+    Out("}");
+    return;
+  }
+
+  Out("return");
+  if (value != NULL) {
+    Out(" ");
+    EmitTopExpression(value, T_NONE);
+  }
+  Out(";");
+}
+
+static void EmitReturn(AST_Node *node) {
+  if (C.in_entry) {
+    if (node->left != NULL) {
+      Out("(void)");
+      EmitTopExpression(node->left, T_NONE);
+      Out(";\n");
+      Indent();
+    }
+    Out("return 0;");
+    return;
+  }
+
+  EmitReturnValue(node->left);
+}
+
+static void EmitPrint(AST_Node *node) {
+  enum TypeSpecifier type = ValueSpec(node->left);
+  const char *function = IsFloatSpec(type) ? "crom_print_f64"
+                       : IsUnsignedSpec(type) ? "crom_print_u64"
+                       : (type == T_CHAR) ? "crom_print_char"
+                       : (type == T_BOOL) ? "crom_print_bool"
+                       : (type == T_STRING) ? "crom_print_string"
+                       : "crom_print_i64";
+
+  Out("%s(", function);
+  EmitTopExpression(node->left, type);
+  Out(");");
+}
+
+static void EmitStatement(AST_Node *node) {
+  if (node == NULL) return;
+
+  switch (node->node_type) {
+    // Emitted separately, or carry no code
+    case FUNCTION_NODE:
+    case ENUM_IDENTIFIER_NODE:
+    case STRUCT_DECLARATION_NODE:
+      return;
+    case DECLARATION_NODE:
+      if (TypeIs_Function(node->data_type)) return;
+      break;
+    default:
+      break;
+  }
+
+  Indent();
+  switch (node->node_type) {
+    case START_NODE:
+    case CHAIN_NODE:
+    case FUNCTION_BODY_NODE: EmitBlock(node); break;
+    case IF_NODE:            EmitIf(node); break;
+    case WHILE_NODE:
+      Out("while (");
+      EmitTopExpression(node->left, T_BOOL);
+      Out(") ");
+      EmitBlock(node->right);
+      break;
+    case FOR_NODE:           EmitFor(node); break;
+    case BREAK_NODE:         Out("break;"); break;
+    case CONTINUE_NODE:      Out("continue;"); break;
+    case RETURN_NODE:        EmitReturn(node); break;
+    case PRINT_CALL_NODE:    EmitPrint(node); break;
+    default:
+      EmitSimpleStatement(node);
+      Out(";");
+      break;
+  }
+  Out("\n");
+}
+
+static void EmitChain(AST_Node *chain) {
+  for (; chain != NULL; chain = chain->right) {
+    if (chain->left != NULL) EmitStatement(chain->left);
+  }
+}
+
+/* === Top level === */
+static int64_t ConstantInt(AST_Node *node) {
+  if (node->node_type == UNARY_OP_NODE && node->token.type == MINUS) return -ConstantInt(node->left);
+  if (node->node_type == IDENTIFIER_NODE) {
+    CEnumMember *e = FindEnumMember(node->token);
+    return (e != NULL) ? e->value : 0;
+  }
+
+  return (int64_t)ParseUnsigned(node->token);
+}
+
+static void CollectEnum(AST_Node *node) {
+  int64_t next = 0;
+
+  for (AST_Node *chain = node; chain != NULL; chain = chain->right) {
+    AST_Node *entry = chain->left;
+    if (entry == NULL) continue;
+
+    int64_t value = (entry->node_type == ENUM_ASSIGNMENT_NODE) ? ConstantInt(entry->left) : next;
+    next = value + 1;
+
+    CEnumMember member = {entry->token, value};
+    ARENA_PUSH(C.scratch, C.enum_members, C.enum_count, C.enum_capacity, member);
+  }
+}
+
+// Finds the definitions and string literals the prelude has to declare
+static void CollectDefinitions(AST_Node *node) {
+  while (node != NULL) {
+    switch (node->node_type) {
+      case FUNCTION_NODE:
+        ARENA_PUSH(C.scratch, C.functions, C.function_count, C.function_capacity, node);
+        break;
+      case STRUCT_DECLARATION_NODE:
+        ARENA_PUSH(C.scratch, C.structs, C.struct_count, C.struct_capacity, node);
+        break;
+      case ENUM_IDENTIFIER_NODE:
+        CollectEnum(node);
+        return;
+      default:
+        if (node->token.type == STRING_LITERAL) {
+          ARENA_PUSH(C.scratch, C.strings, C.string_count, C.string_capacity, node->token);
+        }
+        break;
+    }
+
+    if (node->left != NULL) CollectDefinitions(node->left);
+    if (node->middle != NULL) CollectDefinitions(node->middle);
+    node = node->right;
+  }
+}
+
+static void EmitStructs() {
+  for (int i = 0; i < C.struct_count; i++) {
+    Out("struct ");
+    EmitName(C.structs[i]->token);
+    Out(" {\n");
+
+    for (StructMember *m = C.structs[i]->data_type.members.next; m != NULL; m = m->next) {
+      Out("  ");
+      EmitDeclarator(m->type, m->token, (Token){0});
+      Out(";\n");
+    }
+
+    Out("};\n\n");
+  }
+}
+
+static void EmitEnumMembers() {
+  for (int i = 0; i < C.enum_count; i++) {
+    Out("static const int64_t ");
+    EmitName(C.enum_members[i].name);
+    Out(" = %" PRId64 ";\n", C.enum_members[i].value);
+  }
+
+  if (C.enum_count > 0) Out("\n");
+}
+
+static void EmitStrings() {
+  for (int i = 0; i < C.string_count; i++) {
+    Token t = C.strings[i];
+    Out("static char crom_str%d[] = \"%.*s\";\n", i, t.length, t.position_in_source);
+  }
+
+  if (C.string_count > 0) Out("\n");
+}
+
+static void EmitSignature(AST_Node *function) {
+  Out("static %s ", ScalarCType(function->left->data_type.specifier));
+  EmitName(function->token);
+  Out("(");
+
+  bool first = true;
+  for (AST_Node *param = function->middle; param != NULL; param = param->left) {
+    if (param->token.type != IDENTIFIER) continue;
+
+    if (!first) Out(", ");
+    EmitDeclarator(param->data_type, param->token, (Token){0});
+    first = false;
+  }
+
+  Out(first ? "void)" : ")");
+}
+
+static void EmitPrototypes() {
+  for (int i = 0; i < C.function_count; i++) {
+    EmitSignature(C.functions[i]);
+    Out(";\n");
+  }
+
+  if (C.function_count > 0) Out("\n");
+}
+
+static void EmitGlobals(AST_Node *root) {
+  bool any = false;
+
+  for (AST_Node *chain = root; chain != NULL; chain = chain->right) {
+    AST_Node *stmt = chain->left;
+    if (stmt == NULL) continue;
+
+    if (IsVariableDeclaration(stmt)) {
+      CVariable *var = DeclareVariable(stmt->token, stmt->data_type);
+      EmitDeclarator(var->type, var->name, var->struct_name);
+    } else if (IsDefinition(stmt)) {
+      CVariable *var = DeclareVariable(stmt->token, stmt->right->data_type);
+      EmitDeclarator(var->type, var->name, var->struct_name);
+
+      if (IsConstant(stmt->left)) {
+        Out(" = ");
+        EmitInitializer(var, stmt->left);
+      }
+    } else {
+      continue;
+    }
+
+    Out(";\n");
+    any = true;
+  }
+
+  if (any) Out("\n");
+}
+
+static void EmitFunction(AST_Node *function) {
+  EmitSignature(function);
+  Out(" {\n");
+
+  C.indent++;
+  C.function = function;
+  EnterScope();
+  for (AST_Node *param = function->middle; param != NULL; param = param->left) {
+    if (param->token.type == IDENTIFIER) DeclareVariable(param->token, param->data_type);
+  }
+
+  if (ContainsSelfTailCall(function->right)) Out("crom_tail_call:;\n");
+  EmitChain(function->right);
+  C.function = NULL;
+
+  LeaveScope();
+  C.indent--;
+  Out("}\n\n");
+}
+
+static void EmitEntry(AST_Node *root) {
+  Out("int main(void) {\n");
+  C.indent++;
+  C.in_entry = true;
+
+  for (AST_Node *chain = root; chain != NULL; chain = chain->right) {
+    AST_Node *stmt = chain->left;
+    if (stmt == NULL || IsVariableDeclaration(stmt)) continue;
+
+    // Globals were declared in the prelude; only the initialization is left
+    if (IsDefinition(stmt)) {
+      if (IsConstant(stmt->left)) continue;
+
+      Indent();
+      EmitAssignment(stmt);
+      Out(";\n");
+      continue;
+    }
+
+    EmitStatement(stmt);
+  }
+
+  C.in_entry = false;
+  Indent();
+  Out("return 0;\n");
+  C.indent--;
+  Out("}\n");
+}
+
+void EmitC(AST_Node *root, SymbolTable *st, FILE *out) {
+  memset(&C, 0, sizeof(C));
+  C.scratch = NewArena();
+  C.out = out;
+  C.st = st;
+
+  CollectDefinitions(root);
+
+  Out("#include \"crom_runtime.h\"\n\n");
+  EmitStructs();
+  EmitEnumMembers();
+  EmitStrings();
+  EmitPrototypes();
+  EmitGlobals(root);
+
+  for (int i = 0; i < C.function_count; i++) {
+    EmitFunction(C.functions[i]);
+  }
+
+  EmitEntry(root);
+
+  DeleteArena(C.scratch);
+}
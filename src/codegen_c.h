@@ -0,0 +1,16 @@
+#ifndef CODEGEN_C_H
+#define CODEGEN_C_H
+
+#include <stdio.h>
+
+#include "ast.h"
+#include "symbol_table.h"
+
+/* Translates a type checked AST into a C11 translation unit. The output
+ * includes "crom_runtime.h" (from the runtime/ directory) for strings,
+ * print, bounds checks and division; top level statements become C's
+ * main(). Integer arithmetic wraps like the native backend without any
+ * compiler flags. */
+void EmitC(AST_Node *root, SymbolTable *st, FILE *out);
+
+#endif
@@ -0,0 +1,1241 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen_x64.h"
+#include "error.h"
+#include "regalloc.h"
+
+/* A straightforward code generator: every IR value that needs one gets a
+ * home, a register chosen by the linear scan allocator (regalloc.h) or an
+ * 8-byte stack slot when it was spilled. Each instruction loads its
+ * operands into fixed scratch registers (rax/rcx for integers, xmm0/xmm1
+ * for floats), computes and moves the result to its home. Integer values
+ * are kept sign or zero extended to 64 bits, so comparisons and divisions
+ * can always work on full registers. Floats are kept as raw bits in
+ * general purpose registers, f32 in the low half.
+ *
+ * Vector values always live in 16-byte (SSE2) or 32-byte (AVX2) stack
+ * slots and are worked on in xmm0/xmm1 or ymm0/ymm1. Functions using ymm
+ * registers clear their upper halves before calls and returns, so that
+ * SSE code elsewhere doesn't pay for a state transition.
+ *
+ * Constants, stack slots, globals and strings are rematerialized at each
+ * use instead of occupying a home. Phis are resolved with copies on the
+ * incoming edges, staged through temporaries so that phis reading each
+ * other's values see the old ones; copies between values sharing a
+ * register are dropped. */
+
+static const char *int_arg_registers[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+#define INT_ARG_REGISTERS 6
+#define FLOAT_ARG_REGISTERS 8
+
+typedef struct {
+  bool is_float;
+  int reg;          // register index, or -1 when passed on the stack
+  int stack_offset; // byte offset from the first stack argument
+} ArgLocation;
+
+static struct {
+  FILE *out;
+  IR_Module *module;
+  IR_Function *fn;
+  int fn_index;
+
+  RegAllocation ra;
+  int *slot;           // frame offset per value, 0 if it has none
+  int phi_temps;       // frame offset of the phi staging area
+  int phi_temp_size;   // bytes per staged phi, more than 8 with vector phis
+  int saved_registers; // frame offset of the callee-saved register area
+  int frame_size;
+  bool uses_bounds_check;
+  bool uses_ymm;
+} X64;
+
+static void Asm(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  fputs("  ", X64.out);
+  vfprintf(X64.out, fmt, args);
+  fputc('\n', X64.out);
+
+  va_end(args);
+}
+
+static void Label(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+
+  vfprintf(X64.out, fmt, args);
+  fputs(":\n", X64.out);
+
+  va_end(args);
+}
+
+static void FunctionSymbol(IR_Function *fn, char *buffer, int size) {
+  if (fn->is_entry) snprintf(buffer, size, "main");
+  else snprintf(buffer, size, "crom_%s", fn->name);
+}
+
+static IR_Type TypeOf(IR_Value v) {
+  return X64.fn->insts[v].type;
+}
+
+static bool IsUnsigned(IR_Type t) {
+  return !IRType_IsSigned(t);
+}
+
+// The register holding `v`, or NULL when it lives in a stack slot or has no home
+static const char *HomeRegister(IR_Value v) {
+  int reg = X64.ra.reg[v];
+  return (reg == REG_NONE) ? NULL : X64RegisterName(reg);
+}
+
+// Clears the upper halves of the ymm registers before control leaves the function
+static void LeaveAVX() {
+  if (X64.uses_ymm) Asm("vzeroupper");
+}
+
+/* === Operands === */
+static uint64_t ConstBits(IR_Inst *inst) {
+  switch (inst->type) {
+    case IRT_F64: {
+      uint64_t bits;
+      memcpy(&bits, &inst->imm.f, sizeof(bits));
+      return bits;
+    }
+    case IRT_F32: {
+      float f = (float)inst->imm.f;
+      uint32_t bits;
+      memcpy(&bits, &f, sizeof(bits));
+      return bits;
+    }
+    default:
+      return inst->imm.u;
+  }
+}
+
+// Puts the raw 64 bits of value `v` into a general purpose register
+static void LoadRaw(IR_Value v, const char *reg) {
+  IR_Inst *inst = &X64.fn->insts[v];
+
+  switch (inst->op) {
+    case IR_CONST: {
+      int64_t bits = (int64_t)ConstBits(inst);
+      if (bits >= INT32_MIN && bits <= INT32_MAX) Asm("movq $%lld, %%%s", (long long)bits, reg);
+      else Asm("movabsq $%lld, %%%s", (long long)bits, reg);
+    } break;
+    case IR_ALLOCA:
+      Asm("leaq -%d(%%rbp), %%%s", X64.slot[v], reg);
+      break;
+    case IR_GLOBAL:
+      Asm("leaq crom_g%lld_%s(%%rip), %%%s", (long long)inst->imm.i, X64.module->globals[inst->imm.i].name, reg);
+      break;
+    case IR_STRING:
+      Asm("leaq .Lstr%lld(%%rip), %%%s", (long long)inst->imm.i, reg);
+      break;
+    default: {
+      const char *home = HomeRegister(v);
+      if (home == NULL) Asm("movq -%d(%%rbp), %%%s", X64.slot[v], reg);
+      else if (strcmp(home, reg) != 0) Asm("movq %%%s, %%%s", home, reg);
+    } break;
+  }
+}
+
+static void LoadFloat(IR_Value v, int xmm) {
+  const char *home = HomeRegister(v);
+  if (home == NULL) {
+    LoadRaw(v, "r11");
+    home = "r11";
+  }
+
+  Asm("movq %%%s, %%xmm%d", home, xmm);
+}
+
+static void StoreRax(IR_Value v) {
+  const char *home = HomeRegister(v);
+  if (home == NULL) Asm("movq %%rax, -%d(%%rbp)", X64.slot[v]);
+  else Asm("movq %%rax, %%%s", home);
+}
+
+// Moves a float result from xmm0 into rax as raw bits, f32 zero extended
+static void FloatResultToRax(IR_Type t) {
+  if (t == IRT_F32) Asm("movd %%xmm0, %%eax");
+  else Asm("movq %%xmm0, %%rax");
+}
+
+// Re-establishes the sign or zero extension invariant for `t` in rax
+static void Canonicalize(IR_Type t) {
+  switch (t) {
+    case IRT_BOOL:
+    case IRT_U8:
+    case IRT_CHAR: Asm("movzbl %%al, %%eax"); break;
+    case IRT_I8:   Asm("movsbq %%al, %%rax"); break;
+    case IRT_I16:  Asm("movswq %%ax, %%rax"); break;
+    case IRT_U16:  Asm("movzwl %%ax, %%eax"); break;
+    case IRT_I32:  Asm("movslq %%eax, %%rax"); break;
+    case IRT_U32:
+    case IRT_F32:  Asm("movl %%eax, %%eax"); break;
+    default: break;
+  }
+}
+
+/* === Calling convention === */
+static void ClassifyArgs(IR_Type *types, int count, ArgLocation *locations, int *stack_bytes) {
+  int ints = 0, floats = 0, stack = 0;
+
+  for (int i = 0; i < count; i++) {
+    ArgLocation loc = {IRType_IsFloat(types[i]), -1, 0};
+
+    if (loc.is_float && floats < FLOAT_ARG_REGISTERS) {
+      loc.reg = floats++;
+    } else if (!loc.is_float && ints < INT_ARG_REGISTERS) {
+      loc.reg = ints++;
+    } else {
+      loc.stack_offset = stack;
+      stack += 8;
+    }
+
+    locations[i] = loc;
+  }
+
+  *stack_bytes = stack;
+}
+
+int X64StackArgBytes(IR_Type *types, int count) {
+  ArgLocation *locations = malloc((count + 1) * sizeof(ArgLocation));
+  int stack_bytes;
+  ClassifyArgs(types, count, locations, &stack_bytes);
+  free(locations);
+
+  return stack_bytes;
+}
+
+// Returns the number of arguments passed in xmm registers
+static int LoadRegisterArgs(IR_Value *args, int count, ArgLocation *locations) {
+  // Arguments living in argument registers could be overwritten before
+  // they are read, those calls pass every register argument through the stack
+  bool staged = false;
+  for (int i = 0; i < count; i++) {
+    const char *home = HomeRegister(args[i]);
+    for (int r = 0; r < INT_ARG_REGISTERS && home != NULL; r++) {
+      if (strcmp(home, int_arg_registers[r]) == 0) staged = true;
+    }
+  }
+
+  if (staged) {
+    for (int i = 0; i < count; i++) {
+      if (locations[i].reg < 0) continue;
+      LoadRaw(args[i], "rax");
+      Asm("pushq %%rax");
+    }
+  }
+
+  int float_count = 0;
+  for (int i = count - 1; i >= 0; i--) {
+    if (locations[i].reg < 0) continue;
+
+    if (locations[i].is_float) {
+      if (staged) {
+        Asm("popq %%r11");
+        Asm("movq %%r11, %%xmm%d", locations[i].reg);
+      } else {
+        LoadFloat(args[i], locations[i].reg);
+      }
+      float_count++;
+    } else if (staged) {
+      Asm("popq %%%s", int_arg_registers[locations[i].reg]);
+    } else {
+      LoadRaw(args[i], int_arg_registers[locations[i].reg]);
+    }
+  }
+
+  return float_count;
+}
+
+static void EmitCall(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  IR_Function *callee = &X64.module->functions[inst->imm.i];
+  IR_Value *args = IRArgs(X64.fn, v);
+  int count = inst->args_count;
+
+  ArgLocation *locations = malloc((count + 1) * sizeof(ArgLocation));
+  int stack_bytes;
+  ClassifyArgs(callee->param_types, count, locations, &stack_bytes);
+
+  // The stack must be 16-byte aligned at the call
+  int padding = (stack_bytes % 16 != 0) ? 8 : 0;
+  if (padding > 0) Asm("subq $%d, %%rsp", padding);
+
+  for (int i = count - 1; i >= 0; i--) {
+    if (locations[i].reg >= 0) continue;
+    LoadRaw(args[i], "rax");
+    Asm("pushq %%rax");
+  }
+
+  int float_count = LoadRegisterArgs(args, count, locations);
+
+  char symbol[256];
+  FunctionSymbol(callee, symbol, sizeof(symbol));
+  Asm("movl $%d, %%eax", float_count);
+  LeaveAVX();
+  Asm("call %s", symbol);
+
+  if (stack_bytes + padding > 0) Asm("addq $%d, %%rsp", stack_bytes + padding);
+
+  if (inst->type != IRT_VOID) {
+    if (IRType_IsFloat(inst->type)) FloatResultToRax(inst->type);
+    else Canonicalize(inst->type);
+    StoreRax(v);
+  }
+
+  free(locations);
+}
+
+static void SaveOrRestoreRegisters(bool save);
+
+/* Stack arguments overwrite the ones this function received, which the
+ * prologue already moved to their homes; the callee returns straight to
+ * this function's caller */
+static void EmitTailCall(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  IR_Function *callee = &X64.module->functions[inst->imm.i];
+  IR_Value *args = IRArgs(X64.fn, v);
+  int count = inst->args_count;
+
+  ArgLocation *locations = malloc((count + 1) * sizeof(ArgLocation));
+  int stack_bytes;
+  ClassifyArgs(callee->param_types, count, locations, &stack_bytes);
+
+  for (int i = 0; i < count; i++) {
+    if (locations[i].reg >= 0) continue;
+    LoadRaw(args[i], "rax");
+    Asm("movq %%rax, %d(%%rbp)", 16 + locations[i].stack_offset);
+  }
+
+  int float_count = LoadRegisterArgs(args, count, locations);
+
+  char symbol[256];
+  FunctionSymbol(callee, symbol, sizeof(symbol));
+  SaveOrRestoreRegisters(false);
+  LeaveAVX();
+  Asm("leave");
+  Asm("movl $%d, %%eax", float_count);
+  Asm("jmp %s", symbol);
+
+  free(locations);
+}
+
+static void ZeroStackSlots();
+
+/* Parameters are pushed first and moved to their homes once the frame is
+ * zeroed: homes may be argument registers that are yet to be read, and the
+ * zeroing clobbers rdi and rcx. */
+static void EmitParams() {
+  IR_Function *fn = X64.fn;
+  ArgLocation *locations = malloc((fn->param_count + 1) * sizeof(ArgLocation));
+  int stack_bytes;
+  ClassifyArgs(fn->param_types, fn->param_count, locations, &stack_bytes);
+
+  IR_BasicBlock *entry = &fn->blocks[0];
+  int pushed = 0;
+  for (int i = 0; i < entry->inst_count; i++) {
+    IR_Value v = entry->insts[i];
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op != IR_PARAM) continue;
+
+    ArgLocation loc = locations[inst->imm.i];
+    if (loc.reg < 0) {
+      Asm("movq %d(%%rbp), %%rax", 16 + loc.stack_offset);
+      Canonicalize(inst->type);
+    } else if (loc.is_float) {
+      Asm((inst->type == IRT_F32) ? "movd %%xmm%d, %%eax" : "movq %%xmm%d, %%rax", loc.reg);
+    } else {
+      Asm("movq %%%s, %%rax", int_arg_registers[loc.reg]);
+      Canonicalize(inst->type);
+    }
+
+    Asm("pushq %%rax");
+    pushed++;
+  }
+
+  ZeroStackSlots();
+
+  for (int i = entry->inst_count - 1; i >= 0 && pushed > 0; i--) {
+    IR_Value v = entry->insts[i];
+    if (fn->insts[v].op != IR_PARAM) continue;
+
+    Asm("popq %%rax");
+    StoreRax(v);
+    pushed--;
+  }
+
+  free(locations);
+}
+
+/* === Instructions === */
+static void EmitIntBinary(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  bool is_unsigned = IsUnsigned(inst->type);
+
+  LoadRaw(inst->a, "rax");
+  LoadRaw(inst->b, "rcx");
+
+  switch (inst->op) {
+    case IR_ADD: Asm("addq %%rcx, %%rax"); break;
+    case IR_SUB: Asm("subq %%rcx, %%rax"); break;
+    case IR_MUL: Asm("imulq %%rcx, %%rax"); break;
+    case IR_AND: Asm("andq %%rcx, %%rax"); break;
+    case IR_OR:  Asm("orq %%rcx, %%rax"); break;
+    case IR_XOR: Asm("xorq %%rcx, %%rax"); break;
+    case IR_SHL: Asm("shlq %%cl, %%rax"); break;
+    case IR_SHR: Asm(is_unsigned ? "shrq %%cl, %%rax" : "sarq %%cl, %%rax"); break;
+    case IR_DIV:
+    case IR_MOD:
+      if (is_unsigned) {
+        Asm("xorl %%edx, %%edx");
+        Asm("divq %%rcx");
+      } else {
+        Asm("cqo");
+        Asm("idivq %%rcx");
+      }
+      if (inst->op == IR_MOD) Asm("movq %%rdx, %%rax");
+      break;
+    default: break;
+  }
+
+  Canonicalize(inst->type);
+  StoreRax(v);
+}
+
+static void EmitFloatBinary(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  const char *suffix = (inst->type == IRT_F32) ? "ss" : "sd";
+
+  LoadFloat(inst->a, 0);
+  LoadFloat(inst->b, 1);
+
+  switch (inst->op) {
+    case IR_ADD: Asm("add%s %%xmm1, %%xmm0", suffix); break;
+    case IR_SUB: Asm("sub%s %%xmm1, %%xmm0", suffix); break;
+    case IR_MUL: Asm("mul%s %%xmm1, %%xmm0", suffix); break;
+    case IR_DIV: Asm("div%s %%xmm1, %%xmm0", suffix); break;
+    case IR_MOD:
+      LeaveAVX();
+      Asm("call %s@PLT", (inst->type == IRT_F32) ? "fmodf" : "fmod");
+      break;
+    default:
+      COMPILER_ERROR_FMTMSG("EmitFloatBinary(): '%s' is not defined for floats", IROpTranslation(inst->op));
+  }
+
+  FloatResultToRax(inst->type);
+  StoreRax(v);
+}
+
+static void EmitComparison(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  IR_Type t = TypeOf(inst->a);
+
+  if (IRType_IsFloat(t)) {
+    const char *suffix = (t == IRT_F32) ? "ss" : "sd";
+    LoadFloat(inst->a, 0);
+    LoadFloat(inst->b, 1);
+
+    // ucomis sets the flags like an unsigned compare; only a > b and a >= b
+    // are false for unordered operands, so less-than swaps the operands
+    switch (inst->op) {
+      case IR_EQ:
+        Asm("ucomi%s %%xmm1, %%xmm0", suffix);
+        Asm("sete %%al");
+        Asm("setnp %%cl");
+        Asm("andb %%cl, %%al");
+        break;
+      case IR_NE:
+        Asm("ucomi%s %%xmm1, %%xmm0", suffix);
+        Asm("setne %%al");
+        Asm("setp %%cl");
+        Asm("orb %%cl, %%al");
+        break;
+      case IR_GT: Asm("ucomi%s %%xmm1, %%xmm0", suffix); Asm("seta %%al"); break;
+      case IR_GE: Asm("ucomi%s %%xmm1, %%xmm0", suffix); Asm("setae %%al"); break;
+      case IR_LT: Asm("ucomi%s %%xmm0, %%xmm1", suffix); Asm("seta %%al"); break;
+      case IR_LE: Asm("ucomi%s %%xmm0, %%xmm1", suffix); Asm("setae %%al"); break;
+      default: break;
+    }
+  } else {
+    bool is_unsigned = IsUnsigned(t);
+    LoadRaw(inst->a, "rax");
+    LoadRaw(inst->b, "rcx");
+    Asm("cmpq %%rcx, %%rax");
+
+    switch (inst->op) {
+      case IR_EQ: Asm("sete %%al"); break;
+      case IR_NE: Asm("setne %%al"); break;
+      case IR_LT: Asm(is_unsigned ? "setb %%al"  : "setl %%al"); break;
+      case IR_LE: Asm(is_unsigned ? "setbe %%al" : "setle %%al"); break;
+      case IR_GT: Asm(is_unsigned ? "seta %%al"  : "setg %%al"); break;
+      case IR_GE: Asm(is_unsigned ? "setae %%al" : "setge %%al"); break;
+      default: break;
+    }
+  }
+
+  Asm("movzbl %%al, %%eax");
+  StoreRax(v);
+}
+
+static void EmitUnary(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  LoadRaw(inst->a, "rax");
+
+  if (inst->op == IR_NEG) {
+    if (inst->type == IRT_F64) Asm("btcq $63, %%rax");
+    else if (inst->type == IRT_F32) Asm("xorl $0x80000000, %%eax");
+    else Asm("negq %%rax");
+  } else if (inst->type == IRT_BOOL) {
+    Asm("xorl $1, %%eax");
+  } else {
+    Asm("notq %%rax");
+  }
+
+  Canonicalize(inst->type);
+  StoreRax(v);
+}
+
+static void EmitConvert(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  IR_Type from = TypeOf(inst->a);
+  IR_Type to = inst->type;
+  bool from_float = IRType_IsFloat(from);
+  bool to_float = IRType_IsFloat(to);
+
+  LoadRaw(inst->a, "rax");
+
+  if (from_float && to_float) {
+    Asm("movq %%rax, %%xmm0");
+    if (from != to) Asm((to == IRT_F64) ? "cvtss2sd %%xmm0, %%xmm0" : "cvtsd2ss %%xmm0, %%xmm0");
+    FloatResultToRax(to);
+  } else if (from_float) {
+    Asm("movq %%rax, %%xmm0");
+    if (to == IRT_BOOL) {
+      Asm("xorps %%xmm1, %%xmm1");
+      Asm((from == IRT_F32) ? "ucomiss %%xmm1, %%xmm0" : "ucomisd %%xmm1, %%xmm0");
+      Asm("setne %%al");
+      Asm("setp %%cl");
+      Asm("orb %%cl, %%al");
+    } else {
+      Asm((from == IRT_F32) ? "cvttss2siq %%xmm0, %%rax" : "cvttsd2siq %%xmm0, %%rax");
+    }
+    Canonicalize(to);
+  } else if (to_float) {
+    const char *suffix = (to == IRT_F32) ? "ss" : "sd";
+
+    if (from == IRT_U64) {
+      // Values with the top bit set don't fit cvtsi2s*: halve them, keeping
+      // the low bit for correct rounding, convert and double the result
+      Asm("testq %%rax, %%rax");
+      Asm("js .Lcvt%d_%d", X64.fn_index, v);
+      Asm("cvtsi2%sq %%rax, %%xmm0", suffix);
+      Asm("jmp .Lcvt%d_%d_done", X64.fn_index, v);
+      Label(".Lcvt%d_%d", X64.fn_index, v);
+      Asm("movq %%rax, %%rcx");
+      Asm("shrq %%rcx");
+      Asm("andl $1, %%eax");
+      Asm("orq %%rax, %%rcx");
+      Asm("cvtsi2%sq %%rcx, %%xmm0", suffix);
+      Asm("add%s %%xmm0, %%xmm0", suffix);
+      Label(".Lcvt%d_%d_done", X64.fn_index, v);
+    } else {
+      Asm("cvtsi2%sq %%rax, %%xmm0", suffix);
+    }
+    FloatResultToRax(to);
+  } else if (to == IRT_BOOL) {
+    Asm("testq %%rax, %%rax");
+    Asm("setne %%al");
+    Canonicalize(to);
+  } else {
+    Canonicalize(to);
+  }
+
+  StoreRax(v);
+}
+
+static void EmitLoad(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  LoadRaw(inst->a, "rcx");
+
+  switch (inst->type) {
+    case IRT_I8:   Asm("movsbq (%%rcx), %%rax"); break;
+    case IRT_BOOL:
+    case IRT_U8:
+    case IRT_CHAR: Asm("movzbl (%%rcx), %%eax"); break;
+    case IRT_I16:  Asm("movswq (%%rcx), %%rax"); break;
+    case IRT_U16:  Asm("movzwl (%%rcx), %%eax"); break;
+    case IRT_I32:  Asm("movslq (%%rcx), %%rax"); break;
+    case IRT_U32:
+    case IRT_F32:  Asm("movl (%%rcx), %%eax"); break;
+    default:       Asm("movq (%%rcx), %%rax"); break;
+  }
+
+  StoreRax(v);
+}
+
+static void EmitStore(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  LoadRaw(inst->a, "rcx");
+  LoadRaw(inst->b, "rax");
+
+  switch (IRType_Size(TypeOf(inst->b))) {
+    case 1:  Asm("movb %%al, (%%rcx)"); break;
+    case 2:  Asm("movw %%ax, (%%rcx)"); break;
+    case 4:  Asm("movl %%eax, (%%rcx)"); break;
+    default: Asm("movq %%rax, (%%rcx)"); break;
+  }
+}
+
+static void EmitElementPtr(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  int64_t size = inst->imm.i;
+
+  LoadRaw(inst->a, "rax");
+  LoadRaw(inst->b, "rcx");
+
+  if (size == 1 || size == 2 || size == 4 || size == 8) {
+    Asm("leaq (%%rax,%%rcx,%lld), %%rax", (long long)size);
+  } else {
+    Asm("imulq $%lld, %%rcx, %%rcx", (long long)size);
+    Asm("addq %%rcx, %%rax");
+  }
+
+  StoreRax(v);
+}
+
+/* === Vectors === */
+bool X64HasVectorOp(IR_Op op, IR_Type type, int bytes) {
+  if (IRType_IsFloat(type)) return op == IR_ADD || op == IR_SUB || op == IR_MUL || op == IR_DIV;
+  if (!IRType_IsInteger(type) || type == IRT_BOOL || type == IRT_CHAR) return false;
+
+  switch (op) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+      return true;
+    case IR_MUL:
+      // pmulld is SSE4.1, so 32-bit products need AVX2; nothing multiplies bytes or 64-bit lanes
+      return IRType_Size(type) == 2 || (IRType_Size(type) == 4 && bytes == 32);
+    default:
+      return false;
+  }
+}
+
+static int VectorBytes(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  return inst->lanes * IRType_Size(inst->type);
+}
+
+static const char *VectorMove(int bytes) {
+  return (bytes == 32) ? "vmovdqu" : "movdqu";
+}
+
+static const char *VectorRegister(int bytes) {
+  return (bytes == 32) ? "ymm" : "xmm";
+}
+
+static void LoadVector(IR_Value v, int reg) {
+  int bytes = VectorBytes(v);
+  Asm("%s -%d(%%rbp), %%%s%d", VectorMove(bytes), X64.slot[v], VectorRegister(bytes), reg);
+}
+
+static void StoreVector(int reg, IR_Value v) {
+  int bytes = VectorBytes(v);
+  Asm("%s %%%s%d, -%d(%%rbp)", VectorMove(bytes), VectorRegister(bytes), reg, X64.slot[v]);
+}
+
+static void EmitVectorBinary(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  int bytes = VectorBytes(v);
+  int size = IRType_Size(inst->type);
+  const char *lane_suffix = (size == 1) ? "b" : (size == 2) ? "w" : (size == 4) ? "d" : "q";
+  char mnemonic[16];
+
+  if (!X64HasVectorOp(inst->op, inst->type, bytes)) {
+    COMPILER_ERROR_FMTMSG("EmitVectorBinary(): No %d-byte vector '%s' for %s", bytes, IROpTranslation(inst->op), IRTypeTranslation(inst->type));
+  }
+
+  if (IRType_IsFloat(inst->type)) {
+    snprintf(mnemonic, sizeof(mnemonic), "%s%s", IROpTranslation(inst->op), (inst->type == IRT_F32) ? "ps" : "pd");
+  } else {
+    switch (inst->op) {
+      case IR_ADD: snprintf(mnemonic, sizeof(mnemonic), "padd%s", lane_suffix); break;
+      case IR_SUB: snprintf(mnemonic, sizeof(mnemonic), "psub%s", lane_suffix); break;
+      case IR_MUL: snprintf(mnemonic, sizeof(mnemonic), "pmull%s", lane_suffix); break;
+      case IR_AND: snprintf(mnemonic, sizeof(mnemonic), "pand"); break;
+      case IR_OR:  snprintf(mnemonic, sizeof(mnemonic), "por"); break;
+      default:     snprintf(mnemonic, sizeof(mnemonic), "pxor"); break;
+    }
+  }
+
+  LoadVector(inst->a, 0);
+  LoadVector(inst->b, 1);
+  if (bytes == 32) Asm("v%s %%ymm1, %%ymm0, %%ymm0", mnemonic);
+  else Asm("%s %%xmm1, %%xmm0", mnemonic);
+  StoreVector(0, v);
+}
+
+static void EmitVectorLoad(IR_Value v) {
+  int bytes = VectorBytes(v);
+
+  LoadRaw(X64.fn->insts[v].a, "rcx");
+  Asm("%s (%%rcx), %%%s0", VectorMove(bytes), VectorRegister(bytes));
+  StoreVector(0, v);
+}
+
+static void EmitVectorStore(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  int bytes = VectorBytes(inst->b);
+
+  LoadRaw(inst->a, "rcx");
+  LoadVector(inst->b, 0);
+  Asm("%s %%%s0, (%%rcx)", VectorMove(bytes), VectorRegister(bytes));
+}
+
+// Writes the scalar into each lane of the slot; broadcasts mostly end up outside of loops
+static void EmitBroadcast(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  int size = IRType_Size(inst->type);
+  const char *reg = (size == 1) ? "al" : (size == 2) ? "ax" : (size == 4) ? "eax" : "rax";
+  char suffix = (size == 1) ? 'b' : (size == 2) ? 'w' : (size == 4) ? 'l' : 'q';
+
+  LoadRaw(inst->a, "rax");
+  for (int lane = 0; lane < inst->lanes; lane++) {
+    Asm("mov%c %%%s, -%d(%%rbp)", suffix, reg, X64.slot[v] - lane * size);
+  }
+}
+
+static void LoadLane(IR_Value vector, int lane, const char *reg64, const char *reg32) {
+  IR_Type t = TypeOf(vector);
+  int offset = X64.slot[vector] - lane * IRType_Size(t);
+
+  switch (t) {
+    case IRT_I8:  Asm("movsbq -%d(%%rbp), %%%s", offset, reg64); break;
+    case IRT_U8:  Asm("movzbl -%d(%%rbp), %%%s", offset, reg32); break;
+    case IRT_I16: Asm("movswq -%d(%%rbp), %%%s", offset, reg64); break;
+    case IRT_U16: Asm("movzwl -%d(%%rbp), %%%s", offset, reg32); break;
+    case IRT_I32: Asm("movslq -%d(%%rbp), %%%s", offset, reg64); break;
+    case IRT_U32: Asm("movl -%d(%%rbp), %%%s", offset, reg32); break;
+    default:      Asm("movq -%d(%%rbp), %%%s", offset, reg64); break;
+  }
+}
+
+// Combines the lanes one by one; reductions run once a vectorized loop is done
+static void EmitReduce(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+  IR_Value vector = inst->a;
+
+  LoadLane(vector, 0, "rax", "eax");
+  for (int lane = 1; lane < X64.fn->insts[vector].lanes; lane++) {
+    LoadLane(vector, lane, "rcx", "ecx");
+
+    switch (inst->imm.i) {
+      case IR_ADD: Asm("addq %%rcx, %%rax"); break;
+      case IR_MUL: Asm("imulq %%rcx, %%rax"); break;
+      case IR_AND: Asm("andq %%rcx, %%rax"); break;
+      case IR_OR:  Asm("orq %%rcx, %%rax"); break;
+      default:     Asm("xorq %%rcx, %%rax"); break;
+    }
+  }
+
+  Canonicalize(inst->type);
+  StoreRax(v);
+}
+
+static void EmitPrint(IR_Value v) {
+  IR_Type t = TypeOf(X64.fn->insts[v].a);
+  IR_Value value = X64.fn->insts[v].a;
+  int float_count = 0;
+
+  if (IRType_IsFloat(t)) {
+    LoadFloat(value, 0);
+    if (t == IRT_F32) Asm("cvtss2sd %%xmm0, %%xmm0");
+    Asm("leaq .Lfmt_float(%%rip), %%rdi");
+    float_count = 1;
+  } else if (t == IRT_BOOL) {
+    LoadRaw(value, "rax");
+    Asm("leaq .Lstr_true(%%rip), %%rsi");
+    Asm("leaq .Lstr_false(%%rip), %%rcx");
+    Asm("testq %%rax, %%rax");
+    Asm("cmovzq %%rcx, %%rsi");
+    Asm("leaq .Lfmt_string(%%rip), %%rdi");
+  } else {
+    const char *format = (t == IRT_PTR) ? ".Lfmt_string"
+                       : (t == IRT_CHAR) ? ".Lfmt_char"
+                       : IsUnsigned(t) ? ".Lfmt_uint"
+                       : ".Lfmt_int";
+    LoadRaw(value, "rsi");
+    Asm("leaq %s(%%rip), %%rdi", format);
+  }
+
+  Asm("movl $%d, %%eax", float_count);
+  LeaveAVX();
+  Asm("call printf@PLT");
+}
+
+static int PredecessorOccurrence(IR_Block block, IR_Block pred, int nth) {
+  IR_BasicBlock *b = &X64.fn->blocks[block];
+  for (int i = 0; i < b->pred_count; i++) {
+    if (b->preds[i] == pred && nth-- == 0) return i;
+  }
+
+  return IR_NONE;
+}
+
+// Whether the copy of `arg` into `phi` is a no-op, both living in the same register
+static bool IsCoalesced(IR_Value phi, IR_Value arg) {
+  return ValueNeedsHome(&X64.fn->insts[arg]) && X64.ra.reg[phi] != REG_NONE &&
+         X64.ra.reg[phi] == X64.ra.reg[arg];
+}
+
+// Copies the values flowing along the edge from -> to into to's phis
+static void EmitEdgeCopies(IR_Block from, IR_Block to, int nth) {
+  IR_BasicBlock *target = &X64.fn->blocks[to];
+  int pred_index = PredecessorOccurrence(to, from, nth);
+  int phi_count = 0;
+
+  while (phi_count < target->inst_count && X64.fn->insts[target->insts[phi_count]].op == IR_PHI) phi_count++;
+  if (phi_count == 0) return;
+
+  if (phi_count == 1) {
+    IR_Value phi = target->insts[0];
+    IR_Value arg = IRArgs(X64.fn, phi)[pred_index];
+    if (IsCoalesced(phi, arg)) return;
+
+    if (X64.fn->insts[phi].lanes > 0) {
+      LoadVector(arg, 0);
+      StoreVector(0, phi);
+    } else {
+      LoadRaw(arg, "rax");
+      StoreRax(phi);
+    }
+    return;
+  }
+
+  for (int i = 0; i < phi_count; i++) {
+    IR_Value phi = target->insts[i];
+    IR_Value arg = IRArgs(X64.fn, phi)[pred_index];
+    int temp = X64.phi_temps - X64.phi_temp_size * i;
+    if (IsCoalesced(phi, arg)) continue;
+
+    if (X64.fn->insts[phi].lanes > 0) {
+      int bytes = VectorBytes(phi);
+      LoadVector(arg, 0);
+      Asm("%s %%%s0, -%d(%%rbp)", VectorMove(bytes), VectorRegister(bytes), temp);
+    } else {
+      LoadRaw(arg, "rax");
+      Asm("movq %%rax, -%d(%%rbp)", temp);
+    }
+  }
+  for (int i = 0; i < phi_count; i++) {
+    IR_Value phi = target->insts[i];
+    int temp = X64.phi_temps - X64.phi_temp_size * i;
+    if (IsCoalesced(phi, IRArgs(X64.fn, phi)[pred_index])) continue;
+
+    if (X64.fn->insts[phi].lanes > 0) {
+      int bytes = VectorBytes(phi);
+      Asm("%s -%d(%%rbp), %%%s0", VectorMove(bytes), temp, VectorRegister(bytes));
+      StoreVector(0, phi);
+    } else {
+      Asm("movq -%d(%%rbp), %%rax", temp);
+      StoreRax(phi);
+    }
+  }
+}
+
+static bool HasEdgeCopies(IR_Block from, IR_Block to, int nth) {
+  IR_BasicBlock *target = &X64.fn->blocks[to];
+  int pred_index = PredecessorOccurrence(to, from, nth);
+
+  for (int i = 0; i < target->inst_count && X64.fn->insts[target->insts[i]].op == IR_PHI; i++) {
+    IR_Value phi = target->insts[i];
+    if (!IsCoalesced(phi, IRArgs(X64.fn, phi)[pred_index])) return true;
+  }
+
+  return false;
+}
+
+static void EmitJumpTo(IR_Block from, IR_Block to, int nth) {
+  EmitEdgeCopies(from, to, nth);
+  if (to != from + 1) Asm("jmp .L%d_%d", X64.fn_index, to);
+}
+
+static void SaveOrRestoreRegisters(bool save) {
+  int offset = X64.saved_registers;
+
+  for (int r = X64_FIRST_CALLEE_SAVED; r < X64_REGISTER_COUNT; r++) {
+    if (!(X64.ra.callee_saved_used & (1u << r))) continue;
+
+    if (save) Asm("movq %%%s, -%d(%%rbp)", X64RegisterName(r), offset);
+    else Asm("movq -%d(%%rbp), %%%s", offset, X64RegisterName(r));
+    offset -= 8;
+  }
+}
+
+static void EmitTerminator(IR_Block b, IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+
+  switch (inst->op) {
+    case IR_JUMP:
+      EmitJumpTo(b, inst->target[0], 0);
+      break;
+    case IR_BRANCH: {
+      IR_Block if_true = inst->target[0];
+      IR_Block if_false = inst->target[1];
+      int false_nth = (if_true == if_false) ? 1 : 0;
+
+      LoadRaw(inst->a, "rax");
+      Asm("testq %%rax, %%rax");
+
+      // Either side that follows falls through, the other is jumped to directly when it needs no copies
+      if (if_true == b + 1 && !HasEdgeCopies(b, if_false, false_nth)) {
+        Asm("jz .L%d_%d", X64.fn_index, if_false);
+        EmitEdgeCopies(b, if_true, 0);
+        break;
+      }
+      if (if_false == b + 1 && !HasEdgeCopies(b, if_true, 0)) {
+        Asm("jnz .L%d_%d", X64.fn_index, if_true);
+        EmitEdgeCopies(b, if_false, false_nth);
+        break;
+      }
+
+      Asm("jz .L%d_%d_else", X64.fn_index, b);
+      EmitEdgeCopies(b, if_true, 0);
+      Asm("jmp .L%d_%d", X64.fn_index, if_true);
+      Label(".L%d_%d_else", X64.fn_index, b);
+      EmitJumpTo(b, if_false, false_nth);
+    } break;
+    case IR_RETURN:
+      if (inst->a != IR_NONE) {
+        LoadRaw(inst->a, "rax");
+        if (IRType_IsFloat(TypeOf(inst->a))) Asm("movq %%rax, %%xmm0");
+      } else if (X64.fn->is_entry) {
+        Asm("xorl %%eax, %%eax");
+      }
+      if (X64.fn->is_entry && X64.module->profile_global != IR_NONE) Asm("call crom_profile_write");
+      SaveOrRestoreRegisters(false);
+      LeaveAVX();
+      Asm("leave");
+      Asm("ret");
+      break;
+    case IR_TAIL_CALL:
+      EmitTailCall(v);
+      break;
+    case IR_UNREACHABLE:
+      Asm("ud2");
+      break;
+    default:
+      break;
+  }
+}
+
+static void EmitInst(IR_Value v) {
+  IR_Inst *inst = &X64.fn->insts[v];
+
+  if (inst->lanes > 0 && inst->op != IR_PHI) {
+    switch (inst->op) {
+      case IR_LOAD:      EmitVectorLoad(v); break;
+      case IR_BROADCAST: EmitBroadcast(v); break;
+      default:           EmitVectorBinary(v); break;
+    }
+    return;
+  }
+
+  if (inst->op == IR_STORE && X64.fn->insts[inst->b].lanes > 0) {
+    EmitVectorStore(v);
+    return;
+  }
+
+  if (IROp_IsBinary(inst->op)) {
+    if (IRType_IsFloat(inst->type)) EmitFloatBinary(v);
+    else EmitIntBinary(v);
+    return;
+  }
+
+  if (IROp_IsComparison(inst->op)) {
+    EmitComparison(v);
+    return;
+  }
+
+  switch (inst->op) {
+    case IR_NEG:
+    case IR_NOT:         EmitUnary(v); break;
+    case IR_CONVERT:     EmitConvert(v); break;
+    case IR_LOAD:        EmitLoad(v); break;
+    case IR_STORE:       EmitStore(v); break;
+    case IR_ELEMENT_PTR: EmitElementPtr(v); break;
+    case IR_MEMBER_PTR:
+      LoadRaw(inst->a, "rax");
+      if (inst->imm.i != 0) Asm("addq $%lld, %%rax", (long long)inst->imm.i);
+      StoreRax(v);
+      break;
+    case IR_BOUNDS_CHECK:
+      LoadRaw(inst->a, "rax");
+      Asm("movq $%lld, %%rcx", (long long)inst->imm.i);
+      // Unsigned, so negative indices fail too
+      Asm("cmpq %%rcx, %%rax");
+      Asm("jae .L%d_out_of_bounds", X64.fn_index);
+      X64.uses_bounds_check = true;
+      break;
+    case IR_CALL:        EmitCall(v); break;
+    case IR_PRINT:       EmitPrint(v); break;
+    case IR_REDUCE:      EmitReduce(v); break;
+
+    // Rematerialized at their uses, or handled in the prologue and on edges
+    case IR_CONST:
+    case IR_ALLOCA:
+    case IR_GLOBAL:
+    case IR_STRING:
+    case IR_PARAM:
+    case IR_PHI:
+    case IR_NOP:
+      break;
+    default:
+      COMPILER_ERROR_FMTMSG("EmitInst(): Unhandled IR op '%s'", IROpTranslation(inst->op));
+  }
+}
+
+/* === Functions === */
+static void LayoutFrame() {
+  IR_Function *fn = X64.fn;
+  int offset = 0;
+  int max_phis = 0;
+
+  X64.slot = calloc(fn->inst_count + 1, sizeof(int));
+  X64.phi_temp_size = 8;
+  X64.uses_ymm = false;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    int phis = 0;
+
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Value v = block->insts[i];
+      IR_Inst *inst = &fn->insts[v];
+
+      if (inst->op == IR_PHI) phis++;
+
+      if (inst->op == IR_ALLOCA) {
+        int size = (inst->imm.i + 15) / 16 * 16;
+        offset += (size > 0) ? size : 16;
+        offset = (offset + 15) / 16 * 16;
+        X64.slot[v] = offset;
+      } else if (inst->lanes > 0) {
+        int bytes = VectorBytes(v);
+        offset = (offset + bytes + 15) / 16 * 16;
+        X64.slot[v] = offset;
+        if (inst->op == IR_PHI && bytes > X64.phi_temp_size) X64.phi_temp_size = bytes;
+        if (bytes == 32) X64.uses_ymm = true;
+      } else if (ValueNeedsHome(inst) && X64.ra.reg[v] == REG_NONE) {
+        offset += 8;
+        X64.slot[v] = offset;
+      }
+    }
+
+    if (phis > max_phis) max_phis = phis;
+  }
+
+  // Callee-saved registers in use; register i of them lives at saved_registers - 8 * i
+  for (int r = X64_FIRST_CALLEE_SAVED; r < X64_REGISTER_COUNT; r++) {
+    if (X64.ra.callee_saved_used & (1u << r)) offset += 8;
+  }
+  X64.saved_registers = offset;
+
+  // Staging area for parallel phi copies; temp i lives at phi_temps - phi_temp_size * i
+  offset = (offset + X64.phi_temp_size * max_phis + 15) / 16 * 16;
+  X64.phi_temps = offset;
+
+  X64.frame_size = (offset + 15) / 16 * 16;
+}
+
+static void ZeroStackSlots() {
+  IR_BasicBlock *entry = &X64.fn->blocks[0];
+
+  for (int i = 0; i < entry->inst_count; i++) {
+    IR_Value v = entry->insts[i];
+    IR_Inst *inst = &X64.fn->insts[v];
+    if (inst->op != IR_ALLOCA || inst->imm.i <= 0) continue;
+
+    Asm("leaq -%d(%%rbp), %%rdi", X64.slot[v]);
+    Asm("movl $%lld, %%ecx", (long long)inst->imm.i);
+    Asm("xorl %%eax, %%eax");
+    Asm("rep stosb");
+  }
+}
+
+static void EmitFunction(int index) {
+  IR_Function *fn = &X64.module->functions[index];
+  if (!fn->is_defined) return;
+
+  X64.fn = fn;
+  X64.fn_index = index;
+  X64.uses_bounds_check = false;
+  AllocateRegisters(fn, &X64.ra);
+  LayoutFrame();
+
+  char symbol[256];
+  FunctionSymbol(fn, symbol, sizeof(symbol));
+
+  fputc('\n', X64.out);
+  if (fn->is_entry) Asm(".globl %s", symbol);
+  Asm(".type %s, @function", symbol);
+  Label("%s", symbol);
+  Asm("pushq %%rbp");
+  Asm("movq %%rsp, %%rbp");
+  if (X64.frame_size > 0) Asm("subq $%d, %%rsp", X64.frame_size);
+
+  SaveOrRestoreRegisters(true);
+  EmitParams();
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    Label(".L%d_%d", index, b);
+
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Value v = block->insts[i];
+      if (IROp_IsTerminator(fn->insts[v].op)) EmitTerminator(b, v);
+      else EmitInst(v);
+    }
+  }
+
+  if (X64.uses_bounds_check) {
+    Label(".L%d_out_of_bounds", index);
+    Asm("call crom_out_of_bounds");
+  }
+
+  Asm(".size %s, .-%s", symbol, symbol);
+
+  free(X64.slot);
+  X64.slot = NULL;
+  FreeRegAllocation(&X64.ra);
+}
+
+/* === Module === */
+static void EmitBytes(const char *data, int length) {
+  fputs("  .byte ", X64.out);
+  for (int i = 0; i < length; i++) {
+    fprintf(X64.out, "%d,", (unsigned char)data[i]);
+  }
+  fputs("0\n", X64.out);
+}
+
+static void EmitData() {
+  IR_Module *m = X64.module;
+
+  Asm(".section .rodata");
+  Label(".Lfmt_int");
+  Asm(".string \"%%ld\\n\"");
+  Label(".Lfmt_uint");
+  Asm(".string \"%%lu\\n\"");
+  Label(".Lfmt_char");
+  Asm(".string \"%%c\\n\"");
+  Label(".Lfmt_float");
+  Asm(".string \"%%g\\n\"");
+  Label(".Lfmt_string");
+  Asm(".string \"%%s\\n\"");
+  Label(".Lstr_true");
+  Asm(".string \"true\"");
+  Label(".Lstr_false");
+  Asm(".string \"false\"");
+  Label(".Lmsg_out_of_bounds");
+  Asm(".string \"Array index out of bounds\\n\"");
+  if (m->profile_global != IR_NONE) {
+    Label(".Lprofile_path");
+    EmitBytes(m->profile_path, strlen(m->profile_path));
+    Label(".Lprofile_mode");
+    Asm(".string \"wb\"");
+  }
+
+  // Strings are writable, Crom allows assigning to their characters
+  Asm(".data");
+  for (int i = 0; i < m->string_count; i++) {
+    Label(".Lstr%d", i);
+    EmitBytes(m->strings[i].data, m->strings[i].length);
+  }
+
+  Asm(".bss");
+  for (int i = 0; i < m->global_count; i++) {
+    IR_Global *g = &m->globals[i];
+    Asm(".p2align 4");
+    Label("crom_g%d_%s", i, g->name);
+    Asm(".zero %d", (g->size > 0) ? g->size : 8);
+  }
+}
+
+// Writes the profile counters (ir_profile.h) to their file, keeping rax for the caller
+static void EmitProfileWriter() {
+  IR_Module *m = X64.module;
+  IR_Global *counters = &m->globals[m->profile_global];
+
+  fputc('\n', X64.out);
+  Asm(".type crom_profile_write, @function");
+  Label("crom_profile_write");
+  Asm("pushq %%rbp");
+  Asm("movq %%rsp, %%rbp");
+  Asm("pushq %%rax");
+  Asm("pushq %%rbx");
+  Asm("leaq .Lprofile_path(%%rip), %%rdi");
+  Asm("leaq .Lprofile_mode(%%rip), %%rsi");
+  Asm("call fopen@PLT");
+  Asm("testq %%rax, %%rax");
+  Asm("jz .Lprofile_done");
+  Asm("movq %%rax, %%rbx");
+  Asm("leaq crom_g%d_%s(%%rip), %%rdi", m->profile_global, counters->name);
+  Asm("movl $8, %%esi");
+  Asm("movl $%d, %%edx", counters->size / 8);
+  Asm("movq %%rbx, %%rcx");
+  Asm("call fwrite@PLT");
+  Asm("movq %%rbx, %%rdi");
+  Asm("call fclose@PLT");
+  Label(".Lprofile_done");
+  Asm("popq %%rbx");
+  Asm("popq %%rax");
+  Asm("popq %%rbp");
+  Asm("ret");
+}
+
+static void EmitRuntime() {
+  // Reports a failed bounds check and exits the way the compiler would
+  fputc('\n', X64.out);
+  Asm(".type crom_out_of_bounds, @function");
+  Label("crom_out_of_bounds");
+  Asm("pushq %%rbp");
+  Asm("movq %%rsp, %%rbp");
+  Asm("xorl %%edi, %%edi");
+  Asm("call fflush@PLT");
+  Asm("movq stderr@GOTPCREL(%%rip), %%rax");
+  Asm("movq (%%rax), %%rdi");
+  Asm("leaq .Lmsg_out_of_bounds(%%rip), %%rsi");
+  Asm("xorl %%eax, %%eax");
+  Asm("call fprintf@PLT");
+  if (X64.module->profile_global != IR_NONE) Asm("call crom_profile_write");
+  Asm("movl $%d, %%edi", ERR_ARRAY_OUT_OF_BOUNDS);
+  Asm("call exit@PLT");
+
+  if (X64.module->profile_global != IR_NONE) EmitProfileWriter();
+}
+
+void EmitX64Assembly(IR_Module *m, FILE *out) {
+  memset(&X64, 0, sizeof(X64));
+  X64.out = out;
+  X64.module = m;
+
+  EmitData();
+
+  Asm(".text");
+  for (int i = 0; i < m->function_count; i++) {
+    EmitFunction(i);
+  }
+  EmitRuntime();
+
+  Asm(".section .note.GNU-stack,\"\",@progbits");
+}
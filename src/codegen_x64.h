@@ -0,0 +1,22 @@
+#ifndef CODEGEN_X64_H
+#define CODEGEN_X64_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Writes the module as x86-64 System V assembly (GNU as, AT&T syntax).
+ * The entry function becomes the C `main`, so the output links against
+ * libc, which provides printf for `print`, either with the system C
+ * compiler driver or with the built-in assembler and linker. */
+void EmitX64Assembly(IR_Module *m, FILE *out);
+
+// Bytes of stack the System V convention needs for arguments of these types
+int X64StackArgBytes(IR_Type *types, int count);
+
+/* Whether there is an instruction for `op` on vectors of `bytes` bytes
+ * (16 with SSE2, 32 with AVX2) holding elements of `type` */
+bool X64HasVectorOp(IR_Op op, IR_Type type, int bytes);
+
+#endif
@@ -8,6 +8,7 @@
 #include <stdlib.h> // for strtoll and friends
 #include <string.h> // for strlen
 
+#include "allocator.h"
 #include "common.h"
 #include "error.h"
 
@@ -28,7 +29,7 @@ static int GetBase(Token t) {
 }
 
 static char *RemoveSpaces(Token t) {
-  char *new_str = calloc(t.length, sizeof(char));
+  char *new_str = AllocateZeroed(MEM_STRINGS, t.length + ROOM_FOR_NULL_BYTE, sizeof(char));
 
   int c = 0;
   for (int i = 0; i < t.length; i++) {
@@ -64,6 +65,7 @@ uint64_t TokenToUint64(Token t) {
 
   errno = 0;
   unsigned long long value = strtoull(chars, NULL, base);
+  if (chars != t.position_in_source) Release(MEM_STRINGS, (char *)chars);
   if (errno != 0) {
     SetErrorCode(ERR_OVERFLOW);
     COMPILER_ERROR("TokenToUint64() overflow");
@@ -117,7 +119,7 @@ bool DoubleUnderflow(Token t) {
 }
 
 char *NewString(int size) {
-  return malloc(sizeof(char) * size);
+  return Allocate(MEM_STRINGS, sizeof(char) * size);
 }
 
 char *CopyString(const char *s) {
@@ -0,0 +1,337 @@
+#include <dirent.h>   // for opendir, readdir
+#include <fcntl.h>    // for open
+#include <stdint.h>
+#include <stdio.h>    // for fopen, tmpfile, rename
+#include <stdlib.h>   // for atexit, exit, malloc
+#include <string.h>   // for strcmp, memcmp
+#include <sys/stat.h> // for stat, fchmod
+#include <unistd.h>   // for dup, dup2, getpid
+#include <utime.h>    // for utime
+
+#include "common.h"
+#include "compile_cache.h"
+#include "allocator.h"
+#include "error.h"
+#include "hash.h"
+
+#define CACHE_MAGIC "CRCC"
+#define CACHE_VERSION 1
+#define CACHE_SUFFIX ".cache"
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  int32_t exit_code;
+  uint32_t output_mode; // permissions of the output file, 0 if there is none
+  uint64_t stdout_size;
+  uint64_t stderr_size;
+  uint64_t output_size;
+} CacheHeader;
+
+// The run being captured, for StoreEntry() to find at exit
+static struct {
+  uint64_t key;
+  char *entry_path;
+  const char *directory;
+  uint64_t limit;
+  const char *output_path;
+
+  FILE *captured_stdout;
+  FILE *captured_stderr;
+  int real_stdout;
+  int real_stderr;
+} Cache;
+
+static bool StartsWith(const char *s, const char *prefix) {
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+// Reads all of `path`, or returns NULL
+static char *ReadWholeFile(const char *path, size_t *length) {
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) return NULL;
+
+  size_t capacity = 4096;
+  char *data = malloc(capacity);
+  *length = 0;
+  size_t read;
+  while ((read = fread(data + *length, 1, capacity - *length, in)) > 0) {
+    *length += read;
+    if (*length == capacity) {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+
+  fclose(in);
+  return data;
+}
+
+static uint64_t HashString(const char *s, uint64_t seed) {
+  return HashBytesFast(s, strlen(s) + 1, seed);
+}
+
+// Without /proc, the build time has to do. Hashed once, which a compile server does before forking
+uint64_t CompilerIdentity() {
+  static uint64_t identity;
+  static bool known;
+  if (known) return identity;
+
+  size_t length;
+  char *executable = ReadWholeFile("/proc/self/exe", &length);
+  if (executable == NULL) {
+    identity = HashString(__DATE__ " " __TIME__, 0);
+  } else {
+    identity = HashBytesFast(executable, length, 0);
+    free(executable);
+  }
+
+  known = true;
+  return identity;
+}
+
+uint64_t OptionsKey(CompilerOptions options, int argc, char **argv, const char **ignored) {
+  uint64_t key = CompilerIdentity();
+
+  for (int i = 1; i < argc; i++) {
+    bool ignore = false;
+    for (int j = 0; ignored[j] != NULL && !ignore; j++) ignore = StartsWith(argv[i], ignored[j]);
+
+    if (!ignore) key = HashString(argv[i], key);
+    if (strcmp(argv[i], "-o") == 0) i++;
+  }
+
+  if (options.profile_use != NULL) {
+    size_t length;
+    char *profile = ReadWholeFile(options.profile_use, &length);
+    if (profile != NULL) {
+      key = HashBytesFast(profile, length, key + 1);
+      free(profile);
+    }
+  }
+
+  return key;
+}
+
+static uint64_t ComputeKey(CompilerOptions options, int argc, char **argv, const char **sources, const int *lengths) {
+  // The output path doesn't change what is written there, nor does which compile server writes it
+  const char *ignored[] = {"--cache-dir=", "--cache-limit=", "--connect", NULL};
+  uint64_t key = OptionsKey(options, argc, argv, ignored);
+
+  for (int i = 0; i < options.input_count; i++) {
+    key = HashString(options.input_filenames[i], key);
+    key = HashBytesFast(sources[i], lengths[i], key);
+  }
+
+  return key;
+}
+
+static bool WriteAll(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written <= 0) return false;
+    data += written;
+    length -= written;
+  }
+
+  return true;
+}
+
+/* === Hits === */
+// An entry is only replayed if its header holds `key`, so a file renamed or copied over it is a miss
+static void ReplayEntry(const char *path, uint64_t key, const char *output_path) {
+  size_t length;
+  char *entry = ReadWholeFile(path, &length);
+  if (entry == NULL) return;
+
+  CacheHeader header;
+  if (length < sizeof(header)) goto stale;
+  memcpy(&header, entry, sizeof(header));
+
+  if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION || header.key != key ||
+      sizeof(header) + header.stdout_size + header.stderr_size + header.output_size != length ||
+      (header.exit_code == OK && (header.output_mode != 0) != (output_path != NULL))) {
+    goto stale;
+  }
+
+  const char *out = entry + sizeof(header);
+  const char *err = out + header.stdout_size;
+  const char *output = err + header.stderr_size;
+
+  if (header.output_mode != 0) {
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, header.output_mode);
+    if (fd < 0 || !WriteAll(fd, output, header.output_size)) goto stale;
+    fchmod(fd, header.output_mode);
+    close(fd);
+  }
+
+  WriteAll(STDOUT_FILENO, out, header.stdout_size);
+  WriteAll(STDERR_FILENO, err, header.stderr_size);
+
+  // Touched, as the most recently used
+  utime(path, NULL);
+  exit(header.exit_code);
+
+stale:
+  free(entry);
+}
+
+/* === Misses === */
+typedef struct {
+  char *path;
+  time_t used;
+  off_t size;
+} CacheFile;
+
+static int CompareCacheFiles(const void *a, const void *b) {
+  time_t x = ((const CacheFile *)a)->used, y = ((const CacheFile *)b)->used;
+  return (x > y) - (x < y);
+}
+
+// Removes the least recently used entries until those left fit within the limit
+static void EvictEntries() {
+  DIR *dir = opendir(Cache.directory);
+  if (dir == NULL) return;
+
+  CacheFile *files = NULL;
+  int count = 0, capacity = 0;
+  uint64_t total = 0;
+
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    size_t name_length = strlen(ent->d_name);
+    if (name_length <= strlen(CACHE_SUFFIX) ||
+        strcmp(ent->d_name + name_length - strlen(CACHE_SUFFIX), CACHE_SUFFIX) != 0) {
+      continue;
+    }
+
+    char *directory = Concat((char *)Cache.directory, "/");
+    char *path = Concat(directory, ent->d_name);
+    Release(MEM_STRINGS, directory);
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+      Release(MEM_STRINGS, path);
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = (capacity == 0) ? 64 : capacity * 2;
+      files = realloc(files, capacity * sizeof(CacheFile));
+    }
+    files[count++] = (CacheFile){.path = path, .used = st.st_mtime, .size = st.st_size};
+    total += st.st_size;
+  }
+  closedir(dir);
+
+  qsort(files, count, sizeof(CacheFile), CompareCacheFiles);
+  for (int i = 0; i < count && total > Cache.limit; i++) {
+    if (remove(files[i].path) == 0) total -= files[i].size;
+  }
+
+  for (int i = 0; i < count; i++) Release(MEM_STRINGS, files[i].path);
+  free(files);
+}
+
+// The compiler wrote to the file's descriptor, so the size comes from there
+static char *ReadCaptured(FILE *f, uint64_t *length) {
+  struct stat st;
+  fstat(fileno(f), &st);
+  *length = st.st_size;
+  char *data = malloc(*length + 1);
+
+  rewind(f);
+  *length = fread(data, 1, *length, f);
+  fclose(f);
+  return data;
+}
+
+// Runs at exit: gives the captured output back to the real stdout and stderr, then stores it
+static void StoreEntry() {
+  fflush(stdout);
+  fflush(stderr);
+  dup2(Cache.real_stdout, STDOUT_FILENO);
+  dup2(Cache.real_stderr, STDERR_FILENO);
+
+  CacheHeader header = {.magic = CACHE_MAGIC, .version = CACHE_VERSION, .key = Cache.key, .exit_code = GetErrorCode()};
+  char *out = ReadCaptured(Cache.captured_stdout, &header.stdout_size);
+  char *err = ReadCaptured(Cache.captured_stderr, &header.stderr_size);
+  WriteAll(STDOUT_FILENO, out, header.stdout_size);
+  WriteAll(STDERR_FILENO, err, header.stderr_size);
+
+  // Internal errors may be down to the machine, like a full disk, and aren't worth repeating
+  if (header.exit_code == ERR_COMPILER || header.exit_code == ERR_INTERPRETER) return;
+
+  char *output = NULL;
+  size_t output_size = 0;
+  if (Cache.output_path != NULL && header.exit_code == OK) {
+    struct stat st;
+    if (stat(Cache.output_path, &st) != 0) return;
+
+    output = ReadWholeFile(Cache.output_path, &output_size);
+    if (output == NULL) return;
+    header.output_mode = st.st_mode & 07777;
+    header.output_size = output_size;
+  }
+
+  char temporary[64];
+  snprintf(temporary, sizeof(temporary), ".%d.tmp", (int)getpid());
+  char *temporary_path = Concat(Cache.entry_path, temporary);
+
+  FILE *f = fopen(temporary_path, "wb");
+  if (f == NULL) return;
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(out, 1, header.stdout_size, f) == header.stdout_size &&
+            fwrite(err, 1, header.stderr_size, f) == header.stderr_size &&
+            fwrite(output, 1, output_size, f) == output_size;
+  ok &= (fclose(f) == 0);
+
+  if (!ok || rename(temporary_path, Cache.entry_path) != 0) {
+    remove(temporary_path);
+    return;
+  }
+
+  EvictEntries();
+}
+
+static void Capture(FILE *captured, int fd, int *real_fd) {
+  *real_fd = dup(fd);
+  dup2(fileno(captured), fd);
+}
+
+void UseCompileCache(CompilerOptions options, int argc, char **argv, const char **sources, const int *lengths) {
+  if (options.cache_dir == NULL) return;
+
+  // Nothing to store for programs run right away, and object files are a cache of their own
+  if (options.jit || options.object_path != NULL) return;
+
+  // Verifying incremental builds forks a second compiler, which mustn't store an entry of its own
+  if (options.incremental_verify) return;
+
+  mkdir(options.cache_dir, 0777);
+
+  Cache.key = ComputeKey(options, argc, argv, sources, lengths);
+  Cache.directory = options.cache_dir;
+  Cache.limit = (uint64_t)options.cache_limit << 20;
+  Cache.output_path = options.output_path;
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx" CACHE_SUFFIX, (unsigned long long)Cache.key);
+  Cache.entry_path = Concat((char *)options.cache_dir, name);
+
+  ReplayEntry(Cache.entry_path, Cache.key, options.output_path);
+
+  // Without somewhere to keep the output, this run just isn't cached
+  Cache.captured_stdout = tmpfile();
+  Cache.captured_stderr = tmpfile();
+  if (Cache.captured_stdout == NULL || Cache.captured_stderr == NULL) return;
+
+  fflush(stdout);
+  fflush(stderr);
+  Capture(Cache.captured_stdout, STDOUT_FILENO, &Cache.real_stdout);
+  Capture(Cache.captured_stderr, STDERR_FILENO, &Cache.real_stderr);
+
+  atexit(StoreEntry);
+}
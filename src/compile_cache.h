@@ -0,0 +1,42 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <stdint.h>
+
+#include "options.h"
+
+/* A cache of whole compiler runs (--cache-dir=), for builds that compile
+ * the same files again and again.
+ *
+ * An entry is keyed by a hash of the compiler's own executable, the
+ * command line, the names and contents of the input files and the
+ * profile read by -fprofile-use, and holds what the run wrote to stdout
+ * and stderr, its exit code and the file written to -o, if any:
+ *
+ *   <dir>/<key in hex>.cache
+ *   +-------------------+
+ *   | CacheHeader       |  magic, version, key, exit code, section sizes
+ *   +-------------------+
+ *   | stdout            |
+ *   | stderr            |
+ *   | output file       |
+ *   +-------------------+
+ *
+ * UseCompileCache() is called once the sources are read. On a hit it
+ * replays the entry and exits without compiling; on a miss it captures
+ * stdout and stderr and stores the entry when the compiler exits, unless
+ * that was because of an internal error. Entries are written to a
+ * temporary file and renamed, so compilers sharing a directory never see
+ * half of one. Hits touch their entry, and storing one removes the least
+ * recently used ones until the directory is within --cache-limit= MiB. */
+void UseCompileCache(CompilerOptions options, int argc, char **argv, const char **sources, const int *lengths);
+
+// A hash of the compiler's executable, which any change to the compiler changes
+uint64_t CompilerIdentity();
+
+/* A hash of the compiler, its arguments but for those starting with one of
+ * the NULL-terminated `ignored` and the profile read by -fprofile-use. The
+ * path after -o is never part of it. */
+uint64_t OptionsKey(CompilerOptions options, int argc, char **argv, const char **ignored);
+
+#endif
@@ -1,16 +1,61 @@
+#include "allocator.h"
 #include "compiler.h"
+#include "incremental.h"
 #include "lexer.h"
 #include "parser.h"
 #include "symbol_table.h"
+#include "time_report.h"
 #include "type_checker.h"
 
 AST_Node *Compile(const char *filename, const char *source, SymbolTable *st) {
-  InitLexer(filename, source);
-  InitParser(st);
+  return CompileProgram(&filename, &source, 1, st);
+}
+
+/* Every file is parsed into the same symbol table, so later files see the
+ * declarations of earlier ones, and their statement chains are joined
+ * into one program before it is checked as a whole */
+AST_Node *CompileProgram(const char **filenames, const char **sources, int count, SymbolTable *st) {
   DebugRegisterSymbolTable(st);
-  AST_Node *ast = ParserBuildAST();
+  BeginLeakCheck();
+
+  BeginPhase(PHASE_PARSE);
+  BeginIncrementalProgram(filenames, sources, count, st);
+
+  AST_Node *program = NULL;
+  AST_Node *last = NULL;
+
+  for (int i = 0; i < count; i++) {
+    InitLexer(filenames[i], sources[i]);
+    InitParser(st);
+    AST_Node *ast = ParserBuildAST();
+
+    if (program == NULL) {
+      program = ast;
+    } else {
+      last->left = ast->left;
+      last->right = ast->right;
+    }
+
+    // The chain ends in an empty node, which the next file's statements fill in
+    last = (last == NULL) ? program : last;
+    while (last->right != NULL) last = last->right;
+  }
+
+  EndIncrementalParsing();
+  EndPhase();
+
+  BeginPhase(PHASE_CHECK);
+  CheckTypes(program, st);
+  EndPhase();
+
+  EndIncrementalProgram(st);
 
-  CheckTypes(ast, st);
+  // What the program and its symbols hold on to is all a compile may keep
+  if (CheckingLeaks()) {
+    MarkAST(program);
+    MarkSymbolTable(st);
+    EndLeakCheck();
+  }
 
-  return ast;
+  return program;
 }
@@ -5,5 +5,6 @@
 #include "symbol_table.h"
 
 AST_Node *Compile(const char *filename, const char *source, SymbolTable *st);
+AST_Node *CompileProgram(const char **filenames, const char **sources, int count, SymbolTable *st);
 
 #endif
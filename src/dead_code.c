@@ -0,0 +1,618 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dead_code.h"
+#include "hash.h"
+
+// What the program does with one name. Names are unique across a program
+typedef struct {
+  const char *name;
+  int length;
+
+  int reads;
+  int writes;
+  int removable_writes;   // statements that do nothing but store a value that is free to compute
+  bool declared;
+  Type type;
+  AST_Node *constant;     // the literal of a variable written once, before anything could read it
+
+  AST_Node *function;     // the definition of a function
+  bool called;            // from the top level, directly or not
+} Name;
+
+typedef enum {
+  CONST_NONE,
+  CONST_BOOL,
+  CONST_INT,
+} ConstantKind;
+
+static struct {
+  Name *names;
+  int name_count, capacity;
+
+  bool in_function;
+  bool calls_seen;        // at the top level, so far
+
+  int functions_removed;
+} DCE;
+
+/* === Names === */
+
+static Name *Find(Token t) {
+  uint64_t mask = DCE.capacity - 1;
+  for (uint64_t i = HashBytes(t.position_in_source, t.length) & mask;; i = (i + 1) & mask) {
+    Name *n = &DCE.names[i];
+    if (n->name == NULL) return n;
+    if (n->length == t.length && memcmp(n->name, t.position_in_source, t.length) == 0) return n;
+  }
+}
+
+// Entries move when the table grows, so don't hold on to one across a new name
+static Name *Lookup(Token t) {
+  if (DCE.capacity > 0) {
+    Name *n = Find(t);
+    if (n->name != NULL) return n;
+  }
+
+  if ((DCE.name_count + 1) * 2 > DCE.capacity) {
+    Name *old = DCE.names;
+    int old_capacity = DCE.capacity;
+
+    DCE.capacity = (old_capacity == 0) ? 64 : old_capacity * 2;
+    DCE.names = calloc(DCE.capacity, sizeof(Name));
+
+    for (int i = 0; i < old_capacity; i++) {
+      if (old[i].name == NULL) continue;
+      Token name = {.position_in_source = old[i].name, .length = old[i].length};
+      *Find(name) = old[i];
+    }
+    free(old);
+  }
+
+  Name *n = Find(t);
+  n->name = t.position_in_source;
+  n->length = t.length;
+  DCE.name_count++;
+  return n;
+}
+
+static void ResetNames() {
+  free(DCE.names);
+  DCE.names = NULL;
+  DCE.name_count = DCE.capacity = 0;
+}
+
+/* === Expressions === */
+
+static bool IsLinkEnd(AST_Node *link) {
+  return link->right == NULL;
+}
+
+static int CountNodes(AST_Node *node) {
+  if (node == NULL) return 0;
+  return 1 + CountNodes(node->left) + CountNodes(node->middle) + CountNodes(node->right);
+}
+
+static bool ParseInt(Token t, int64_t *value) {
+  uint64_t u = 0;
+  for (int i = 0; i < t.length; i++) {
+    char c = t.position_in_source[i];
+    if (c == ' ') continue;
+    if (c < '0' || c > '9' || u > (UINT64_MAX - 9) / 10) return false;
+    u = u * 10 + (c - '0');
+  }
+  if (u > INT64_MAX) return false;
+
+  *value = (int64_t)u;
+  return true;
+}
+
+// Literal subscripts are range checked while compiling, all others may fail
+static bool IsSafeSubscript(AST_Node *subscript) {
+  return subscript == NULL || subscript->token.type == INT_LITERAL;
+}
+
+// A divisor that can't fault: literals are never negative, so never -1 either
+static bool IsNonZeroLiteral(AST_Node *node) {
+  int64_t value;
+  return node->node_type == LITERAL_NODE && node->token.type == INT_LITERAL && ParseInt(node->token, &value) && value != 0;
+}
+
+// Whether computing the expression has no effect besides its value
+static bool IsPure(AST_Node *node) {
+  if (node == NULL) return true;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+      return true;
+    case IDENTIFIER_NODE:
+      return IsSafeSubscript(node->middle);
+    case BINARY_ARITHMETIC_NODE:
+      if ((node->token.type == DIVIDE || node->token.type == MODULO) && !IsNonZeroLiteral(node->right)) {
+        return false;
+      }
+      return IsPure(node->left) && IsPure(node->right);
+    case UNARY_OP_NODE:
+    case BINARY_LOGICAL_NODE:
+    case BINARY_BITWISE_NODE:
+    case TERNARY_IF_NODE:
+    case INITIALIZER_LIST_NODE:
+    case CHAIN_NODE:
+      return IsPure(node->left) && IsPure(node->middle) && IsPure(node->right);
+    default:
+      return false;
+  }
+}
+
+static bool FitsType(int64_t value, Type type) {
+  if (TypeIs_I8(type))  return value >= INT8_MIN && value <= INT8_MAX;
+  if (TypeIs_I16(type)) return value >= INT16_MIN && value <= INT16_MAX;
+  if (TypeIs_I32(type)) return value >= INT32_MIN && value <= INT32_MAX;
+  if (TypeIs_I64(type)) return true;
+  if (TypeIs_U8(type))  return value >= 0 && value <= UINT8_MAX;
+  if (TypeIs_U16(type)) return value >= 0 && value <= UINT16_MAX;
+  if (TypeIs_U32(type)) return value >= 0 && value <= UINT32_MAX;
+  if (TypeIs_U64(type)) return value >= 0;
+  return false;
+}
+
+static ConstantKind Evaluate(AST_Node *node, int64_t *value) {
+  if (node == NULL) return CONST_NONE;
+  int64_t l, r;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+      if (node->token.type == BOOL_LITERAL) {
+        *value = (node->token.length == 4 && memcmp(node->token.position_in_source, "true", 4) == 0);
+        return CONST_BOOL;
+      }
+      if (node->token.type == INT_LITERAL && ParseInt(node->token, value)) return CONST_INT;
+      return CONST_NONE;
+
+    case IDENTIFIER_NODE: {
+      if (node->middle != NULL || node->token.type != IDENTIFIER) return CONST_NONE;
+      Name *n = Lookup(node->token);
+      if (n->constant == NULL || n->writes != 1) return CONST_NONE;
+
+      ConstantKind kind = Evaluate(n->constant, value);
+      if (kind == CONST_INT && !FitsType(*value, n->type)) return CONST_NONE;
+      if (kind == CONST_BOOL && !TypeIs_Bool(n->type)) return CONST_NONE;
+      return kind;
+    }
+
+    case UNARY_OP_NODE: {
+      ConstantKind kind = Evaluate(node->left, &l);
+      if (node->token.type == LOGICAL_NOT && kind == CONST_BOOL) {
+        *value = !l;
+        return CONST_BOOL;
+      }
+      if (node->token.type == MINUS && kind == CONST_INT && l != INT64_MIN) {
+        *value = -l;
+        return CONST_INT;
+      }
+      return CONST_NONE;
+    }
+
+    case BINARY_LOGICAL_NODE: {
+      ConstantKind left = Evaluate(node->left, &l);
+
+      // The right side doesn't run once the left decides
+      if (node->token.type == LOGICAL_AND && left == CONST_BOOL && !l) return (*value = false), CONST_BOOL;
+      if (node->token.type == LOGICAL_OR && left == CONST_BOOL && l) return (*value = true), CONST_BOOL;
+
+      ConstantKind right = Evaluate(node->right, &r);
+      if (left == CONST_NONE || left != right) return CONST_NONE;
+
+      switch (node->token.type) {
+        case LOGICAL_AND:         *value = l && r; break;
+        case LOGICAL_OR:          *value = l || r; break;
+        case EQUALITY:            *value = l == r; break;
+        case LOGICAL_NOT_EQUALS:  *value = l != r; break;
+        case LESS_THAN:           *value = l < r;  break;
+        case LESS_THAN_EQUALS:    *value = l <= r; break;
+        case GREATER_THAN:        *value = l > r;  break;
+        case GREATER_THAN_EQUALS: *value = l >= r; break;
+        default:                  return CONST_NONE;
+      }
+      return CONST_BOOL;
+    }
+
+    default:
+      return CONST_NONE;
+  }
+}
+
+static bool IsConstantCondition(AST_Node *node, bool *taken) {
+  int64_t value;
+  if (Evaluate(node, &value) != CONST_BOOL) return false;
+
+  *taken = value;
+  return true;
+}
+
+// Ternaries with a constant condition become the branch they pick
+static void FoldExpression(AST_Node **slot) {
+  AST_Node *node = *slot;
+  if (node == NULL) return;
+
+  bool taken;
+  while (node->node_type == TERNARY_IF_NODE && IsConstantCondition(node->left, &taken)) {
+    node = *slot = taken ? node->middle : node->right;
+  }
+
+  FoldExpression(&node->left);
+  FoldExpression(&node->middle);
+  FoldExpression(&node->right);
+}
+
+/* === References === */
+
+// A statement that does nothing but store a value that is free to compute
+static bool IsRemovableWrite(AST_Node *stmt, Token *name) {
+  switch (stmt->node_type) {
+    case DECLARATION_NODE:
+      if (TypeIs_Function(stmt->data_type)) return false;
+      *name = stmt->token;
+      return true;
+    case ASSIGNMENT_NODE:
+      *name = stmt->token;
+      return IsSafeSubscript(stmt->middle) && IsPure(stmt->left);
+    case TERSE_ASSIGNMENT_NODE:
+      *name = stmt->left->token;
+      return stmt->left->node_type == IDENTIFIER_NODE && IsSafeSubscript(stmt->left->middle) && IsPure(stmt->right);
+    case POSTFIX_INCREMENT_NODE:
+    case POSTFIX_DECREMENT_NODE:
+      *name = stmt->token;
+      return IsSafeSubscript(stmt->middle);
+    case PREFIX_INCREMENT_NODE:
+    case PREFIX_DECREMENT_NODE:
+      if (stmt->left == NULL || stmt->left->node_type != IDENTIFIER_NODE) return false;
+      *name = stmt->left->token;
+      return IsSafeSubscript(stmt->left->middle);
+    default:
+      return false;
+  }
+}
+
+static bool MayBeRemoved(Name *n) {
+  return n->declared && n->reads == 0 && n->writes == n->removable_writes &&
+         !TypeIs_Struct(n->type) && !TypeIs_Enum(n->type) && !TypeIs_EnumMember(n->type) &&
+         !TypeIs_Function(n->type);
+}
+
+// Anything done with a name in a way not tracked below counts as a read and a write
+static void OpaqueUse(Token t) {
+  if (t.type != IDENTIFIER) return;
+  Name *n = Lookup(t);
+  n->reads++;
+  n->writes++;
+}
+
+static void CountReferences(AST_Node *node, bool is_statement);
+
+static void CountChildren(AST_Node *node) {
+  bool is_chain = node->node_type == CHAIN_NODE || node->node_type == START_NODE ||
+                  node->node_type == FUNCTION_BODY_NODE;
+
+  CountReferences(node->left, is_chain);
+  CountReferences(node->middle, false);
+  CountReferences(node->right, false);
+}
+
+static void CountWrite(AST_Node *stmt, Token name, bool is_statement) {
+  Name *n = Lookup(name);
+  Token ignored;
+
+  n->writes++;
+  if (is_statement && IsRemovableWrite(stmt, &ignored)) n->removable_writes++;
+}
+
+static void CountReferences(AST_Node *node, bool is_statement) {
+  if (node == NULL) return;
+
+  switch (node->node_type) {
+    case DECLARATION_NODE: {
+      if (TypeIs_Function(node->data_type)) break;
+
+      Name *n = Lookup(node->token);
+      n->declared = true;
+      n->type = node->data_type;
+      CountWrite(node, node->token, is_statement);
+      break;
+    }
+
+    case ASSIGNMENT_NODE: {
+      Name *n = Lookup(node->token);
+      CountWrite(node, node->token, is_statement);
+
+      if (node->right != NULL) {
+        n->declared = true;
+        n->type = node->right->data_type;
+
+        bool literal = node->left != NULL && node->left->node_type == LITERAL_NODE && node->middle == NULL;
+        if (literal && (DCE.in_function || !DCE.calls_seen)) n->constant = node->left;
+      }
+      if (n->writes > 1) n->constant = NULL;
+
+      CountReferences(node->left, false);
+      CountReferences(node->middle, false);
+      break;
+    }
+
+    case TERSE_ASSIGNMENT_NODE:
+      CountWrite(node, node->left->token, is_statement);
+      if (!is_statement) Lookup(node->left->token)->reads++;
+      Lookup(node->left->token)->constant = NULL;
+      CountReferences(node->left->middle, false);
+      CountReferences(node->right, false);
+      break;
+
+    case POSTFIX_INCREMENT_NODE:
+    case POSTFIX_DECREMENT_NODE:
+      CountWrite(node, node->token, is_statement);
+      if (!is_statement) Lookup(node->token)->reads++;
+      Lookup(node->token)->constant = NULL;
+      CountReferences(node->middle, false);
+      break;
+
+    case PREFIX_INCREMENT_NODE:
+    case PREFIX_DECREMENT_NODE:
+      if (node->left == NULL || node->left->node_type != IDENTIFIER_NODE) {
+        CountChildren(node);
+        break;
+      }
+      CountWrite(node, node->left->token, is_statement);
+      if (!is_statement) Lookup(node->left->token)->reads++;
+      Lookup(node->left->token)->constant = NULL;
+      CountReferences(node->left->middle, false);
+      break;
+
+    case IDENTIFIER_NODE:
+    case ARRAY_SUBSCRIPT_NODE:
+      if (node->token.type == IDENTIFIER) Lookup(node->token)->reads++;
+      CountReferences(node->middle, false);
+      break;
+
+    case FUNCTION_ARGUMENT_NODE:
+      if (node->left == NULL && node->token.type == IDENTIFIER) Lookup(node->token)->reads++;
+      CountReferences(node->left, false);
+      CountReferences(node->right, false);
+      break;
+
+    case FUNCTION_CALL_NODE:
+      if (!DCE.in_function) DCE.calls_seen = true;
+      CountReferences(node->middle, false);
+      CountReferences(node->right, false);
+      break;
+
+    case FUNCTION_NODE:
+      Lookup(node->token)->function = node;
+      DCE.in_function = true;
+      CountReferences(node->middle, false);
+      CountReferences(node->right, false);
+      DCE.in_function = false;
+      break;
+
+    case LITERAL_NODE:
+      break;
+
+    default:
+      OpaqueUse(node->token);
+      CountChildren(node);
+      break;
+  }
+}
+
+static void MarkCalls(AST_Node *node) {
+  if (node == NULL) return;
+
+  if (node->node_type == FUNCTION_CALL_NODE) {
+    Name *n = Lookup(node->token);
+    if (!n->called) {
+      AST_Node *function = n->function;
+      n->called = true;
+      if (function != NULL) MarkCalls(function->right);
+    }
+  }
+
+  if (node->node_type == FUNCTION_NODE) return;
+
+  MarkCalls(node->left);
+  MarkCalls(node->middle);
+  MarkCalls(node->right);
+}
+
+static void Analyze(AST_Node *root) {
+  ResetNames();
+  DCE.in_function = false;
+  DCE.calls_seen = false;
+
+  CountReferences(root, false);
+  MarkCalls(root);
+}
+
+/* === Statements === */
+
+// The link takes over the next one, dropping its own statement
+static void RemoveLink(AST_Node *link) {
+  AST_Node *next = link->right;
+  link->left = next->left;
+  link->right = next->right;
+}
+
+static AST_Node *SimplifyStatement(AST_Node *stmt);
+
+static bool EndsInJump(AST_Node *stmt) {
+  if (stmt == NULL) return false;
+
+  switch (stmt->node_type) {
+    case RETURN_NODE:
+    case BREAK_NODE:
+    case CONTINUE_NODE:
+      return true;
+    case CHAIN_NODE:
+      for (AST_Node *link = stmt; link != NULL; link = link->right) {
+        if (EndsInJump(link->left)) return true;
+      }
+      return false;
+    case IF_NODE:
+      return stmt->right != NULL && EndsInJump(stmt->middle) && EndsInJump(stmt->right);
+    default:
+      return false;
+  }
+}
+
+/* The last link of a chain holds nothing, except in for loops, where it
+ * holds the increment (see ForStmt() in the parser) */
+static void SimplifyChain(AST_Node *chain) {
+  AST_Node *link = chain;
+
+  while (link != NULL && !IsLinkEnd(link)) {
+    if (link->left == NULL) {
+      link = link->right;
+      continue;
+    }
+
+    link->left = SimplifyStatement(link->left);
+    if (link->left == NULL) {
+      RemoveLink(link);
+      continue;
+    }
+
+    if (EndsInJump(link->left)) {
+      AST_Node *last = link;
+      while (!IsLinkEnd(last)) last = last->right;
+      link->right = last;
+    }
+
+    link = link->right;
+  }
+
+  if (link != NULL) FoldExpression(&link->left);
+}
+
+// What the statement turns into, or NULL if nothing is left of it
+static AST_Node *SimplifyStatement(AST_Node *stmt) {
+  bool taken;
+
+  switch (stmt->node_type) {
+    case START_NODE:
+    case CHAIN_NODE:
+      SimplifyChain(stmt);
+      return NodeIs_DeadEnd(stmt) ? NULL : stmt;
+
+    case IF_NODE:
+      FoldExpression(&stmt->left);
+      if (IsConstantCondition(stmt->left, &taken)) {
+        AST_Node *branch = taken ? stmt->middle : stmt->right;
+        return (branch == NULL) ? NULL : SimplifyStatement(branch);
+      }
+
+      SimplifyChain(stmt->middle);
+      if (stmt->right != NULL) stmt->right = SimplifyStatement(stmt->right);
+      if (stmt->right == NULL && NodeIs_DeadEnd(stmt->middle) && IsPure(stmt->left)) return NULL;
+      return stmt;
+
+    case WHILE_NODE:
+      FoldExpression(&stmt->left);
+      if (IsConstantCondition(stmt->left, &taken) && !taken) return NULL;
+
+      SimplifyChain(stmt->right);
+      return stmt;
+
+    case FOR_NODE: {
+      AST_Node *loop = stmt->right;
+      FoldExpression(&stmt->left);
+      FoldExpression(&loop->left);
+
+      // Only the initialization runs
+      if (IsConstantCondition(loop->left, &taken) && !taken) return stmt->left;
+
+      SimplifyChain(loop->right);
+      return stmt;
+    }
+
+    case FUNCTION_NODE:
+      SimplifyChain(stmt->right);
+      return stmt;
+
+    default:
+      FoldExpression(&stmt);
+      return stmt;
+  }
+}
+
+static void RemoveUncalledFunctions(AST_Node *root, FILE *report) {
+  for (AST_Node *link = root; link != NULL && !IsLinkEnd(link);) {
+    AST_Node *stmt = link->left;
+    bool is_function = stmt != NULL &&
+                       (stmt->node_type == FUNCTION_NODE ||
+                        (stmt->node_type == DECLARATION_NODE && TypeIs_Function(stmt->data_type)));
+
+    if (is_function && !Lookup(stmt->token)->called) {
+      if (stmt->node_type == FUNCTION_NODE) {
+        DCE.functions_removed++;
+        if (report != NULL) {
+          fprintf(report, "dead code: removed function '%.*s'\n", stmt->token.length, stmt->token.position_in_source);
+        }
+      }
+      RemoveLink(link);
+      continue;
+    }
+
+    link = link->right;
+  }
+}
+
+static void RemoveUnreadVariables(AST_Node *node) {
+  if (node == NULL) return;
+
+  bool is_chain = node->node_type == CHAIN_NODE || node->node_type == START_NODE ||
+                  node->node_type == FUNCTION_BODY_NODE;
+  if (!is_chain) {
+    RemoveUnreadVariables(node->left);
+    RemoveUnreadVariables(node->middle);
+    RemoveUnreadVariables(node->right);
+    return;
+  }
+
+  for (AST_Node *link = node; link != NULL && !IsLinkEnd(link);) {
+    Token name;
+    if (link->left != NULL && IsRemovableWrite(link->left, &name) && MayBeRemoved(Lookup(name))) {
+      RemoveLink(link);
+      continue;
+    }
+
+    RemoveUnreadVariables(link->left);
+    link = link->right;
+  }
+}
+
+void EliminateDeadCode(AST_Node *root, FILE *report) {
+  memset(&DCE, 0, sizeof(DCE));
+
+  int before = CountNodes(root);
+  int previous = before, after = before;
+
+  do {
+    previous = after;
+
+    Analyze(root);
+    SimplifyChain(root);
+
+    Analyze(root);
+    RemoveUncalledFunctions(root, report);
+
+    Analyze(root);
+    RemoveUnreadVariables(root);
+
+    after = CountNodes(root);
+  } while (after < previous);
+
+  if (report != NULL) {
+    fprintf(report, "dead code: removed %d of %d nodes, %d functions\n", before - after, before, DCE.functions_removed);
+  }
+
+  ResetNames();
+}
@@ -0,0 +1,26 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+#include <stdio.h>
+
+#include "ast.h"
+
+/* Dead code elimination on the type checked AST, until nothing changes:
+ *
+ *   - statements after a return, break or continue are dropped
+ *   - if, while, for and ternaries whose condition folds to a constant
+ *     keep only the branch that runs. Conditions fold from literals and
+ *     from variables written exactly once, with a literal, before any
+ *     function could read them
+ *   - functions that can't be called from the top level are removed,
+ *     along with their forward declarations
+ *   - variables that are never read lose their declarations and every
+ *     statement that does nothing but store a value into them, unless
+ *     computing that value could have an effect (calls, updates, division,
+ *     array reads that may be out of bounds)
+ *
+ * With `report` set, removed functions are listed along with how many
+ * AST nodes were removed in total. */
+void EliminateDeadCode(AST_Node *root, FILE *report);
+
+#endif
@@ -3,7 +3,9 @@
  * This is an attempt to create a generic dynamic array setup.
  * Source files use USE_DYNAMIC_ARRAY() with a type of choice,
  * and the corresponding function definitions will be pasted in
- * by the preprocessor.
+ * by the preprocessor. They are static inline, so the ones a file
+ * doesn't use aren't warned about. USE_TAGGED_DYNAMIC_ARRAY() takes
+ * the allocator.h tag the memory is counted under as well.
  *
  * Then, dynamic arrays can be utilized with the provided macros:
  *   - DA(type) for type usage, e.g. DA(float) x;
@@ -20,7 +22,8 @@
 #define DYNAMIC_ARRAY_H
 
 #include <stddef.h> // for NULL
-#include <stdlib.h> // for realloc
+
+#include "allocator.h"
 
 #define INITIAL_CAPACITY 16
 
@@ -39,7 +42,7 @@
   };
 
 #define da_init_definition(type)          \
-  static void                             \
+  static inline void                      \
   da_init_function_name(type)(            \
       struct da_struct_name(type) *array  \
   )                                       \
@@ -49,8 +52,8 @@
     array->data = NULL;                   \
   }
 
-#define da_add_definition(type)                                      \
-  static void                                                        \
+#define da_add_definition(type, tag)                                 \
+  static inline void                                                 \
   da_add_function_name(type)(                                        \
       struct da_struct_name(type) *array,                            \
       type value                                                     \
@@ -60,15 +63,15 @@
       array->capacity = (array->capacity < INITIAL_CAPACITY)         \
                           ? INITIAL_CAPACITY                         \
                           : array->capacity * 2;                     \
-      array->data = realloc(array->data,                             \
-                            array->capacity * sizeof(*array->data)); \
+      array->data = Reallocate(tag, array->data,                     \
+                               array->capacity * sizeof(type));      \
     }                                                                \
                                                                      \
     array->data[array->count++] = value;                             \
   }
 
-#define da_set_definition(type)                                      \
-  static void                                                        \
+#define da_set_definition(type, tag)                                 \
+  static inline void                                                 \
   da_set_function_name(type)(                                        \
       struct da_struct_name(type) *array,                            \
       int index,                                                     \
@@ -79,29 +82,32 @@
       array->capacity = (array->capacity < INITIAL_CAPACITY)         \
                           ? INITIAL_CAPACITY                         \
                           : array->capacity * 2;                     \
-      array->data = realloc(array->data,                             \
-                            array->capacity * sizeof(*array->data)); \
+      array->data = Reallocate(tag, array->data,                     \
+                               array->capacity * sizeof(type));      \
     }                                                                \
                                                                      \
     array->data[index] = value;                                      \
   }
 
-#define da_free_definition(type)           \
-  static void da_free_function_name(type)( \
+#define da_free_definition(type, tag)      \
+  static inline void                       \
+  da_free_function_name(type)(             \
       struct da_struct_name(type) *array   \
   )                                        \
   {                                        \
-    free(array->data);                     \
+    Release(tag, array->data);             \
     da_init_function_name(type)(array);    \
   }
 
 // Pastes all definitions
-#define USE_DYNAMIC_ARRAY(type) \
-  da_struct_definition(type)    \
-  da_init_definition(type)      \
-  da_add_definition(type)       \
-  da_set_definition(type)       \
-  da_free_definition(type)
+#define USE_TAGGED_DYNAMIC_ARRAY(type, tag) \
+  da_struct_definition(type)                \
+  da_init_definition(type)                  \
+  da_add_definition(type, tag)              \
+  da_set_definition(type, tag)              \
+  da_free_definition(type, tag)
+
+#define USE_DYNAMIC_ARRAY(type) USE_TAGGED_DYNAMIC_ARRAY(type, MEM_OTHER)
 
 #define DA(type) struct da_struct_name(type)
 #define DA_INIT(type, arr) da_init_function_name(type)(&arr)
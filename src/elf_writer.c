@@ -0,0 +1,656 @@
+#include <elf.h>
+#include <errno.h>
+#include <stdio.h>    // for fopen, rename, snprintf
+#include <string.h>   // for memcpy, strcmp, strerror
+#include <sys/stat.h> // for chmod
+#include <unistd.h>   // for getpid
+
+#include "common.h"
+#include "elf_writer.h"
+#include "error.h"
+
+typedef struct {
+  Arena *arena;
+  uint8_t *bytes;
+  int size;
+  int capacity;
+} Buffer;
+
+static Buffer NewBuffer(Arena *arena) {
+  return (Buffer){.arena = arena, .bytes = NULL, .size = 0, .capacity = 0};
+}
+
+// Appends `size` bytes of `data` (zeros when NULL), returning their offset
+static int Append(Buffer *b, const void *data, int size) {
+  while (b->size + size > b->capacity) {
+    b->bytes = ArenaGrowArray(b->arena, b->bytes, &b->capacity, 1);
+  }
+
+  int offset = b->size;
+  if (data != NULL) memcpy(b->bytes + offset, data, size);
+  else memset(b->bytes + offset, 0, size);
+  b->size += size;
+
+  return offset;
+}
+
+static int AppendString(Buffer *b, const char *s) {
+  return Append(b, s, strlen(s) + 1);
+}
+
+static void Pad(Buffer *b, int alignment) {
+  Append(b, NULL, (alignment - b->size % alignment) % alignment);
+}
+
+static uint64_t AlignUp(uint64_t n, uint64_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+/* Writes to a temporary file and renames it into place, so a failed
+ * link never leaves a truncated executable behind. */
+static bool WriteWholeFile(Buffer *b, const char *path, mode_t mode) {
+  char tmp_path[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+  FILE *fd = fopen(tmp_path, "wb");
+  if (fd == NULL) {
+    Print("WriteWholeFile(): Could not open '%s': %s\n", tmp_path, strerror(errno));
+    return false;
+  }
+
+  bool ok = fwrite(b->bytes, 1, b->size, fd) == (size_t)b->size;
+  ok = (fclose(fd) == 0) && ok;
+  ok = ok && chmod(tmp_path, mode) == 0;
+  if (ok) ok = rename(tmp_path, path) == 0;
+
+  if (!ok) {
+    Print("WriteWholeFile(): Could not write '%s': %s\n", path, strerror(errno));
+    remove(tmp_path);
+  }
+
+  return ok;
+}
+
+static bool IsLocalLabel(X64_Symbol *s) {
+  return s->section >= 0 && strncmp(s->name, ".L", 2) == 0;
+}
+
+static void InitELFHeader(Elf64_Ehdr *h, uint16_t type) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->e_ident, ELFMAG, SELFMAG);
+  h->e_ident[EI_CLASS] = ELFCLASS64;
+  h->e_ident[EI_DATA] = ELFDATA2LSB;
+  h->e_ident[EI_VERSION] = EV_CURRENT;
+  h->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  h->e_type = type;
+  h->e_machine = EM_X86_64;
+  h->e_version = EV_CURRENT;
+  h->e_ehsize = sizeof(Elf64_Ehdr);
+}
+
+/* === Relocatable objects === */
+static const uint64_t SectionFlags[X64_SECTION_COUNT] = {
+  [X64_TEXT]   = SHF_ALLOC | SHF_EXECINSTR,
+  [X64_RODATA] = SHF_ALLOC,
+  [X64_DATA]   = SHF_ALLOC | SHF_WRITE,
+  [X64_BSS]    = SHF_ALLOC | SHF_WRITE,
+};
+
+// Section header index of an X64_SectionId; index 0 is the null section
+#define SECTION_INDEX(section) (1 + (section))
+
+bool WriteELFObject(X64_Object *obj, const char *path) {
+  Arena *arena = NewArena();
+  Buffer file = NewBuffer(arena), symtab = NewBuffer(arena), strtab = NewBuffer(arena), shstrtab = NewBuffer(arena);
+  Buffer rela[X64_SECTION_COUNT];
+  for (int s = 0; s < X64_SECTION_COUNT; s++) rela[s] = NewBuffer(arena);
+
+  // Symbols: null, one per section, then locals before globals as ELF requires
+  AppendString(&strtab, "");
+  Append(&symtab, NULL, sizeof(Elf64_Sym));
+
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    Elf64_Sym sym = {.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION), .st_shndx = SECTION_INDEX(s)};
+    Append(&symtab, &sym, sizeof(sym));
+  }
+
+  int *symbol_index = ArenaAlloc(arena, (obj->symbol_count + 1) * sizeof(int));
+  int first_global = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    bool globals = pass == 1;
+    if (globals) first_global = symtab.size / sizeof(Elf64_Sym);
+
+    for (int i = 0; i < obj->symbol_count; i++) {
+      X64_Symbol *s = &obj->symbols[i];
+      bool is_global = s->is_global || s->section < 0;
+
+      if (IsLocalLabel(s)) {
+        symbol_index[i] = -1;
+        continue;
+      }
+      if (is_global != globals) continue;
+
+      Elf64_Sym sym = {
+        .st_name = AppendString(&strtab, s->name),
+        .st_info = ELF64_ST_INFO(is_global ? STB_GLOBAL : STB_LOCAL, s->is_function ? STT_FUNC : STT_NOTYPE),
+        .st_shndx = (s->section >= 0) ? SECTION_INDEX(s->section) : SHN_UNDEF,
+        .st_value = (s->section >= 0) ? s->offset : 0,
+      };
+      symbol_index[i] = Append(&symtab, &sym, sizeof(sym)) / sizeof(Elf64_Sym);
+    }
+  }
+
+  // References to .L labels become offsets from their section's symbol
+  for (int i = 0; i < obj->reloc_count; i++) {
+    X64_Reloc *r = &obj->relocs[i];
+    X64_Symbol *s = &obj->symbols[r->symbol];
+    uint32_t sym = symbol_index[r->symbol];
+    int64_t addend = r->addend;
+
+    if (IsLocalLabel(s)) {
+      sym = SECTION_INDEX(s->section);
+      addend += s->offset;
+    }
+
+    Elf64_Rela entry = {r->offset, ELF64_R_INFO(sym, r->type), addend};
+    Append(&rela[r->section], &entry, sizeof(entry));
+  }
+
+  int rela_count = 0;
+  for (int s = 0; s < X64_SECTION_COUNT; s++) rela_count += rela[s].size > 0;
+  int symtab_index = SECTION_INDEX(X64_SECTION_COUNT) + rela_count;
+
+  Elf64_Shdr sections[SECTION_INDEX(X64_SECTION_COUNT) * 2 + 4] = {0};
+  int section_count = 1;
+
+  Append(&file, NULL, sizeof(Elf64_Ehdr));
+  AppendString(&shstrtab, "");
+
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    X64_Section *section = &obj->sections[s];
+    Pad(&file, section->alignment);
+
+    sections[section_count++] = (Elf64_Shdr){
+      .sh_name = AppendString(&shstrtab, X64SectionName(s)),
+      .sh_type = (s == X64_BSS) ? SHT_NOBITS : SHT_PROGBITS,
+      .sh_flags = SectionFlags[s],
+      .sh_offset = Append(&file, section->bytes, (s == X64_BSS) ? 0 : section->size),
+      .sh_size = section->size,
+      .sh_addralign = section->alignment,
+    };
+  }
+
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    if (rela[s].size == 0) continue;
+
+    char name[32];
+    snprintf(name, sizeof(name), ".rela%s", X64SectionName(s));
+    Pad(&file, 8);
+
+    sections[section_count++] = (Elf64_Shdr){
+      .sh_name = AppendString(&shstrtab, name),
+      .sh_type = SHT_RELA,
+      .sh_flags = SHF_INFO_LINK,
+      .sh_offset = Append(&file, rela[s].bytes, rela[s].size),
+      .sh_size = rela[s].size,
+      .sh_link = symtab_index,
+      .sh_info = SECTION_INDEX(s),
+      .sh_addralign = 8,
+      .sh_entsize = sizeof(Elf64_Rela),
+    };
+  }
+
+  Pad(&file, 8);
+  sections[section_count++] = (Elf64_Shdr){
+    .sh_name = AppendString(&shstrtab, ".symtab"),
+    .sh_type = SHT_SYMTAB,
+    .sh_offset = Append(&file, symtab.bytes, symtab.size),
+    .sh_size = symtab.size,
+    .sh_link = symtab_index + 1,
+    .sh_info = first_global,
+    .sh_addralign = 8,
+    .sh_entsize = sizeof(Elf64_Sym),
+  };
+
+  sections[section_count++] = (Elf64_Shdr){
+    .sh_name = AppendString(&shstrtab, ".strtab"),
+    .sh_type = SHT_STRTAB,
+    .sh_offset = Append(&file, strtab.bytes, strtab.size),
+    .sh_size = strtab.size,
+    .sh_addralign = 1,
+  };
+
+  // Marks the stack as non-executable
+  sections[section_count++] = (Elf64_Shdr){
+    .sh_name = AppendString(&shstrtab, ".note.GNU-stack"),
+    .sh_type = SHT_PROGBITS,
+    .sh_offset = file.size,
+    .sh_addralign = 1,
+  };
+
+  int shstrtab_index = section_count;
+  Elf64_Shdr *names = &sections[section_count++];
+  names->sh_name = AppendString(&shstrtab, ".shstrtab");
+  names->sh_type = SHT_STRTAB;
+  names->sh_offset = Append(&file, shstrtab.bytes, shstrtab.size);
+  names->sh_size = shstrtab.size;
+  names->sh_addralign = 1;
+
+  Pad(&file, 8);
+  int section_headers = Append(&file, sections, section_count * sizeof(Elf64_Shdr));
+
+  Elf64_Ehdr header;
+  InitELFHeader(&header, ET_REL);
+  header.e_shoff = section_headers;
+  header.e_shentsize = sizeof(Elf64_Shdr);
+  header.e_shnum = section_count;
+  header.e_shstrndx = shstrtab_index;
+  memcpy(file.bytes, &header, sizeof(header));
+
+  bool ok = WriteWholeFile(&file, path, 0644);
+  DeleteArena(arena);
+
+  return ok;
+}
+
+/* === Linking ===
+ *
+ * The executable is non-PIE with three loadable segments:
+ *
+ *   R   headers, .interp, .hash, .dynsym, .dynstr, .rela.dyn, .rodata
+ *   RX  .text, then one stub per imported function
+ *   RW  .data, GOT, .dynamic, .bss
+ *
+ * Every import gets a GOT slot that the dynamic loader fills at start-up
+ * (the executable asks for immediate binding, so there is no lazy PLT).
+ * Calls to imported functions go through a stub that jumps via the slot. */
+
+#define BASE_ADDRESS 0x400000
+#define PAGE_SIZE 0x1000
+#define STUB_SIZE 8
+#define PROGRAM_HEADER_COUNT 7
+#define DYNAMIC_TAG_COUNT 12 // besides DT_NEEDED
+
+static const char Interpreter[] = "/lib64/ld-linux-x86-64.so.2";
+static const char *SharedLibraries[] = {"libc.so.6", "libm.so.6"};
+
+// The Crom runtime's entry point: calls main() and exits with its result
+static const char StartupAssembly[] =
+  ".text\n"
+  ".globl _start\n"
+  ".type _start, @function\n"
+  "_start:\n"
+  "  xorl %ebp, %ebp\n"
+  "  andq $-16, %rsp\n"
+  "  call main\n"
+  "  movl %eax, %edi\n"
+  "  call exit@PLT\n"
+  "  ud2\n";
+
+typedef struct {
+  const char *name;
+  int stub; // -1 unless the import is called
+} Import;
+
+typedef struct {
+  int object;
+  int symbol;
+} SymbolRef;
+
+static struct {
+  Arena *arena;
+  X64_Object **objects;
+  int object_count;
+
+  // Each object's section contents start at base[object][section] inside the merged sections
+  uint64_t (*base)[X64_SECTION_COUNT];
+  Buffer merged[X64_SECTION_COUNT];
+  int bss_size;
+  int alignment[X64_SECTION_COUNT];
+  uint64_t address[X64_SECTION_COUNT];
+
+  Import *imports;
+  int import_count, import_capacity;
+  int stub_count;
+  uint64_t got_address;
+  uint64_t stub_address;
+} Link;
+
+static SymbolRef FindDefinition(int object, int symbol) {
+  X64_Symbol *s = &Link.objects[object]->symbols[symbol];
+  if (s->section >= 0) return (SymbolRef){object, symbol};
+
+  for (int o = 0; o < Link.object_count; o++) {
+    int found = FindX64Symbol(Link.objects[o], s->name);
+    if (found >= 0 && Link.objects[o]->symbols[found].is_global && Link.objects[o]->symbols[found].section >= 0) {
+      return (SymbolRef){o, found};
+    }
+  }
+
+  return (SymbolRef){-1, -1};
+}
+
+static int FindImport(const char *name) {
+  for (int i = 0; i < Link.import_count; i++) {
+    if (strcmp(Link.imports[i].name, name) == 0) return i;
+  }
+
+  return -1;
+}
+
+static void CheckDuplicateGlobals() {
+  for (int o = 0; o < Link.object_count; o++) {
+    X64_Object *obj = Link.objects[o];
+
+    for (int i = 0; i < obj->symbol_count; i++) {
+      X64_Symbol *s = &obj->symbols[i];
+      if (!s->is_global || s->section < 0) continue;
+
+      for (int other = o + 1; other < Link.object_count; other++) {
+        int found = FindX64Symbol(Link.objects[other], s->name);
+        if (found >= 0 && Link.objects[other]->symbols[found].is_global && Link.objects[other]->symbols[found].section >= 0) {
+          COMPILER_ERROR_FMTMSG("Link: Symbol '%s' is defined more than once", s->name);
+        }
+      }
+    }
+  }
+}
+
+static void MergeSections() {
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    Link.merged[s] = NewBuffer(Link.arena);
+    Link.alignment[s] = 1;
+
+    for (int o = 0; o < Link.object_count; o++) {
+      X64_Section *section = &Link.objects[o]->sections[s];
+      if (section->alignment > Link.alignment[s]) Link.alignment[s] = section->alignment;
+
+      if (s == X64_BSS) {
+        Link.bss_size = AlignUp(Link.bss_size, section->alignment);
+        Link.base[o][s] = Link.bss_size;
+        Link.bss_size += section->size;
+      } else {
+        Pad(&Link.merged[s], section->alignment);
+        Link.base[o][s] = Append(&Link.merged[s], section->bytes, section->size);
+      }
+    }
+  }
+}
+
+// Everything referenced but not defined by any object comes from a shared library
+static void CollectImports() {
+  for (int o = 0; o < Link.object_count; o++) {
+    X64_Object *obj = Link.objects[o];
+
+    for (int i = 0; i < obj->reloc_count; i++) {
+      X64_Reloc *r = &obj->relocs[i];
+      if (FindDefinition(o, r->symbol).object >= 0) continue;
+
+      const char *name = obj->symbols[r->symbol].name;
+      int index = FindImport(name);
+      if (index < 0) {
+        Import import = {name, -1};
+        ARENA_PUSH(Link.arena, Link.imports, Link.import_count, Link.import_capacity, import);
+        index = Link.import_count - 1;
+      }
+
+      if (r->type == X64_RELOC_PLT32 && Link.imports[index].stub < 0) {
+        Link.imports[index].stub = Link.stub_count++;
+      }
+    }
+  }
+}
+
+static uint64_t SymbolAddress(SymbolRef ref) {
+  X64_Symbol *s = &Link.objects[ref.object]->symbols[ref.symbol];
+  return Link.address[s->section] + Link.base[ref.object][s->section] + s->offset;
+}
+
+static void PatchRelative(uint8_t *at, int64_t value, const char *name) {
+  if (value < INT32_MIN || value > INT32_MAX) {
+    COMPILER_ERROR_FMTMSG("Link: Relocation against '%s' out of range", name);
+  }
+
+  int32_t v = (int32_t)value;
+  memcpy(at, &v, sizeof(v));
+}
+
+static void ApplyRelocations() {
+  for (int o = 0; o < Link.object_count; o++) {
+    X64_Object *obj = Link.objects[o];
+
+    for (int i = 0; i < obj->reloc_count; i++) {
+      X64_Reloc *r = &obj->relocs[i];
+      const char *name = obj->symbols[r->symbol].name;
+      uint64_t offset = Link.base[o][r->section] + r->offset;
+      uint8_t *at = Link.merged[r->section].bytes + offset;
+      int64_t place = Link.address[r->section] + offset;
+
+      SymbolRef definition = FindDefinition(o, r->symbol);
+
+      if (definition.object >= 0) {
+        int64_t target = SymbolAddress(definition);
+
+        switch (r->type) {
+          case X64_RELOC_PC32:
+          case X64_RELOC_PLT32:
+            PatchRelative(at, target + r->addend - place, name);
+            break;
+
+          case X64_RELOC_64: {
+            uint64_t value = target + r->addend;
+            memcpy(at, &value, sizeof(value));
+            break;
+          }
+
+          default:
+            COMPILER_ERROR_FMTMSG("Link: GOT reference to local symbol '%s' is not supported", name);
+        }
+        continue;
+      }
+
+      Import *import = &Link.imports[FindImport(name)];
+      int slot = import - Link.imports;
+
+      switch (r->type) {
+        case X64_RELOC_PLT32:
+          PatchRelative(at, Link.stub_address + import->stub * STUB_SIZE + r->addend - place, name);
+          break;
+
+        case X64_RELOC_GOTPCREL:
+          PatchRelative(at, Link.got_address + slot * sizeof(uint64_t) + r->addend - place, name);
+          break;
+
+        default:
+          COMPILER_ERROR_FMTMSG("Link: Direct reference to shared library symbol '%s'", name);
+      }
+    }
+  }
+}
+
+static void AddDynamic(Buffer *b, int64_t tag, uint64_t value) {
+  Elf64_Dyn entry = {.d_tag = tag, .d_un.d_val = value};
+  Append(b, &entry, sizeof(entry));
+}
+
+bool LinkExecutable(X64_Object **objects, int count, const char *path) {
+  memset(&Link, 0, sizeof(Link));
+  Link.arena = NewArena();
+
+  X64_Object *startup = AssembleX64(StartupAssembly, sizeof(StartupAssembly) - 1);
+  Link.object_count = count + 1;
+  Link.objects = ArenaAlloc(Link.arena, Link.object_count * sizeof(X64_Object *));
+  memcpy(Link.objects, objects, count * sizeof(X64_Object *));
+  Link.objects[count] = startup;
+  Link.base = ArenaAlloc(Link.arena, Link.object_count * sizeof(*Link.base));
+
+  CheckDuplicateGlobals();
+  MergeSections();
+  CollectImports();
+
+  SymbolRef entry = FindDefinition(count, FindX64Symbol(startup, "main"));
+  if (entry.object < 0) COMPILER_ERROR("Link: Undefined symbol 'main'");
+
+  // Dynamic linking tables
+  Buffer dynstr = NewBuffer(Link.arena), dynsym = NewBuffer(Link.arena);
+  Buffer hash = NewBuffer(Link.arena), rela = NewBuffer(Link.arena);
+  AppendString(&dynstr, "");
+
+  int needed[sizeof(SharedLibraries) / sizeof(SharedLibraries[0])];
+  int library_count = sizeof(SharedLibraries) / sizeof(SharedLibraries[0]);
+  for (int i = 0; i < library_count; i++) needed[i] = AppendString(&dynstr, SharedLibraries[i]);
+
+  Append(&dynsym, NULL, sizeof(Elf64_Sym));
+  for (int i = 0; i < Link.import_count; i++) {
+    Elf64_Sym sym = {
+      .st_name = AppendString(&dynstr, Link.imports[i].name),
+      .st_info = ELF64_ST_INFO(STB_GLOBAL, (Link.imports[i].stub >= 0) ? STT_FUNC : STT_OBJECT),
+    };
+    Append(&dynsym, &sym, sizeof(sym));
+  }
+
+  // A single bucket chaining through every symbol: the loader only looks up our imports' names
+  uint32_t symbol_count = Link.import_count + 1;
+  uint32_t hash_header[3] = {1, symbol_count, symbol_count - 1};
+  Append(&hash, hash_header, sizeof(hash_header));
+  for (uint32_t i = 0; i < symbol_count; i++) {
+    uint32_t previous = (i == 0) ? 0 : i - 1;
+    Append(&hash, &previous, sizeof(previous));
+  }
+
+  // Layout of the read-only segment
+  uint64_t offset = sizeof(Elf64_Ehdr) + PROGRAM_HEADER_COUNT * sizeof(Elf64_Phdr);
+  uint64_t interp_offset = offset;
+  offset += sizeof(Interpreter);
+  uint64_t hash_offset = offset = AlignUp(offset, 8);
+  offset += hash.size;
+  uint64_t dynsym_offset = offset = AlignUp(offset, 8);
+  offset += dynsym.size;
+  uint64_t dynstr_offset = offset;
+  offset += dynstr.size;
+  uint64_t rela_offset = offset = AlignUp(offset, 8);
+  offset += Link.import_count * sizeof(Elf64_Rela);
+  uint64_t rodata_offset = offset = AlignUp(offset, Link.alignment[X64_RODATA]);
+  offset += Link.merged[X64_RODATA].size;
+  uint64_t readonly_end = offset;
+
+  // Executable segment
+  uint64_t text_offset = offset = AlignUp(offset, PAGE_SIZE);
+  offset += Link.merged[X64_TEXT].size;
+  uint64_t stub_offset = offset = AlignUp(offset, STUB_SIZE);
+  offset += Link.stub_count * STUB_SIZE;
+  uint64_t text_end = offset;
+
+  // Writable segment
+  uint64_t data_offset = offset = AlignUp(offset, PAGE_SIZE);
+  offset += Link.merged[X64_DATA].size;
+  uint64_t got_offset = offset = AlignUp(offset, 8);
+  offset += Link.import_count * sizeof(uint64_t);
+  uint64_t dynamic_offset = offset;
+  offset += (library_count + DYNAMIC_TAG_COUNT) * sizeof(Elf64_Dyn);
+  uint64_t file_end = offset;
+  uint64_t bss_offset = AlignUp(offset, Link.alignment[X64_BSS]);
+  uint64_t memory_end = bss_offset + Link.bss_size;
+
+  Link.address[X64_RODATA] = BASE_ADDRESS + rodata_offset;
+  Link.address[X64_TEXT] = BASE_ADDRESS + text_offset;
+  Link.address[X64_DATA] = BASE_ADDRESS + data_offset;
+  Link.address[X64_BSS] = BASE_ADDRESS + bss_offset;
+  Link.got_address = BASE_ADDRESS + got_offset;
+  Link.stub_address = BASE_ADDRESS + stub_offset;
+
+  ApplyRelocations();
+
+  for (int i = 0; i < Link.import_count; i++) {
+    Elf64_Rela entry = {
+      .r_offset = Link.got_address + i * sizeof(uint64_t),
+      .r_info = ELF64_R_INFO(i + 1, R_X86_64_GLOB_DAT),
+    };
+    Append(&rela, &entry, sizeof(entry));
+  }
+
+  Buffer dynamic = NewBuffer(Link.arena);
+  for (int i = 0; i < library_count; i++) AddDynamic(&dynamic, DT_NEEDED, needed[i]);
+  AddDynamic(&dynamic, DT_HASH, BASE_ADDRESS + hash_offset);
+  AddDynamic(&dynamic, DT_STRTAB, BASE_ADDRESS + dynstr_offset);
+  AddDynamic(&dynamic, DT_SYMTAB, BASE_ADDRESS + dynsym_offset);
+  AddDynamic(&dynamic, DT_STRSZ, dynstr.size);
+  AddDynamic(&dynamic, DT_SYMENT, sizeof(Elf64_Sym));
+  AddDynamic(&dynamic, DT_RELA, BASE_ADDRESS + rela_offset);
+  AddDynamic(&dynamic, DT_RELASZ, rela.size);
+  AddDynamic(&dynamic, DT_RELAENT, sizeof(Elf64_Rela));
+  AddDynamic(&dynamic, DT_FLAGS, DF_BIND_NOW);
+  AddDynamic(&dynamic, DT_FLAGS_1, DF_1_NOW);
+  AddDynamic(&dynamic, DT_DEBUG, 0);
+  AddDynamic(&dynamic, DT_NULL, 0);
+
+  Elf64_Phdr segments[PROGRAM_HEADER_COUNT] = {
+    {PT_PHDR, PF_R, sizeof(Elf64_Ehdr), BASE_ADDRESS + sizeof(Elf64_Ehdr), BASE_ADDRESS + sizeof(Elf64_Ehdr),
+     sizeof(segments), sizeof(segments), 8},
+    {PT_INTERP, PF_R, interp_offset, BASE_ADDRESS + interp_offset, BASE_ADDRESS + interp_offset,
+     sizeof(Interpreter), sizeof(Interpreter), 1},
+    {PT_LOAD, PF_R, 0, BASE_ADDRESS, BASE_ADDRESS, readonly_end, readonly_end, PAGE_SIZE},
+    {PT_LOAD, PF_R | PF_X, text_offset, BASE_ADDRESS + text_offset, BASE_ADDRESS + text_offset,
+     text_end - text_offset, text_end - text_offset, PAGE_SIZE},
+    {PT_LOAD, PF_R | PF_W, data_offset, BASE_ADDRESS + data_offset, BASE_ADDRESS + data_offset,
+     file_end - data_offset, memory_end - data_offset, PAGE_SIZE},
+    {PT_DYNAMIC, PF_R | PF_W, dynamic_offset, BASE_ADDRESS + dynamic_offset, BASE_ADDRESS + dynamic_offset,
+     dynamic.size, dynamic.size, 8},
+    {PT_GNU_STACK, PF_R | PF_W, 0, 0, 0, 0, 0, 16},
+  };
+
+  Elf64_Ehdr header;
+  InitELFHeader(&header, ET_EXEC);
+  header.e_entry = SymbolAddress(FindDefinition(count, FindX64Symbol(startup, "_start")));
+  header.e_phoff = sizeof(Elf64_Ehdr);
+  header.e_phentsize = sizeof(Elf64_Phdr);
+  header.e_phnum = PROGRAM_HEADER_COUNT;
+
+  // Assemble the file in layout order, padding up to each recorded offset
+  Buffer file = NewBuffer(Link.arena);
+  struct {
+    uint64_t offset;
+    const void *data;
+    int size;
+  } parts[] = {
+    {0, &header, sizeof(header)},
+    {sizeof(Elf64_Ehdr), segments, sizeof(segments)},
+    {interp_offset, Interpreter, sizeof(Interpreter)},
+    {hash_offset, hash.bytes, hash.size},
+    {dynsym_offset, dynsym.bytes, dynsym.size},
+    {dynstr_offset, dynstr.bytes, dynstr.size},
+    {rela_offset, rela.bytes, rela.size},
+    {rodata_offset, Link.merged[X64_RODATA].bytes, Link.merged[X64_RODATA].size},
+    {text_offset, Link.merged[X64_TEXT].bytes, Link.merged[X64_TEXT].size},
+    {stub_offset, NULL, Link.stub_count * STUB_SIZE},
+    {data_offset, Link.merged[X64_DATA].bytes, Link.merged[X64_DATA].size},
+    {got_offset, NULL, Link.import_count * sizeof(uint64_t)},
+    {dynamic_offset, dynamic.bytes, dynamic.size},
+  };
+
+  for (int i = 0; i < (int)(sizeof(parts) / sizeof(parts[0])); i++) {
+    Append(&file, NULL, parts[i].offset - file.size);
+    Append(&file, parts[i].data, parts[i].size);
+
+    // jmp *slot(%rip), padded with ud2
+    if (parts[i].offset == stub_offset && parts[i].data == NULL) {
+      for (int j = 0; j < Link.import_count; j++) {
+        Import *import = &Link.imports[j];
+        if (import->stub < 0) continue;
+
+        uint64_t stub = Link.stub_address + import->stub * STUB_SIZE;
+        uint8_t code[STUB_SIZE] = {0xFF, 0x25, 0, 0, 0, 0, 0x0F, 0x0B};
+        int32_t relative = (int32_t)(Link.got_address + j * sizeof(uint64_t) - (stub + 6));
+        memcpy(&code[2], &relative, sizeof(relative));
+        memcpy(file.bytes + stub_offset + import->stub * STUB_SIZE, code, sizeof(code));
+      }
+    }
+  }
+
+  bool ok = WriteWholeFile(&file, path, 0755);
+
+  DeleteX64Object(startup);
+  DeleteArena(Link.arena);
+  return ok;
+}
@@ -0,0 +1,19 @@
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include <stdbool.h>
+
+#include "x64_assembler.h"
+
+/* Writes `obj` as an ELF64 relocatable object (.o), equivalent to what
+ * GNU as produces from the same assembly. Local .L labels are turned into
+ * section-relative relocations, as the system assembler does. */
+bool WriteELFObject(X64_Object *obj, const char *path);
+
+/* Links `objects` with Crom's startup code into an x86-64 executable.
+ * Everything the objects define is laid out and relocated here; symbols
+ * left undefined are imported from libc.so.6 or libm.so.6 and bound by
+ * the system's dynamic loader when the program starts. */
+bool LinkExecutable(X64_Object **objects, int count, const char *path);
+
+#endif
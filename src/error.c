@@ -17,6 +17,10 @@ void SetErrorCode(ErrorCode code) {
   if (error_code == OK) error_code = code;
 }
 
+ErrorCode GetErrorCode() {
+  return error_code;
+}
+
 const char *ErrorCodeTranslation(ErrorCode code) {
   switch(code) {
     case OK:                       return "OK";
@@ -49,6 +53,7 @@ const char *ErrorCodeTranslation(ErrorCode code) {
     case ERR_UNKNOWN:              return "UNKNOWN";
     case ERR_COMPILER:             return "COMPILER";
     case ERR_INTERPRETER:          return "INTERPRETER";
+    case ERR_TAIL_CALL:            return "TAIL CALL";
     default:                       return "Unhandled ErrorCodeTranslation case";
   }
 }
@@ -83,6 +88,7 @@ ErrorCode ErrorCodeLookup(char *str) {
   if (StringsMatch(str, "ERR_MISC")) return ERR_MISC;
   if (StringsMatch(str, "ERR_COMPILER")) return ERR_COMPILER;
   if (StringsMatch(str, "ERR_INTERPRETER")) return ERR_INTERPRETER;
+  if (StringsMatch(str, "ERR_TAIL_CALL")) return ERR_TAIL_CALL;
 
   Print("ErrorCodeLookup(): No match for '%s'\n", str);
   return ERR_UNKNOWN;
@@ -205,6 +211,9 @@ void Error(const char *file, int line, const char *func_name, ErrorCode error_co
     case ERR_INTERPRETER: {
       // This maybe shouldn't be handled in this function
     } break;
+    case ERR_TAIL_CALL: {
+      // This maybe shouldn't be handled in this function
+    } break;
   }
 
   Print("\n");
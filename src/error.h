@@ -38,11 +38,15 @@ typedef enum {
   ERR_UNKNOWN,
   ERR_COMPILER,
   ERR_INTERPRETER,
+
+  // These are exit codes, so new ones go last and existing ones keep their values
+  ERR_TAIL_CALL,
 } ErrorCode;
 
 void Exit();
 
 void SetErrorCode(ErrorCode code);
+ErrorCode GetErrorCode();
 const char *ErrorCodeTranslation(ErrorCode code);
 ErrorCode ErrorCodeLookup(char *str);
 
@@ -0,0 +1,112 @@
+#include "hash.h"
+
+/* 64-bit FNV-1a. Used to fingerprint source files so that stale
+ * compiled artifacts can be detected without re-lexing. */
+uint64_t HashBytes(const void *data, size_t length) {
+  #define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+  #define FNV_PRIME        0x100000001b3ULL
+
+  const unsigned char *bytes = data;
+  uint64_t hash = FNV_OFFSET_BASIS;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+
+  #undef FNV_OFFSET_BASIS
+  #undef FNV_PRIME
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <string.h> // for memcpy
+
+#define STRIPE_BYTES 64
+#define STRIPES_PER_BLOCK 16
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+static const uint64_t stripe_secret[8] = {
+  0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+  0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+#ifndef __SSE2__
+static uint64_t Read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+#endif
+
+// Every lane adds the product of its key-mixed halves, and the neighbouring lane the raw input
+static void Accumulate(uint64_t acc[8], const unsigned char *stripe) {
+#ifdef __SSE2__
+  for (int i = 0; i < 8; i += 2) {
+    __m128i data = _mm_loadu_si128((const __m128i *)(stripe + i * 8));
+    __m128i key = _mm_loadu_si128((const __m128i *)&stripe_secret[i]);
+    __m128i mixed = _mm_xor_si128(data, key);
+    __m128i product = _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+
+    __m128i sum = _mm_add_epi64(_mm_loadu_si128((const __m128i *)&acc[i]), _mm_add_epi64(product, swapped));
+    _mm_storeu_si128((__m128i *)&acc[i], sum);
+  }
+#else
+  for (int i = 0; i < 8; i++) {
+    uint64_t data = Read64(stripe + i * 8);
+    uint64_t mixed = data ^ stripe_secret[i];
+    acc[i ^ 1] += data;
+    acc[i] += (mixed & 0xFFFFFFFFULL) * (mixed >> 32);
+  }
+#endif
+}
+
+static void Scramble(uint64_t acc[8]) {
+  for (int i = 0; i < 8; i++) {
+    acc[i] ^= acc[i] >> 47;
+    acc[i] ^= stripe_secret[7 - i];
+    acc[i] *= PRIME32_1;
+  }
+}
+
+static uint64_t Mix128(uint64_t a, uint64_t b) {
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t HashBytesFast(const void *data, size_t length, uint64_t seed) {
+  const unsigned char *bytes = data;
+  uint64_t acc[8] = {
+    PRIME32_1, PRIME64_1 + seed, PRIME64_2, seed ^ PRIME64_1,
+    PRIME64_2 ^ seed, PRIME32_1 + seed, PRIME64_1, PRIME64_2 - seed,
+  };
+
+  size_t stripes = length / STRIPE_BYTES;
+  for (size_t s = 0; s < stripes; s++) {
+    Accumulate(acc, bytes + s * STRIPE_BYTES);
+    if (s % STRIPES_PER_BLOCK == STRIPES_PER_BLOCK - 1) Scramble(acc);
+  }
+
+  // The rest goes in as one zero-padded stripe, the length tells paddings apart
+  unsigned char last[STRIPE_BYTES] = {0};
+  memcpy(last, bytes + stripes * STRIPE_BYTES, length % STRIPE_BYTES);
+  Accumulate(acc, last);
+  Scramble(acc);
+
+  uint64_t hash = length * PRIME64_1 + seed;
+  for (int i = 0; i < 8; i += 2) {
+    hash += Mix128(acc[i] ^ stripe_secret[i], acc[i + 1] ^ stripe_secret[i + 1]);
+  }
+
+  hash ^= hash >> 37;
+  hash *= 0x165667919E3779F9ULL;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,16 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h> // for size_t
+#include <stdint.h>
+
+uint64_t HashBytes(const void *data, size_t length);
+
+/* A hash for bulk data, such as whole source files, in the style of XXH3:
+ * eight 64-bit lanes take in 64 bytes at a time, with SSE2 where the
+ * compiler targets it and the same arithmetic in plain C elsewhere, so
+ * both give the same hashes. Hashes of several pieces can be chained by
+ * passing one as the `seed` of the next. */
+uint64_t HashBytesFast(const void *data, size_t length, uint64_t seed);
+
+#endif
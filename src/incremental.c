@@ -0,0 +1,1426 @@
+#include <fcntl.h>    // for open
+#include <stdint.h>
+#include <stdio.h>    // for fopen, rename
+#include <stdlib.h>   // for qsort, calloc
+#include <string.h>   // for memcmp, memcpy
+#include <sys/wait.h> // for waitpid
+#include <unistd.h>   // for fork, pipe, getpid
+
+#include "allocator.h"
+#include "arena.h"
+#include "common.h"
+#include "compile_cache.h"
+#include "error.h"
+#include "hash.h"
+#include "incremental.h"
+#include "lexer.h"
+
+#define STATE_MAGIC "CRIN"
+#define STATE_VERSION 1
+
+// Tried at most for a token, before it is taken as changed
+#define MAX_CANDIDATES 16
+
+typedef struct {
+  Token token;
+  LexerPosition after;
+  uint64_t hash;
+} LexedToken;
+
+typedef struct {
+  const char *source;
+  size_t length;
+  LexedToken *tokens;
+  int count;
+  int capacity;
+} LexedFile;
+
+typedef struct {
+  uint64_t *data;
+  int count;
+  int capacity;
+} NameList;
+
+typedef struct {
+  SymbolWriteKind kind;
+  Symbol symbol;
+  Token parent;
+  bool is_name;
+  uint64_t name; // kept along, as the symbol's token may have nowhere to go in a later build
+} SymbolWrite;
+
+typedef struct {
+  SymbolWrite *data;
+  int count;
+  int capacity;
+} WriteList;
+
+typedef struct {
+  uint8_t *data;
+  size_t count;
+  size_t capacity;
+} Buffer;
+
+// A top-level statement of this build
+typedef struct {
+  int file;
+  int first; // index of its first token in the file
+  int count;
+  int old;         // the statement of the last build at the same tokens, or -1
+  bool parse_same; // parsed just as in the last build, so that checking it may be reused too
+
+  AST_Node *ast;
+  NameList parse_reads;
+  NameList check_reads;
+  WriteList parse_writes;
+  WriteList check_writes;
+
+  // What is saved of it, encoded once it was parsed and once it was checked
+  Buffer parsed;
+  Buffer checked;
+} Unit;
+
+// A top-level statement of the last build
+typedef struct {
+  uint64_t fingerprint;
+  uint64_t first_hash;
+  int count;
+
+  NameList parse_reads;
+  NameList check_reads;
+  NameList writes;
+
+  // By token: a hash of its text and column, and its line counted from the statement's first
+  uint64_t *keys;
+  int32_t *lines;
+
+  const uint8_t *parsed;
+  size_t parsed_length;
+  const uint8_t *checked;
+  size_t checked_length;
+
+  bool found; // at the same tokens in this build
+  bool gone;  // not in this build at all, so what it set is changed
+
+  // The statement of this build it is compared with, and how many tokens from its start and end the two share
+  int new_file;
+  int new_first;
+  int new_count;
+  int prefix;
+  int suffix;
+} OldUnit;
+
+typedef struct {
+  int file;
+  int first;
+  int old;
+} Plan;
+
+typedef enum {
+  PHASE_PARSE,
+  PHASE_CHECK,
+} Phase;
+
+typedef struct {
+  uint64_t *slots;
+  int capacity;
+  int count;
+} NameSet;
+
+static struct {
+  const char *path;
+  bool verify;
+
+  bool enabled;
+  bool reuse;
+  bool failed;   // a statement couldn't be told apart, so there's nothing to save
+  bool replaying;
+
+  Arena *arena;
+  SymbolTable *st;
+
+  const char **filenames;
+  LexedFile *files;
+  int file_count;
+
+  uint8_t *state;
+  size_t state_length;
+  OldUnit *old_units;
+  int old_count;
+
+  // The statements of the last build found again, in order
+  Plan *plans;
+  int plan_count;
+  int plan_capacity;
+  int next_plan;
+  int pending_old; // the one found at the statement about to be parsed, or -1
+  int next_old;    // the first not yet found, compared with or gone
+
+  // Names whose symbols this build sets differently than the last one did, so far
+  NameSet changed;
+
+  Unit *units;
+  int unit_count;
+  int unit_capacity;
+  int current; // being parsed or checked, -1 between statements
+  Phase phase;
+
+  // By symbol: the statement that set all of it last, or -1
+  int *writers;
+  int writer_capacity;
+
+  pid_t verifier;
+  int verifier_fd;
+  bool is_verifier;
+} Incremental = {.current = -1, .pending_old = -1, .verifier_fd = -1};
+
+static uint64_t Mix(uint64_t hash, uint64_t value) {
+  hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+  return hash ^ (hash >> 29);
+}
+
+static uint64_t NameHash(Token t) {
+  return HashBytesFast(t.position_in_source, t.length, t.type);
+}
+
+/* Symbols are named by identifiers and literals. A literal's symbol
+ * follows from its text, but for the value its reader gives it right
+ * before, so only the others count as names looked up and set */
+static bool IsName(TokenType type) {
+  return type == IDENTIFIER || type == ENUM_LITERAL;
+}
+
+static void AddName(NameList *list, uint64_t name) {
+  ARENA_PUSH(Incremental.arena, list->data, list->count, list->capacity, name);
+}
+
+static int CompareNames(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void SortNames(NameList *list) {
+  if (list->count == 0) return;
+  qsort(list->data, list->count, sizeof(uint64_t), CompareNames);
+
+  int unique = 0;
+  for (int i = 0; i < list->count; i++) {
+    if (unique == 0 || list->data[unique - 1] != list->data[i]) list->data[unique++] = list->data[i];
+  }
+  list->count = unique;
+}
+
+/* === Names changed in this build === */
+// 0 marks an empty slot, so the one name hashing to it is kept as 1
+static uint64_t SlotName(uint64_t name) {
+  return (name == 0) ? 1 : name;
+}
+
+static bool NameSetHas(NameSet *set, uint64_t name) {
+  if (set->capacity == 0) return false;
+
+  name = SlotName(name);
+  for (int i = name & (set->capacity - 1); set->slots[i] != 0; i = (i + 1) & (set->capacity - 1)) {
+    if (set->slots[i] == name) return true;
+  }
+
+  return false;
+}
+
+static bool NameSetAdd(NameSet *set, uint64_t name) {
+  if (NameSetHas(set, name)) return false;
+
+  if (2 * (set->count + 1) > set->capacity) {
+    NameSet grown = {.capacity = (set->capacity == 0) ? 64 : set->capacity * 2};
+    grown.slots = calloc(grown.capacity, sizeof(uint64_t));
+    for (int i = 0; i < set->capacity; i++) {
+      if (set->slots[i] != 0) NameSetAdd(&grown, set->slots[i]);
+    }
+
+    free(set->slots);
+    *set = grown;
+  }
+
+  name = SlotName(name);
+  int i = name & (set->capacity - 1);
+  while (set->slots[i] != 0) i = (i + 1) & (set->capacity - 1);
+  set->slots[i] = name;
+  set->count++;
+
+  return true;
+}
+
+/* === Lexing ahead === */
+static void LexFile(int f, const char *filename, const char *source) {
+  LexedFile *file = &Incremental.files[f];
+  file->source = source;
+  file->length = strlen(source);
+
+  InitLexer(filename, source);
+  for (Token t = ScanToken(); t.type != TOKEN_EOF && t.type != ERROR; t = ScanToken()) {
+    LexedToken lexed = {.token = t, .after = SaveLexerPosition(), .hash = NameHash(t)};
+    ARENA_PUSH(Incremental.arena, file->tokens, file->count, file->capacity, lexed);
+  }
+}
+
+// Finds the token at or before `p`, or returns false if `p` isn't in any file's tokens
+static bool LocateToken(const char *p, int *file, int *index) {
+  for (int f = 0; f < Incremental.file_count; f++) {
+    LexedFile *lexed = &Incremental.files[f];
+    if (p < lexed->source || p > lexed->source + lexed->length) continue;
+    if (lexed->count == 0 || p < lexed->tokens[0].token.position_in_source) return false;
+
+    int low = 0, high = lexed->count - 1;
+    while (low < high) {
+      int middle = (low + high + 1) / 2;
+      if (lexed->tokens[middle].token.position_in_source <= p) low = middle;
+      else high = middle - 1;
+    }
+
+    *file = f;
+    *index = low;
+    return true;
+  }
+
+  return false;
+}
+
+static uint64_t TokenKey(LexedToken *t) {
+  return Mix(t->hash, (uint32_t)t->token.line_x_offset);
+}
+
+static uint64_t Fingerprint(int file, int first, int count) {
+  LexedToken *tokens = &Incremental.files[file].tokens[first];
+  uint64_t hash = count;
+
+  // Where the tokens are relative to each other counts too, as their lines and columns end up in the AST
+  for (int i = 0; i < count; i++) {
+    Token t = tokens[i].token;
+    hash = Mix(hash, tokens[i].hash);
+    hash = Mix(hash, ((uint64_t)(t.on_line - tokens[0].token.on_line) << 32) | (uint32_t)t.line_x_offset);
+  }
+
+  return hash;
+}
+
+/* === Encoding === */
+static void Put(Buffer *b, const void *data, size_t size) {
+  if (size == 0) return;
+  if (b->count + size > b->capacity) {
+    while (b->count + size > b->capacity) b->capacity = (b->capacity == 0) ? 4096 : b->capacity * 2;
+    b->data = realloc(b->data, b->capacity);
+  }
+
+  memcpy(b->data + b->count, data, size);
+  b->count += size;
+}
+
+static void PutU8(Buffer *b, uint8_t v)   { Put(b, &v, sizeof(v)); }
+static void PutI32(Buffer *b, int32_t v)  { Put(b, &v, sizeof(v)); }
+static void PutU64(Buffer *b, uint64_t v) { Put(b, &v, sizeof(v)); }
+
+typedef enum {
+  TOKEN_FROM_UNIT,   // relative to a statement's tokens, so it moves along with them
+  TOKEN_DETACHED,    // anywhere else, with its text
+} TokenEncoding;
+
+// The statement holding token `index` of `file`, or -1
+static int UnitOfToken(int file, int index) {
+  int low = 0, high = Incremental.unit_count - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    Unit *u = &Incremental.units[middle];
+
+    if (u->file < file || (u->file == file && u->first + u->count <= index)) low = middle + 1;
+    else if (u->file > file || u->first > index) high = middle - 1;
+    else return middle;
+  }
+
+  return -1;
+}
+
+static int FileOfName(const char *filename) {
+  for (int f = 0; f < Incremental.file_count; f++) {
+    if (Incremental.filenames[f] == filename) return f;
+  }
+
+  return -1;
+}
+
+static void PutToken(Buffer *b, Token t) {
+  int file, index, unit = -1;
+  if (t.position_in_source != NULL && LocateToken(t.position_in_source, &file, &index)) {
+    unit = UnitOfToken(file, index);
+  }
+
+  PutU8(b, (unit >= 0) ? TOKEN_FROM_UNIT : TOKEN_DETACHED);
+  PutI32(b, t.type);
+  PutI32(b, t.length);
+  PutI32(b, t.line_x_offset);
+
+  if (unit >= 0) {
+    Unit *u = &Incremental.units[unit];
+    LexedToken *first = &Incremental.files[file].tokens[u->first];
+
+    PutI32(b, unit);
+    PutI32(b, index - u->first);
+    PutI32(b, t.position_in_source - first[index - u->first].token.position_in_source);
+    PutI32(b, t.on_line - first->token.on_line);
+  } else {
+    PutU8(b, t.position_in_source != NULL);
+    if (t.position_in_source != NULL) Put(b, t.position_in_source, t.length);
+    PutI32(b, FileOfName(t.from_filename));
+    PutI32(b, t.on_line);
+  }
+}
+
+static void PutType(Buffer *b, Type t) {
+  PutU8(b, t.category);
+  PutU8(b, t.specifier);
+  PutI32(b, t.array_size);
+
+  int param_count = 0;
+  for (FnParam *p = t.params.next; p != NULL; p = p->next) param_count++;
+  PutI32(b, param_count);
+  for (FnParam *p = t.params.next; p != NULL; p = p->next) {
+    PutType(b, p->type);
+    PutToken(b, p->token);
+  }
+
+  int member_count = 0;
+  for (StructMember *m = t.members.next; m != NULL; m = m->next) member_count++;
+  PutI32(b, member_count);
+  for (StructMember *m = t.members.next; m != NULL; m = m->next) {
+    PutType(b, m->type);
+    PutToken(b, m->token);
+  }
+}
+
+// Only the member in use is written, as the rest of the union may be anything
+static void PutValue(Buffer *b, Value v) {
+  PutType(b, v.type);
+
+  if (TypeIs_String(v.type)) {
+    PutU8(b, v.as.string != NULL);
+    if (v.as.string != NULL) {
+      PutI32(b, strlen(v.as.string));
+      Put(b, v.as.string, strlen(v.as.string));
+    }
+  } else if (TypeIs_Bool(v.type)) {
+    PutU8(b, v.as.boolean);
+  } else if (TypeIs_Char(v.type)) {
+    PutU8(b, v.as.character);
+  } else if (TypeIs_Float(v.type)) {
+    Put(b, &v.as.floating, sizeof(v.as.floating));
+  } else {
+    PutU64(b, v.as.uinteger);
+  }
+}
+
+static void PutSymbol(Buffer *b, Symbol s) {
+  PutToken(b, s.token);
+  PutU8(b, s.declaration_state);
+  PutType(b, s.data_type);
+  PutValue(b, s.value);
+  PutI32(b, s.depth);
+}
+
+static void PutWrite(Buffer *b, SymbolWrite w) {
+  PutU8(b, w.kind);
+  PutU8(b, w.is_name);
+  PutU64(b, w.name);
+  PutSymbol(b, w.symbol);
+  PutU8(b, w.parent.type != ERROR);
+  if (w.parent.type != ERROR) PutToken(b, w.parent);
+}
+
+static void PutWrites(Buffer *b, WriteList *writes) {
+  PutI32(b, writes->count);
+  for (int i = 0; i < writes->count; i++) PutWrite(b, writes->data[i]);
+}
+
+// Nodes reached twice are written once and referred back to after
+typedef struct {
+  AST_Node **keys;
+  int *ids;
+  int capacity;
+  int count;
+} NodeMap;
+
+static int NodeMapFind(NodeMap *map, AST_Node *node) {
+  if (map->capacity == 0) return -1;
+
+  for (int i = HashBytes(&node, sizeof(node)) & (map->capacity - 1); map->keys[i] != NULL; i = (i + 1) & (map->capacity - 1)) {
+    if (map->keys[i] == node) return map->ids[i];
+  }
+
+  return -1;
+}
+
+static void NodeMapAdd(NodeMap *map, AST_Node *node, int id) {
+  if (2 * (map->count + 1) > map->capacity) {
+    NodeMap grown = {.capacity = (map->capacity == 0) ? 256 : map->capacity * 2};
+    grown.keys = calloc(grown.capacity, sizeof(AST_Node *));
+    grown.ids = malloc(grown.capacity * sizeof(int));
+    for (int i = 0; i < map->capacity; i++) {
+      if (map->keys[i] != NULL) NodeMapAdd(&grown, map->keys[i], map->ids[i]);
+    }
+
+    free(map->keys);
+    free(map->ids);
+    *map = grown;
+  }
+
+  int i = HashBytes(&node, sizeof(node)) & (map->capacity - 1);
+  while (map->keys[i] != NULL) i = (i + 1) & (map->capacity - 1);
+  map->keys[i] = node;
+  map->ids[i] = id;
+  map->count++;
+}
+
+typedef enum {
+  NODE_NONE,
+  NODE_NEW,
+  NODE_SEEN,
+} NodeEncoding;
+
+static void PutNode(Buffer *b, NodeMap *seen, AST_Node *node) {
+  if (node == NULL) {
+    PutU8(b, NODE_NONE);
+    return;
+  }
+
+  int id = NodeMapFind(seen, node);
+  if (id >= 0) {
+    PutU8(b, NODE_SEEN);
+    PutI32(b, id);
+    return;
+  }
+  NodeMapAdd(seen, node, seen->count);
+
+  PutU8(b, NODE_NEW);
+  PutI32(b, node->node_type);
+  PutToken(b, node->token);
+  PutType(b, node->data_type);
+  PutNode(b, seen, node->left);
+  PutNode(b, seen, node->middle);
+  PutNode(b, seen, node->right);
+}
+
+static void PutStatement(Buffer *b, AST_Node *ast) {
+  NodeMap seen = {0};
+  PutNode(b, &seen, ast);
+  free(seen.keys);
+  free(seen.ids);
+}
+
+/* === Decoding === */
+typedef struct {
+  const uint8_t *data;
+  size_t length;
+  size_t position;
+  bool failed;
+  bool lenient; // reading only to compare, so tokens with nowhere to go are kept as ones matching none
+} Reader;
+
+static void Get(Reader *r, void *dest, size_t size) {
+  if (r->failed || r->position + size > r->length) {
+    r->failed = true;
+    memset(dest, 0, size);
+    return;
+  }
+
+  memcpy(dest, r->data + r->position, size);
+  r->position += size;
+}
+
+static uint8_t  GetU8(Reader *r)  { uint8_t v;  Get(r, &v, sizeof(v)); return v; }
+static int32_t  GetI32(Reader *r) { int32_t v;  Get(r, &v, sizeof(v)); return v; }
+static uint64_t GetU64(Reader *r) { uint64_t v; Get(r, &v, sizeof(v)); return v; }
+
+// Counts are checked against what is left, so that a damaged file can't ask for more than it holds
+static int GetCount(Reader *r) {
+  int32_t count = GetI32(r);
+  if (count < 0 || (size_t)count > r->length - r->position) {
+    r->failed = true;
+    return 0;
+  }
+
+  return count;
+}
+
+static Token GetToken(Reader *r) {
+  Token t = {0};
+  TokenEncoding encoding = GetU8(r);
+  t.type = GetI32(r);
+  t.length = GetI32(r);
+  t.line_x_offset = GetI32(r);
+
+  if (encoding == TOKEN_FROM_UNIT) {
+    int unit = GetI32(r);
+    int offset = GetI32(r);
+    int delta = GetI32(r);
+    int line_delta = GetI32(r);
+
+    // Tokens of statements that weren't found again, or of their parts that changed, have nowhere to go
+    OldUnit *old = (unit >= 0 && unit < Incremental.old_count) ? &Incremental.old_units[unit] : NULL;
+    if (r->failed || old == NULL || old->new_file < 0 || offset < 0 || offset >= old->count ||
+        (offset >= old->prefix && offset < old->count - old->suffix)) {
+      if (r->lenient) t.on_line = INT32_MIN;
+      else r->failed = true;
+      return t;
+    }
+
+    int index = (offset < old->prefix) ? offset : old->new_count - (old->count - offset);
+    Token moved = Incremental.files[old->new_file].tokens[old->new_first + index].token;
+    t.position_in_source = moved.position_in_source + delta;
+    t.from_filename = Incremental.filenames[old->new_file];
+    t.on_line = moved.on_line + line_delta - old->lines[offset];
+  } else {
+    if (GetU8(r)) {
+      if (t.length < 0 || (size_t)t.length > r->length - r->position) {
+        r->failed = true;
+        return t;
+      }
+
+      char *text = malloc(t.length + 1);
+      Get(r, text, t.length);
+      text[t.length] = '\0';
+      t.position_in_source = text;
+    }
+
+    int file = GetI32(r);
+    t.from_filename = (file >= 0 && file < Incremental.file_count) ? Incremental.filenames[file] : NULL;
+    t.on_line = GetI32(r);
+  }
+
+  return t;
+}
+
+static Type GetType(Reader *r) {
+  Type t = NoType();
+  t.category = GetU8(r);
+  t.specifier = GetU8(r);
+  t.array_size = GetI32(r);
+
+  FnParam **param = &t.params.next;
+  for (int i = GetCount(r); i > 0 && !r->failed; i--) {
+    *param = AllocateZeroed(MEM_TYPES, 1, sizeof(FnParam));
+    (*param)->type = GetType(r);
+    (*param)->token = GetToken(r);
+    param = &(*param)->next;
+  }
+
+  StructMember **member = &t.members.next;
+  for (int i = GetCount(r); i > 0 && !r->failed; i--) {
+    *member = AllocateZeroed(MEM_TYPES, 1, sizeof(StructMember));
+    (*member)->type = GetType(r);
+    (*member)->token = GetToken(r);
+    member = &(*member)->next;
+  }
+
+  return t;
+}
+
+static Value GetValue(Reader *r) {
+  Value v = {.type = GetType(r)};
+
+  if (TypeIs_String(v.type)) {
+    if (GetU8(r)) {
+      int length = GetCount(r);
+      char *s = Allocate(MEM_STRINGS, length + 1);
+      Get(r, s, length);
+      s[length] = '\0';
+      v.as.string = s;
+    }
+  } else if (TypeIs_Bool(v.type)) {
+    v.as.boolean = GetU8(r);
+  } else if (TypeIs_Char(v.type)) {
+    v.as.character = GetU8(r);
+  } else if (TypeIs_Float(v.type)) {
+    Get(r, &v.as.floating, sizeof(v.as.floating));
+  } else {
+    v.as.uinteger = GetU64(r);
+  }
+
+  return v;
+}
+
+static Symbol GetSymbol(Reader *r) {
+  Token token = GetToken(r);
+  enum DeclarationState declaration_state = GetU8(r);
+  Type type = GetType(r);
+
+  Symbol s = NewSymbol(token, type, declaration_state);
+  s.value = GetValue(r);
+  s.depth = GetI32(r);
+
+  return s;
+}
+
+static void GetWrites(Reader *r, WriteList *writes) {
+  for (int i = GetCount(r); i > 0 && !r->failed; i--) {
+    SymbolWrite w = {.kind = GetU8(r), .parent = {.type = ERROR}};
+    w.is_name = GetU8(r);
+    w.name = GetU64(r);
+    w.symbol = GetSymbol(r);
+    if (GetU8(r)) w.parent = GetToken(r);
+
+    ARENA_PUSH(Incremental.arena, writes->data, writes->count, writes->capacity, w);
+  }
+}
+
+typedef struct {
+  AST_Node **data;
+  int count;
+  int capacity;
+} NodeList;
+
+static AST_Node *GetNode(Reader *r, NodeList *nodes) {
+  switch (GetU8(r)) {
+    case NODE_NONE: return NULL;
+    case NODE_SEEN: {
+      int id = GetI32(r);
+      if (id < 0 || id >= nodes->count) {
+        r->failed = true;
+        return NULL;
+      }
+      return nodes->data[id];
+    }
+    case NODE_NEW: break;
+    default: {
+      r->failed = true;
+      return NULL;
+    }
+  }
+
+  int node_type = GetI32(r);
+  if (node_type < 0 || node_type >= NODE_TYPE_COUNT) {
+    r->failed = true;
+    return NULL;
+  }
+
+  AST_Node *node = NewNode(node_type, NULL, NULL, NULL, NoType());
+  ARENA_PUSH(Incremental.arena, nodes->data, nodes->count, nodes->capacity, node);
+
+  node->token = GetToken(r);
+  node->data_type = GetType(r);
+  if (r->failed) return NULL;
+
+  node->left = GetNode(r, nodes);
+  node->middle = GetNode(r, nodes);
+  node->right = GetNode(r, nodes);
+
+  return node;
+}
+
+static AST_Node *GetStatement(Reader *r) {
+  NodeList nodes = {0};
+  return GetNode(r, &nodes);
+}
+
+/* === The state file === */
+static void GetNames(Reader *r, NameList *names) {
+  names->count = names->capacity = GetCount(r);
+  names->data = ArenaAlloc(Incremental.arena, names->count * sizeof(uint64_t));
+  Get(r, names->data, names->count * sizeof(uint64_t));
+}
+
+static const uint8_t *GetBlob(Reader *r, size_t *length) {
+  *length = GetCount(r);
+  const uint8_t *blob = r->data + r->position;
+  r->position += *length;
+  return blob;
+}
+
+static void ReadState() {
+  FILE *in = fopen(Incremental.path, "rb");
+  if (in == NULL) return; // The first build
+
+  size_t capacity = 4096, length = 0, read;
+  uint8_t *data = malloc(capacity);
+  while ((read = fread(data + length, 1, capacity - length, in)) > 0) {
+    length += read;
+    if (length == capacity) {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+  fclose(in);
+
+  Reader r = {.data = data, .length = length};
+  char magic[4];
+  Get(&r, magic, sizeof(magic));
+  int version = GetI32(&r);
+  uint64_t identity = GetU64(&r);
+
+  // Left by another compiler, whose ASTs might not be this one's
+  if (r.failed || memcmp(magic, STATE_MAGIC, 4) != 0 || version != STATE_VERSION || identity != CompilerIdentity()) {
+    free(data);
+    return;
+  }
+
+  int count = GetCount(&r);
+  OldUnit *old_units = ArenaAlloc(Incremental.arena, count * sizeof(OldUnit));
+  for (int i = 0; i < count && !r.failed; i++) {
+    OldUnit *old = &old_units[i];
+    *old = (OldUnit){.new_file = -1, .new_first = -1};
+
+    old->fingerprint = GetU64(&r);
+    old->first_hash = GetU64(&r);
+    old->count = GetCount(&r);
+    if (old->count == 0) r.failed = true;
+
+    old->keys = ArenaAlloc(Incremental.arena, old->count * sizeof(uint64_t));
+    Get(&r, old->keys, old->count * sizeof(uint64_t));
+    old->lines = ArenaAlloc(Incremental.arena, old->count * sizeof(int32_t));
+    Get(&r, old->lines, old->count * sizeof(int32_t));
+
+    GetNames(&r, &old->parse_reads);
+    GetNames(&r, &old->check_reads);
+    GetNames(&r, &old->writes);
+    old->parsed = GetBlob(&r, &old->parsed_length);
+    old->checked = GetBlob(&r, &old->checked_length);
+  }
+
+  if (r.failed || r.position != r.length) {
+    fprintf(stderr, "Incremental state '%s' is damaged, ignored\n", Incremental.path);
+    free(data);
+    return;
+  }
+
+  Incremental.state = data;
+  Incremental.state_length = length;
+  Incremental.old_units = old_units;
+  Incremental.old_count = count;
+}
+
+static void PutNames(Buffer *b, NameList *names) {
+  SortNames(names);
+  PutI32(b, names->count);
+  Put(b, names->data, names->count * sizeof(uint64_t));
+}
+
+static void PutBlob(Buffer *b, Buffer *blob) {
+  PutI32(b, blob->count);
+  Put(b, blob->data, blob->count);
+}
+
+static void AddWrittenNames(NameList *names, WriteList *writes) {
+  for (int i = 0; i < writes->count; i++) {
+    if (writes->data[i].is_name) AddName(names, writes->data[i].name);
+  }
+}
+
+static void WriteState() {
+  Buffer b = {0};
+  Put(&b, STATE_MAGIC, 4);
+  PutI32(&b, STATE_VERSION);
+  PutU64(&b, CompilerIdentity());
+  PutI32(&b, Incremental.unit_count);
+
+  for (int i = 0; i < Incremental.unit_count; i++) {
+    Unit *u = &Incremental.units[i];
+    NameList writes = {0};
+    AddWrittenNames(&writes, &u->parse_writes);
+    AddWrittenNames(&writes, &u->check_writes);
+
+    LexedToken *tokens = &Incremental.files[u->file].tokens[u->first];
+    PutU64(&b, Fingerprint(u->file, u->first, u->count));
+    PutU64(&b, tokens[0].hash);
+    PutI32(&b, u->count);
+    for (int t = 0; t < u->count; t++) PutU64(&b, TokenKey(&tokens[t]));
+    for (int t = 0; t < u->count; t++) PutI32(&b, tokens[t].token.on_line - tokens[0].token.on_line);
+    PutNames(&b, &u->parse_reads);
+    PutNames(&b, &u->check_reads);
+    PutNames(&b, &writes);
+    PutBlob(&b, &u->parsed);
+    PutBlob(&b, &u->checked);
+  }
+
+  // Written aside and renamed, so that a build stopped halfway leaves the last state whole
+  char temporary[64];
+  snprintf(temporary, sizeof(temporary), ".%d.tmp", (int)getpid());
+  char *temporary_path = Concat((char *)Incremental.path, temporary);
+
+  FILE *out = fopen(temporary_path, "wb");
+  if (out != NULL) {
+    bool ok = fwrite(b.data, 1, b.count, out) == b.count;
+    ok &= (fclose(out) == 0);
+    if (!ok || rename(temporary_path, Incremental.path) != 0) remove(temporary_path);
+  }
+
+  free(temporary_path);
+  free(b.data);
+}
+
+/* === Changed names === */
+static bool AnyChanged(NameList *names) {
+  for (int i = 0; i < names->count; i++) {
+    if (NameSetHas(&Incremental.changed, names->data[i])) return true;
+  }
+
+  return false;
+}
+
+static bool SetsAnyChanged(WriteList *writes) {
+  for (int i = 0; i < writes->count; i++) {
+    if (writes->data[i].is_name && NameSetHas(&Incremental.changed, writes->data[i].name)) return true;
+  }
+
+  return false;
+}
+
+static void ChangeAll(NameList *names) {
+  for (int i = 0; i < names->count; i++) NameSetAdd(&Incremental.changed, names->data[i]);
+}
+
+static void ChangeAllSet(WriteList *writes) {
+  for (int i = 0; i < writes->count; i++) {
+    if (writes->data[i].is_name) NameSetAdd(&Incremental.changed, writes->data[i].name);
+  }
+}
+
+// A statement of the last build that isn't in this one
+static void MarkGone(int unit) {
+  OldUnit *old = &Incremental.old_units[unit];
+  if (old->gone) return;
+
+  old->gone = true;
+  ChangeAll(&old->writes);
+}
+
+typedef struct {
+  bool is_name;
+  uint64_t name;
+  size_t start;
+  size_t end;
+} EncodedWrite;
+
+static EncodedWrite *EncodeEach(Buffer *b, WriteList *writes) {
+  EncodedWrite *encoded = malloc((writes->count + 1) * sizeof(EncodedWrite));
+  for (int i = 0; i < writes->count; i++) {
+    SymbolWrite w = writes->data[i];
+    encoded[i] = (EncodedWrite){.is_name = w.is_name, .name = w.name, .start = b->count};
+    PutWrite(b, w);
+    encoded[i].end = b->count;
+  }
+
+  return encoded;
+}
+
+static int NextWriteTo(EncodedWrite *writes, int count, int i, uint64_t name) {
+  while (i < count && !(writes[i].is_name && writes[i].name == name)) i++;
+  return i;
+}
+
+static bool SameWritesTo(uint64_t name, Buffer *a, EncodedWrite *x, int x_count, Buffer *b, EncodedWrite *y, int y_count) {
+  int i = NextWriteTo(x, x_count, 0, name), j = NextWriteTo(y, y_count, 0, name);
+  for (; i < x_count && j < y_count; i = NextWriteTo(x, x_count, i + 1, name), j = NextWriteTo(y, y_count, j + 1, name)) {
+    size_t length = x[i].end - x[i].start;
+    if (length != y[j].end - y[j].start || memcmp(a->data + x[i].start, b->data + y[j].start, length) != 0) return false;
+  }
+
+  return i == x_count && j == y_count;
+}
+
+// Only the names set differently change, which is what keeps an edit to a function's body from reaching its callers
+static void ChangeSetDifferently(WriteList *old, WriteList *now) {
+  Buffer a = {0}, b = {0};
+  EncodedWrite *x = EncodeEach(&a, old), *y = EncodeEach(&b, now);
+
+  for (int i = 0; i < old->count + now->count; i++) {
+    EncodedWrite w = (i < old->count) ? x[i] : y[i - old->count];
+    if (!w.is_name || NameSetHas(&Incremental.changed, w.name)) continue;
+
+    if (!SameWritesTo(w.name, &a, x, old->count, &b, y, now->count)) NameSetAdd(&Incremental.changed, w.name);
+  }
+
+  free(x);
+  free(y);
+  free(a.data);
+  free(b.data);
+}
+
+static void Encode(Buffer *b, WriteList *writes, AST_Node *ast) {
+  b->count = 0;
+  PutWrites(b, writes);
+  PutStatement(b, ast);
+}
+
+/* What the last build saved of a statement's parsing or checking is read
+ * and encoded again, to compare with `encoded` with its tokens where they
+ * are now. Returns whether the two are the same, after changing what was
+ * set differently */
+static bool CompareWithOld(OldUnit *old, const uint8_t *blob, size_t length, WriteList *writes, Buffer *encoded) {
+  WriteList old_writes = {0};
+  Reader r = {.data = blob, .length = length, .lenient = true};
+  GetWrites(&r, &old_writes);
+  AST_Node *ast = GetStatement(&r);
+
+  if (r.failed || r.position != r.length || ast == NULL) {
+    ChangeAll(&old->writes);
+    ChangeAllSet(writes);
+    return false;
+  }
+
+  Buffer again = {0};
+  Encode(&again, &old_writes, ast);
+  bool same = again.count == encoded->count && memcmp(again.data, encoded->data, again.count) == 0;
+  if (!same) ChangeSetDifferently(&old_writes, writes);
+
+  free(again.data);
+  return same;
+}
+
+/* === Planning === */
+typedef struct {
+  uint64_t hash;
+  int unit;
+} Candidate;
+
+static int CompareCandidates(const void *a, const void *b) {
+  const Candidate *x = a, *y = b;
+  if (x->hash != y->hash) return (x->hash > y->hash) - (x->hash < y->hash);
+  return x->unit - y->unit;
+}
+
+// The first statement of the last build from `k` on that the tokens from `index` of `file` on match, or -1
+static int FindOldUnit(Candidate *candidates, int file, int index, int k) {
+  LexedFile *lexed = &Incremental.files[file];
+  uint64_t hash = lexed->tokens[index].hash;
+
+  int low = 0, high = Incremental.old_count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    Candidate c = candidates[middle];
+    if (c.hash < hash || (c.hash == hash && c.unit < k)) low = middle + 1;
+    else high = middle;
+  }
+
+  for (int i = low; i < Incremental.old_count && i < low + MAX_CANDIDATES && candidates[i].hash == hash; i++) {
+    OldUnit *old = &Incremental.old_units[candidates[i].unit];
+    if (index + old->count <= lexed->count && Fingerprint(file, index, old->count) == old->fingerprint) {
+      return candidates[i].unit;
+    }
+  }
+
+  return -1;
+}
+
+// Statements are found again in the order they were in
+static void PlanReuse() {
+  Candidate *candidates = malloc(Incremental.old_count * sizeof(Candidate));
+  for (int i = 0; i < Incremental.old_count; i++) {
+    candidates[i] = (Candidate){.hash = Incremental.old_units[i].first_hash, .unit = i};
+  }
+  qsort(candidates, Incremental.old_count, sizeof(Candidate), CompareCandidates);
+
+  int k = 0;
+  for (int f = 0; f < Incremental.file_count; f++) {
+    LexedFile *lexed = &Incremental.files[f];
+
+    for (int i = 0; i < lexed->count;) {
+      int found = FindOldUnit(candidates, f, i, k);
+      if (found < 0) {
+        i++;
+        continue;
+      }
+
+      OldUnit *old = &Incremental.old_units[found];
+      old->found = true;
+      old->new_file = f;
+      old->new_first = i;
+      old->new_count = old->prefix = old->count;
+
+      Plan plan = {.file = f, .first = i, .old = found};
+      ARENA_PUSH(Incremental.arena, Incremental.plans, Incremental.plan_count, Incremental.plan_capacity, plan);
+
+      i += old->count;
+      k = found + 1;
+    }
+  }
+  free(candidates);
+}
+
+/* Statements of the last build that weren't found again are gone once the
+ * parser gets past where they were, unless they were compared with one
+ * parsed in their place before that */
+static void PassOldUnits(int end) {
+  for (; Incremental.next_old < end; Incremental.next_old++) {
+    if (!Incremental.old_units[Incremental.next_old].found) MarkGone(Incremental.next_old);
+  }
+}
+
+// Statements found again before `index` of `file` were parsed as part of others
+static void PassPlans(int file, int index) {
+  for (; Incremental.next_plan < Incremental.plan_count; Incremental.next_plan++) {
+    Plan plan = Incremental.plans[Incremental.next_plan];
+    if (plan.file > file || (plan.file == file && plan.first >= index)) break;
+
+    PassOldUnits(plan.old);
+    MarkGone(plan.old);
+    Incremental.next_old = plan.old + 1;
+  }
+}
+
+// The statement of the last build in the place of one parsed where none was found, or -1
+static int OldUnitInPlace() {
+  int end = (Incremental.next_plan < Incremental.plan_count) ? Incremental.plans[Incremental.next_plan].old : Incremental.old_count;
+  return (Incremental.next_old < end) ? Incremental.next_old++ : -1;
+}
+
+// Tokens the same from the start and from the end of the two statements are taken as each other
+static void Align(OldUnit *old, Unit *u) {
+  LexedToken *tokens = &Incremental.files[u->file].tokens[u->first];
+  int shared = (old->count < u->count) ? old->count : u->count;
+
+  int prefix = 0;
+  while (prefix < shared && old->keys[prefix] == TokenKey(&tokens[prefix]) &&
+         old->lines[prefix] == tokens[prefix].token.on_line - tokens[0].token.on_line) {
+    prefix++;
+  }
+
+  int suffix = 0, old_last = old->count - 1, new_last = u->count - 1;
+  while (prefix + suffix < shared && old->keys[old_last - suffix] == TokenKey(&tokens[new_last - suffix]) &&
+         old->lines[old_last - suffix] - old->lines[old_last] ==
+           tokens[new_last - suffix].token.on_line - tokens[new_last].token.on_line) {
+    suffix++;
+  }
+
+  old->new_file = u->file;
+  old->new_first = u->first;
+  old->new_count = u->count;
+  old->prefix = prefix;
+  old->suffix = suffix;
+}
+
+/* === Verification === */
+static void StartVerifier() {
+  int fds[2];
+  if (pipe(fds) != 0) COMPILER_ERROR("--incremental-verify: Could not create a pipe");
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid < 0) COMPILER_ERROR("--incremental-verify: Could not fork");
+
+  if (pid == 0) {
+    // Compiles from scratch, quietly
+    close(fds[0]);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+
+    Incremental.is_verifier = true;
+    Incremental.reuse = false;
+    Incremental.verifier_fd = fds[1];
+    return;
+  }
+
+  close(fds[1]);
+  Incremental.verifier = pid;
+  Incremental.verifier_fd = fds[0];
+}
+
+// Every statement's AST, then every symbol
+static void DumpProgram(Buffer *b, SymbolTable *st) {
+  for (int i = 0; i < Incremental.unit_count; i++) PutStatement(b, Incremental.units[i].ast);
+
+  PutI32(b, SymbolCount(st));
+  for (int i = 0; i < SymbolCount(st); i++) {
+    Symbol s = GetSymbolById(st, i);
+    PutSymbol(b, s);
+    PutI32(b, s.symbol_guid);
+    PutI32(b, s.parent_struct_symbol_guid_ref);
+    PutI32(b, s.declared_on_line);
+  }
+}
+
+static void CheckAgainstVerifier(SymbolTable *st) {
+  Buffer theirs = {0};
+  uint8_t chunk[65536];
+  ssize_t read_size;
+  while ((read_size = read(Incremental.verifier_fd, chunk, sizeof(chunk))) > 0) Put(&theirs, chunk, read_size);
+  close(Incremental.verifier_fd);
+
+  int status;
+  waitpid(Incremental.verifier, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    COMPILER_ERROR("--incremental-verify: Compiling from scratch failed where the incremental build didn't");
+  }
+
+  Buffer ours = {0};
+  DumpProgram(&ours, st);
+  if (ours.count != theirs.count || memcmp(ours.data, theirs.data, ours.count) != 0) {
+    COMPILER_ERROR("--incremental-verify: The incremental build differs from one from scratch");
+  }
+
+  free(ours.data);
+  free(theirs.data);
+}
+
+/* === Replaying === */
+static void Replay(SymbolWrite w) {
+  SymbolTable *st = Incremental.st;
+
+  switch (w.kind) {
+    case WRITE_SYMBOL: {
+      Symbol s = w.symbol;
+      if (w.parent.type != ERROR) s.parent_struct_symbol_guid_ref = RetrieveFrom(st, w.parent).symbol_guid;
+      AddTo(st, s);
+    } break;
+    case WRITE_DECLARATION: SetDecl(st, w.symbol.token, w.symbol.declaration_state); break;
+    case WRITE_VALUE:       SetSymbolValue(st, w.symbol.token, w.symbol.value); break;
+    case WRITE_TYPE:        SetSymbolDataType(st, w.symbol.token, w.symbol.data_type); break;
+    case WRITE_PARENT:      SetSymbolParentStruct(st, w.symbol.token, RetrieveFrom(st, w.parent)); break;
+  }
+}
+
+static void ReplayWrites(int unit, WriteList *writes) {
+  Incremental.current = unit;
+  Incremental.replaying = true;
+  for (int i = 0; i < writes->count; i++) Replay(writes->data[i]);
+  Incremental.replaying = false;
+  Incremental.current = -1;
+}
+
+/* === Hooks === */
+void UseIncrementalState(const char *path, bool verify) {
+  Incremental.path = path;
+  Incremental.verify = verify;
+}
+
+void BeginIncrementalProgram(const char **filenames, const char **sources, int count, SymbolTable *st) {
+  if (Incremental.path == NULL) return;
+
+  Incremental.enabled = true;
+  Incremental.reuse = true;
+  Incremental.arena = NewArena();
+  Incremental.st = st;
+  Incremental.filenames = filenames;
+  Incremental.file_count = count;
+
+  Incremental.files = ArenaAlloc(Incremental.arena, count * sizeof(LexedFile));
+  memset(Incremental.files, 0, count * sizeof(LexedFile));
+  for (int f = 0; f < count; f++) LexFile(f, filenames[f], sources[f]);
+
+  ReadState();
+  PlanReuse();
+
+  if (Incremental.verify) StartVerifier();
+}
+
+void EndIncrementalParsing() {
+  if (!Incremental.enabled) return;
+
+  PassPlans(Incremental.file_count, 0);
+  PassOldUnits(Incremental.old_count);
+}
+
+void EndIncrementalProgram(SymbolTable *st) {
+  if (!Incremental.enabled) return;
+
+  if (Incremental.is_verifier) {
+    Buffer dump = {0};
+    if (!Incremental.failed) DumpProgram(&dump, st);
+
+    FILE *out = fdopen(Incremental.verifier_fd, "wb");
+    bool ok = !Incremental.failed && fwrite(dump.data, 1, dump.count, out) == dump.count;
+    ok &= (fclose(out) == 0);
+    _exit(ok ? 0 : 1);
+  }
+
+  // Statements that couldn't be told apart leave nothing to compare or save
+  if (Incremental.failed) return;
+
+  if (Incremental.verifier > 0) CheckAgainstVerifier(st);
+  WriteState();
+}
+
+AST_Node *ReuseParsedStatement(Token first, Token *last) {
+  if (!Incremental.reuse || Incremental.failed) return NULL;
+
+  int file, index;
+  if (!LocateToken(first.position_in_source, &file, &index)) return NULL;
+
+  PassPlans(file, index);
+  if (Incremental.next_plan == Incremental.plan_count) return NULL;
+
+  Plan plan = Incremental.plans[Incremental.next_plan];
+  if (plan.file != file || plan.first != index) return NULL;
+  PassOldUnits(plan.old);
+  Incremental.next_old = plan.old + 1;
+  Incremental.next_plan++;
+
+  // Parsed again if it looked up a name set differently now, to be compared with how it was parsed before
+  OldUnit *old = &Incremental.old_units[plan.old];
+  Incremental.pending_old = plan.old;
+  if (AnyChanged(&old->parse_reads)) return NULL;
+
+  Unit u = {
+    .file = file,
+    .first = index,
+    .count = old->count,
+    .old = plan.old,
+    .parse_same = true,
+    .parse_reads = old->parse_reads,
+  };
+
+  Reader r = {.data = old->parsed, .length = old->parsed_length};
+  GetWrites(&r, &u.parse_writes);
+  u.ast = GetStatement(&r);
+  if (r.failed || r.position != r.length || u.ast == NULL) return NULL;
+  Incremental.pending_old = -1;
+
+  ARENA_PUSH(Incremental.arena, Incremental.units, Incremental.unit_count, Incremental.unit_capacity, u);
+  Unit *reused = &Incremental.units[Incremental.unit_count - 1];
+  Incremental.phase = PHASE_PARSE;
+  ReplayWrites(Incremental.unit_count - 1, &reused->parse_writes);
+  Encode(&reused->parsed, &reused->parse_writes, reused->ast);
+
+  LexedToken *end = &Incremental.files[file].tokens[index + old->count - 1];
+  RestoreLexerPosition(end->after);
+  *last = end->token;
+
+  return reused->ast;
+}
+
+void BeginParsingStatement(Token first) {
+  if (!Incremental.enabled || Incremental.failed) return;
+
+  int file, index;
+  if (!LocateToken(first.position_in_source, &file, &index) ||
+      Incremental.files[file].tokens[index].token.position_in_source != first.position_in_source) {
+    Incremental.failed = true;
+    return;
+  }
+
+  Unit u = {.file = file, .first = index, .old = Incremental.pending_old};
+  if (Incremental.reuse && u.old < 0) u.old = OldUnitInPlace();
+  Incremental.pending_old = -1;
+
+  ARENA_PUSH(Incremental.arena, Incremental.units, Incremental.unit_count, Incremental.unit_capacity, u);
+  Incremental.current = Incremental.unit_count - 1;
+  Incremental.phase = PHASE_PARSE;
+}
+
+void EndParsingStatement(Token last, AST_Node *statement) {
+  if (!Incremental.enabled || Incremental.failed || Incremental.current < 0) return;
+
+  Unit *u = &Incremental.units[Incremental.current];
+  Incremental.current = -1;
+
+  int file, index;
+  if (!LocateToken(last.position_in_source, &file, &index) || file != u->file) {
+    Incremental.failed = true;
+    return;
+  }
+
+  u->count = index - u->first + 1;
+  u->ast = statement;
+  Encode(&u->parsed, &u->parse_writes, statement);
+
+  if (u->old < 0) {
+    ChangeAllSet(&u->parse_writes);
+    return;
+  }
+
+  // Its tokens are told apart from those of the one it is compared with, as ASTs and symbols of others may hold them
+  OldUnit *old = &Incremental.old_units[u->old];
+  if (!old->found || old->count != u->count) Align(old, u);
+
+  u->parse_same = CompareWithOld(old, old->parsed, old->parsed_length, &u->parse_writes, &u->parsed);
+}
+
+AST_Node *ReuseCheckedStatement(int statement) {
+  if (!Incremental.enabled || Incremental.failed) return NULL;
+
+  if (statement >= Incremental.unit_count) {
+    Incremental.failed = true;
+    return NULL;
+  }
+
+  Incremental.phase = PHASE_CHECK;
+  Incremental.current = statement;
+
+  Unit *u = &Incremental.units[statement];
+  if (!Incremental.reuse || u->old < 0 || !u->parse_same) return NULL;
+
+  // What it set while being parsed others may have set since, which it wouldn't have counted as looking up
+  OldUnit *old = &Incremental.old_units[u->old];
+  if (AnyChanged(&old->check_reads) || SetsAnyChanged(&u->parse_writes)) return NULL;
+
+  WriteList writes = {0};
+  Reader r = {.data = old->checked, .length = old->checked_length};
+  GetWrites(&r, &writes);
+  AST_Node *checked = GetStatement(&r);
+  if (r.failed || r.position != r.length || checked == NULL) return NULL;
+
+  u->check_reads = old->check_reads;
+  u->check_writes = writes;
+  u->ast = checked;
+  ReplayWrites(statement, &u->check_writes);
+  Encode(&u->checked, &u->check_writes, checked);
+
+  return checked;
+}
+
+void EndCheckingStatement(AST_Node *statement) {
+  if (!Incremental.enabled || Incremental.failed || Incremental.current < 0) return;
+
+  Unit *u = &Incremental.units[Incremental.current];
+  Incremental.current = -1;
+
+  u->ast = statement;
+  Encode(&u->checked, &u->check_writes, statement);
+
+  if (u->old < 0) {
+    ChangeAllSet(&u->check_writes);
+    return;
+  }
+
+  OldUnit *old = &Incremental.old_units[u->old];
+  CompareWithOld(old, old->checked, old->checked_length, &u->check_writes, &u->checked);
+}
+
+void RecordSymbolRead(Token name, int st_index) {
+  if (Incremental.current < 0 || Incremental.replaying || Incremental.failed) return;
+  if (!IsName(name.type)) return;
+
+  // What the statement set itself it knows already
+  if (st_index >= 0 && st_index < Incremental.writer_capacity &&
+      Incremental.writers[st_index] == Incremental.current) {
+    return;
+  }
+
+  Unit *u = &Incremental.units[Incremental.current];
+  AddName((Incremental.phase == PHASE_PARSE) ? &u->parse_reads : &u->check_reads, NameHash(name));
+}
+
+void RecordSymbolWrite(SymbolWriteKind kind, Symbol s, Token parent, int st_index) {
+  if (!Incremental.enabled || st_index < 0) return;
+
+  if (st_index >= Incremental.writer_capacity) {
+    int capacity = (Incremental.writer_capacity == 0) ? 64 : Incremental.writer_capacity;
+    while (capacity <= st_index) capacity *= 2;
+
+    Incremental.writers = realloc(Incremental.writers, capacity * sizeof(int));
+    memset(Incremental.writers + Incremental.writer_capacity, -1, (capacity - Incremental.writer_capacity) * sizeof(int));
+    Incremental.writer_capacity = capacity;
+  }
+
+  // Setting one field of a symbol another statement set leaves it set by both
+  int *writer = &Incremental.writers[st_index];
+  if (Incremental.current < 0) *writer = -1;
+  else if (kind == WRITE_SYMBOL) *writer = Incremental.current;
+  else if (*writer != Incremental.current) *writer = -1;
+
+  if (Incremental.current < 0 || Incremental.replaying || Incremental.failed) return;
+
+  Unit *u = &Incremental.units[Incremental.current];
+  SymbolWrite w = {.kind = kind, .symbol = s, .parent = parent, .is_name = IsName(s.token.type)};
+  if (w.is_name) w.name = NameHash(s.token);
+  WriteList *writes = (Incremental.phase == PHASE_PARSE) ? &u->parse_writes : &u->check_writes;
+  ARENA_PUSH(Incremental.arena, writes->data, writes->count, writes->capacity, w);
+}
@@ -0,0 +1,52 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "symbol_table.h"
+
+/* Incremental recompilation of the front end (--incremental=FILE).
+ *
+ * The unit of reuse is a top-level statement: a function, a struct, an
+ * enum or a global. The state file keeps, for every statement of the last
+ * build, a fingerprint of its tokens, the names it looked up in the symbol
+ * table that another statement had set, while being parsed and while
+ * being checked, and the changes it made to the table and its AST after
+ * each of the two.
+ *
+ * Before parsing, every file is lexed, and the statements of the last
+ * build are found again in the new tokens by their fingerprints, in the
+ * same order. What those that weren't found set is changed. A statement
+ * found again is reused when the parser gets to it if none of the names
+ * it looked up while being parsed were changed: its AST is read back with
+ * its tokens moved to where they are now, and its changes to the table
+ * are made again in the order they were made in. Otherwise it is parsed,
+ * and only the names it sets differently than before are changed, so an
+ * edit to a function's body doesn't reach the statements calling it.
+ * Checking works the same way, for statements parsed just as before.
+ *
+ * The state is written once the program has been checked. With `verify`
+ * set, a child process compiles the same program from scratch, and the
+ * compiler stops with an internal error if the ASTs and symbol tables
+ * differ. */
+void UseIncrementalState(const char *path, bool verify);
+
+void BeginIncrementalProgram(const char **filenames, const char **sources, int count, SymbolTable *st);
+void EndIncrementalParsing();
+void EndIncrementalProgram(SymbolTable *st);
+
+// Called by the parser for every top-level statement; `last` is set to the last token of one reused
+AST_Node *ReuseParsedStatement(Token first, Token *last);
+void BeginParsingStatement(Token first);
+void EndParsingStatement(Token last, AST_Node *statement);
+
+// Called by the type checker for every top-level statement, counted from 0; returns the checked AST of one reused
+AST_Node *ReuseCheckedStatement(int statement);
+void EndCheckingStatement(AST_Node *statement);
+
+// Called by the symbol table for every lookup and change
+void RecordSymbolRead(Token name, int st_index);
+void RecordSymbolWrite(SymbolWriteKind kind, Symbol s, Token parent, int st_index);
+
+#endif
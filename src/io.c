@@ -1,8 +1,8 @@
 #include <errno.h>  // for errno
 #include <stdio.h>  // for fopen et al.
-#include <stdlib.h> // for malloc
 #include <string.h> // for strerror
 
+#include "allocator.h"
 #include "common.h"
 #include "error.h"
 #include "io.h"
@@ -15,7 +15,7 @@ int ReadFile(const char *filename, char **dest) {
   size_t filesize = ftell(fd);
   rewind(fd);
 
-  char *contents = malloc(filesize + ROOM_FOR_NULL_BYTE);
+  char *contents = Allocate(MEM_SOURCE, filesize + ROOM_FOR_NULL_BYTE);
   if (contents == NULL) COMPILER_ERROR_FMTMSG("Not enough memory to read file %s: ", filename, strerror(errno));
 
   size_t bytes_read = fread(contents, sizeof(char), filesize, fd);
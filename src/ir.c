@@ -0,0 +1,820 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "error.h"
+#include "ir.h"
+
+IR_Module *NewIRModule() {
+  Arena *arena = NewArena();
+  IR_Module *m = ArenaAlloc(arena, sizeof(IR_Module));
+  m->arena = arena;
+  m->entry_function = IR_NONE;
+  m->profile_global = IR_NONE;
+
+  return m;
+}
+
+void DeleteIRModule(IR_Module *m) {
+  DeleteArena(m->arena);
+}
+
+int AddIRFunction(IR_Module *m, const char *name, int name_length, IR_Type return_type) {
+  IR_Function fn = {0};
+  fn.name = ArenaCopyString(m->arena, name, name_length);
+  fn.return_type = return_type;
+
+  ARENA_PUSH(m->arena, m->functions, m->function_count, m->function_capacity, fn);
+  return m->function_count - 1;
+}
+
+void AddIRParam(IR_Module *m, IR_Function *fn, IR_Type type) {
+  ARENA_PUSH(m->arena, fn->param_types, fn->param_count, fn->param_capacity, type);
+}
+
+int AddIRGlobal(IR_Module *m, const char *name, int name_length, IR_Type type, int size) {
+  IR_Global g = {0};
+  g.name = ArenaCopyString(m->arena, name, name_length);
+  g.type = type;
+  g.size = size;
+
+  ARENA_PUSH(m->arena, m->globals, m->global_count, m->global_capacity, g);
+  return m->global_count - 1;
+}
+
+int AddIRString(IR_Module *m, const char *data, int length) {
+  for (int i = 0; i < m->string_count; i++) {
+    IR_String *s = &m->strings[i];
+    if (s->length == length && memcmp(s->data, data, length) == 0) return i;
+  }
+
+  IR_String s = {ArenaCopyString(m->arena, data, length), length};
+  ARENA_PUSH(m->arena, m->strings, m->string_count, m->string_capacity, s);
+  return m->string_count - 1;
+}
+
+int FindIRFunction(IR_Module *m, const char *name) {
+  for (int i = 0; i < m->function_count; i++) {
+    if (strcmp(m->functions[i].name, name) == 0) return i;
+  }
+
+  return IR_NONE;
+}
+
+IR_Block NewIRBlock(IR_Module *m, IR_Function *fn) {
+  IR_BasicBlock block = {.count = -1};
+  ARENA_PUSH(m->arena, fn->blocks, fn->block_count, fn->block_capacity, block);
+
+  return fn->block_count - 1;
+}
+
+IR_Value NewIRInst(IR_Module *m, IR_Function *fn, IR_Inst inst) {
+  inst.block = IR_NONE;
+  ARENA_PUSH(m->arena, fn->insts, fn->inst_count, fn->inst_capacity, inst);
+
+  return fn->inst_count - 1;
+}
+
+void AppendIRInst(IR_Module *m, IR_Function *fn, IR_Block block, IR_Value v) {
+  IR_BasicBlock *b = &fn->blocks[block];
+  fn->insts[v].block = block;
+  ARENA_PUSH(m->arena, b->insts, b->inst_count, b->inst_capacity, v);
+}
+
+void InsertIRInst(IR_Module *m, IR_Function *fn, IR_Block block, int position, IR_Value v) {
+  IR_BasicBlock *b = &fn->blocks[block];
+  if (b->inst_count >= b->inst_capacity) {
+    b->insts = ArenaGrowArray(m->arena, b->insts, &b->inst_capacity, sizeof(IR_Value));
+  }
+
+  memmove(&b->insts[position + 1], &b->insts[position], (b->inst_count - position) * sizeof(IR_Value));
+  b->insts[position] = v;
+  b->inst_count++;
+  fn->insts[v].block = block;
+}
+
+IR_Value EmitIR(IR_Module *m, IR_Function *fn, IR_Block block, IR_Inst inst) {
+  IR_Value v = NewIRInst(m, fn, inst);
+  AppendIRInst(m, fn, block, v);
+
+  return v;
+}
+
+IR_Value EmitIRBeforeTerminator(IR_Module *m, IR_Function *fn, IR_Block block, IR_Inst inst) {
+  if (!IRBlockIsTerminated(fn, block)) return EmitIR(m, fn, block, inst);
+
+  IR_Value v = NewIRInst(m, fn, inst);
+  InsertIRInst(m, fn, block, fn->blocks[block].inst_count - 1, v);
+
+  return v;
+}
+
+IR_Value EmitIRPhi(IR_Module *m, IR_Function *fn, IR_Block block, IR_Type type) {
+  IR_Inst phi = {.op = IR_PHI, .type = type, .a = IR_NONE, .b = IR_NONE};
+  IR_Value v = NewIRInst(m, fn, phi);
+
+  IR_BasicBlock *b = &fn->blocks[block];
+  int position = 0;
+  while (position < b->inst_count && fn->insts[b->insts[position]].op == IR_PHI) position++;
+
+  InsertIRInst(m, fn, block, position, v);
+  return v;
+}
+
+void RemoveIRInst(IR_Function *fn, IR_Value v) {
+  IR_Inst *inst = &fn->insts[v];
+
+  if (inst->block != IR_NONE) {
+    IR_BasicBlock *b = &fn->blocks[inst->block];
+    for (int i = 0; i < b->inst_count; i++) {
+      if (b->insts[i] == v) {
+        memmove(&b->insts[i], &b->insts[i + 1], (b->inst_count - i - 1) * sizeof(IR_Value));
+        b->inst_count--;
+        break;
+      }
+    }
+  }
+
+  memset(inst, 0, sizeof(IR_Inst));
+  inst->op = IR_NOP;
+  inst->block = IR_NONE;
+  inst->a = IR_NONE;
+  inst->b = IR_NONE;
+}
+
+/* Moves the instructions of `block` from `position` on into a new block,
+ * which takes over as predecessor of the block's successors. `block` is
+ * left without a terminator. */
+IR_Block SplitIRBlock(IR_Module *m, IR_Function *fn, IR_Block block, int position) {
+  IR_Block tail = NewIRBlock(m, fn);
+  IR_BasicBlock *b = &fn->blocks[block];
+  fn->blocks[tail].count = b->count;
+  for (int i = position; i < b->inst_count; i++) {
+    AppendIRInst(m, fn, tail, b->insts[i]);
+  }
+  b->inst_count = position;
+
+  IR_Block succs[2];
+  int n = IRSuccessors(fn, tail, succs);
+  for (int i = 0; i < n; i++) {
+    if (i == 1 && succs[1] == succs[0]) break;
+
+    IR_BasicBlock *succ = &fn->blocks[succs[i]];
+    for (int p = 0; p < succ->pred_count; p++) {
+      if (succ->preds[p] == block) succ->preds[p] = tail;
+    }
+  }
+
+  return tail;
+}
+
+void SetIRArgs(IR_Module *m, IR_Function *fn, IR_Value v, IR_Value *args, int count) {
+  /* Argument lists are packed into one array per function. Overwriting a
+   * list with one that fits reuses its slots, otherwise a fresh range is
+   * appended at the end. */
+  IR_Inst *inst = &fn->insts[v];
+  if (count > inst->args_count) {
+    inst->args_start = fn->arg_count;
+    for (int i = 0; i < count; i++) {
+      ARENA_PUSH(m->arena, fn->args, fn->arg_count, fn->arg_capacity, IR_NONE);
+    }
+    inst = &fn->insts[v];
+  }
+
+  memmove(&fn->args[inst->args_start], args, count * sizeof(IR_Value));
+  inst->args_count = count;
+}
+
+IR_Value *IRArgs(IR_Function *fn, IR_Value v) {
+  return &fn->args[fn->insts[v].args_start];
+}
+
+void AddIRPredecessor(IR_Module *m, IR_Function *fn, IR_Block block, IR_Block pred) {
+  IR_BasicBlock *b = &fn->blocks[block];
+  ARENA_PUSH(m->arena, b->preds, b->pred_count, b->pred_capacity, pred);
+}
+
+int IRPredecessorIndex(IR_Function *fn, IR_Block block, IR_Block pred) {
+  IR_BasicBlock *b = &fn->blocks[block];
+  for (int i = 0; i < b->pred_count; i++) {
+    if (b->preds[i] == pred) return i;
+  }
+
+  return IR_NONE;
+}
+
+void RemoveIRPredecessor(IR_Function *fn, IR_Block block, IR_Block pred) {
+  int index = IRPredecessorIndex(fn, block, pred);
+  if (index == IR_NONE) return;
+
+  IR_BasicBlock *b = &fn->blocks[block];
+  for (int i = 0; i < b->inst_count; i++) {
+    IR_Inst *inst = &fn->insts[b->insts[i]];
+    if (inst->op != IR_PHI) break;
+
+    IR_Value *args = &fn->args[inst->args_start];
+    memmove(&args[index], &args[index + 1], (inst->args_count - index - 1) * sizeof(IR_Value));
+    inst->args_count--;
+  }
+
+  memmove(&b->preds[index], &b->preds[index + 1], (b->pred_count - index - 1) * sizeof(IR_Block));
+  b->pred_count--;
+}
+
+IR_Inst *IRInst(IR_Function *fn, IR_Value v) {
+  return &fn->insts[v];
+}
+
+IR_Inst *IRTerminator(IR_Function *fn, IR_Block block) {
+  IR_BasicBlock *b = &fn->blocks[block];
+  if (b->inst_count == 0) return NULL;
+
+  IR_Inst *last = &fn->insts[b->insts[b->inst_count - 1]];
+  return IROp_IsTerminator(last->op) ? last : NULL;
+}
+
+bool IRBlockIsTerminated(IR_Function *fn, IR_Block block) {
+  return IRTerminator(fn, block) != NULL;
+}
+
+int IRSuccessors(IR_Function *fn, IR_Block block, IR_Block succs[2]) {
+  IR_Inst *term = IRTerminator(fn, block);
+  if (term == NULL) return 0;
+
+  switch (term->op) {
+    case IR_JUMP:
+      succs[0] = term->target[0];
+      return 1;
+    case IR_BRANCH:
+      succs[0] = term->target[0];
+      succs[1] = term->target[1];
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+/* Collects pointers to every value operand of `v` (a, b and the argument
+ * list) so passes can read or rewrite them uniformly */
+int IRInstOperands(IR_Function *fn, IR_Value v, IR_Value **operands, int max) {
+  IR_Inst *inst = &fn->insts[v];
+  int count = 0;
+
+  if (inst->a != IR_NONE && count < max) operands[count++] = &inst->a;
+  if (inst->b != IR_NONE && count < max) operands[count++] = &inst->b;
+
+  for (int i = 0; i < inst->args_count && count < max; i++) {
+    operands[count++] = &fn->args[inst->args_start + i];
+  }
+
+  return count;
+}
+
+void ReplaceAllIRUses(IR_Function *fn, IR_Value from, IR_Value to) {
+  for (int i = 0; i < fn->inst_count; i++) {
+    IR_Inst *inst = &fn->insts[i];
+    if (inst->op == IR_NOP) continue;
+
+    if (inst->a == from) inst->a = to;
+    if (inst->b == from) inst->b = to;
+    for (int j = 0; j < inst->args_count; j++) {
+      if (fn->args[inst->args_start + j] == from) fn->args[inst->args_start + j] = to;
+    }
+  }
+}
+
+/* Moves every block b to position new_index[b] and rewrites all block
+ * references to match. Blocks mapped to IR_NONE are dropped, nothing live
+ * may refer to them anymore. */
+void RenumberIRBlocks(IR_Function *fn, IR_Block *new_index) {
+  IR_BasicBlock *old = malloc((fn->block_count + 1) * sizeof(IR_BasicBlock));
+  memcpy(old, fn->blocks, fn->block_count * sizeof(IR_BasicBlock));
+
+  int live = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    if (new_index[b] == IR_NONE) continue;
+
+    IR_BasicBlock *block = &old[b];
+    for (int i = 0; i < block->pred_count; i++) {
+      block->preds[i] = new_index[block->preds[i]];
+    }
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Inst *inst = &fn->insts[block->insts[i]];
+      inst->block = new_index[b];
+      if (inst->op == IR_JUMP || inst->op == IR_BRANCH) {
+        inst->target[0] = new_index[inst->target[0]];
+        if (inst->op == IR_BRANCH) inst->target[1] = new_index[inst->target[1]];
+      }
+    }
+
+    fn->blocks[new_index[b]] = *block;
+    live++;
+  }
+  fn->block_count = live;
+
+  free(old);
+}
+
+void RemoveUnreachableIRBlocks(IR_Function *fn) {
+  if (fn->block_count == 0) return;
+
+  bool *reachable = calloc(fn->block_count, sizeof(bool));
+  IR_Block *worklist = malloc(fn->block_count * sizeof(IR_Block));
+  int worklist_count = 0;
+
+  reachable[0] = true;
+  worklist[worklist_count++] = 0;
+  while (worklist_count > 0) {
+    IR_Block b = worklist[--worklist_count];
+    IR_Block succs[2];
+    int n = IRSuccessors(fn, b, succs);
+    for (int i = 0; i < n; i++) {
+      if (!reachable[succs[i]]) {
+        reachable[succs[i]] = true;
+        worklist[worklist_count++] = succs[i];
+      }
+    }
+  }
+
+  // Detach dead blocks from the edges they contribute to live blocks
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    if (reachable[b]) continue;
+
+    IR_Block succs[2];
+    int n = IRSuccessors(fn, b, succs);
+    for (int i = 0; i < n; i++) {
+      if (reachable[succs[i]]) RemoveIRPredecessor(fn, succs[i], b);
+    }
+
+    IR_BasicBlock *block = &fn->blocks[b];
+    while (block->inst_count > 0) {
+      RemoveIRInst(fn, block->insts[block->inst_count - 1]);
+    }
+  }
+
+  // Compact the block array
+  IR_Block *new_index = worklist;
+  int live = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    new_index[b] = reachable[b] ? live++ : IR_NONE;
+  }
+  RenumberIRBlocks(fn, new_index);
+
+  free(worklist);
+  free(reachable);
+}
+
+static IR_Value FindReplacement(IR_Value *replacement, IR_Value v) {
+  while (v != IR_NONE && replacement[v] != IR_NONE) v = replacement[v];
+  return v;
+}
+
+/* Removes phis whose operands are all the same value (ignoring the phi
+ * itself), which SSA construction leaves behind in loops and at joins
+ * where a variable was not redefined. Replacements are resolved in one
+ * sweep over the function instead of one sweep per phi. */
+void RemoveTrivialIRPhis(IR_Function *fn) {
+  IR_Value *replacement = malloc(fn->inst_count * sizeof(IR_Value));
+  for (int i = 0; i < fn->inst_count; i++) replacement[i] = IR_NONE;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (IR_Value v = 0; v < fn->inst_count; v++) {
+      IR_Inst *phi = &fn->insts[v];
+      if (phi->op != IR_PHI || replacement[v] != IR_NONE) continue;
+
+      IR_Value same = IR_NONE;
+      bool trivial = true;
+      for (int i = 0; i < phi->args_count; i++) {
+        IR_Value arg = FindReplacement(replacement, fn->args[phi->args_start + i]);
+        if (arg == v || arg == same) continue;
+        if (same != IR_NONE) {
+          trivial = false;
+          break;
+        }
+        same = arg;
+      }
+
+      if (trivial && same != IR_NONE) {
+        replacement[v] = same;
+        changed = true;
+      }
+    }
+  }
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op == IR_NOP) continue;
+
+    if (inst->a != IR_NONE) inst->a = FindReplacement(replacement, inst->a);
+    if (inst->b != IR_NONE) inst->b = FindReplacement(replacement, inst->b);
+    for (int i = 0; i < inst->args_count; i++) {
+      IR_Value *arg = &fn->args[inst->args_start + i];
+      *arg = FindReplacement(replacement, *arg);
+    }
+  }
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    if (replacement[v] != IR_NONE) RemoveIRInst(fn, v);
+  }
+
+  free(replacement);
+}
+
+/* Removes values that nothing with a side effect depends on, including
+ * phi cycles that only feed each other. Parameters and stack slots stay,
+ * the backends expect them in the entry block, and so do divisions that
+ * may fault, unused or not. */
+void RemoveDeadIRValues(IR_Function *fn) {
+  bool *live = calloc(fn->inst_count + 1, sizeof(bool));
+  IR_Value *worklist = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  int worklist_count = 0;
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op == IR_NOP || inst->block == IR_NONE) continue;
+
+    if (IROp_HasSideEffects(inst->op) || IRInst_MayFault(fn, v) || inst->op == IR_PARAM || inst->op == IR_ALLOCA) {
+      live[v] = true;
+      worklist[worklist_count++] = v;
+    }
+  }
+
+  while (worklist_count > 0) {
+    IR_Inst *inst = &fn->insts[worklist[--worklist_count]];
+
+    for (int i = -2; i < inst->args_count; i++) {
+      IR_Value operand = (i == -2) ? inst->a : (i == -1) ? inst->b : fn->args[inst->args_start + i];
+      if (operand == IR_NONE || live[operand]) continue;
+
+      live[operand] = true;
+      worklist[worklist_count++] = operand;
+    }
+  }
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    if (!live[v] && fn->insts[v].op != IR_NOP) RemoveIRInst(fn, v);
+  }
+
+  free(worklist);
+  free(live);
+}
+
+IR_Inst IRConst(IR_Type type, IR_Imm imm) {
+  IR_Inst inst = {.op = IR_CONST, .type = type, .a = IR_NONE, .b = IR_NONE};
+  inst.imm = IRCanonicalImm(type, imm);
+
+  return inst;
+}
+
+IR_Inst IRUnary(IR_Op op, IR_Type type, IR_Value a) {
+  IR_Inst inst = {.op = op, .type = type, .a = a, .b = IR_NONE};
+  return inst;
+}
+
+IR_Inst IRBinary(IR_Op op, IR_Type type, IR_Value a, IR_Value b) {
+  IR_Inst inst = {.op = op, .type = type, .a = a, .b = b};
+  return inst;
+}
+
+/* Integers are kept sign- or zero-extended to 64 bits according to their
+ * type, f32 constants are kept rounded to single precision */
+IR_Imm IRCanonicalImm(IR_Type type, IR_Imm imm) {
+  IR_Imm result = imm;
+
+  switch (type) {
+    case IRT_BOOL: result.u = (imm.u != 0); break;
+    case IRT_I8:   result.i = (int8_t)imm.u; break;
+    case IRT_I16:  result.i = (int16_t)imm.u; break;
+    case IRT_I32:  result.i = (int32_t)imm.u; break;
+    case IRT_U8:
+    case IRT_CHAR: result.u = (uint8_t)imm.u; break;
+    case IRT_U16:  result.u = (uint16_t)imm.u; break;
+    case IRT_U32:  result.u = (uint32_t)imm.u; break;
+    case IRT_F32:  result.f = (float)imm.f; break;
+    default: break;
+  }
+
+  return result;
+}
+
+IR_Imm IRConvertImm(IR_Type from, IR_Type to, IR_Imm imm) {
+  IR_Imm result = imm;
+
+  if (IRType_IsFloat(from) && !IRType_IsFloat(to)) {
+    if (IRType_IsSigned(to)) result.i = (int64_t)imm.f;
+    else if (to == IRT_BOOL) result.u = (imm.f != 0.0);
+    else result.u = (uint64_t)imm.f;
+  } else if (!IRType_IsFloat(from) && IRType_IsFloat(to)) {
+    result.f = IRType_IsSigned(from) ? (double)imm.i : (double)imm.u;
+  } else if (to == IRT_BOOL) {
+    result.u = (imm.u != 0);
+  }
+
+  return IRCanonicalImm(to, result);
+}
+
+bool IROp_IsTerminator(IR_Op op) {
+  return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN || op == IR_TAIL_CALL || op == IR_UNREACHABLE;
+}
+
+bool IROp_IsBinary(IR_Op op) {
+  return op >= IR_ADD && op <= IR_SHR;
+}
+
+bool IROp_IsComparison(IR_Op op) {
+  return op >= IR_EQ && op <= IR_GE;
+}
+
+bool IROp_HasSideEffects(IR_Op op) {
+  return op == IR_STORE || op == IR_CALL || op == IR_BOUNDS_CHECK || op == IR_PRINT || IROp_IsTerminator(op);
+}
+
+// Integer division faults on a zero divisor, and on -1 when a signed dividend is the smallest value
+bool IRInst_MayFault(IR_Function *fn, IR_Value v) {
+  IR_Inst *inst = &fn->insts[v];
+  if ((inst->op != IR_DIV && inst->op != IR_MOD) || IRType_IsFloat(inst->type)) return false;
+
+  IR_Inst *divisor = &fn->insts[inst->b];
+  return divisor->op != IR_CONST || divisor->imm.i == 0 || (IRType_IsSigned(inst->type) && divisor->imm.i == -1);
+}
+
+int IRType_Size(IR_Type t) {
+  switch (t) {
+    case IRT_VOID: return 0;
+    case IRT_BOOL:
+    case IRT_I8:
+    case IRT_U8:
+    case IRT_CHAR: return 1;
+    case IRT_I16:
+    case IRT_U16:  return 2;
+    case IRT_I32:
+    case IRT_U32:
+    case IRT_F32:  return 4;
+    default:       return 8;
+  }
+}
+
+bool IRType_IsInteger(IR_Type t) {
+  return (t >= IRT_I8 && t <= IRT_U64) || t == IRT_CHAR || t == IRT_BOOL;
+}
+
+bool IRType_IsSigned(IR_Type t) {
+  return t >= IRT_I8 && t <= IRT_I64;
+}
+
+bool IRType_IsFloat(IR_Type t) {
+  return t == IRT_F32 || t == IRT_F64;
+}
+
+const char *IRTypeTranslation(IR_Type t) {
+  switch (t) {
+    case IRT_VOID: return "void";
+    case IRT_BOOL: return "bool";
+    case IRT_I8:   return "i8";
+    case IRT_I16:  return "i16";
+    case IRT_I32:  return "i32";
+    case IRT_I64:  return "i64";
+    case IRT_U8:   return "u8";
+    case IRT_U16:  return "u16";
+    case IRT_U32:  return "u32";
+    case IRT_U64:  return "u64";
+    case IRT_F32:  return "f32";
+    case IRT_F64:  return "f64";
+    case IRT_CHAR: return "char";
+    case IRT_PTR:  return "ptr";
+    default:       return "?";
+  }
+}
+
+const char *IROpTranslation(IR_Op op) {
+  switch (op) {
+    case IR_NOP:          return "nop";
+    case IR_CONST:        return "const";
+    case IR_PARAM:        return "param";
+    case IR_PHI:          return "phi";
+    case IR_STRING:       return "string";
+    case IR_GLOBAL:       return "global";
+    case IR_ALLOCA:       return "alloca";
+    case IR_ADD:          return "add";
+    case IR_SUB:          return "sub";
+    case IR_MUL:          return "mul";
+    case IR_DIV:          return "div";
+    case IR_MOD:          return "mod";
+    case IR_AND:          return "and";
+    case IR_OR:           return "or";
+    case IR_XOR:          return "xor";
+    case IR_SHL:          return "shl";
+    case IR_SHR:          return "shr";
+    case IR_NEG:          return "neg";
+    case IR_NOT:          return "not";
+    case IR_EQ:           return "eq";
+    case IR_NE:           return "ne";
+    case IR_LT:           return "lt";
+    case IR_LE:           return "le";
+    case IR_GT:           return "gt";
+    case IR_GE:           return "ge";
+    case IR_CONVERT:      return "convert";
+    case IR_BROADCAST:    return "broadcast";
+    case IR_REDUCE:       return "reduce";
+    case IR_LOAD:         return "load";
+    case IR_STORE:        return "store";
+    case IR_ELEMENT_PTR:  return "elemptr";
+    case IR_MEMBER_PTR:   return "memberptr";
+    case IR_BOUNDS_CHECK: return "boundscheck";
+    case IR_CALL:         return "call";
+    case IR_PRINT:        return "print";
+    case IR_JUMP:         return "jmp";
+    case IR_BRANCH:       return "br";
+    case IR_RETURN:       return "ret";
+    case IR_TAIL_CALL:    return "tailcall";
+    case IR_UNREACHABLE:  return "unreachable";
+    default:              return "?";
+  }
+}
+
+static void PrintImm(IR_Type type, IR_Imm imm) {
+  if (IRType_IsFloat(type))          Print("%.17g", imm.f);
+  else if (type == IRT_BOOL)         Print("%s", imm.u ? "true" : "false");
+  else if (IRType_IsSigned(type))    Print("%lld", (long long)imm.i);
+  else                               Print("%llu", (unsigned long long)imm.u);
+}
+
+static void PrintEscapedString(const char *s, int length) {
+  Print("\"");
+  for (int i = 0; i < length; i++) {
+    switch (s[i]) {
+      case '\n': Print("\\n"); break;
+      case '\t': Print("\\t"); break;
+      case '\r': Print("\\r"); break;
+      case '\\': Print("\\\\"); break;
+      case '"':  Print("\\\""); break;
+      default:
+        if (s[i] >= 32 && s[i] < 127) Print("%c", s[i]);
+        else Print("\\x%02x", (unsigned char)s[i]);
+        break;
+    }
+  }
+  Print("\"");
+}
+
+// The type of value `v`, "<4 x i32>" for vectors
+static const char *ValueTypeName(IR_Function *fn, IR_Value v, char *buffer, int size) {
+  IR_Inst *inst = &fn->insts[v];
+  if (inst->lanes == 0) return IRTypeTranslation(inst->type);
+
+  snprintf(buffer, size, "<%d x %s>", inst->lanes, IRTypeTranslation(inst->type));
+  return buffer;
+}
+
+static void PrintInst(IR_Module *m, IR_Function *fn, IR_Value v) {
+  IR_Inst *inst = &fn->insts[v];
+  const char *op = IROpTranslation(inst->op);
+  char type_buffer[32], operand_buffer[32];
+  const char *type = ValueTypeName(fn, v, type_buffer, sizeof(type_buffer));
+
+  Print("  ");
+  if (inst->type != IRT_VOID) Print("%%%d = ", v);
+
+  switch (inst->op) {
+    case IR_CONST:
+      Print("%s %s ", op, type);
+      PrintImm(inst->type, inst->imm);
+      break;
+    case IR_PARAM:
+      Print("%s %s %lld", op, type, (long long)inst->imm.i);
+      break;
+    case IR_PHI: {
+      Print("%s %s ", op, type);
+      IR_BasicBlock *b = &fn->blocks[inst->block];
+      for (int i = 0; i < inst->args_count; i++) {
+        IR_Block pred = (i < b->pred_count) ? b->preds[i] : IR_NONE;
+        Print("%s[%%%d, bb%d]", (i > 0) ? ", " : "", fn->args[inst->args_start + i], pred);
+      }
+    } break;
+    case IR_STRING:
+      Print("%s $%lld", op, (long long)inst->imm.i);
+      break;
+    case IR_GLOBAL:
+      Print("%s @%s", op, m->globals[inst->imm.i].name);
+      break;
+    case IR_ALLOCA:
+      Print("%s %lld", op, (long long)inst->imm.i);
+      break;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+      Print("%s %s %%%d, %%%d", op, IRTypeTranslation(fn->insts[inst->a].type), inst->a, inst->b);
+      break;
+    case IR_CONVERT:
+      Print("%s %s %%%d to %s", op, IRTypeTranslation(fn->insts[inst->a].type), inst->a, type);
+      break;
+    case IR_LOAD:
+      Print("%s %s %%%d", op, type, inst->a);
+      break;
+    case IR_STORE:
+      Print("%s %s %%%d, %%%d", op, ValueTypeName(fn, inst->b, operand_buffer, sizeof(operand_buffer)), inst->b, inst->a);
+      break;
+    case IR_REDUCE:
+      Print("%s %s %s %%%d", op, IROpTranslation(inst->imm.i), ValueTypeName(fn, inst->a, operand_buffer, sizeof(operand_buffer)), inst->a);
+      break;
+    case IR_ELEMENT_PTR:
+      Print("%s %%%d, %%%d x %lld", op, inst->a, inst->b, (long long)inst->imm.i);
+      break;
+    case IR_MEMBER_PTR:
+      Print("%s %%%d + %lld", op, inst->a, (long long)inst->imm.i);
+      break;
+    case IR_BOUNDS_CHECK:
+      Print("%s %%%d, %lld", op, inst->a, (long long)inst->imm.i);
+      break;
+    case IR_CALL:
+    case IR_TAIL_CALL:
+      Print("%s %s @%s(", op, IRTypeTranslation(m->functions[inst->imm.i].return_type), m->functions[inst->imm.i].name);
+      for (int i = 0; i < inst->args_count; i++) {
+        Print("%s%%%d", (i > 0) ? ", " : "", fn->args[inst->args_start + i]);
+      }
+      Print(")");
+      break;
+    case IR_PRINT:
+      Print("%s %s %%%d", op, IRTypeTranslation(fn->insts[inst->a].type), inst->a);
+      break;
+    case IR_JUMP:
+      Print("%s bb%d", op, inst->target[0]);
+      break;
+    case IR_BRANCH:
+      Print("%s %%%d, bb%d, bb%d", op, inst->a, inst->target[0], inst->target[1]);
+      break;
+    case IR_RETURN:
+      if (inst->a == IR_NONE) Print("%s", op);
+      else Print("%s %s %%%d", op, IRTypeTranslation(fn->insts[inst->a].type), inst->a);
+      break;
+    case IR_UNREACHABLE:
+    case IR_NOP:
+      Print("%s", op);
+      break;
+    default:
+      if (inst->b != IR_NONE) Print("%s %s %%%d, %%%d", op, type, inst->a, inst->b);
+      else Print("%s %s %%%d", op, type, inst->a);
+      break;
+  }
+
+  Print("\n");
+}
+
+void PrintIRFunction(IR_Module *m, IR_Function *fn) {
+  Print("fn %s(", fn->name);
+  for (int i = 0; i < fn->param_count; i++) {
+    Print("%s%s", (i > 0) ? ", " : "", IRTypeTranslation(fn->param_types[i]));
+  }
+  Print(") -> %s", IRTypeTranslation(fn->return_type));
+
+  if (!fn->is_defined) {
+    Print(";\n");
+    return;
+  }
+  Print(" {\n");
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    Print("bb%d:", b);
+    if (block->pred_count > 0) {
+      Print("%*s; preds:", 8, "");
+      for (int i = 0; i < block->pred_count; i++) Print(" bb%d", block->preds[i]);
+    }
+    if (block->count >= 0) {
+      Print("%s count: %lld", (block->pred_count > 0) ? "," : "        ;", (long long)block->count);
+    }
+    Print("\n");
+
+    for (int i = 0; i < block->inst_count; i++) {
+      PrintInst(m, fn, block->insts[i]);
+    }
+  }
+
+  Print("}\n");
+}
+
+void PrintIRModule(IR_Module *m) {
+  for (int i = 0; i < m->global_count; i++) {
+    IR_Global *g = &m->globals[i];
+    Print("global @%s : %s, %d bytes\n", g->name, (g->type == IRT_VOID) ? "aggregate" : IRTypeTranslation(g->type), g->size);
+  }
+  for (int i = 0; i < m->string_count; i++) {
+    Print("string $%d = ", i);
+    PrintEscapedString(m->strings[i].data, m->strings[i].length);
+    Print("\n");
+  }
+  if (m->global_count > 0 || m->string_count > 0) Print("\n");
+
+  for (int i = 0; i < m->function_count; i++) {
+    if (i > 0) Print("\n");
+    PrintIRFunction(m, &m->functions[i]);
+  }
+}
@@ -0,0 +1,237 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* Crom SSA intermediate representation
+ *
+ * A module owns functions, globals and a string table. A function owns
+ * one flat array of instructions and one flat array of basic blocks;
+ * instructions and blocks refer to each other by index (IR_Value and
+ * IR_Block), never by pointer, and all storage comes from the module's
+ * arena. A basic block is an ordered list of instruction indices: phis
+ * first, exactly one terminator last.
+ *
+ * Every instruction produces at most one value, named by its own index.
+ * Instructions that are deleted become IR_NOP and are dropped from their
+ * block's list, so indices stay stable for the lifetime of the function.
+ *
+ * Scalars (numbers, bools, chars, string pointers) live in SSA values.
+ * Arrays and structs live in memory obtained from IR_ALLOCA (locals) or
+ * IR_GLOBAL (globals), both of which are zero-initialized.
+ *
+ * Values with `lanes` set are vectors of that many elements of their type,
+ * made by the loop vectorizer (ir_vectorize.h). Arithmetic, loads, stores
+ * and phis work on them element-wise; a vector load or store covers
+ * `lanes` consecutive elements starting at its address. */
+
+#define IR_NONE (-1)
+
+typedef int32_t IR_Value;
+typedef int32_t IR_Block;
+
+typedef enum {
+  IRT_VOID,
+  IRT_BOOL,
+  IRT_I8, IRT_I16, IRT_I32, IRT_I64,
+  IRT_U8, IRT_U16, IRT_U32, IRT_U64,
+  IRT_F32, IRT_F64,
+  IRT_CHAR,
+  IRT_PTR,
+  IRT_COUNT,
+} IR_Type;
+
+typedef enum {
+  IR_NOP,
+
+  // Values
+  IR_CONST,       // imm
+  IR_PARAM,       // imm.i = parameter index
+  IR_PHI,         // args = one incoming value per predecessor, in predecessor order
+  IR_STRING,      // imm.i = index into the module string table
+  IR_GLOBAL,      // imm.i = index into the module globals
+  IR_ALLOCA,      // imm.i = size in bytes
+
+  // Arithmetic and bitwise ops; operands have the same type as the result
+  IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD,
+  IR_AND, IR_OR, IR_XOR, IR_SHL, IR_SHR,
+  IR_NEG, IR_NOT,
+
+  // Comparisons; operands share a type, the result is bool
+  IR_EQ, IR_NE, IR_LT, IR_LE, IR_GT, IR_GE,
+
+  IR_CONVERT,     // a converted to the instruction type
+
+  // Vectors
+  IR_BROADCAST,   // a = scalar, copied into every lane
+  IR_REDUCE,      // a = vector, its lanes combined by imm.i = IR_ADD, IR_MUL, IR_AND, IR_OR or IR_XOR
+
+  // Memory
+  IR_LOAD,        // a = address
+  IR_STORE,       // a = address, b = value
+  IR_ELEMENT_PTR, // a = base address, b = i64 index, imm.i = element size
+  IR_MEMBER_PTR,  // a = base address, imm.i = byte offset
+  IR_BOUNDS_CHECK,// a = i64 index, imm.i = array length
+
+  IR_CALL,        // imm.i = callee function index, args = arguments
+  IR_PRINT,       // a = value, written to stdout followed by a newline
+
+  // Terminators
+  IR_JUMP,        // target[0]
+  IR_BRANCH,      // a = bool condition, target[0] if true, target[1] if false
+  IR_RETURN,      // a = value, or IR_NONE
+  IR_TAIL_CALL,   // imm.i = callee function index, args = arguments; returns whatever the callee returns
+  IR_UNREACHABLE,
+
+  IR_OP_COUNT
+} IR_Op;
+
+typedef union {
+  int64_t  i;
+  uint64_t u;
+  double   f;
+} IR_Imm;
+
+typedef struct {
+  IR_Op    op;
+  IR_Type  type;
+  uint8_t  lanes; // 0 for scalars
+  IR_Block block;
+
+  IR_Value a, b;
+  int32_t  args_start;
+  int32_t  args_count;
+  IR_Block target[2];
+
+  IR_Imm imm;
+} IR_Inst;
+
+typedef struct {
+  IR_Value *insts;
+  int inst_count, inst_capacity;
+
+  IR_Block *preds;
+  int pred_count, pred_capacity;
+
+  int64_t count; // times run according to the profile (ir_profile.h), -1 if unknown
+} IR_BasicBlock;
+
+typedef struct {
+  char *name;
+  bool is_entry;
+  bool is_defined;
+  bool requires_tail_calls; // declared 'tailrec'
+
+  IR_Type return_type;
+  IR_Type *param_types;
+  int param_count, param_capacity;
+
+  IR_Inst *insts;
+  int inst_count, inst_capacity;
+
+  IR_Value *args;
+  int arg_count, arg_capacity;
+
+  IR_BasicBlock *blocks;
+  int block_count, block_capacity;
+} IR_Function;
+
+typedef struct {
+  char *name;
+  IR_Type type; // element type for scalars, IRT_VOID for aggregates
+  int size;
+} IR_Global;
+
+typedef struct {
+  char *data;
+  int length;
+} IR_String;
+
+typedef struct {
+  Arena *arena;
+
+  IR_Function *functions;
+  int function_count, function_capacity;
+
+  IR_Global *globals;
+  int global_count, global_capacity;
+
+  IR_String *strings;
+  int string_count, string_capacity;
+
+  int entry_function;
+
+  // Counters written to `profile_path` on exit, or IR_NONE (ir_profile.h)
+  int profile_global;
+  const char *profile_path;
+
+  // Whether block counts come from a profile, and the highest of them
+  bool has_profile;
+  int64_t profile_max;
+} IR_Module;
+
+IR_Module *NewIRModule();
+void DeleteIRModule(IR_Module *m);
+
+int AddIRFunction(IR_Module *m, const char *name, int name_length, IR_Type return_type);
+void AddIRParam(IR_Module *m, IR_Function *fn, IR_Type type);
+int AddIRGlobal(IR_Module *m, const char *name, int name_length, IR_Type type, int size);
+int AddIRString(IR_Module *m, const char *data, int length);
+int FindIRFunction(IR_Module *m, const char *name);
+
+IR_Block NewIRBlock(IR_Module *m, IR_Function *fn);
+IR_Value NewIRInst(IR_Module *m, IR_Function *fn, IR_Inst inst);
+void AppendIRInst(IR_Module *m, IR_Function *fn, IR_Block block, IR_Value v);
+void InsertIRInst(IR_Module *m, IR_Function *fn, IR_Block block, int position, IR_Value v);
+IR_Value EmitIR(IR_Module *m, IR_Function *fn, IR_Block block, IR_Inst inst);
+IR_Value EmitIRBeforeTerminator(IR_Module *m, IR_Function *fn, IR_Block block, IR_Inst inst);
+IR_Value EmitIRPhi(IR_Module *m, IR_Function *fn, IR_Block block, IR_Type type);
+void RemoveIRInst(IR_Function *fn, IR_Value v);
+IR_Block SplitIRBlock(IR_Module *m, IR_Function *fn, IR_Block block, int position);
+
+void SetIRArgs(IR_Module *m, IR_Function *fn, IR_Value v, IR_Value *args, int count);
+IR_Value *IRArgs(IR_Function *fn, IR_Value v);
+
+void AddIRPredecessor(IR_Module *m, IR_Function *fn, IR_Block block, IR_Block pred);
+void RemoveIRPredecessor(IR_Function *fn, IR_Block block, IR_Block pred);
+int IRPredecessorIndex(IR_Function *fn, IR_Block block, IR_Block pred);
+
+IR_Inst *IRInst(IR_Function *fn, IR_Value v);
+IR_Inst *IRTerminator(IR_Function *fn, IR_Block block);
+bool IRBlockIsTerminated(IR_Function *fn, IR_Block block);
+int IRSuccessors(IR_Function *fn, IR_Block block, IR_Block succs[2]);
+int IRInstOperands(IR_Function *fn, IR_Value v, IR_Value **operands, int max);
+
+void ReplaceAllIRUses(IR_Function *fn, IR_Value from, IR_Value to);
+void RenumberIRBlocks(IR_Function *fn, IR_Block *new_index);
+void RemoveUnreachableIRBlocks(IR_Function *fn);
+void RemoveTrivialIRPhis(IR_Function *fn);
+void RemoveDeadIRValues(IR_Function *fn);
+
+IR_Inst IRConst(IR_Type type, IR_Imm imm);
+IR_Inst IRUnary(IR_Op op, IR_Type type, IR_Value a);
+IR_Inst IRBinary(IR_Op op, IR_Type type, IR_Value a, IR_Value b);
+IR_Imm IRCanonicalImm(IR_Type type, IR_Imm imm);
+IR_Imm IRConvertImm(IR_Type from, IR_Type to, IR_Imm imm);
+
+bool IROp_IsTerminator(IR_Op op);
+bool IROp_IsBinary(IR_Op op);
+bool IROp_IsComparison(IR_Op op);
+bool IROp_HasSideEffects(IR_Op op);
+bool IRInst_MayFault(IR_Function *fn, IR_Value v);
+
+int  IRType_Size(IR_Type t);
+bool IRType_IsInteger(IR_Type t);
+bool IRType_IsSigned(IR_Type t);
+bool IRType_IsFloat(IR_Type t);
+
+const char *IRTypeTranslation(IR_Type t);
+const char *IROpTranslation(IR_Op op);
+
+void PrintIRFunction(IR_Module *m, IR_Function *fn);
+void PrintIRModule(IR_Module *m);
+
+#endif
@@ -0,0 +1,280 @@
+#include <stdlib.h>
+
+#include "ir_analysis.h"
+
+static void ComputeReversePostorder(IR_Function *fn, IR_DomTree *dom) {
+  int n = fn->block_count;
+  bool *visited = calloc(n, sizeof(bool));
+  IR_Block *stack = malloc(n * sizeof(IR_Block));
+  int *next_succ = calloc(n, sizeof(int));
+  IR_Block *postorder = malloc(n * sizeof(IR_Block));
+  int post_count = 0;
+  int top = 0;
+
+  // Iterative DFS, so deeply nested programs don't overflow the C stack
+  stack[top++] = 0;
+  visited[0] = true;
+  while (top > 0) {
+    IR_Block b = stack[top - 1];
+    IR_Block succs[2];
+    int succ_count = IRSuccessors(fn, b, succs);
+
+    if (next_succ[b] < succ_count) {
+      IR_Block s = succs[next_succ[b]++];
+      if (!visited[s]) {
+        visited[s] = true;
+        stack[top++] = s;
+      }
+      continue;
+    }
+
+    postorder[post_count++] = b;
+    top--;
+  }
+
+  dom->rpo_count = post_count;
+  for (int i = 0; i < n; i++) dom->rpo_index[i] = IR_NONE;
+  for (int i = 0; i < post_count; i++) {
+    IR_Block b = postorder[post_count - 1 - i];
+    dom->rpo[i] = b;
+    dom->rpo_index[b] = i;
+  }
+
+  free(postorder);
+  free(next_succ);
+  free(stack);
+  free(visited);
+}
+
+static IR_Block Intersect(IR_DomTree *dom, IR_Block a, IR_Block b) {
+  while (a != b) {
+    while (dom->rpo_index[a] > dom->rpo_index[b]) a = dom->idom[a];
+    while (dom->rpo_index[b] > dom->rpo_index[a]) b = dom->idom[b];
+  }
+
+  return a;
+}
+
+static void NumberDominatorTree(IR_DomTree *dom) {
+  int n = dom->block_count;
+  int *first_child = malloc(n * sizeof(int));
+  int *next_sibling = malloc(n * sizeof(int));
+  for (int i = 0; i < n; i++) {
+    first_child[i] = IR_NONE;
+    next_sibling[i] = IR_NONE;
+    dom->pre[i] = IR_NONE;
+    dom->post[i] = IR_NONE;
+  }
+
+  for (int i = dom->rpo_count - 1; i > 0; i--) {
+    IR_Block b = dom->rpo[i];
+    IR_Block parent = dom->idom[b];
+    next_sibling[b] = first_child[parent];
+    first_child[parent] = b;
+  }
+
+  IR_Block *stack = malloc(n * sizeof(IR_Block));
+  int *cursor = malloc(n * sizeof(int));
+  int top = 0;
+  int counter = 0;
+
+  stack[top++] = 0;
+  cursor[0] = first_child[0];
+  dom->pre[0] = counter++;
+  while (top > 0) {
+    IR_Block b = stack[top - 1];
+    IR_Block child = cursor[b];
+
+    if (child != IR_NONE) {
+      cursor[b] = next_sibling[child];
+      dom->pre[child] = counter++;
+      cursor[child] = first_child[child];
+      stack[top++] = child;
+      continue;
+    }
+
+    dom->post[b] = counter++;
+    top--;
+  }
+
+  free(cursor);
+  free(stack);
+  free(next_sibling);
+  free(first_child);
+}
+
+/* Cooper, Harvey & Kennedy, "A Simple, Fast Dominance Algorithm" */
+void ComputeIRDominators(IR_Function *fn, IR_DomTree *dom) {
+  int n = fn->block_count;
+  dom->block_count = n;
+  dom->rpo = malloc(n * sizeof(IR_Block));
+  dom->rpo_index = malloc(n * sizeof(int));
+  dom->idom = malloc(n * sizeof(IR_Block));
+  dom->pre = malloc(n * sizeof(int));
+  dom->post = malloc(n * sizeof(int));
+
+  if (n == 0) {
+    dom->rpo_count = 0;
+    return;
+  }
+
+  ComputeReversePostorder(fn, dom);
+
+  for (int i = 0; i < n; i++) dom->idom[i] = IR_NONE;
+  dom->idom[0] = 0;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (int i = 1; i < dom->rpo_count; i++) {
+      IR_Block b = dom->rpo[i];
+      IR_BasicBlock *block = &fn->blocks[b];
+      IR_Block new_idom = IR_NONE;
+
+      for (int p = 0; p < block->pred_count; p++) {
+        IR_Block pred = block->preds[p];
+        if (dom->rpo_index[pred] == IR_NONE || dom->idom[pred] == IR_NONE) continue;
+
+        new_idom = (new_idom == IR_NONE) ? pred : Intersect(dom, pred, new_idom);
+      }
+
+      if (dom->idom[b] != new_idom) {
+        dom->idom[b] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  NumberDominatorTree(dom);
+  dom->idom[0] = IR_NONE;
+}
+
+void FreeIRDominators(IR_DomTree *dom) {
+  free(dom->rpo);
+  free(dom->rpo_index);
+  free(dom->idom);
+  free(dom->pre);
+  free(dom->post);
+}
+
+bool IRBlockIsReachable(IR_DomTree *dom, IR_Block b) {
+  return dom->rpo_index[b] != IR_NONE;
+}
+
+bool IRDominates(IR_DomTree *dom, IR_Block a, IR_Block b) {
+  if (!IRBlockIsReachable(dom, a) || !IRBlockIsReachable(dom, b)) return false;
+  return dom->pre[a] <= dom->pre[b] && dom->post[b] <= dom->post[a];
+}
+
+static int CompareLoopSize(const void *a, const void *b) {
+  return ((const IR_Loop *)a)->block_count - ((const IR_Loop *)b)->block_count;
+}
+
+/* Back edges are edges into a block that dominates their source. Loops
+ * sharing a header are merged; irreducible cycles have no such header and
+ * are not reported. */
+void ComputeIRLoops(IR_Function *fn, IR_DomTree *dom, IR_LoopForest *forest) {
+  int n = fn->block_count;
+  forest->loops = malloc((n + 1) * sizeof(IR_Loop));
+  forest->loop_count = 0;
+
+  IR_Block *worklist = malloc((n + 1) * sizeof(IR_Block));
+
+  for (int r = 0; r < dom->rpo_count; r++) {
+    IR_Block header = dom->rpo[r];
+    IR_BasicBlock *block = &fn->blocks[header];
+
+    IR_Loop loop = {.header = header, .parent = IR_NONE, .is_innermost = true};
+    for (int p = 0; p < block->pred_count; p++) {
+      IR_Block pred = block->preds[p];
+      if (!IRDominates(dom, header, pred)) continue;
+
+      if (loop.latches == NULL) loop.latches = malloc(block->pred_count * sizeof(IR_Block));
+      loop.latches[loop.latch_count++] = pred;
+    }
+    if (loop.latch_count == 0) continue;
+
+    loop.contains = calloc(n, sizeof(bool));
+    loop.contains[header] = true;
+
+    int worklist_count = 0;
+    for (int i = 0; i < loop.latch_count; i++) {
+      if (!loop.contains[loop.latches[i]]) {
+        loop.contains[loop.latches[i]] = true;
+        worklist[worklist_count++] = loop.latches[i];
+      }
+    }
+    while (worklist_count > 0) {
+      IR_BasicBlock *b = &fn->blocks[worklist[--worklist_count]];
+      for (int p = 0; p < b->pred_count; p++) {
+        IR_Block pred = b->preds[p];
+        if (loop.contains[pred] || !IRBlockIsReachable(dom, pred)) continue;
+
+        loop.contains[pred] = true;
+        worklist[worklist_count++] = pred;
+      }
+    }
+
+    loop.blocks = malloc(n * sizeof(IR_Block));
+    for (int i = r; i < dom->rpo_count; i++) {
+      if (loop.contains[dom->rpo[i]]) loop.blocks[loop.block_count++] = dom->rpo[i];
+    }
+
+    forest->loops[forest->loop_count++] = loop;
+  }
+
+  // A loop nested in another has fewer blocks, so sorting by size puts inner loops first
+  qsort(forest->loops, forest->loop_count, sizeof(IR_Loop), CompareLoopSize);
+
+  for (int i = 0; i < forest->loop_count; i++) {
+    IR_Loop *loop = &forest->loops[i];
+    for (int j = i + 1; j < forest->loop_count && loop->parent == IR_NONE; j++) {
+      if (forest->loops[j].contains[loop->header]) loop->parent = j;
+    }
+    if (loop->parent != IR_NONE) forest->loops[loop->parent].is_innermost = false;
+  }
+
+  free(worklist);
+}
+
+void FreeIRLoops(IR_LoopForest *forest) {
+  for (int i = 0; i < forest->loop_count; i++) {
+    free(forest->loops[i].blocks);
+    free(forest->loops[i].contains);
+    free(forest->loops[i].latches);
+  }
+  free(forest->loops);
+}
+
+// Blocks added since `dom` was computed lie outside every loop
+IR_Block FindIRPreheader(IR_Function *fn, IR_DomTree *dom, IR_Loop *loop) {
+  IR_BasicBlock *header = &fn->blocks[loop->header];
+  IR_Block outside = IR_NONE;
+
+  for (int p = 0; p < header->pred_count; p++) {
+    IR_Block pred = header->preds[p];
+    if (pred < dom->block_count && loop->contains[pred]) continue;
+    if (outside != IR_NONE) return IR_NONE;
+    outside = pred;
+  }
+
+  if (outside == IR_NONE || IRTerminator(fn, outside)->op != IR_JUMP) return IR_NONE;
+  return outside;
+}
+
+IR_Value IRAddressRoot(IR_Function *fn, IR_Value address) {
+  IR_Inst *inst = &fn->insts[address];
+  while (inst->op == IR_ELEMENT_PTR || inst->op == IR_MEMBER_PTR) {
+    address = inst->a;
+    inst = &fn->insts[address];
+  }
+
+  return (inst->op == IR_ALLOCA || inst->op == IR_GLOBAL) ? address : IR_NONE;
+}
+
+bool IRSameRoot(IR_Function *fn, IR_Value a, IR_Value b) {
+  IR_Inst *x = &fn->insts[a];
+  IR_Inst *y = &fn->insts[b];
+  return a == b || (x->op == IR_GLOBAL && y->op == IR_GLOBAL && x->imm.i == y->imm.i);
+}
@@ -0,0 +1,62 @@
+#ifndef IR_ANALYSIS_H
+#define IR_ANALYSIS_H
+
+#include <stdbool.h>
+
+#include "ir.h"
+
+/* Control flow analyses over an IR_Function. Results are heap allocated
+ * and describe the function as it was when they were computed; passes
+ * that change the CFG must recompute them. */
+
+typedef struct {
+  int block_count;
+
+  IR_Block *rpo;      // reachable blocks in reverse postorder
+  int rpo_count;
+  int *rpo_index;     // position of each block in rpo, or IR_NONE if unreachable
+
+  IR_Block *idom;     // immediate dominator of each block, IR_NONE for entry/unreachable
+
+  // Dominator tree pre/post numbering, for constant time dominance queries
+  int *pre;
+  int *post;
+} IR_DomTree;
+
+/* A natural loop: the header and every block that reaches one of its back
+ * edges without passing through the header */
+typedef struct {
+  IR_Block header;
+  IR_Block *blocks;   // header first, the rest in reverse postorder
+  int block_count;
+  bool *contains;     // per block
+
+  IR_Block *latches;  // sources of the back edges
+  int latch_count;
+
+  int parent;         // innermost enclosing loop, or IR_NONE
+  bool is_innermost;
+} IR_Loop;
+
+typedef struct {
+  IR_Loop *loops;     // inner loops come before the loops containing them
+  int loop_count;
+} IR_LoopForest;
+
+void ComputeIRDominators(IR_Function *fn, IR_DomTree *dom);
+void FreeIRDominators(IR_DomTree *dom);
+bool IRDominates(IR_DomTree *dom, IR_Block a, IR_Block b);
+bool IRBlockIsReachable(IR_DomTree *dom, IR_Block b);
+
+void ComputeIRLoops(IR_Function *fn, IR_DomTree *dom, IR_LoopForest *forest);
+void FreeIRLoops(IR_LoopForest *forest);
+
+// The loop's only predecessor from outside, if it does nothing but jump to the header
+IR_Block FindIRPreheader(IR_Function *fn, IR_DomTree *dom, IR_Loop *loop);
+
+// The alloca or global an address points into, or IR_NONE
+IR_Value IRAddressRoot(IR_Function *fn, IR_Value address);
+// Whether two roots are the same memory, as two loads of one global are
+bool IRSameRoot(IR_Function *fn, IR_Value a, IR_Value b);
+
+#endif
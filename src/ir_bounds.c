@@ -0,0 +1,415 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "ir_analysis.h"
+#include "ir_bounds.h"
+
+// A range query answers with the range of the type after this many steps
+#define QUERY_BUDGET 512
+#define MAX_DEPTH 16
+
+typedef struct {
+  int64_t lo, hi; // empty if lo > hi
+} Range;
+
+static const Range FULL = {INT64_MIN, INT64_MAX};
+static const Range EMPTY = {INT64_MAX, INT64_MIN};
+
+// Loop phis are assumed to stay in a range while checking that they do
+typedef struct {
+  IR_Value phi;
+  Range range;
+} Assumption;
+
+static struct {
+  IR_Function *fn;
+  IR_DomTree dom;
+
+  int *position;          // of every instruction within its block
+  IR_Value *first_check;  // per value, a bounds check of it
+  IR_Value *next_check;   // per bounds check, the next one of the same index
+
+  // Phi ranges don't depend on where they are asked for, unless worked out under assumptions
+  Range *phi_ranges;
+  bool *phi_known;
+
+  // Values whose facts are being gathered; conditions comparing against them are skipped
+  int *narrowing;
+
+  Assumption assumptions[MAX_DEPTH];
+  int assumption_count;
+  int budget;
+} Bounds;
+
+/* === Ranges === */
+
+static bool IsEmpty(Range r) {
+  return r.lo > r.hi;
+}
+
+static bool Contains(Range outer, Range inner) {
+  return IsEmpty(inner) || (outer.lo <= inner.lo && inner.hi <= outer.hi);
+}
+
+static Range Intersect(Range a, Range b) {
+  return (Range){a.lo > b.lo ? a.lo : b.lo, a.hi < b.hi ? a.hi : b.hi};
+}
+
+static Range Union(Range a, Range b) {
+  if (IsEmpty(a)) return b;
+  if (IsEmpty(b)) return a;
+  return (Range){a.lo < b.lo ? a.lo : b.lo, a.hi > b.hi ? a.hi : b.hi};
+}
+
+// u64 doesn't fit the signed bounds, so nothing is known about it
+static bool IsTracked(IR_Type t) {
+  return IRType_IsInteger(t) && t != IRT_U64;
+}
+
+static Range TypeRange(IR_Type t) {
+  switch (t) {
+    case IRT_BOOL: return (Range){0, 1};
+    case IRT_I8:   return (Range){INT8_MIN, INT8_MAX};
+    case IRT_I16:  return (Range){INT16_MIN, INT16_MAX};
+    case IRT_I32:  return (Range){INT32_MIN, INT32_MAX};
+    case IRT_CHAR:
+    case IRT_U8:   return (Range){0, UINT8_MAX};
+    case IRT_U16:  return (Range){0, UINT16_MAX};
+    case IRT_U32:  return (Range){0, UINT32_MAX};
+    default:       return FULL;
+  }
+}
+
+// Results outside the type wrap around, to anywhere in it
+static Range Fit(Range r, IR_Type t) {
+  return Contains(TypeRange(t), r) ? r : TypeRange(t);
+}
+
+static int64_t Min4(int64_t a, int64_t b, int64_t c, int64_t d) {
+  int64_t ab = a < b ? a : b, cd = c < d ? c : d;
+  return ab < cd ? ab : cd;
+}
+
+static int64_t Max4(int64_t a, int64_t b, int64_t c, int64_t d) {
+  int64_t ab = a > b ? a : b, cd = c > d ? c : d;
+  return ab > cd ? ab : cd;
+}
+
+// The smallest 2^n - 1 that is at least x, for x >= 0
+static int64_t LowBitsMask(int64_t x) {
+  int64_t mask = 0;
+  while (mask < x) mask = (mask << 1) | 1;
+  return mask;
+}
+
+static Range Arithmetic(IR_Op op, Range a, Range b) {
+  if (IsEmpty(a) || IsEmpty(b)) return EMPTY;
+  Range r;
+
+  switch (op) {
+    case IR_ADD:
+      if (__builtin_add_overflow(a.lo, b.lo, &r.lo) || __builtin_add_overflow(a.hi, b.hi, &r.hi)) return FULL;
+      return r;
+    case IR_SUB:
+      if (__builtin_sub_overflow(a.lo, b.hi, &r.lo) || __builtin_sub_overflow(a.hi, b.lo, &r.hi)) return FULL;
+      return r;
+    case IR_MUL: {
+      int64_t c[4];
+      if (__builtin_mul_overflow(a.lo, b.lo, &c[0]) || __builtin_mul_overflow(a.lo, b.hi, &c[1]) ||
+          __builtin_mul_overflow(a.hi, b.lo, &c[2]) || __builtin_mul_overflow(a.hi, b.hi, &c[3])) {
+        return FULL;
+      }
+      return (Range){Min4(c[0], c[1], c[2], c[3]), Max4(c[0], c[1], c[2], c[3])};
+    }
+    case IR_DIV:
+      if (b.lo <= 0) return FULL;
+      return (Range){Min4(a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi),
+                     Max4(a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi)};
+    case IR_MOD:
+      if (b.lo <= 0) return FULL;
+      r.lo = (a.lo >= 0) ? 0 : (a.lo > 1 - b.hi ? a.lo : 1 - b.hi);
+      r.hi = (a.hi <= 0) ? 0 : (a.hi < b.hi - 1 ? a.hi : b.hi - 1);
+      return r;
+    case IR_AND:
+      if (a.lo >= 0 && b.lo >= 0) return (Range){0, a.hi < b.hi ? a.hi : b.hi};
+      if (a.lo >= 0) return (Range){0, a.hi};
+      if (b.lo >= 0) return (Range){0, b.hi};
+      return FULL;
+    case IR_OR:
+    case IR_XOR:
+      if (a.lo < 0 || b.lo < 0) return FULL;
+      return (Range){0, LowBitsMask(a.hi > b.hi ? a.hi : b.hi)};
+    case IR_SHR:
+      if (a.lo < 0 || b.lo != b.hi || b.lo < 0 || b.lo > 63) return FULL;
+      return (Range){a.lo >> b.lo, a.hi >> b.lo};
+    default:
+      return FULL;
+  }
+}
+
+/* === Range analysis === */
+
+static bool SameValue(IR_Value a, IR_Value b, int depth) {
+  if (a == b) return true;
+  if (depth == 0) return false;
+
+  IR_Inst *x = &Bounds.fn->insts[a];
+  IR_Inst *y = &Bounds.fn->insts[b];
+  if (x->op != y->op || x->type != y->type || x->lanes != 0 || y->lanes != 0) return false;
+
+  if (x->op == IR_CONST) return x->imm.i == y->imm.i;
+  if (x->op == IR_CONVERT || x->op == IR_NEG) return SameValue(x->a, y->a, depth - 1);
+  if (!IROp_IsBinary(x->op) || IROp_IsComparison(x->op)) return false;
+
+  return SameValue(x->a, y->a, depth - 1) && SameValue(x->b, y->b, depth - 1);
+}
+
+static IR_Op SwappedComparison(IR_Op op) {
+  switch (op) {
+    case IR_LT: return IR_GT;
+    case IR_LE: return IR_GE;
+    case IR_GT: return IR_LT;
+    case IR_GE: return IR_LE;
+    default:    return op;
+  }
+}
+
+static IR_Op NegatedComparison(IR_Op op) {
+  switch (op) {
+    case IR_EQ: return IR_NE;
+    case IR_NE: return IR_EQ;
+    case IR_LT: return IR_GE;
+    case IR_LE: return IR_GT;
+    case IR_GT: return IR_LE;
+    case IR_GE: return IR_LT;
+    default:    return op;
+  }
+}
+
+static Range RangeAt(IR_Value v, IR_Block block, int position, int depth);
+
+// What `cond` being `holds` says about v
+static Range Condition(IR_Value cond, bool holds, IR_Value v, IR_Block block, int position, int depth) {
+  IR_Inst *compare = &Bounds.fn->insts[cond];
+  if (!IROp_IsComparison(compare->op) || !IsTracked(Bounds.fn->insts[compare->a].type)) return FULL;
+
+  IR_Op op = compare->op;
+  IR_Value other;
+  if (SameValue(compare->a, v, 2)) {
+    other = compare->b;
+  } else if (SameValue(compare->b, v, 2)) {
+    other = compare->a;
+    op = SwappedComparison(op);
+  } else {
+    return FULL;
+  }
+  if (Bounds.narrowing[other] > 0) return FULL;
+  if (!holds) op = NegatedComparison(op);
+
+  Range r = RangeAt(other, block, position, depth + 1);
+  if (IsEmpty(r)) return EMPTY;
+
+  switch (op) {
+    case IR_EQ: return r;
+    case IR_LT: return (r.hi == INT64_MIN) ? EMPTY : (Range){INT64_MIN, r.hi - 1};
+    case IR_LE: return (Range){INT64_MIN, r.hi};
+    case IR_GT: return (r.lo == INT64_MAX) ? EMPTY : (Range){r.lo + 1, INT64_MAX};
+    case IR_GE: return (Range){r.lo, INT64_MAX};
+    default:    return FULL;
+  }
+}
+
+// Narrows r down with the checks and branches that v passed to get to the point
+static Range Facts(IR_Value v, Range r, IR_Block block, int position, int depth) {
+  IR_Function *fn = Bounds.fn;
+
+  for (IR_Value c = Bounds.first_check[v]; c != IR_NONE; c = Bounds.next_check[c]) {
+    IR_Block b = fn->insts[c].block;
+    bool passed = (b == block) ? Bounds.position[c] < position : IRDominates(&Bounds.dom, b, block);
+    if (passed) r = Intersect(r, (Range){0, fn->insts[c].imm.i - 1});
+  }
+
+  // Blocks with one predecessor are reached through one edge of the branch that ends it
+  Bounds.narrowing[v]++;
+  for (IR_Block b = block; Bounds.dom.idom[b] != IR_NONE && !IsEmpty(r); b = Bounds.dom.idom[b]) {
+    IR_Inst *term = IRTerminator(fn, Bounds.dom.idom[b]);
+    if (fn->blocks[b].pred_count != 1 || term == NULL || term->op != IR_BRANCH) continue;
+    if (term->target[0] == term->target[1]) continue;
+
+    r = Intersect(r, Condition(term->a, term->target[0] == b, v, block, position, depth));
+  }
+  Bounds.narrowing[v]--;
+
+  return r;
+}
+
+/* A loop phi is assumed to stay at or above the values it enters the loop
+ * with, which holds if every value it gets on the way around does too;
+ * failing that, at or below. */
+static Range LoopPhiRange(IR_Value v, int depth) {
+  IR_Function *fn = Bounds.fn;
+  IR_Inst *inst = &fn->insts[v];
+  IR_BasicBlock *header = &fn->blocks[inst->block];
+  IR_Value *args = IRArgs(fn, v);
+
+  for (int i = 0; i < Bounds.assumption_count; i++) {
+    if (Bounds.assumptions[i].phi == v) return Bounds.assumptions[i].range;
+  }
+
+  Range entry = EMPTY;
+  bool loops = false;
+  for (int i = 0; i < header->pred_count; i++) {
+    IR_Block pred = header->preds[i];
+    if (!IRBlockIsReachable(&Bounds.dom, pred)) continue;
+
+    if (IRDominates(&Bounds.dom, inst->block, pred)) {
+      loops = true;
+    } else {
+      entry = Union(entry, RangeAt(args[i], pred, fn->blocks[pred].inst_count, depth + 1));
+    }
+  }
+
+  if (!loops) return entry;
+  if (IsEmpty(entry) || Bounds.assumption_count == MAX_DEPTH) return TypeRange(inst->type);
+
+  Range type = TypeRange(inst->type);
+  Range candidates[2] = {{entry.lo, type.hi}, {type.lo, entry.hi}};
+
+  for (int c = 0; c < 2; c++) {
+    Bounds.assumptions[Bounds.assumption_count++] = (Assumption){v, candidates[c]};
+
+    Range around = EMPTY;
+    for (int i = 0; i < header->pred_count; i++) {
+      IR_Block pred = header->preds[i];
+      if (!IRDominates(&Bounds.dom, inst->block, pred)) continue;
+      around = Union(around, RangeAt(args[i], pred, fn->blocks[pred].inst_count, depth + 1));
+    }
+
+    Bounds.assumption_count--;
+    if (Contains(candidates[c], around)) return candidates[c];
+  }
+
+  return type;
+}
+
+static Range PhiRange(IR_Value v, int depth) {
+  if (Bounds.assumption_count > 0) return LoopPhiRange(v, depth);
+  if (Bounds.phi_known[v]) return Bounds.phi_ranges[v];
+
+  Range r = LoopPhiRange(v, depth);
+  if (Bounds.budget >= 0) {
+    Bounds.phi_ranges[v] = r;
+    Bounds.phi_known[v] = true;
+  }
+  return r;
+}
+
+// The values v may have at `position` in `block`
+static Range RangeAt(IR_Value v, IR_Block block, int position, int depth) {
+  IR_Function *fn = Bounds.fn;
+  IR_Inst *inst = &fn->insts[v];
+
+  if (!IsTracked(inst->type) || inst->lanes != 0) return FULL;
+  if (inst->op == IR_CONST) return (Range){inst->imm.i, inst->imm.i};
+  if (depth > MAX_DEPTH || --Bounds.budget < 0) return TypeRange(inst->type);
+
+  Range r;
+  switch (inst->op) {
+    case IR_PHI:
+      r = PhiRange(v, depth);
+      break;
+    case IR_CONVERT: {
+      IR_Type from = fn->insts[inst->a].type;
+      r = IsTracked(from) ? Fit(RangeAt(inst->a, block, position, depth + 1), inst->type) : TypeRange(inst->type);
+      break;
+    }
+    case IR_NEG: {
+      Range a = RangeAt(inst->a, block, position, depth + 1);
+      r = Fit(Arithmetic(IR_SUB, (Range){0, 0}, a), inst->type);
+      break;
+    }
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+    case IR_AND: case IR_OR: case IR_XOR: case IR_SHR: {
+      Range a = RangeAt(inst->a, block, position, depth + 1);
+      Range b = RangeAt(inst->b, block, position, depth + 1);
+      r = Fit(Arithmetic(inst->op, a, b), inst->type);
+      break;
+    }
+    default:
+      r = TypeRange(inst->type);
+      break;
+  }
+
+  return Facts(v, Intersect(r, TypeRange(inst->type)), block, position, depth);
+}
+
+/* === Elimination === */
+
+static void EliminateInFunction(IR_Function *fn, FILE *report) {
+  if (!fn->is_defined || fn->block_count == 0) return;
+
+  Bounds.fn = fn;
+  Bounds.position = malloc((fn->inst_count + 1) * sizeof(int));
+  Bounds.first_check = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  Bounds.next_check = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  Bounds.phi_ranges = malloc((fn->inst_count + 1) * sizeof(Range));
+  Bounds.phi_known = calloc(fn->inst_count + 1, sizeof(bool));
+  Bounds.narrowing = calloc(fn->inst_count + 1, sizeof(int));
+  IR_Value *redundant = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  int eliminated = 0, kept = 0;
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) Bounds.first_check[v] = IR_NONE;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    for (int i = 0; i < fn->blocks[b].inst_count; i++) {
+      IR_Value v = fn->blocks[b].insts[i];
+      Bounds.position[v] = i;
+
+      if (fn->insts[v].op == IR_BOUNDS_CHECK) {
+        Bounds.next_check[v] = Bounds.first_check[fn->insts[v].a];
+        Bounds.first_check[fn->insts[v].a] = v;
+      }
+    }
+  }
+
+  ComputeIRDominators(fn, &Bounds.dom);
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    for (int i = 0; i < fn->blocks[b].inst_count; i++) {
+      IR_Inst *check = &fn->insts[fn->blocks[b].insts[i]];
+      if (check->op != IR_BOUNDS_CHECK) continue;
+
+      Bounds.budget = QUERY_BUDGET;
+      Bounds.assumption_count = 0;
+      Range index = RangeAt(check->a, b, i, 0);
+
+      if (Contains((Range){0, check->imm.i - 1}, index)) {
+        redundant[eliminated++] = fn->blocks[b].insts[i];
+      } else {
+        kept++;
+      }
+    }
+  }
+
+  // Removed only now, since the checks still tell something about the indices
+  for (int i = 0; i < eliminated; i++) RemoveIRInst(fn, redundant[i]);
+
+  if (report != NULL && eliminated + kept > 0) {
+    fprintf(report, "bounds checks: %s: %d eliminated, %d kept\n", fn->is_entry ? "main" : fn->name, eliminated, kept);
+  }
+
+  FreeIRDominators(&Bounds.dom);
+  free(redundant);
+  free(Bounds.narrowing);
+  free(Bounds.phi_known);
+  free(Bounds.phi_ranges);
+  free(Bounds.next_check);
+  free(Bounds.first_check);
+  free(Bounds.position);
+}
+
+void EliminateBoundsChecks(IR_Module *m, FILE *report) {
+  for (int i = 0; i < m->function_count; i++) {
+    EliminateInFunction(&m->functions[i], report);
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef IR_BOUNDS_H
+#define IR_BOUNDS_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Bounds check elimination. Lowering already leaves out the checks of
+ * constant indices; this removes the IR_BOUNDS_CHECKs whose index is
+ * known to be in range wherever they run. The range of an integer is
+ * worked out from
+ *
+ *   - constants, the range of its type, and arithmetic on ranges
+ *     (anything that may overflow is as wide as its type)
+ *   - loop counters, which stay above their initial value while stepped
+ *     up (or below it while stepped down) without overflowing
+ *   - comparisons on the way to the check: `i < n` holds in the blocks
+ *     only reachable through the branch's true edge
+ *   - earlier checks of the same index, which leave it in range
+ *
+ * With `report` set, every function with bounds checks gets a line with
+ * how many were eliminated and how many are kept. */
+void EliminateBoundsChecks(IR_Module *m, FILE *report);
+
+#endif
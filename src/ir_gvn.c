@@ -0,0 +1,395 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "ir_analysis.h"
+#include "ir_gvn.h"
+
+/* What makes two values the same, besides the incoming values of phis.
+ * Hashed as raw bytes, so keys are zeroed before they are filled in */
+typedef struct {
+  IR_Op op;
+  IR_Type type;
+  int32_t lanes;
+  IR_Value a, b;
+  IR_Imm imm;
+  int32_t memory;   // loads: the state of memory they read
+  IR_Block block;   // phis
+} Key;
+
+typedef struct {
+  Key key;
+  uint64_t hash;
+  IR_Value value;   // IR_NONE if the slot is free
+} Entry;
+
+// Loads carried past a store that can't change what they read, per block
+#define MAX_AVAILABLE_LOADS 32
+
+static struct {
+  IR_Function *fn;
+  IR_DomTree dom;
+
+  IR_Value *leader;   // per value, the value it is replaced by, or itself
+  int *memory_out;    // per block, the state of memory it leaves behind
+  int memory_count;
+
+  Entry available[MAX_AVAILABLE_LOADS]; // loads numbered since the block or the current state of memory began
+  int available_count;
+
+  Entry *table;
+  int capacity;
+} GVN;
+
+static IR_Value Leader(IR_Value v) {
+  return (v == IR_NONE) ? IR_NONE : GVN.leader[v];
+}
+
+static int InstructionCount(IR_Function *fn) {
+  int count = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) count += fn->blocks[b].inst_count;
+  return count;
+}
+
+/* === Keys === */
+
+static bool IsCommutative(IR_Op op) {
+  switch (op) {
+    case IR_ADD: case IR_MUL: case IR_AND: case IR_OR: case IR_XOR:
+    case IR_EQ: case IR_NE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static IR_Op Mirrored(IR_Op op) {
+  switch (op) {
+    case IR_LT: return IR_GT;
+    case IR_LE: return IR_GE;
+    case IR_GT: return IR_LT;
+    case IR_GE: return IR_LE;
+    default:    return op;
+  }
+}
+
+/* Whether `v` is numbered at all, and if so, its key. Anything with an
+ * effect, or that may differ every time it runs, is not */
+static bool MakeKey(IR_Value v, int memory, Key *key) {
+  IR_Inst *inst = &GVN.fn->insts[v];
+  memset(key, 0, sizeof(Key));
+
+  key->op = inst->op;
+  key->type = inst->type;
+  key->lanes = inst->lanes;
+  key->a = Leader(inst->a);
+  key->b = Leader(inst->b);
+  key->block = IR_NONE;
+
+  switch (inst->op) {
+    case IR_CONST:
+      // Compared by their bits as the type holds them, so -0.0 and 0.0 stay apart
+      key->imm = IRCanonicalImm(inst->type, inst->imm);
+      return true;
+
+    case IR_STRING:
+    case IR_GLOBAL:
+    case IR_ELEMENT_PTR:
+    case IR_MEMBER_PTR:
+    case IR_REDUCE:
+      key->imm = inst->imm;
+      return true;
+
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+    case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR:
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+      if (key->a > key->b && (IsCommutative(inst->op) || IROp_IsComparison(inst->op))) {
+        IR_Value swap = key->a;
+        key->a = key->b;
+        key->b = swap;
+        key->op = Mirrored(inst->op);
+      }
+      return true;
+
+    case IR_NEG:
+    case IR_NOT:
+    case IR_CONVERT:
+    case IR_BROADCAST:
+      return true;
+
+    case IR_LOAD:
+      key->memory = memory;
+      return true;
+
+    case IR_PHI:
+      key->block = inst->block;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static uint64_t HashKey(Key *key, IR_Value phi) {
+  uint64_t hash = HashBytes(key, sizeof(Key));
+  if (phi == IR_NONE) return hash;
+
+  IR_Value *args = IRArgs(GVN.fn, phi);
+  for (int i = 0; i < GVN.fn->insts[phi].args_count; i++) {
+    IR_Value incoming = Leader(args[i]);
+    hash = (hash ^ HashBytes(&incoming, sizeof(incoming))) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static bool PhiArgsMatch(IR_Value x, IR_Value y) {
+  IR_Function *fn = GVN.fn;
+  IR_Value *xs = IRArgs(fn, x);
+  IR_Value *ys = IRArgs(fn, y);
+
+  if (fn->insts[x].args_count != fn->insts[y].args_count) return false;
+  for (int i = 0; i < fn->insts[x].args_count; i++) {
+    if (Leader(xs[i]) != Leader(ys[i])) return false;
+  }
+  return true;
+}
+
+/* === Table === */
+
+/* An earlier value with the same key that is available in `block`. Since
+ * blocks are visited in reverse postorder, one in the same block is always
+ * earlier */
+static IR_Value Find(Key *key, uint64_t hash, IR_Value phi, IR_Block block) {
+  uint64_t mask = GVN.capacity - 1;
+
+  for (uint64_t i = hash & mask; GVN.table[i].value != IR_NONE; i = (i + 1) & mask) {
+    Entry *e = &GVN.table[i];
+    if (e->hash != hash || memcmp(&e->key, key, sizeof(Key)) != 0) continue;
+    if (phi != IR_NONE && !PhiArgsMatch(e->value, phi)) continue;
+
+    if (IRDominates(&GVN.dom, GVN.fn->insts[e->value].block, block)) return e->value;
+  }
+
+  return IR_NONE;
+}
+
+static void Insert(Key *key, uint64_t hash, IR_Value value) {
+  uint64_t mask = GVN.capacity - 1;
+  uint64_t i = hash & mask;
+
+  while (GVN.table[i].value != IR_NONE) i = (i + 1) & mask;
+
+  GVN.table[i].key = *key;
+  GVN.table[i].hash = hash;
+  GVN.table[i].value = value;
+}
+
+/* === Numbering === */
+
+// The state of memory on entry, unchanged if every predecessor leaves the same one behind
+static int MemoryIn(IR_Block block) {
+  IR_Function *fn = GVN.fn;
+  IR_BasicBlock *b = &fn->blocks[block];
+  int memory = IR_NONE;
+
+  for (int i = 0; i < b->pred_count; i++) {
+    IR_Block pred = b->preds[i];
+    bool visited = GVN.dom.rpo_index[pred] != IR_NONE && GVN.dom.rpo_index[pred] < GVN.dom.rpo_index[block];
+
+    if (!visited || (memory != IR_NONE && GVN.memory_out[pred] != memory)) return GVN.memory_count++;
+    memory = GVN.memory_out[pred];
+  }
+
+  return (memory == IR_NONE) ? GVN.memory_count++ : memory;
+}
+
+/* Where an address points: `offset` bytes into `base`, which is a stack
+ * slot or global when `is_object` is set. Without a known offset,
+ * `offset` is -1 */
+static IR_Value BaseOf(IR_Value address, int64_t *offset, bool *is_object) {
+  IR_Function *fn = GVN.fn;
+  *offset = 0;
+
+  for (;;) {
+    IR_Inst *inst = &fn->insts[address];
+
+    if (inst->op == IR_MEMBER_PTR) {
+      if (*offset >= 0) *offset += inst->imm.i;
+    } else if (inst->op == IR_ELEMENT_PTR) {
+      IR_Inst *index = &fn->insts[Leader(inst->b)];
+      if (index->op == IR_CONST && *offset >= 0 && index->imm.i >= 0 && index->imm.i < (INT32_MAX / 16)) {
+        *offset += index->imm.i * inst->imm.i;
+      } else {
+        *offset = -1;
+      }
+    } else {
+      *is_object = (inst->op == IR_ALLOCA || inst->op == IR_GLOBAL);
+      return address;
+    }
+
+    address = Leader(inst->a);
+  }
+}
+
+static int64_t AccessSize(IR_Type type, int lanes) {
+  return (int64_t)IRType_Size(type) * (lanes > 0 ? lanes : 1);
+}
+
+// Whether a store of `size` bytes to `store_address` can't change what the load `key` reads
+static bool CannotOverlap(IR_Value store_address, int64_t size, Key *load) {
+  int64_t store_offset, load_offset;
+  bool store_is_object, load_is_object;
+  IR_Value store_base = BaseOf(store_address, &store_offset, &store_is_object);
+  IR_Value load_base = BaseOf(load->a, &load_offset, &load_is_object);
+
+  if (store_base != load_base) {
+    IR_Inst *x = &GVN.fn->insts[store_base];
+    IR_Inst *y = &GVN.fn->insts[load_base];
+    bool same_global = x->op == IR_GLOBAL && y->op == IR_GLOBAL && x->imm.i == y->imm.i;
+    if (!same_global) return store_is_object && load_is_object;
+  }
+  if (store_offset < 0 || load_offset < 0) return false;
+
+  return store_offset + size <= load_offset ||
+         load_offset + AccessSize(load->type, load->lanes) <= store_offset;
+}
+
+static void MakeAvailable(Key *key, uint64_t hash, IR_Value value) {
+  Insert(key, hash, value);
+  if (GVN.available_count == MAX_AVAILABLE_LOADS) return;
+
+  Entry *e = &GVN.available[GVN.available_count++];
+  e->key = *key;
+  e->hash = hash;
+  e->value = value;
+}
+
+/* A store starts a new state of memory. Loads it can't change are numbered
+ * in the new state as well, and a load of the stored address reads back
+ * the stored value */
+static int Store(IR_Value store, int memory) {
+  IR_Function *fn = GVN.fn;
+  IR_Inst *inst = &fn->insts[store];
+  IR_Inst *stored = &fn->insts[inst->b];
+  int64_t size = AccessSize(stored->type, stored->lanes);
+
+  int kept = 0;
+  for (int i = 0; i < GVN.available_count; i++) {
+    Entry *e = &GVN.available[i];
+    if (!CannotOverlap(Leader(inst->a), size, &e->key)) continue;
+
+    e->key.memory = memory;
+    e->hash = HashKey(&e->key, IR_NONE);
+    Insert(&e->key, e->hash, e->value);
+    GVN.available[kept++] = *e;
+  }
+  GVN.available_count = kept;
+
+  Key key;
+  memset(&key, 0, sizeof(Key));
+  key.op = IR_LOAD;
+  key.type = stored->type;
+  key.lanes = stored->lanes;
+  key.a = Leader(inst->a);
+  key.b = IR_NONE;
+  key.memory = memory;
+  key.block = IR_NONE;
+  MakeAvailable(&key, HashKey(&key, IR_NONE), Leader(inst->b));
+
+  return memory;
+}
+
+static void NumberBlock(IR_Block block) {
+  IR_Function *fn = GVN.fn;
+  IR_BasicBlock *b = &fn->blocks[block];
+  int memory = MemoryIn(block);
+
+  GVN.available_count = 0;
+
+  for (int i = 0; i < b->inst_count; i++) {
+    IR_Value v = b->insts[i];
+    IR_Inst *inst = &fn->insts[v];
+    Key key;
+
+    if (inst->op == IR_CALL) {
+      memory = GVN.memory_count++;
+      GVN.available_count = 0;
+      continue;
+    }
+
+    if (inst->op == IR_STORE) {
+      memory = Store(v, GVN.memory_count++);
+      continue;
+    }
+
+    if (!MakeKey(v, memory, &key)) continue;
+
+    IR_Value phi = (inst->op == IR_PHI) ? v : IR_NONE;
+    uint64_t hash = HashKey(&key, phi);
+    IR_Value same = Find(&key, hash, phi, block);
+
+    if (same != IR_NONE) GVN.leader[v] = same;
+    else if (inst->op == IR_LOAD) MakeAvailable(&key, hash, v);
+    else Insert(&key, hash, v);
+  }
+
+  GVN.memory_out[block] = memory;
+}
+
+static void NumberFunction(IR_Function *fn, FILE *report) {
+  if (!fn->is_defined || fn->block_count == 0) return;
+
+  GVN.fn = fn;
+  GVN.leader = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  GVN.memory_out = malloc((fn->block_count + 1) * sizeof(int));
+  GVN.memory_count = 0;
+
+  // Every instruction adds at most one entry, stores add the loads they keep as well
+  int entries = 0;
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    entries += (fn->insts[v].op == IR_STORE) ? 1 + MAX_AVAILABLE_LOADS : 1;
+  }
+
+  GVN.capacity = 16;
+  while (GVN.capacity < 2 * entries) GVN.capacity *= 2;
+  GVN.table = malloc(GVN.capacity * sizeof(Entry));
+  for (int i = 0; i < GVN.capacity; i++) GVN.table[i].value = IR_NONE;
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) GVN.leader[v] = v;
+
+  ComputeIRDominators(fn, &GVN.dom);
+  int before = InstructionCount(fn);
+
+  for (int i = 0; i < GVN.dom.rpo_count; i++) NumberBlock(GVN.dom.rpo[i]);
+
+  bool changed = false;
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    if (fn->insts[v].op == IR_NOP) continue;
+    if (GVN.leader[v] != v) changed = true;
+
+    IR_Inst *inst = &fn->insts[v];
+    inst->a = Leader(inst->a);
+    inst->b = Leader(inst->b);
+    for (int i = 0; i < inst->args_count; i++) fn->args[inst->args_start + i] = Leader(fn->args[inst->args_start + i]);
+  }
+
+  if (changed) {
+    RemoveDeadIRValues(fn);
+
+    if (report != NULL) {
+      fprintf(report, "gvn: %s: %d -> %d instructions\n", fn->is_entry ? "main" : fn->name, before, InstructionCount(fn));
+    }
+  }
+
+  FreeIRDominators(&GVN.dom);
+  free(GVN.table);
+  free(GVN.memory_out);
+  free(GVN.leader);
+}
+
+void NumberIRValues(IR_Module *m, FILE *report) {
+  for (int i = 0; i < m->function_count; i++) {
+    NumberFunction(&m->functions[i], report);
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef IR_GVN_H
+#define IR_GVN_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Global value numbering. Values computed by the same operation on the
+ * same operands, with the same type and width, are numbered alike; every
+ * one dominated by an earlier value with its number is replaced by that
+ * value and removed. Operands of commutative operations are ordered, and
+ * comparisons are turned around to compare the lower operand first.
+ *
+ * Loads are numbered by their address and the state of memory they read.
+ * Memory changes with every store and call, and is carried on into blocks
+ * whose predecessors all leave it unchanged. A store also numbers a load
+ * of its address right after it, so such loads take the stored value.
+ *
+ * With `report` set, every function that changed gets a line with its
+ * instruction count before and after. */
+void NumberIRValues(IR_Module *m, FILE *report);
+
+#endif
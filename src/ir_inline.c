@@ -0,0 +1,433 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir_inline.h"
+
+#define CALL_OVERHEAD 3
+
+// Inlining into a function stops once it has grown this large
+#define CALLER_SIZE_LIMIT 2000
+
+// With a profile, calls run at least 1/HOT_CALL_RATIO as often as the most frequent block get a higher threshold
+#define HOT_CALL_RATIO 100
+#define HOT_CALL_BONUS 60
+
+typedef struct {
+  int size;
+  int call_sites;     // calls to this function from anywhere in the module
+  bool calls_others;
+  bool calls_itself;
+  bool has_locals;
+  bool has_tail_calls;
+} FunctionSummary;
+
+static struct {
+  IR_Module *module;
+  int threshold;
+  FILE *remarks;
+
+  FunctionSummary *summary; // per function
+  bool *was_called;
+
+  IR_Block *layout;         // block order of the caller being inlined into
+  int layout_count, layout_capacity;
+} Inline;
+
+static int InstCost(IR_Inst *inst) {
+  switch (inst->op) {
+    case IR_NOP:
+    case IR_CONST:
+    case IR_PARAM:
+    case IR_PHI:
+    case IR_GLOBAL:
+    case IR_STRING:
+    case IR_ALLOCA:
+    case IR_JUMP:
+    case IR_RETURN:
+      return 0;
+    case IR_DIV:
+    case IR_MOD:
+    case IR_PRINT:
+      return 2;
+    case IR_CALL:
+    case IR_TAIL_CALL:
+      return CALL_OVERHEAD + inst->args_count;
+    default:
+      return 1;
+  }
+}
+
+static void Summarize(int index) {
+  IR_Function *fn = &Inline.module->functions[index];
+  FunctionSummary *s = &Inline.summary[index];
+  int call_sites = s->call_sites;
+
+  memset(s, 0, sizeof(*s));
+  s->call_sites = call_sites;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Inst *inst = &fn->insts[block->insts[i]];
+      s->size += InstCost(inst);
+
+      if (inst->op == IR_ALLOCA) s->has_locals = true;
+      if (inst->op == IR_TAIL_CALL) s->has_tail_calls = true;
+      if (inst->op == IR_CALL || inst->op == IR_TAIL_CALL) {
+        if (inst->imm.i == index) s->calls_itself = true;
+        else s->calls_others = true;
+      }
+    }
+  }
+}
+
+static void CountCallSites(IR_Function *fn, int delta) {
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Inst *inst = &fn->insts[block->insts[i]];
+      if (inst->op != IR_CALL && inst->op != IR_TAIL_CALL) continue;
+
+      Inline.summary[inst->imm.i].call_sites += delta;
+      Inline.was_called[inst->imm.i] = true;
+    }
+  }
+}
+
+/* === Cost model === */
+
+// Uses of parameter `index` in `fn`
+static int ParamUses(IR_Function *fn, int index) {
+  IR_Value param = IR_NONE;
+  IR_BasicBlock *entry = &fn->blocks[0];
+  for (int i = 0; i < entry->inst_count && param == IR_NONE; i++) {
+    IR_Inst *inst = &fn->insts[entry->insts[i]];
+    if (inst->op == IR_PARAM && inst->imm.i == index) param = entry->insts[i];
+  }
+  if (param == IR_NONE) return 0;
+
+  int uses = 0;
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op == IR_NOP) continue;
+
+    if (inst->a == param) uses++;
+    if (inst->b == param) uses++;
+    for (int i = 0; i < inst->args_count; i++) {
+      if (fn->args[inst->args_start + i] == param) uses++;
+    }
+  }
+
+  return uses;
+}
+
+static int Benefit(IR_Function *caller, IR_Value call, int callee_index, int *constant_args) {
+  IR_Function *callee = &Inline.module->functions[callee_index];
+  IR_Inst *inst = &caller->insts[call];
+  int benefit = CALL_OVERHEAD + inst->args_count;
+
+  *constant_args = 0;
+  for (int i = 0; i < inst->args_count; i++) {
+    if (caller->insts[IRArgs(caller, call)[i]].op != IR_CONST) continue;
+
+    (*constant_args)++;
+    benefit += 1 + ParamUses(callee, i);
+  }
+
+  if (Inline.summary[callee_index].call_sites == 1) benefit += Inline.summary[callee_index].size;
+
+  return benefit;
+}
+
+static void Remark(IR_Function *caller, IR_Function *callee, const char *fmt, ...) {
+  if (Inline.remarks == NULL) return;
+
+  fprintf(Inline.remarks, "inline: %s: call to %s: ", caller->is_entry ? "main" : caller->name, callee->name);
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(Inline.remarks, fmt, args);
+  va_end(args);
+
+  fputc('\n', Inline.remarks);
+}
+
+static bool ShouldInline(int caller_index, IR_Value call) {
+  IR_Function *caller = &Inline.module->functions[caller_index];
+  int callee_index = caller->insts[call].imm.i;
+  IR_Function *callee = &Inline.module->functions[callee_index];
+  FunctionSummary *s = &Inline.summary[callee_index];
+
+  if (!callee->is_defined) return false;
+
+  if (callee_index == caller_index || s->calls_itself) {
+    Remark(caller, callee, "kept, recursive");
+    return false;
+  }
+  if (s->has_locals) {
+    Remark(caller, callee, "kept, has stack locals");
+    return false;
+  }
+  if (s->has_tail_calls) {
+    Remark(caller, callee, "kept, ends in a tail call");
+    return false;
+  }
+  if (s->calls_others && s->call_sites > 1) {
+    Remark(caller, callee, "kept, not a leaf and called from %d sites", s->call_sites);
+    return false;
+  }
+  if (Inline.summary[caller_index].size > CALLER_SIZE_LIMIT) {
+    Remark(caller, callee, "kept, caller reached the size limit");
+    return false;
+  }
+
+  // Inlining a function's only call never grows the program, even where it didn't run
+  int64_t count = caller->blocks[caller->insts[call].block].count;
+  if (Inline.module->has_profile && count == 0 && s->call_sites > 1) {
+    Remark(caller, callee, "kept, never ran in the profile");
+    return false;
+  }
+
+  bool hot = Inline.module->has_profile && count > 0 && count * HOT_CALL_RATIO >= Inline.module->profile_max;
+  int threshold = hot ? Inline.threshold + HOT_CALL_BONUS : Inline.threshold;
+
+  int constant_args;
+  int benefit = Benefit(caller, call, callee_index, &constant_args);
+  int cost = s->size - benefit;
+  bool inline_it = cost <= threshold;
+
+  Remark(caller, callee, "%s, cost %d %s %d (size %d, benefit %d, %d constant argument%s%s%s)",
+         inline_it ? "inlined" : "kept", cost, inline_it ? "<=" : ">", threshold,
+         s->size, benefit, constant_args, (constant_args == 1) ? "" : "s",
+         (s->call_sites == 1) ? ", only call site" : "", hot ? ", hot" : "");
+
+  return inline_it;
+}
+
+/* === Transformation === */
+static void PlaceAfter(IR_Block anchor, IR_Block *blocks, int count) {
+  int position = 0;
+  while (Inline.layout[position] != anchor) position++;
+
+  for (int i = 0; i < count; i++) {
+    ARENA_PUSH(Inline.module->arena, Inline.layout, Inline.layout_count, Inline.layout_capacity, IR_NONE);
+  }
+  memmove(&Inline.layout[position + 1 + count], &Inline.layout[position + 1],
+          (Inline.layout_count - count - position - 1) * sizeof(IR_Block));
+  memcpy(&Inline.layout[position + 1], blocks, count * sizeof(IR_Block));
+}
+
+/* Splits the call's block after the call, clones the callee's blocks in
+ * between with parameters replaced by the arguments and returns turned
+ * into jumps to the split off rest; returned values meet in a phi */
+static void InlineCall(IR_Function *caller, IR_Value call) {
+  IR_Module *m = Inline.module;
+  IR_Function *callee = &m->functions[caller->insts[call].imm.i];
+  IR_Block block = caller->insts[call].block;
+
+  IR_BasicBlock *b = &caller->blocks[block];
+  int position = 0;
+  while (b->insts[position] != call) position++;
+  IR_Block rest = SplitIRBlock(m, caller, block, position + 1);
+
+  IR_Value *args = malloc((caller->insts[call].args_count + 1) * sizeof(IR_Value));
+  memcpy(args, IRArgs(caller, call), caller->insts[call].args_count * sizeof(IR_Value));
+
+  IR_Value *value_map = malloc((callee->inst_count + 1) * sizeof(IR_Value));
+  IR_Block *block_map = malloc((callee->block_count + 1) * sizeof(IR_Block));
+  IR_Value *returned = malloc((callee->block_count + 1) * sizeof(IR_Value));
+  IR_Block *return_blocks = malloc((callee->block_count + 1) * sizeof(IR_Block));
+  IR_Value *buffer = malloc((callee->arg_count + callee->block_count + 1) * sizeof(IR_Value));
+  int return_count = 0;
+
+  // The callee's counts are scaled down to the share of its calls made from here
+  int64_t site_count = caller->blocks[block].count;
+  int64_t entry_count = callee->blocks[0].count;
+  for (IR_Block gb = 0; gb < callee->block_count; gb++) {
+    block_map[gb] = NewIRBlock(m, caller);
+    if (site_count >= 0 && entry_count > 0 && callee->blocks[gb].count >= 0) {
+      caller->blocks[block_map[gb]].count = (int64_t)((double)callee->blocks[gb].count * site_count / entry_count);
+    }
+  }
+
+  // Operands may refer to values defined later in block order, so they are remapped afterwards
+  IR_Inst jump = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {rest}};
+  for (IR_Block gb = 0; gb < callee->block_count; gb++) {
+    IR_BasicBlock *source = &callee->blocks[gb];
+    for (int i = 0; i < source->inst_count; i++) {
+      IR_Value v = source->insts[i];
+      IR_Inst inst = callee->insts[v];
+
+      if (inst.op == IR_PARAM) {
+        value_map[v] = args[inst.imm.i];
+      } else if (inst.op == IR_RETURN) {
+        returned[return_count] = inst.a;
+        return_blocks[return_count++] = block_map[gb];
+        EmitIR(m, caller, block_map[gb], jump);
+      } else {
+        inst.args_start = 0;
+        inst.args_count = 0;
+        value_map[v] = EmitIR(m, caller, block_map[gb], inst);
+      }
+    }
+
+    for (int i = 0; i < source->pred_count; i++) {
+      AddIRPredecessor(m, caller, block_map[gb], block_map[source->preds[i]]);
+    }
+  }
+
+  for (IR_Block gb = 0; gb < callee->block_count; gb++) {
+    IR_BasicBlock *source = &callee->blocks[gb];
+    for (int i = 0; i < source->inst_count; i++) {
+      IR_Value v = source->insts[i];
+      IR_Inst *from = &callee->insts[v];
+      if (from->op == IR_PARAM || from->op == IR_RETURN) continue;
+
+      IR_Inst *to = &caller->insts[value_map[v]];
+      if (from->a != IR_NONE) to->a = value_map[from->a];
+      if (from->b != IR_NONE) to->b = value_map[from->b];
+      if (from->op == IR_JUMP || from->op == IR_BRANCH) {
+        to->target[0] = block_map[from->target[0]];
+        if (from->op == IR_BRANCH) to->target[1] = block_map[from->target[1]];
+      }
+
+      if (from->args_count > 0) {
+        for (int j = 0; j < from->args_count; j++) buffer[j] = value_map[IRArgs(callee, v)[j]];
+        SetIRArgs(m, caller, value_map[v], buffer, from->args_count);
+      }
+    }
+  }
+
+  for (int i = 0; i < return_count; i++) {
+    AddIRPredecessor(m, caller, rest, return_blocks[i]);
+  }
+
+  if (callee->return_type != IRT_VOID && return_count > 0) {
+    IR_Value result = value_map[returned[0]];
+    if (return_count > 1) {
+      result = EmitIRPhi(m, caller, rest, callee->return_type);
+      for (int i = 0; i < return_count; i++) buffer[i] = value_map[returned[i]];
+      SetIRArgs(m, caller, result, buffer, return_count);
+    }
+    ReplaceAllIRUses(caller, call, result);
+  }
+
+  RemoveIRInst(caller, call);
+  IR_Inst enter = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {block_map[0]}};
+  EmitIR(m, caller, block, enter);
+  AddIRPredecessor(m, caller, block_map[0], block);
+
+  block_map[callee->block_count] = rest;
+  PlaceAfter(block, block_map, callee->block_count + 1);
+
+  free(buffer);
+  free(return_blocks);
+  free(returned);
+  free(block_map);
+  free(value_map);
+  free(args);
+}
+
+static void ApplyLayout(IR_Function *fn) {
+  IR_Block *new_index = malloc((fn->block_count + 1) * sizeof(IR_Block));
+  for (int i = 0; i < Inline.layout_count; i++) new_index[Inline.layout[i]] = i;
+
+  RenumberIRBlocks(fn, new_index);
+  free(new_index);
+}
+
+static void InlineInto(int index) {
+  IR_Module *m = Inline.module;
+  IR_Function *fn = &m->functions[index];
+  if (!fn->is_defined) return;
+
+  // Calls are collected upfront, calls in inlined bodies were already considered in their own function
+  IR_Value *calls = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  int call_count = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    for (int i = 0; i < block->inst_count; i++) {
+      if (fn->insts[block->insts[i]].op == IR_CALL) calls[call_count++] = block->insts[i];
+    }
+  }
+
+  Inline.layout_count = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    ARENA_PUSH(m->arena, Inline.layout, Inline.layout_count, Inline.layout_capacity, b);
+  }
+
+  bool changed = false;
+  for (int i = 0; i < call_count; i++) {
+    if (!ShouldInline(index, calls[i])) continue;
+
+    int callee_index = fn->insts[calls[i]].imm.i;
+    InlineCall(fn, calls[i]);
+    CountCallSites(&m->functions[callee_index], 1);
+    Inline.summary[callee_index].call_sites--;
+    Summarize(index);
+    changed = true;
+  }
+
+  if (changed) {
+    ApplyLayout(fn);
+    RemoveUnreachableIRBlocks(fn);
+  }
+
+  free(calls);
+}
+
+// Callees before their callers, so that bodies are inlined in their final form
+static void PostOrder(int index, bool *visited, int *order, int *count) {
+  visited[index] = true;
+
+  IR_Function *fn = &Inline.module->functions[index];
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op == IR_CALL && !visited[inst->imm.i]) PostOrder(inst->imm.i, visited, order, count);
+  }
+
+  order[(*count)++] = index;
+}
+
+void InlineFunctions(IR_Module *m, int threshold, FILE *remarks) {
+  memset(&Inline, 0, sizeof(Inline));
+  Inline.module = m;
+  Inline.threshold = threshold;
+  Inline.remarks = remarks;
+  Inline.summary = calloc(m->function_count + 1, sizeof(FunctionSummary));
+  Inline.was_called = calloc(m->function_count + 1, sizeof(bool));
+
+  for (int i = 0; i < m->function_count; i++) CountCallSites(&m->functions[i], 1);
+  for (int i = 0; i < m->function_count; i++) Summarize(i);
+
+  bool *visited = calloc(m->function_count + 1, sizeof(bool));
+  int *order = malloc((m->function_count + 1) * sizeof(int));
+  int count = 0;
+  for (int i = 0; i < m->function_count; i++) {
+    if (!visited[i]) PostOrder(i, visited, order, &count);
+  }
+
+  for (int i = 0; i < count; i++) InlineInto(order[i]);
+
+  // Dropping a function can leave the functions only it called without callers
+  bool removed = true;
+  while (removed) {
+    removed = false;
+
+    for (int i = 0; i < m->function_count; i++) {
+      IR_Function *fn = &m->functions[i];
+      if (fn->is_entry || !fn->is_defined || !Inline.was_called[i] || Inline.summary[i].call_sites > 0) continue;
+
+      CountCallSites(fn, -1);
+      fn->is_defined = false;
+      removed = true;
+      if (remarks != NULL) fprintf(remarks, "inline: %s: removed, every call was inlined\n", fn->name);
+    }
+  }
+
+  free(order);
+  free(visited);
+  free(Inline.was_called);
+  free(Inline.summary);
+}
@@ -0,0 +1,33 @@
+#ifndef IR_INLINE_H
+#define IR_INLINE_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Function inlining. Functions are visited callees first, so a body is
+ * inlined as it looks after its own calls were considered. A call site is
+ * inlined when the callee's size minus the benefit of inlining it is at
+ * most `threshold`:
+ *
+ *   size     roughly one per instruction; constants, params, phis and
+ *            jumps are free
+ *   benefit  the call sequence and argument moves, plus a bonus for every
+ *            constant argument that later folding can propagate into its
+ *            uses, plus the whole body when this is the callee's only
+ *            call site and the original can be dropped
+ *
+ * Only leaf functions and functions called from a single site are
+ * considered. Recursive functions, functions with stack locals (which are
+ * zeroed once per frame) and functions ending in tail calls are never
+ * inlined. Functions whose every call was inlined are dropped from the
+ * module.
+ *
+ * With a profile (ir_profile.h), calls from blocks that never ran are
+ * kept unless they are their callee's only call, and calls from blocks
+ * that ran often are inlined at a higher threshold.
+ *
+ * With `remarks` set, one line per call site explains the decision. */
+void InlineFunctions(IR_Module *m, int threshold, FILE *remarks);
+
+#endif
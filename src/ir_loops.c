@@ -0,0 +1,919 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir_analysis.h"
+#include "ir_loops.h"
+
+// Loops are unrolled completely up to this many iterations and this many instructions
+#define FULL_UNROLL_TRIPS 16
+#define FULL_UNROLL_SIZE 128
+
+// Partially unrolled loop bodies grow to at most this many instructions
+#define UNROLL_SIZE 64
+#define MAX_UNROLL_FACTOR 8
+
+// With a profile, loops entered at least 1/HOT_LOOP_RATIO as often as the most frequent block may grow this much more
+#define HOT_LOOP_RATIO 100
+#define HOT_UNROLL_SCALE 2
+
+typedef struct {
+  IR_Block preheader;
+  int64_t trip_count;     // -1 if unknown
+  bool exits_from_header; // the header's branch is the only way out
+  bool has_calls;
+  bool may_fail;          // prints, calls, or divides by something that may be zero
+  bool stores_anywhere;   // stores through a pointer of unknown origin
+  IR_Value *stored_roots; // allocas and globals the loop stores into
+  int stored_count;
+} LoopFacts;
+
+static struct {
+  IR_Module *module;
+  IR_Function *fn;
+  bool unroll;
+  FILE *report;
+
+  IR_DomTree dom;
+  IR_LoopForest forest;
+
+  IR_Block *layout;       // block order, applied once the function is done
+  int layout_count, layout_capacity;
+} Loops;
+
+static void Report(IR_Loop *loop, const char *fmt, ...) {
+  if (Loops.report == NULL) return;
+
+  fprintf(Loops.report, "loops: %s: loop at bb%d: ", Loops.fn->is_entry ? "main" : Loops.fn->name, loop->header);
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(Loops.report, fmt, args);
+  va_end(args);
+
+  fputc('\n', Loops.report);
+}
+
+static void Analyze() {
+  ComputeIRDominators(Loops.fn, &Loops.dom);
+  ComputeIRLoops(Loops.fn, &Loops.dom, &Loops.forest);
+}
+
+static void ReleaseAnalyses() {
+  FreeIRLoops(&Loops.forest);
+  FreeIRDominators(&Loops.dom);
+}
+
+static bool InLoop(IR_Loop *loop, IR_Value v) {
+  IR_Block b = Loops.fn->insts[v].block;
+  return b != IR_NONE && b < Loops.dom.block_count && loop->contains[b];
+}
+
+/* === Layout === */
+
+static void PlaceAt(int position, IR_Block *blocks, int count) {
+  for (int i = 0; i < count; i++) {
+    ARENA_PUSH(Loops.module->arena, Loops.layout, Loops.layout_count, Loops.layout_capacity, IR_NONE);
+  }
+  memmove(&Loops.layout[position + count], &Loops.layout[position],
+          (Loops.layout_count - count - position) * sizeof(IR_Block));
+  memcpy(&Loops.layout[position], blocks, count * sizeof(IR_Block));
+}
+
+static int LayoutPosition(IR_Block b) {
+  int position = 0;
+  while (Loops.layout[position] != b) position++;
+  return position;
+}
+
+static void ApplyLayout() {
+  IR_Block *new_index = malloc((Loops.fn->block_count + 1) * sizeof(IR_Block));
+  for (int i = 0; i < Loops.layout_count; i++) new_index[Loops.layout[i]] = i;
+
+  RenumberIRBlocks(Loops.fn, new_index);
+  free(new_index);
+}
+
+/* === Preheaders === */
+
+/* Routes every edge into the loop from outside through a new block right
+ * before the header. Header phis keep their incoming values from inside
+ * the loop and get the ones from outside merged in the new block. */
+static void InsertPreheader(IR_Loop *loop) {
+  IR_Module *m = Loops.module;
+  IR_Function *fn = Loops.fn;
+  IR_Block header = loop->header;
+  IR_Block preheader = NewIRBlock(m, fn);
+
+  IR_BasicBlock *h = &fn->blocks[header];
+  int pred_count = h->pred_count;
+  bool *inside = malloc(pred_count * sizeof(bool));
+  IR_Value *incoming = malloc((pred_count + 1) * sizeof(IR_Value));
+  IR_Value *outer = malloc((pred_count + 1) * sizeof(IR_Value));
+
+  for (int p = 0; p < pred_count; p++) {
+    IR_Block pred = h->preds[p];
+    inside[p] = pred < Loops.dom.block_count && loop->contains[pred];
+    if (inside[p]) continue;
+
+    IR_Inst *term = IRTerminator(fn, pred);
+    if (term->target[0] == header) term->target[0] = preheader;
+    if (term->op == IR_BRANCH && term->target[1] == header) term->target[1] = preheader;
+    AddIRPredecessor(m, fn, preheader, pred);
+  }
+
+  for (int i = 0; i < h->inst_count; i++) {
+    IR_Value phi = h->insts[i];
+    if (fn->insts[phi].op != IR_PHI) break;
+
+    int inner_count = 0, outer_count = 0;
+    for (int p = 0; p < pred_count; p++) {
+      IR_Value arg = IRArgs(fn, phi)[p];
+      if (inside[p]) incoming[inner_count++] = arg;
+      else outer[outer_count++] = arg;
+    }
+
+    IR_Value merged = outer[0];
+    for (int p = 1; p < outer_count; p++) {
+      if (outer[p] == merged) continue;
+
+      merged = EmitIRPhi(m, fn, preheader, fn->insts[phi].type);
+      SetIRArgs(m, fn, merged, outer, outer_count);
+      break;
+    }
+
+    incoming[inner_count] = merged;
+    SetIRArgs(m, fn, phi, incoming, inner_count + 1);
+    h = &fn->blocks[header];
+  }
+
+  int kept = 0;
+  for (int p = 0; p < pred_count; p++) {
+    if (inside[p]) h->preds[kept++] = h->preds[p];
+  }
+  h->preds[kept++] = preheader;
+  h->pred_count = kept;
+
+  IR_Inst jump = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {header}};
+  EmitIR(m, fn, preheader, jump);
+  PlaceAt(LayoutPosition(header), &preheader, 1);
+
+  free(outer);
+  free(incoming);
+  free(inside);
+}
+
+/* === Facts === */
+
+/* Whether `phi` in the loop header is a counter: it starts out with a value
+ * from the preheader and the latch sends it around as `phi + step` or
+ * `phi - step` for a constant step */
+static bool IsCounter(IR_Loop *loop, IR_Block preheader, IR_Value phi, IR_Value *init, int64_t *step) {
+  IR_Function *fn = Loops.fn;
+  IR_Inst *inst = &fn->insts[phi];
+  if (inst->op != IR_PHI || inst->block != loop->header || loop->latch_count != 1) return false;
+  if (!IRType_IsInteger(inst->type) || inst->type == IRT_BOOL || inst->lanes > 0 || inst->args_count != 2) return false;
+
+  int entry = IRPredecessorIndex(fn, loop->header, preheader);
+  int latch = IRPredecessorIndex(fn, loop->header, loop->latches[0]);
+  if (entry == IR_NONE || latch == IR_NONE) return false;
+
+  IR_Inst *next = &fn->insts[IRArgs(fn, phi)[latch]];
+  IR_Value amount;
+  if (next->op == IR_ADD && next->a == phi) amount = next->b;
+  else if (next->op == IR_ADD && next->b == phi) amount = next->a;
+  else if (next->op == IR_SUB && next->a == phi) amount = next->b;
+  else return false;
+
+  IR_Inst *constant = &fn->insts[amount];
+  if (constant->op != IR_CONST || constant->imm.i == INT64_MIN) return false;
+
+  *step = (next->op == IR_SUB) ? -constant->imm.i : constant->imm.i;
+  *init = IRArgs(fn, phi)[entry];
+  return true;
+}
+
+static IR_Op SwappedComparison(IR_Op op) {
+  switch (op) {
+    case IR_LT: return IR_GT;
+    case IR_LE: return IR_GE;
+    case IR_GT: return IR_LT;
+    case IR_GE: return IR_LE;
+    default:    return op;
+  }
+}
+
+static IR_Op NegatedComparison(IR_Op op) {
+  switch (op) {
+    case IR_EQ: return IR_NE;
+    case IR_NE: return IR_EQ;
+    case IR_LT: return IR_GE;
+    case IR_LE: return IR_GT;
+    case IR_GT: return IR_LE;
+    default:    return IR_LT;
+  }
+}
+
+/* Iterations of a loop whose header compares a counter with constant start
+ * and step against a constant, and leaves once the comparison fails */
+static int64_t TripCount(IR_Loop *loop, IR_Block preheader) {
+  IR_Function *fn = Loops.fn;
+  IR_Inst *term = IRTerminator(fn, loop->header);
+  if (term == NULL || term->op != IR_BRANCH) return -1;
+
+  bool stays_if_true = loop->contains[term->target[0]];
+  if (stays_if_true == loop->contains[term->target[1]]) return -1;
+
+  IR_Inst *compare = &fn->insts[term->a];
+  if (!IROp_IsComparison(compare->op)) return -1;
+
+  IR_Op op = compare->op;
+  IR_Value counter = compare->a;
+  IR_Value bound = compare->b;
+  if (fn->insts[bound].op == IR_PHI) {
+    counter = compare->b;
+    bound = compare->a;
+    op = SwappedComparison(op);
+  }
+  if (!stays_if_true) op = NegatedComparison(op);
+
+  IR_Value init;
+  int64_t step;
+  if (!IsCounter(loop, preheader, counter, &init, &step)) return -1;
+
+  IR_Type type = fn->insts[counter].type;
+  if (!IRType_IsSigned(type) || fn->insts[init].op != IR_CONST || fn->insts[bound].op != IR_CONST) return -1;
+
+  int64_t start = fn->insts[init].imm.i;
+  int64_t end = fn->insts[bound].imm.i;
+
+  // Keeps the arithmetic below clear of overflow
+  if (llabs(start) > (1LL << 40) || llabs(end) > (1LL << 40) || llabs(step) > (1LL << 20)) return -1;
+
+  int64_t trips;
+  switch (op) {
+    case IR_LT:
+      if (step <= 0) return -1;
+      trips = (start >= end) ? 0 : (end - start + step - 1) / step;
+      break;
+    case IR_LE:
+      if (step <= 0) return -1;
+      trips = (start > end) ? 0 : (end - start) / step + 1;
+      break;
+    case IR_GT:
+      if (step >= 0) return -1;
+      trips = (start <= end) ? 0 : (start - end - step - 1) / -step;
+      break;
+    case IR_GE:
+      if (step >= 0) return -1;
+      trips = (start < end) ? 0 : (start - end) / -step + 1;
+      break;
+    case IR_NE:
+      if (step == 0 || (end - start) % step != 0 || (end - start) / step < 0) return -1;
+      trips = (end - start) / step;
+      break;
+    default:
+      return -1;
+  }
+
+  // The counter must not wrap around, up to the value it leaves with
+  IR_Imm last = {.i = start + trips * step};
+  if (IRCanonicalImm(type, last).i != last.i) return -1;
+
+  return trips;
+}
+
+static void GatherFacts(IR_Loop *loop, LoopFacts *facts) {
+  IR_Function *fn = Loops.fn;
+  int inst_count = 0;
+  for (int i = 0; i < loop->block_count; i++) inst_count += fn->blocks[loop->blocks[i]].inst_count;
+
+  facts->exits_from_header = true;
+  facts->stored_roots = malloc((inst_count + 1) * sizeof(IR_Value));
+
+  for (int i = 0; i < loop->block_count; i++) {
+    IR_Block b = loop->blocks[i];
+    IR_BasicBlock *block = &fn->blocks[b];
+
+    for (int j = 0; j < block->inst_count; j++) {
+      IR_Inst *inst = &fn->insts[block->insts[j]];
+
+      switch (inst->op) {
+        case IR_CALL:
+        case IR_TAIL_CALL:
+          facts->has_calls = true;
+          facts->may_fail = true;
+          break;
+        case IR_PRINT:
+          facts->may_fail = true;
+          break;
+        case IR_DIV:
+        case IR_MOD:
+          if (IRInst_MayFault(fn, block->insts[j])) facts->may_fail = true;
+          break;
+        case IR_STORE: {
+          IR_Value root = IRAddressRoot(fn, inst->a);
+          if (root == IR_NONE) facts->stores_anywhere = true;
+          else facts->stored_roots[facts->stored_count++] = root;
+        } break;
+        default:
+          break;
+      }
+    }
+
+    if (b == loop->header) continue;
+
+    IR_Block succs[2];
+    int n = IRSuccessors(fn, b, succs);
+    if (n == 0) facts->exits_from_header = false;
+    for (int s = 0; s < n; s++) {
+      if (!loop->contains[succs[s]]) facts->exits_from_header = false;
+    }
+  }
+
+  facts->trip_count = TripCount(loop, facts->preheader);
+}
+
+/* === Invariant code motion === */
+
+static bool MayBeOverwritten(LoopFacts *facts, IR_Value address) {
+  if (facts->has_calls || facts->stores_anywhere) return true;
+
+  IR_Value root = IRAddressRoot(Loops.fn, address);
+  if (root == IR_NONE) return facts->stored_count > 0;
+
+  for (int i = 0; i < facts->stored_count; i++) {
+    if (IRSameRoot(Loops.fn, root, facts->stored_roots[i])) return true;
+  }
+  return false;
+}
+
+// Loads of scalars and struct members can't fault, wherever they run
+static bool IsSafeToLoadEarly(IR_Value address) {
+  IR_Inst *inst = &Loops.fn->insts[address];
+  while (inst->op == IR_MEMBER_PTR) inst = &Loops.fn->insts[inst->a];
+
+  return inst->op == IR_ALLOCA || inst->op == IR_GLOBAL || inst->op == IR_PARAM;
+}
+
+/* Whether an instruction of `block` that may fail can run before the loop
+ * instead: the loop runs at least once, reaches `block` on that first
+ * iteration, and can't do anything observable or fail before it */
+static bool CanFailEarly(IR_Loop *loop, LoopFacts *facts, IR_Block block) {
+  if (facts->trip_count < 1 || !facts->exits_from_header || facts->may_fail) return false;
+
+  for (int i = 0; i < loop->latch_count; i++) {
+    if (!IRDominates(&Loops.dom, block, loop->latches[i])) return false;
+  }
+  return true;
+}
+
+static bool IsHoistable(IR_Loop *loop, LoopFacts *facts, IR_Value v) {
+  IR_Inst *inst = &Loops.fn->insts[v];
+
+  if (inst->a != IR_NONE && InLoop(loop, inst->a)) return false;
+  if (inst->b != IR_NONE && InLoop(loop, inst->b)) return false;
+
+  switch (inst->op) {
+    case IR_CONST:
+    case IR_STRING:
+    case IR_GLOBAL:
+    case IR_ADD: case IR_SUB: case IR_MUL:
+    case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR:
+    case IR_NEG: case IR_NOT:
+    case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+    case IR_CONVERT:
+    case IR_ELEMENT_PTR:
+    case IR_MEMBER_PTR:
+      return true;
+    case IR_DIV:
+    case IR_MOD:
+      return !IRInst_MayFault(Loops.fn, v);
+    case IR_LOAD:
+      if (MayBeOverwritten(facts, inst->a)) return false;
+      return IsSafeToLoadEarly(inst->a) || CanFailEarly(loop, facts, inst->block);
+    case IR_BOUNDS_CHECK:
+      return CanFailEarly(loop, facts, inst->block);
+    default:
+      return false;
+  }
+}
+
+static void MoveToPreheader(IR_Value v, IR_Block preheader) {
+  IR_Function *fn = Loops.fn;
+  IR_BasicBlock *b = &fn->blocks[fn->insts[v].block];
+
+  int i = 0;
+  while (b->insts[i] != v) i++;
+  memmove(&b->insts[i], &b->insts[i + 1], (b->inst_count - i - 1) * sizeof(IR_Value));
+  b->inst_count--;
+
+  InsertIRInst(Loops.module, fn, preheader, fn->blocks[preheader].inst_count - 1, v);
+}
+
+// Blocks are visited in reverse postorder, so operands are considered before their uses
+static int HoistInvariants(IR_Loop *loop, LoopFacts *facts) {
+  IR_Function *fn = Loops.fn;
+  int hoisted = 0;
+
+  for (int i = 0; i < loop->block_count; i++) {
+    IR_BasicBlock *block = &fn->blocks[loop->blocks[i]];
+
+    for (int j = 0; j < block->inst_count; j++) {
+      IR_Value v = block->insts[j];
+      if (!IsHoistable(loop, facts, v)) continue;
+
+      MoveToPreheader(v, facts->preheader);
+      if (fn->insts[v].op != IR_CONST) hoisted++;
+      j--;
+    }
+  }
+
+  return hoisted;
+}
+
+/* === Strength reduction === */
+
+static IR_Value EmitInPreheader(LoopFacts *facts, IR_Inst inst) {
+  return EmitIRBeforeTerminator(Loops.module, Loops.fn, facts->preheader, inst);
+}
+
+static IR_Value EmitConstant(LoopFacts *facts, IR_Type type, int64_t value) {
+  IR_Imm imm = {.i = value};
+  return EmitInPreheader(facts, IRConst(type, imm));
+}
+
+/* A new counter in the loop header that starts at `init` and is advanced
+ * by `step`, with the counter itself as first operand, at the latch */
+static IR_Value AddCounter(IR_Loop *loop, LoopFacts *facts, IR_Value init, IR_Inst step) {
+  IR_Module *m = Loops.module;
+  IR_Function *fn = Loops.fn;
+
+  IR_Value phi = EmitIRPhi(m, fn, loop->header, fn->insts[init].type);
+  step.a = phi;
+  IR_Value next = EmitIRBeforeTerminator(m, fn, loop->latches[0], step);
+
+  IR_Value args[2];
+  args[IRPredecessorIndex(fn, loop->header, facts->preheader)] = init;
+  args[IRPredecessorIndex(fn, loop->header, loop->latches[0])] = next;
+  SetIRArgs(m, fn, phi, args, 2);
+
+  return phi;
+}
+
+// counter * factor, with the factor invariant: the product steps by step * factor
+static IR_Value ReduceProduct(IR_Loop *loop, LoopFacts *facts, IR_Value v) {
+  IR_Function *fn = Loops.fn;
+  IR_Inst inst = fn->insts[v];
+  if (!IRType_IsInteger(inst.type) || IRType_Size(inst.type) != 8) return IR_NONE;
+
+  IR_Value counter = inst.a, factor = inst.b, init;
+  int64_t step;
+  if (!IsCounter(loop, facts->preheader, counter, &init, &step)) {
+    counter = inst.b;
+    factor = inst.a;
+    if (!IsCounter(loop, facts->preheader, counter, &init, &step)) return IR_NONE;
+  }
+  if (InLoop(loop, factor)) return IR_NONE;
+
+  IR_Inst *f = &fn->insts[factor];
+  IR_Value start, stride;
+  if (f->op == IR_CONST) {
+    int64_t k = f->imm.i;
+    stride = EmitConstant(facts, inst.type, (int64_t)((uint64_t)step * (uint64_t)k));
+    if (fn->insts[init].op == IR_CONST) {
+      start = EmitConstant(facts, inst.type, (int64_t)((uint64_t)fn->insts[init].imm.i * (uint64_t)k));
+    } else {
+      start = EmitInPreheader(facts, IRBinary(IR_MUL, inst.type, init, factor));
+    }
+  } else {
+    stride = EmitInPreheader(facts, IRBinary(IR_MUL, inst.type, EmitConstant(facts, inst.type, step), factor));
+    start = EmitInPreheader(facts, IRBinary(IR_MUL, inst.type, init, factor));
+  }
+
+  return AddCounter(loop, facts, start, IRBinary(IR_ADD, inst.type, IR_NONE, stride));
+}
+
+/* &base[index] with an invariant base, where the index is a counter plus an
+ * invariant, or a counter scaled by an element size lea can't encode */
+static IR_Value ReduceElementPtr(IR_Loop *loop, LoopFacts *facts, IR_Value v) {
+  IR_Function *fn = Loops.fn;
+  IR_Inst inst = fn->insts[v];
+  if (InLoop(loop, inst.a)) return IR_NONE;
+
+  IR_Value init, start_index;
+  int64_t step;
+  IR_Inst *index = &fn->insts[inst.b];
+
+  if (IsCounter(loop, facts->preheader, inst.b, &init, &step)) {
+    int64_t size = inst.imm.i;
+    if (size == 1 || size == 2 || size == 4 || size == 8) return IR_NONE;
+    start_index = init;
+  } else if (index->op == IR_ADD) {
+    IR_Value counter = index->a, offset = index->b;
+    if (!IsCounter(loop, facts->preheader, counter, &init, &step)) {
+      counter = index->b;
+      offset = index->a;
+      if (!IsCounter(loop, facts->preheader, counter, &init, &step)) return IR_NONE;
+    }
+    if (InLoop(loop, offset)) return IR_NONE;
+
+    start_index = EmitInPreheader(facts, IRBinary(IR_ADD, IRT_I64, init, offset));
+  } else {
+    return IR_NONE;
+  }
+
+  IR_Inst start = {.op = IR_ELEMENT_PTR, .type = IRT_PTR, .a = inst.a, .b = start_index, .imm = inst.imm};
+  IR_Inst advance = {.op = IR_ELEMENT_PTR, .type = IRT_PTR, .a = IR_NONE, .b = EmitConstant(facts, IRT_I64, step), .imm = inst.imm};
+  return AddCounter(loop, facts, EmitInPreheader(facts, start), advance);
+}
+
+static int ReduceStrength(IR_Loop *loop, LoopFacts *facts) {
+  IR_Function *fn = Loops.fn;
+  if (loop->latch_count != 1) return 0;
+
+  // Collected upfront, reducing adds phis to the header and steps to the latch
+  int count = 0;
+  for (int i = 0; i < loop->block_count; i++) count += fn->blocks[loop->blocks[i]].inst_count;
+
+  IR_Value *candidates = malloc((count + 1) * sizeof(IR_Value));
+  count = 0;
+  for (int i = 0; i < loop->block_count; i++) {
+    IR_BasicBlock *block = &fn->blocks[loop->blocks[i]];
+    for (int j = 0; j < block->inst_count; j++) {
+      IR_Op op = fn->insts[block->insts[j]].op;
+      if (op == IR_MUL || op == IR_ELEMENT_PTR) candidates[count++] = block->insts[j];
+    }
+  }
+
+  // The same product or address computed twice shares one counter
+  IR_Inst *keys = malloc((count + 1) * sizeof(IR_Inst));
+  IR_Value *counters = malloc((count + 1) * sizeof(IR_Value));
+  int reduced = 0;
+
+  for (int i = 0; i < count; i++) {
+    IR_Value v = candidates[i];
+    IR_Inst inst = fn->insts[v];
+
+    IR_Value counter = IR_NONE;
+    for (int r = 0; r < reduced && counter == IR_NONE; r++) {
+      IR_Inst *key = &keys[r];
+      if (key->op == inst.op && key->a == inst.a && key->b == inst.b && key->imm.i == inst.imm.i) counter = counters[r];
+    }
+
+    if (counter == IR_NONE) {
+      counter = (inst.op == IR_MUL) ? ReduceProduct(loop, facts, v) : ReduceElementPtr(loop, facts, v);
+      if (counter == IR_NONE) continue;
+
+      keys[reduced] = inst;
+      counters[reduced++] = counter;
+    }
+
+    ReplaceAllIRUses(fn, v, counter);
+    RemoveIRInst(fn, v);
+  }
+
+  free(counters);
+  free(keys);
+  free(candidates);
+  return reduced;
+}
+
+/* === Unrolling === */
+
+static int LoopSize(IR_Loop *loop) {
+  IR_Function *fn = Loops.fn;
+  int size = 0;
+
+  for (int i = 0; i < loop->block_count; i++) {
+    IR_BasicBlock *block = &fn->blocks[loop->blocks[i]];
+    for (int j = 0; j < block->inst_count; j++) {
+      IR_Op op = fn->insts[block->insts[j]].op;
+      if (op != IR_PHI && op != IR_CONST && op != IR_JUMP) size++;
+    }
+  }
+
+  return size;
+}
+
+static IR_Value Lookup(IR_Value *map, int count, IR_Value v) {
+  return (v >= 0 && v < count && map[v] != IR_NONE) ? map[v] : v;
+}
+
+static IR_Value CloneInst(IR_Value v, IR_Block block) {
+  IR_Module *m = Loops.module;
+  IR_Function *fn = Loops.fn;
+
+  IR_Inst inst = fn->insts[v];
+  int count = inst.args_count;
+  inst.args_count = 0;
+
+  IR_Value clone = NewIRInst(m, fn, inst);
+  AppendIRInst(m, fn, block, clone);
+
+  if (count > 0) {
+    IR_Value *args = malloc(count * sizeof(IR_Value));
+    memcpy(args, IRArgs(fn, v), count * sizeof(IR_Value));
+    SetIRArgs(m, fn, clone, args, count);
+    free(args);
+  }
+
+  return clone;
+}
+
+/* Chains copies of the loop body one after another. Every copy but the
+ * original starts with the header's instructions minus its phis, which
+ * become the values the previous copy sends around the back edge, and
+ * minus its exit test, which the trip count makes redundant. Unrolling
+ * completely adds a final copy of just the header that leaves the loop. */
+static void UnrollLoop(IR_Loop *loop, int copies, bool completely) {
+  IR_Module *m = Loops.module;
+  IR_Function *fn = Loops.fn;
+  IR_Block header = loop->header;
+  IR_Block latch = loop->latches[0];
+  int latch_index = IRPredecessorIndex(fn, header, latch);
+
+  IR_Inst *test = IRTerminator(fn, header);
+  bool stays_if_true = loop->contains[test->target[0]];
+  IR_Block body = test->target[stays_if_true ? 0 : 1];
+  IR_Block exit = test->target[stays_if_true ? 1 : 0];
+
+  int value_count = fn->inst_count;
+  int block_count = fn->block_count;
+  IR_Value *previous = malloc(value_count * sizeof(IR_Value));
+  IR_Value *current = malloc(value_count * sizeof(IR_Value));
+  IR_Block *block_map = malloc(block_count * sizeof(IR_Block));
+  IR_Block *clones = malloc(loop->block_count * sizeof(IR_Block));
+  for (int v = 0; v < value_count; v++) previous[v] = IR_NONE;
+
+  // Copies are laid out like the original, one after another
+  IR_Block *ordered = malloc(loop->block_count * sizeof(IR_Block));
+  int ordered_count = 0;
+  for (int i = 0; i < Loops.layout_count; i++) {
+    IR_Block b = Loops.layout[i];
+    if (b < block_count && loop->contains[b]) ordered[ordered_count++] = b;
+  }
+  IR_Block anchor = ordered[ordered_count - 1];
+  IR_Block previous_latch = latch;
+
+  int last = completely ? copies : copies - 1;
+  for (int k = 1; k <= last; k++) {
+    bool leaves = completely && k == last;
+
+    for (int v = 0; v < value_count; v++) current[v] = IR_NONE;
+    for (int b = 0; b < block_count; b++) block_map[b] = IR_NONE;
+
+    int clone_count = 0;
+    for (int i = 0; i < ordered_count; i++) {
+      if (leaves && ordered[i] != header) continue;
+      block_map[ordered[i]] = NewIRBlock(m, fn);
+      clones[clone_count++] = block_map[ordered[i]];
+    }
+
+    for (int i = 0; i < fn->blocks[header].inst_count; i++) {
+      IR_Value phi = fn->blocks[header].insts[i];
+      if (fn->insts[phi].op != IR_PHI) break;
+      current[phi] = Lookup(previous, value_count, IRArgs(fn, phi)[latch_index]);
+    }
+
+    for (int i = 0; i < ordered_count; i++) {
+      IR_Block b = ordered[i];
+      if (block_map[b] == IR_NONE) continue;
+
+      for (int j = 0; j < fn->blocks[b].inst_count; j++) {
+        IR_Value v = fn->blocks[b].insts[j];
+        IR_Op op = fn->insts[v].op;
+        if (b == header && (op == IR_PHI || IROp_IsTerminator(op))) continue;
+
+        current[v] = CloneInst(v, block_map[b]);
+      }
+    }
+
+    for (int i = 0; i < clone_count; i++) {
+      IR_BasicBlock *clone = &fn->blocks[clones[i]];
+      for (int j = 0; j < clone->inst_count; j++) {
+        IR_Value *operands[256];
+        IR_Inst *inst = &fn->insts[clone->insts[j]];
+        int n = IRInstOperands(fn, clone->insts[j], operands, 256);
+        for (int o = 0; o < n; o++) *operands[o] = Lookup(current, value_count, *operands[o]);
+
+        // The latch already jumps to the first copy; linking the copies below fixes its target
+        if (inst->op == IR_JUMP || inst->op == IR_BRANCH) {
+          for (int t = 0; t < ((inst->op == IR_BRANCH) ? 2 : 1); t++) {
+            IR_Block target = inst->target[t];
+            if (target < block_count && block_map[target] != IR_NONE) inst->target[t] = block_map[target];
+          }
+        }
+      }
+    }
+
+    for (int i = 0; i < ordered_count; i++) {
+      IR_Block b = ordered[i];
+      if (b == header || block_map[b] == IR_NONE) continue;
+
+      for (int p = 0; p < fn->blocks[b].pred_count; p++) {
+        AddIRPredecessor(m, fn, block_map[b], block_map[fn->blocks[b].preds[p]]);
+      }
+    }
+
+    IR_Inst jump = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {leaves ? exit : block_map[body]}};
+    EmitIR(m, fn, block_map[header], jump);
+    AddIRPredecessor(m, fn, block_map[header], previous_latch);
+    IRTerminator(fn, previous_latch)->target[0] = block_map[header];
+
+    PlaceAt(LayoutPosition(anchor) + 1, clones, clone_count);
+    anchor = clones[clone_count - 1];
+    previous_latch = block_map[latch];
+
+    IR_Value *swap = previous;
+    previous = current;
+    current = swap;
+  }
+
+  if (completely) {
+    IR_Block final = block_map[header];
+
+    test = IRTerminator(fn, header);
+    test->op = IR_JUMP;
+    test->a = IR_NONE;
+    test->target[0] = body;
+
+    IR_BasicBlock *e = &fn->blocks[exit];
+    for (int p = 0; p < e->pred_count; p++) {
+      if (e->preds[p] == header) e->preds[p] = final;
+    }
+    RemoveIRPredecessor(fn, header, latch);
+
+    // Values of the header used after the loop now come from the final copy
+    for (IR_Value v = 0; v < value_count; v++) {
+      IR_Inst *inst = &fn->insts[v];
+      if (inst->op == IR_NOP || inst->block == IR_NONE || loop->contains[inst->block]) continue;
+
+      IR_Value *operands[256];
+      int n = IRInstOperands(fn, v, operands, 256);
+      for (int o = 0; o < n; o++) *operands[o] = Lookup(previous, value_count, *operands[o]);
+    }
+  } else {
+    IRTerminator(fn, previous_latch)->target[0] = header;
+    fn->blocks[header].preds[latch_index] = previous_latch;
+
+    for (int i = 0; i < fn->blocks[header].inst_count; i++) {
+      IR_Value phi = fn->blocks[header].insts[i];
+      if (fn->insts[phi].op != IR_PHI) break;
+
+      IR_Value *args = IRArgs(fn, phi);
+      args[latch_index] = Lookup(previous, value_count, args[latch_index]);
+    }
+  }
+
+  free(ordered);
+  free(clones);
+  free(block_map);
+  free(current);
+  free(previous);
+}
+
+static void ConsiderUnrolling(IR_Loop *loop, LoopFacts *facts) {
+  IR_Function *fn = Loops.fn;
+  int64_t trips = facts->trip_count;
+
+  if (trips < 0) {
+    Report(loop, "not unrolled, unknown trip count");
+    return;
+  }
+  if (trips == 0) return;
+  int64_t count = fn->blocks[loop->header].count;
+  if (Loops.module->has_profile && count == 0) {
+    Report(loop, "not unrolled, never ran in the profile");
+    return;
+  }
+  if (!facts->exits_from_header) {
+    Report(loop, "not unrolled, leaves from inside its body");
+    return;
+  }
+
+  IR_Inst *latch_jump = IRTerminator(fn, loop->latches[0]);
+  if (loop->latches[0] == loop->header || latch_jump->op != IR_JUMP) return;
+
+  bool hot = Loops.module->has_profile && count > 0 && count * HOT_LOOP_RATIO >= Loops.module->profile_max;
+  int scale = hot ? HOT_UNROLL_SCALE : 1;
+
+  int size = LoopSize(loop);
+  if (trips <= FULL_UNROLL_TRIPS * scale && trips * size <= FULL_UNROLL_SIZE * scale) {
+    UnrollLoop(loop, (int)trips, true);
+    Report(loop, "unrolled completely, %lld iterations", (long long)trips);
+    return;
+  }
+
+  int factor = MAX_UNROLL_FACTOR;
+  while (factor > 1 && (trips % factor != 0 || factor * size > UNROLL_SIZE * scale)) factor /= 2;
+
+  if (factor == 1) {
+    Report(loop, "not unrolled, %lld iterations of size %d", (long long)trips, size);
+    return;
+  }
+
+  UnrollLoop(loop, factor, false);
+  Report(loop, "unrolled by %d, %lld iterations", factor, (long long)trips);
+}
+
+// Unrolling changes the CFG, so loops are found again after every one
+static void UnrollInnermostLoops() {
+  IR_Function *fn = Loops.fn;
+  IR_Block *done = malloc((fn->block_count + 1) * sizeof(IR_Block));
+  int done_count = 0;
+
+  for (;;) {
+    Analyze();
+
+    IR_Loop *loop = NULL;
+    for (int i = 0; i < Loops.forest.loop_count && loop == NULL; i++) {
+      IR_Loop *candidate = &Loops.forest.loops[i];
+      if (!candidate->is_innermost) continue;
+
+      bool seen = false;
+      for (int d = 0; d < done_count; d++) seen |= (done[d] == candidate->header);
+      if (!seen) loop = candidate;
+    }
+
+    if (loop == NULL) {
+      ReleaseAnalyses();
+      break;
+    }
+    done[done_count++] = loop->header;
+
+    LoopFacts facts = {.preheader = FindIRPreheader(Loops.fn, &Loops.dom, loop)};
+    if (facts.preheader != IR_NONE) {
+      GatherFacts(loop, &facts);
+      ConsiderUnrolling(loop, &facts);
+    }
+
+    free(facts.stored_roots);
+    ReleaseAnalyses();
+  }
+
+  free(done);
+}
+
+static void OptimizeFunction(IR_Function *fn) {
+  if (!fn->is_defined || fn->block_count == 0) return;
+
+  Loops.fn = fn;
+  Loops.layout_count = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    ARENA_PUSH(Loops.module->arena, Loops.layout, Loops.layout_count, Loops.layout_capacity, b);
+  }
+
+  Analyze();
+  if (Loops.forest.loop_count == 0) {
+    ReleaseAnalyses();
+    return;
+  }
+
+  // Everything below places code in preheaders
+  bool inserted = false;
+  for (int i = 0; i < Loops.forest.loop_count; i++) {
+    IR_Loop *loop = &Loops.forest.loops[i];
+    if (loop->header != 0 && FindIRPreheader(Loops.fn, &Loops.dom, loop) == IR_NONE) {
+      InsertPreheader(loop);
+      inserted = true;
+    }
+  }
+  if (inserted) {
+    ReleaseAnalyses();
+    Analyze();
+  }
+
+  for (int i = 0; i < Loops.forest.loop_count; i++) {
+    IR_Loop *loop = &Loops.forest.loops[i];
+    LoopFacts facts = {.preheader = FindIRPreheader(Loops.fn, &Loops.dom, loop)};
+    if (facts.preheader == IR_NONE) continue;
+
+    GatherFacts(loop, &facts);
+    int hoisted = HoistInvariants(loop, &facts);
+    int reduced = ReduceStrength(loop, &facts);
+    if (hoisted > 0 || reduced > 0) {
+      Report(loop, "hoisted %d, strength-reduced %d", hoisted, reduced);
+    }
+
+    free(facts.stored_roots);
+  }
+  ReleaseAnalyses();
+
+  if (Loops.unroll) UnrollInnermostLoops();
+
+  ApplyLayout();
+  RemoveTrivialIRPhis(fn);
+  RemoveDeadIRValues(fn);
+}
+
+void OptimizeLoops(IR_Module *m, bool unroll, FILE *report) {
+  memset(&Loops, 0, sizeof(Loops));
+  Loops.module = m;
+  Loops.unroll = unroll;
+  Loops.report = report;
+
+  for (int i = 0; i < m->function_count; i++) {
+    OptimizeFunction(&m->functions[i]);
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef IR_LOOPS_H
+#define IR_LOOPS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Loop optimizations over natural loops, inner loops first. Every loop
+ * first gets a preheader, a block that is its only entry from outside.
+ *
+ *   invariant code motion  values computed the same way on every iteration
+ *                          move to the preheader. Loads move when nothing
+ *                          in the loop may store to their memory, bounds
+ *                          checks and loads through dynamic indices only
+ *                          when the loop is known to run at least once and
+ *                          can't print or fail in some other way first.
+ *   strength reduction     products of a counter and an invariant, and
+ *                          element addresses with a counter-plus-invariant
+ *                          or scaled index, become new counters stepped by
+ *                          an addition on every iteration
+ *   unrolling              innermost loops with a constant trip count are
+ *                          unrolled completely when small, otherwise by a
+ *                          factor that divides the trip count, so no
+ *                          remainder loop is needed; with a profile
+ *                          (ir_profile.h), loops that never ran are left
+ *                          alone and frequent ones may grow twice as large
+ *
+ * With `report` set, one line per loop and transformation describes what
+ * was done. Blocks are numbered as in the IR before loop optimization. */
+void OptimizeLoops(IR_Module *m, bool unroll, FILE *report);
+
+#endif
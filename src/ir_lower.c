@@ -0,0 +1,1528 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "error.h"
+#include "hash.h"
+#include "ir_lower.h"
+
+/* Builds SSA form directly while walking the AST, following Braun et al.,
+ * "Simple and Efficient Construction of Static Single Assignment Form".
+ *
+ * Scalar locals never touch memory: an assignment records the value as the
+ * variable's current definition in the block being filled, and a read walks
+ * up the predecessors, placing phis where control flow merges. A block is
+ * sealed once all of its predecessors are known; reads in unsealed blocks
+ * (loop headers) get placeholder phis that are completed on sealing.
+ * Trivial phis and unreachable blocks are cleaned up per function.
+ *
+ * Arrays and structs live in stack slots (IR_ALLOCA). Top level variables
+ * that a function body refers to become IR globals; all others are locals
+ * of the entry function. */
+
+typedef enum {
+  VAR_SSA,
+  VAR_MEMORY,
+  VAR_GLOBAL,
+} VarStorage;
+
+typedef struct {
+  Type type;
+  Type struct_type;     // definition with member list, for struct variables
+  IR_Type value_type;   // type of the variable's value; PTR for arrays, structs and strings
+  IR_Type element_type; // for arrays and strings
+  int length;           // array length, 0 if unknown (strings, array params)
+  int size;             // bytes of storage for memory and global variables
+
+  VarStorage storage;
+  int global;
+  IR_Value address;
+} Variable;
+
+typedef struct {
+  const char *name;
+  int length;
+  int value;
+} NameEntry;
+
+typedef struct {
+  NameEntry *entries;
+  int count;
+  int capacity;
+} NameMap;
+
+typedef struct {
+  uint64_t key; // ((block << 32) | variable) + 1, 0 marks an empty slot
+  IR_Value value;
+} DefEntry;
+
+typedef struct {
+  IR_Value phi;
+  int var;
+  int next;
+} IncompletePhi;
+
+typedef struct {
+  int var;           // IR_NONE when the value lives at `address`
+  IR_Value address;
+  IR_Type type;
+} LValue;
+
+static struct {
+  Arena *scratch;
+  IR_Module *module;
+  IR_Function *fn;
+  IR_Block block;
+  SymbolTable *st;
+
+  Variable *vars;
+  int var_count, var_capacity;
+
+  NameMap functions;
+  NameMap enum_members;
+  int64_t *enum_values;
+  int enum_count, enum_capacity;
+  NameMap captured;
+  NameMap globals;
+  NameMap locals;
+
+  // Per function SSA construction state
+  DefEntry *defs;
+  int def_count, def_capacity;
+  bool *sealed;
+  int *incomplete_head;
+  int block_state_capacity;
+  IncompletePhi *incomplete;
+  int incomplete_count, incomplete_capacity;
+
+  IR_Block break_target;
+  IR_Block continue_target;
+} Lower;
+
+static IR_Value LowerExpression(AST_Node *node, IR_Type hint);
+static void LowerStatement(AST_Node *node);
+static void LowerChain(AST_Node *chain);
+
+/* === Name maps === */
+static int NameMapGet(NameMap *map, const char *name, int length) {
+  if (map->capacity == 0) return IR_NONE;
+
+  uint64_t mask = map->capacity - 1;
+  for (uint64_t i = HashBytes(name, length) & mask;; i = (i + 1) & mask) {
+    NameEntry *e = &map->entries[i];
+    if (e->name == NULL) return IR_NONE;
+    if (e->length == length && memcmp(e->name, name, length) == 0) return e->value;
+  }
+}
+
+static void NameMapInsert(NameEntry *entries, int capacity, NameEntry entry, int *count) {
+  uint64_t mask = capacity - 1;
+  for (uint64_t i = HashBytes(entry.name, entry.length) & mask;; i = (i + 1) & mask) {
+    NameEntry *e = &entries[i];
+    if (e->name == NULL) {
+      *e = entry;
+      (*count)++;
+      return;
+    }
+    if (e->length == entry.length && memcmp(e->name, entry.name, entry.length) == 0) {
+      e->value = entry.value;
+      return;
+    }
+  }
+}
+
+static void NameMapPut(NameMap *map, const char *name, int length, int value) {
+  if ((map->count + 1) * 2 > map->capacity) {
+    int new_capacity = (map->capacity == 0) ? 64 : map->capacity * 2;
+    NameEntry *entries = ArenaAlloc(Lower.scratch, new_capacity * sizeof(NameEntry));
+    int new_count = 0;
+
+    for (int i = 0; i < map->capacity; i++) {
+      if (map->entries[i].name != NULL) NameMapInsert(entries, new_capacity, map->entries[i], &new_count);
+    }
+
+    map->entries = entries;
+    map->capacity = new_capacity;
+    map->count = new_count;
+  }
+
+  NameEntry entry = {name, length, value};
+  NameMapInsert(map->entries, map->capacity, entry, &map->count);
+}
+
+static int TokenGet(NameMap *map, Token t) {
+  return NameMapGet(map, t.position_in_source, t.length);
+}
+
+static void TokenPut(NameMap *map, Token t, int value) {
+  NameMapPut(map, t.position_in_source, t.length, value);
+}
+
+/* === SSA construction === */
+static uint64_t DefKey(int var, IR_Block block) {
+  return (((uint64_t)block << 32) | (uint32_t)var) + 1;
+}
+
+static uint64_t DefSlot(uint64_t key, int capacity) {
+  return (key * 0x9E3779B97F4A7C15ull >> 32) & (capacity - 1);
+}
+
+static IR_Value GetDef(int var, IR_Block block) {
+  if (Lower.def_capacity == 0) return IR_NONE;
+
+  uint64_t key = DefKey(var, block);
+  for (uint64_t i = DefSlot(key, Lower.def_capacity);; i = (i + 1) & (Lower.def_capacity - 1)) {
+    if (Lower.defs[i].key == 0) return IR_NONE;
+    if (Lower.defs[i].key == key) return Lower.defs[i].value;
+  }
+}
+
+static void InsertDef(DefEntry *defs, int capacity, uint64_t key, IR_Value value, int *count) {
+  for (uint64_t i = DefSlot(key, capacity);; i = (i + 1) & (capacity - 1)) {
+    if (defs[i].key == 0) {
+      defs[i].key = key;
+      defs[i].value = value;
+      (*count)++;
+      return;
+    }
+    if (defs[i].key == key) {
+      defs[i].value = value;
+      return;
+    }
+  }
+}
+
+static void SetDef(int var, IR_Block block, IR_Value value) {
+  if ((Lower.def_count + 1) * 2 > Lower.def_capacity) {
+    int new_capacity = (Lower.def_capacity == 0) ? 256 : Lower.def_capacity * 2;
+    DefEntry *defs = ArenaAlloc(Lower.scratch, new_capacity * sizeof(DefEntry));
+    int new_count = 0;
+
+    for (int i = 0; i < Lower.def_capacity; i++) {
+      if (Lower.defs[i].key != 0) InsertDef(defs, new_capacity, Lower.defs[i].key, Lower.defs[i].value, &new_count);
+    }
+
+    Lower.defs = defs;
+    Lower.def_capacity = new_capacity;
+    Lower.def_count = new_count;
+  }
+
+  InsertDef(Lower.defs, Lower.def_capacity, DefKey(var, block), value, &Lower.def_count);
+}
+
+static IR_Block NewBlock() {
+  IR_Block b = NewIRBlock(Lower.module, Lower.fn);
+
+  if (b >= Lower.block_state_capacity) {
+    int new_capacity = (Lower.block_state_capacity == 0) ? 64 : Lower.block_state_capacity * 2;
+    bool *sealed = ArenaAlloc(Lower.scratch, new_capacity * sizeof(bool));
+    int *heads = ArenaAlloc(Lower.scratch, new_capacity * sizeof(int));
+
+    if (Lower.block_state_capacity > 0) {
+      memcpy(sealed, Lower.sealed, Lower.block_state_capacity * sizeof(bool));
+      memcpy(heads, Lower.incomplete_head, Lower.block_state_capacity * sizeof(int));
+    }
+
+    Lower.sealed = sealed;
+    Lower.incomplete_head = heads;
+    Lower.block_state_capacity = new_capacity;
+  }
+
+  Lower.sealed[b] = false;
+  Lower.incomplete_head[b] = IR_NONE;
+
+  return b;
+}
+
+static IR_Value Emit(IR_Inst inst) {
+  return EmitIR(Lower.module, Lower.fn, Lower.block, inst);
+}
+
+static IR_Value EmitConst(IR_Type type, IR_Imm imm) {
+  return Emit(IRConst(type, imm));
+}
+
+static IR_Value EmitInt(IR_Type type, int64_t i) {
+  IR_Imm imm = {0};
+  if (IRType_IsFloat(type)) imm.f = (double)i;
+  else imm.i = i;
+
+  return EmitConst(type, imm);
+}
+
+static IR_Value ReadVariable(int var, IR_Block block);
+
+static IR_Value AddPhiOperands(int var, IR_Value phi) {
+  IR_Block block = Lower.fn->insts[phi].block;
+  int pred_count = Lower.fn->blocks[block].pred_count;
+  IR_Value *args = malloc((pred_count + 1) * sizeof(IR_Value));
+
+  for (int i = 0; i < pred_count; i++) {
+    args[i] = ReadVariable(var, Lower.fn->blocks[block].preds[i]);
+  }
+
+  SetIRArgs(Lower.module, Lower.fn, phi, args, pred_count);
+  free(args);
+
+  return phi;
+}
+
+static IR_Value ReadVariable(int var, IR_Block block) {
+  IR_Value v = GetDef(var, block);
+  if (v != IR_NONE) return v;
+
+  // Walk straight-line chains of single predecessors without recursing
+  IR_Block b = block;
+  while (Lower.sealed[b] && Lower.fn->blocks[b].pred_count == 1) {
+    b = Lower.fn->blocks[b].preds[0];
+    v = GetDef(var, b);
+    if (v != IR_NONE) break;
+  }
+
+  if (v == IR_NONE) {
+    IR_Type type = Lower.vars[var].value_type;
+    IR_BasicBlock *bb = &Lower.fn->blocks[b];
+
+    if (!Lower.sealed[b]) {
+      v = EmitIRPhi(Lower.module, Lower.fn, b, type);
+      IncompletePhi incomplete = {v, var, Lower.incomplete_head[b]};
+      ARENA_PUSH(Lower.scratch, Lower.incomplete, Lower.incomplete_count, Lower.incomplete_capacity, incomplete);
+      Lower.incomplete_head[b] = Lower.incomplete_count - 1;
+    } else if (bb->pred_count == 0) {
+      // Read before any assignment (or in dead code): the value is zero
+      IR_Imm zero = {0};
+      v = EmitIRBeforeTerminator(Lower.module, Lower.fn, b, IRConst(type, zero));
+    } else {
+      v = EmitIRPhi(Lower.module, Lower.fn, b, type);
+      SetDef(var, b, v);
+      AddPhiOperands(var, v);
+    }
+  }
+
+  // Cache the result in every block of the chain walked above
+  for (IR_Block c = block; c != b; c = Lower.fn->blocks[c].preds[0]) {
+    SetDef(var, c, v);
+  }
+  SetDef(var, b, v);
+
+  return v;
+}
+
+static void SealBlock(IR_Block block) {
+  for (int i = Lower.incomplete_head[block]; i != IR_NONE; i = Lower.incomplete[i].next) {
+    AddPhiOperands(Lower.incomplete[i].var, Lower.incomplete[i].phi);
+  }
+
+  Lower.incomplete_head[block] = IR_NONE;
+  Lower.sealed[block] = true;
+}
+
+static void Jump(IR_Block target) {
+  if (IRBlockIsTerminated(Lower.fn, Lower.block)) return;
+
+  IR_Inst jump = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {target, IR_NONE}};
+  Emit(jump);
+  AddIRPredecessor(Lower.module, Lower.fn, target, Lower.block);
+}
+
+static void Branch(IR_Value condition, IR_Block if_true, IR_Block if_false) {
+  IR_Inst branch = {.op = IR_BRANCH, .a = condition, .b = IR_NONE, .target = {if_true, if_false}};
+  Emit(branch);
+  AddIRPredecessor(Lower.module, Lower.fn, if_true, Lower.block);
+  AddIRPredecessor(Lower.module, Lower.fn, if_false, Lower.block);
+}
+
+// Continues lowering in a fresh block that nothing jumps to, after a
+// return, break or continue
+static void StartUnreachableBlock() {
+  Lower.block = NewBlock();
+  SealBlock(Lower.block);
+}
+
+/* === Types === */
+static IR_Type ScalarIRType(Type t) {
+  switch (t.specifier) {
+    case T_I8:     return IRT_I8;
+    case T_I16:    return IRT_I16;
+    case T_I32:    return IRT_I32;
+    case T_I64:    return IRT_I64;
+    case T_U8:     return IRT_U8;
+    case T_U16:    return IRT_U16;
+    case T_U32:    return IRT_U32;
+    case T_U64:    return IRT_U64;
+    case T_F32:    return IRT_F32;
+    case T_F64:    return IRT_F64;
+    case T_CHAR:   return IRT_CHAR;
+    case T_STRING: return IRT_PTR;
+    case T_BOOL:   return IRT_BOOL;
+    case T_ENUM:   return IRT_I64;
+    case T_STRUCT: return IRT_PTR;
+    default:       return IRT_VOID;
+  }
+}
+
+static bool IsAggregate(Type t) {
+  return (TypeIs_Array(t) && !TypeIs_String(t)) || TypeIs_Struct(t);
+}
+
+static IR_Type ValueIRType(Type t) {
+  return IsAggregate(t) ? IRT_PTR : ScalarIRType(t);
+}
+
+static bool IsNumericIRType(IR_Type t) {
+  return t >= IRT_I8 && t <= IRT_F64;
+}
+
+static IR_Type WiderIRType(IR_Type a, IR_Type b) {
+  if (IRType_IsFloat(a) || IRType_IsFloat(b)) {
+    return (a == IRT_F64 || b == IRT_F64 || !IRType_IsFloat(a) || !IRType_IsFloat(b)) ? IRT_F64 : IRT_F32;
+  }
+
+  return (IRType_Size(b) > IRType_Size(a)) ? b : a;
+}
+
+static int TypeSize(Type t, int *alignment) {
+  IR_Type element = ScalarIRType(t);
+  int size = IRType_Size(element);
+  *alignment = (size > 0) ? size : 1;
+
+  if (TypeIs_Array(t) && !TypeIs_String(t)) return size * t.array_size;
+  return size;
+}
+
+static int AlignTo(int offset, int alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+static int StructSize(Type struct_type, int *alignment) {
+  int offset = 0;
+  *alignment = 1;
+
+  for (StructMember *m = struct_type.members.next; m != NULL; m = m->next) {
+    int member_alignment;
+    int size = TypeSize(m->type, &member_alignment);
+    offset = AlignTo(offset, member_alignment) + size;
+    if (member_alignment > *alignment) *alignment = member_alignment;
+  }
+
+  return AlignTo(offset, *alignment);
+}
+
+static bool MemberLayout(Type struct_type, Token name, int *offset, Type *member_type) {
+  int current = 0;
+
+  for (StructMember *m = struct_type.members.next; m != NULL; m = m->next) {
+    int alignment;
+    int size = TypeSize(m->type, &alignment);
+    current = AlignTo(current, alignment);
+
+    if (TokenValuesMatch(m->token, name)) {
+      *offset = current;
+      *member_type = m->type;
+      return true;
+    }
+
+    current += size;
+  }
+
+  return false;
+}
+
+static Type StructDefinition(Token variable_name, Type fallback) {
+  Symbol s = RetrieveFrom(Lower.st, variable_name);
+  if (IN_SYMBOL_TABLE(s)) {
+    Symbol definition = GetSymbolById(Lower.st, s.parent_struct_symbol_guid_ref);
+    if (IN_SYMBOL_TABLE(definition) && definition.data_type.members.next != NULL) return definition.data_type;
+  }
+
+  return fallback;
+}
+
+/* === Variables === */
+static int NewVariable(Type type) {
+  Variable var = {0};
+  var.type = type;
+  var.value_type = ValueIRType(type);
+  var.element_type = IRT_VOID;
+  var.global = IR_NONE;
+  var.address = IR_NONE;
+
+  if (TypeIs_String(type)) {
+    var.element_type = IRT_CHAR;
+  } else if (TypeIs_Array(type)) {
+    var.element_type = ScalarIRType(type);
+    var.length = type.array_size;
+  }
+
+  ARENA_PUSH(Lower.scratch, Lower.vars, Lower.var_count, Lower.var_capacity, var);
+  return Lower.var_count - 1;
+}
+
+static IR_Value EmitAlloca(int size) {
+  IR_Inst alloca = {.op = IR_ALLOCA, .type = IRT_PTR, .a = IR_NONE, .b = IR_NONE, .imm.i = size};
+  IR_Value v = NewIRInst(Lower.module, Lower.fn, alloca);
+
+  // Stack slots go at the very top of the entry block so they dominate every use
+  InsertIRInst(Lower.module, Lower.fn, 0, 0, v);
+  return v;
+}
+
+static int FindGlobal(Token name, Type type) {
+  int existing = TokenGet(&Lower.globals, name);
+  if (existing == IR_NONE) return IR_NONE;
+
+  return TypesMatchExactly(Lower.vars[existing].type, type) ? existing : IR_NONE;
+}
+
+static int DeclareVariable(Token name, Type type) {
+  if (Lower.fn->is_entry && TokenGet(&Lower.captured, name) != IR_NONE) {
+    int existing = FindGlobal(name, type);
+    if (existing != IR_NONE) return existing;
+  }
+
+  int v = NewVariable(type);
+  Variable *var = &Lower.vars[v];
+  int alignment;
+
+  if (TypeIs_Struct(type)) {
+    var->struct_type = StructDefinition(name, type);
+    var->size = StructSize(var->struct_type, &alignment);
+  } else {
+    var->size = IsAggregate(type) ? TypeSize(type, &alignment) : IRType_Size(var->value_type);
+  }
+
+  if (Lower.fn->is_entry && TokenGet(&Lower.captured, name) != IR_NONE) {
+    var->storage = VAR_GLOBAL;
+    var->global = AddIRGlobal(Lower.module, name.position_in_source, name.length,
+                              IsAggregate(type) ? IRT_VOID : var->value_type, var->size);
+    TokenPut(&Lower.globals, name, v);
+    return v;
+  }
+
+  if (IsAggregate(type)) {
+    var->storage = VAR_MEMORY;
+    var->address = EmitAlloca(var->size);
+  } else {
+    var->storage = VAR_SSA;
+  }
+
+  TokenPut(&Lower.locals, name, v);
+  return v;
+}
+
+static int LookupVariable(Token name) {
+  int v = TokenGet(&Lower.locals, name);
+  if (v != IR_NONE) return v;
+
+  return TokenGet(&Lower.globals, name);
+}
+
+static int RequireVariable(Token name) {
+  int v = LookupVariable(name);
+  if (v == IR_NONE) {
+    COMPILER_ERROR_FMTMSG("LowerToIR(): Unknown variable '%.*s' on line %d", name.length, name.position_in_source, name.on_line);
+  }
+
+  return v;
+}
+
+static IR_Value VariableAddress(int v) {
+  Variable *var = &Lower.vars[v];
+
+  switch (var->storage) {
+    case VAR_MEMORY:
+      return var->address;
+    case VAR_GLOBAL: {
+      IR_Inst global = {.op = IR_GLOBAL, .type = IRT_PTR, .a = IR_NONE, .b = IR_NONE, .imm.i = var->global};
+      return Emit(global);
+    }
+    default:
+      return ReadVariable(v, Lower.block);
+  }
+}
+
+static IR_Value Load(IR_Type type, IR_Value address) {
+  return Emit(IRUnary(IR_LOAD, type, address));
+}
+
+static void Store(IR_Value address, IR_Value value) {
+  Emit(IRBinary(IR_STORE, IRT_VOID, address, value));
+}
+
+static IR_Value ReadVar(int v) {
+  Variable *var = &Lower.vars[v];
+
+  if (var->storage == VAR_SSA) return ReadVariable(v, Lower.block);
+  if (IsAggregate(var->type)) return VariableAddress(v);
+
+  IR_Type type = var->value_type;
+  return Load(type, VariableAddress(v));
+}
+
+static void WriteVar(int v, IR_Value value) {
+  if (Lower.vars[v].storage == VAR_SSA) {
+    SetDef(v, Lower.block, value);
+    return;
+  }
+
+  Store(VariableAddress(v), value);
+}
+
+/* === Literals === */
+static void TokenText(Token t, char *buffer, int size, bool skip_spaces) {
+  int n = 0;
+  for (int i = 0; i < t.length && n < size - 1; i++) {
+    if (skip_spaces && t.position_in_source[i] == ' ') continue;
+    buffer[n++] = t.position_in_source[i];
+  }
+  buffer[n] = '\0';
+}
+
+static uint64_t ParseUnsigned(Token t) {
+  char buffer[128];
+  TokenText(t, buffer, sizeof(buffer), true);
+
+  switch (t.type) {
+    case HEX_LITERAL:    return strtoull(buffer, NULL, 16);
+    case BINARY_LITERAL: return strtoull(buffer, NULL, 2);
+    default:             return strtoull(buffer, NULL, 10);
+  }
+}
+
+static char DecodeEscape(char c) {
+  switch (c) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case '0': return '\0';
+    default:  return c;
+  }
+}
+
+static int DecodeString(Token t, char *out) {
+  int n = 0;
+  for (int i = 0; i < t.length; i++) {
+    char c = t.position_in_source[i];
+    if (c == '\\' && i + 1 < t.length) c = DecodeEscape(t.position_in_source[++i]);
+    out[n++] = c;
+  }
+
+  return n;
+}
+
+static IR_Type LiteralType(Token t) {
+  switch (t.type) {
+    case INT_LITERAL:    return IRT_I64;
+    case HEX_LITERAL:
+    case BINARY_LITERAL: return IRT_U64;
+    case FLOAT_LITERAL:  return IRT_F64;
+    case CHAR_LITERAL:   return IRT_CHAR;
+    case BOOL_LITERAL:   return IRT_BOOL;
+    case STRING_LITERAL: return IRT_PTR;
+    default:             return IRT_VOID;
+  }
+}
+
+static bool LiteralIsFlexible(Token t) {
+  return t.type == INT_LITERAL || t.type == HEX_LITERAL ||
+         t.type == BINARY_LITERAL || t.type == FLOAT_LITERAL;
+}
+
+static IR_Value LowerLiteral(Token t, IR_Type hint) {
+  IR_Imm imm = {0};
+
+  switch (t.type) {
+    case INT_LITERAL:
+    case HEX_LITERAL:
+    case BINARY_LITERAL: {
+      IR_Type type = IsNumericIRType(hint) ? hint : LiteralType(t);
+      uint64_t u = ParseUnsigned(t);
+      if (IRType_IsFloat(type)) imm.f = (double)u;
+      else imm.u = u;
+
+      return EmitConst(type, imm);
+    }
+    case FLOAT_LITERAL: {
+      char buffer[128];
+      TokenText(t, buffer, sizeof(buffer), false);
+      imm.f = strtod(buffer, NULL);
+
+      return EmitConst(IRType_IsFloat(hint) ? hint : IRT_F64, imm);
+    }
+    case CHAR_LITERAL:
+      imm.u = (unsigned char)((t.length > 1 && t.position_in_source[0] == '\\')
+                                ? DecodeEscape(t.position_in_source[1])
+                                : t.position_in_source[0]);
+      return EmitConst(IRT_CHAR, imm);
+    case BOOL_LITERAL:
+      imm.u = (t.length == 4 && memcmp(t.position_in_source, "true", 4) == 0);
+      return EmitConst(IRT_BOOL, imm);
+    case STRING_LITERAL: {
+      char *decoded = malloc(t.length + 1);
+      int length = DecodeString(t, decoded);
+      IR_Inst s = {.op = IR_STRING, .type = IRT_PTR, .a = IR_NONE, .b = IR_NONE};
+      s.imm.i = AddIRString(Lower.module, decoded, length);
+      free(decoded);
+
+      return Emit(s);
+    }
+    default:
+      COMPILER_ERROR_FMTMSG("LowerLiteral(): Unexpected literal '%.*s' on line %d", t.length, t.position_in_source, t.on_line);
+      return IR_NONE;
+  }
+}
+
+/* === Expressions === */
+static IR_Value Coerce(IR_Value v, IR_Type to) {
+  IR_Inst *inst = &Lower.fn->insts[v];
+  IR_Type from = inst->type;
+
+  if (from == to || to == IRT_VOID || from == IRT_VOID) return v;
+  if (from == IRT_PTR || to == IRT_PTR) return v;
+
+  if (inst->op == IR_CONST) {
+    IR_Imm imm = IRConvertImm(from, to, inst->imm);
+    return EmitConst(to, imm);
+  }
+
+  return Emit(IRUnary(IR_CONVERT, to, v));
+}
+
+static IR_Type VariableElementOrValueType(int v, bool subscripted) {
+  Variable *var = &Lower.vars[v];
+  return subscripted ? var->element_type : var->value_type;
+}
+
+static IR_Type NameType(Token name, bool subscripted) {
+  if (TokenGet(&Lower.enum_members, name) != IR_NONE) return IRT_I64;
+
+  int v = LookupVariable(name);
+  return (v == IR_NONE) ? IRT_VOID : VariableElementOrValueType(v, subscripted);
+}
+
+static IR_Type MemberType(AST_Node *node) {
+  int v = LookupVariable(node->token);
+  if (v == IR_NONE || node->left == NULL) return IRT_VOID;
+
+  int offset;
+  Type member_type;
+  if (!MemberLayout(Lower.vars[v].struct_type, node->left->token, &offset, &member_type)) return IRT_VOID;
+
+  if (node->left->middle != NULL) return TypeIs_String(member_type) ? IRT_CHAR : ScalarIRType(member_type);
+  return ValueIRType(member_type);
+}
+
+/* The type an expression has on its own, or IRT_VOID when it is built
+ * only from numeric literals and takes the type its context asks for */
+static IR_Type NaturalType(AST_Node *node) {
+  if (node == NULL) return IRT_VOID;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+      return LiteralIsFlexible(node->token) ? IRT_VOID : LiteralType(node->token);
+    case IDENTIFIER_NODE:
+      return NameType(node->token, node->middle != NULL);
+    case FUNCTION_ARGUMENT_NODE:
+      if (node->left != NULL) return NaturalType(node->left);
+      if (node->token.type == IDENTIFIER) return NameType(node->token, false);
+      return LiteralIsFlexible(node->token) ? IRT_VOID : LiteralType(node->token);
+    case UNARY_OP_NODE:
+      return (node->token.type == LOGICAL_NOT) ? IRT_BOOL : NaturalType(node->left);
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE: {
+      IR_Type l = NaturalType(node->left);
+      IR_Type r = NaturalType(node->right);
+      if (l == IRT_VOID) return r;
+      if (r == IRT_VOID || l == r) return l;
+      return WiderIRType(l, r);
+    }
+    case BINARY_LOGICAL_NODE:
+      return IRT_BOOL;
+    case TERSE_ASSIGNMENT_NODE:
+      if (node->token.type == LOGICAL_NOT_EQUALS) return IRT_BOOL;
+      return NaturalType(node->left);
+    case ASSIGNMENT_NODE: {
+      int v = LookupVariable(node->token);
+      return (v == IR_NONE) ? IRT_VOID : VariableElementOrValueType(v, node->middle != NULL);
+    }
+    case TERNARY_IF_NODE: {
+      IR_Type t = NaturalType(node->middle);
+      return (t != IRT_VOID) ? t : NaturalType(node->right);
+    }
+    case FUNCTION_CALL_NODE: {
+      int f = TokenGet(&Lower.functions, node->token);
+      return (f == IR_NONE) ? IRT_VOID : Lower.module->functions[f].return_type;
+    }
+    case STRUCT_IDENTIFIER_NODE:
+      return MemberType(node);
+    case PREFIX_INCREMENT_NODE:
+    case PREFIX_DECREMENT_NODE:
+      return NaturalType(node->left);
+    case POSTFIX_INCREMENT_NODE:
+    case POSTFIX_DECREMENT_NODE:
+      return NameType(node->token, node->middle != NULL);
+    default:
+      return IRT_VOID;
+  }
+}
+
+static IR_Type DefaultLiteralType(AST_Node *node) {
+  if (node == NULL) return IRT_I64;
+
+  switch (node->node_type) {
+    case LITERAL_NODE:
+    case FUNCTION_ARGUMENT_NODE:
+      if (node->left != NULL) return DefaultLiteralType(node->left);
+      return LiteralIsFlexible(node->token) ? LiteralType(node->token) : IRT_I64;
+    case UNARY_OP_NODE:
+      return DefaultLiteralType(node->left);
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE: {
+      IR_Type l = DefaultLiteralType(node->left);
+      IR_Type r = DefaultLiteralType(node->right);
+      return (IRType_IsFloat(r) && !IRType_IsFloat(l)) ? r : l;
+    }
+    case TERNARY_IF_NODE:
+      return DefaultLiteralType(node->middle);
+    default:
+      return IRT_I64;
+  }
+}
+
+static IR_Type OperandType(AST_Node *left, AST_Node *right, IR_Type hint) {
+  IR_Type l = NaturalType(left);
+  IR_Type r = NaturalType(right);
+
+  if (l == IRT_VOID && r == IRT_VOID) {
+    if (IsNumericIRType(hint)) return hint;
+
+    l = DefaultLiteralType(left);
+    r = DefaultLiteralType(right);
+    return IRType_IsFloat(r) ? r : l;
+  }
+
+  if (l == IRT_VOID) return r;
+  if (r == IRT_VOID || l == r) return l;
+
+  return IsNumericIRType(hint) ? hint : WiderIRType(l, r);
+}
+
+static IR_Value LowerIndex(AST_Node *subscript);
+
+static IR_Value ElementAddress(IR_Value base, IR_Type element, int length, AST_Node *subscript) {
+  IR_Value index = LowerIndex(subscript);
+  IR_Inst *index_inst = &Lower.fn->insts[index];
+  bool in_bounds = index_inst->op == IR_CONST && index_inst->imm.i >= 0 && index_inst->imm.i < length;
+
+  if (length > 0 && !in_bounds) {
+    IR_Inst check = {.op = IR_BOUNDS_CHECK, .type = IRT_VOID, .a = index, .b = IR_NONE, .imm.i = length};
+    Emit(check);
+  }
+
+  IR_Inst element_ptr = {.op = IR_ELEMENT_PTR, .type = IRT_PTR, .a = base, .b = index, .imm.i = IRType_Size(element)};
+  return Emit(element_ptr);
+}
+
+static IR_Value VariableElementAddress(int v, AST_Node *subscript) {
+  IR_Type element = Lower.vars[v].element_type;
+  int length = Lower.vars[v].length;
+  IR_Value base = ReadVar(v);
+
+  return ElementAddress(base, element, length, subscript);
+}
+
+static LValue NameLValue(Token name, AST_Node *subscript) {
+  int v = RequireVariable(name);
+  LValue lv = {v, IR_NONE, Lower.vars[v].value_type};
+
+  if (subscript != NULL) {
+    lv.var = IR_NONE;
+    lv.type = Lower.vars[v].element_type;
+    lv.address = VariableElementAddress(v, subscript);
+  }
+
+  return lv;
+}
+
+static IR_Value LoadLValue(LValue lv) {
+  return (lv.var != IR_NONE) ? ReadVar(lv.var) : Load(lv.type, lv.address);
+}
+
+static void StoreLValue(LValue lv, IR_Value value) {
+  if (lv.var != IR_NONE) WriteVar(lv.var, value);
+  else Store(lv.address, value);
+}
+
+static IR_Value ReadName(Token name, AST_Node *subscript) {
+  int e = TokenGet(&Lower.enum_members, name);
+  if (e != IR_NONE && LookupVariable(name) == IR_NONE) {
+    return EmitInt(IRT_I64, Lower.enum_values[e]);
+  }
+
+  return LoadLValue(NameLValue(name, subscript));
+}
+
+static IR_Value LowerIndex(AST_Node *subscript) {
+  Token t = subscript->token;
+  if (t.type == INT_LITERAL) return EmitInt(IRT_I64, (int64_t)ParseUnsigned(t));
+
+  return Coerce(ReadName(t, NULL), IRT_I64);
+}
+
+static IR_Value MemberAddress(AST_Node *node, Type *member_type) {
+  int v = RequireVariable(node->token);
+  AST_Node *member = node->left;
+
+  int offset;
+  if (!MemberLayout(Lower.vars[v].struct_type, member->token, &offset, member_type)) {
+    COMPILER_ERROR_FMTMSG("LowerToIR(): '%.*s' has no member '%.*s'",
+                          node->token.length, node->token.position_in_source,
+                          member->token.length, member->token.position_in_source);
+  }
+
+  IR_Value base = ReadVar(v);
+  IR_Inst member_ptr = {.op = IR_MEMBER_PTR, .type = IRT_PTR, .a = base, .b = IR_NONE, .imm.i = offset};
+  return Emit(member_ptr);
+}
+
+static IR_Value LowerMemberAccess(AST_Node *node) {
+  Type member_type;
+  IR_Value address = MemberAddress(node, &member_type);
+  AST_Node *member = node->left;
+  IR_Type type = ValueIRType(member_type);
+
+  if (member->middle != NULL) {
+    if (TypeIs_String(member_type)) {
+      address = ElementAddress(Load(IRT_PTR, address), IRT_CHAR, 0, member->middle);
+      type = IRT_CHAR;
+    } else {
+      type = ScalarIRType(member_type);
+      address = ElementAddress(address, type, member_type.array_size, member->middle);
+    }
+  } else if (IsAggregate(member_type)) {
+    return address;
+  }
+
+  if (member->left != NULL) {
+    IR_Value value = Coerce(LowerExpression(member->left, type), type);
+    Store(address, value);
+    return value;
+  }
+
+  return Load(type, address);
+}
+
+static IR_Op ArithmeticOp(TokenType t) {
+  switch (t) {
+    case PLUS:
+    case PLUS_EQUALS:                return IR_ADD;
+    case MINUS:
+    case MINUS_EQUALS:               return IR_SUB;
+    case ASTERISK:
+    case TIMES_EQUALS:               return IR_MUL;
+    case DIVIDE:
+    case DIVIDE_EQUALS:              return IR_DIV;
+    case MODULO:
+    case MODULO_EQUALS:              return IR_MOD;
+    case BITWISE_AND:
+    case BITWISE_AND_EQUALS:         return IR_AND;
+    case BITWISE_OR:
+    case BITWISE_OR_EQUALS:          return IR_OR;
+    case BITWISE_XOR:
+    case BITWISE_XOR_EQUALS:         return IR_XOR;
+    case BITWISE_LEFT_SHIFT:
+    case BITWISE_LEFT_SHIFT_EQUALS:  return IR_SHL;
+    case BITWISE_RIGHT_SHIFT:
+    case BITWISE_RIGHT_SHIFT_EQUALS: return IR_SHR;
+    case EQUALITY:                   return IR_EQ;
+    case LOGICAL_NOT_EQUALS:         return IR_NE;
+    case LESS_THAN:                  return IR_LT;
+    case LESS_THAN_EQUALS:           return IR_LE;
+    case GREATER_THAN:               return IR_GT;
+    case GREATER_THAN_EQUALS:        return IR_GE;
+    default:                         return IR_NOP;
+  }
+}
+
+static IR_Value LowerBinary(AST_Node *node, IR_Type hint) {
+  IR_Op op = ArithmeticOp(node->token.type);
+  if (op == IR_NOP) {
+    COMPILER_ERROR_FMTMSG("LowerBinary(): Unhandled operator '%s'", TokenTypeTranslation(node->token.type));
+  }
+
+  IR_Type type = OperandType(node->left, node->right, hint);
+  if (op == IR_SHL || op == IR_SHR) {
+    IR_Type l = NaturalType(node->left);
+    if (l != IRT_VOID) type = l;
+  }
+
+  IR_Value a = Coerce(LowerExpression(node->left, type), type);
+  IR_Value b = Coerce(LowerExpression(node->right, type), type);
+
+  return Emit(IRBinary(op, type, a, b));
+}
+
+static IR_Value LowerComparison(IR_Op op, AST_Node *left, AST_Node *right) {
+  IR_Type type = OperandType(left, right, IRT_VOID);
+
+  IR_Value a = Coerce(LowerExpression(left, type), type);
+  IR_Value b = Coerce(LowerExpression(right, type), type);
+
+  return Emit(IRBinary(op, IRT_BOOL, a, b));
+}
+
+static IR_Value LowerCondition(AST_Node *node) {
+  return Coerce(LowerExpression(node, IRT_BOOL), IRT_BOOL);
+}
+
+static IR_Value LowerShortCircuit(AST_Node *node, bool is_and) {
+  IR_Value lhs = LowerCondition(node->left);
+  IR_Value shortcut = EmitInt(IRT_BOOL, is_and ? 0 : 1);
+
+  IR_Block rhs_block = NewBlock();
+  IR_Block merge = NewBlock();
+  if (is_and) Branch(lhs, rhs_block, merge);
+  else Branch(lhs, merge, rhs_block);
+
+  SealBlock(rhs_block);
+  Lower.block = rhs_block;
+  IR_Value rhs = LowerCondition(node->right);
+  Jump(merge);
+
+  SealBlock(merge);
+  Lower.block = merge;
+
+  IR_Value incoming[2] = {shortcut, rhs};
+  IR_Value phi = EmitIRPhi(Lower.module, Lower.fn, merge, IRT_BOOL);
+  SetIRArgs(Lower.module, Lower.fn, phi, incoming, 2);
+
+  return phi;
+}
+
+static IR_Value LowerLogical(AST_Node *node) {
+  switch (node->token.type) {
+    case LOGICAL_AND: return LowerShortCircuit(node, true);
+    case LOGICAL_OR:  return LowerShortCircuit(node, false);
+    default:          return LowerComparison(ArithmeticOp(node->token.type), node->left, node->right);
+  }
+}
+
+static IR_Value LowerUnary(AST_Node *node, IR_Type hint) {
+  switch (node->token.type) {
+    case LOGICAL_NOT: {
+      IR_Value v = LowerCondition(node->left);
+      return Emit(IRBinary(IR_XOR, IRT_BOOL, v, EmitInt(IRT_BOOL, 1)));
+    }
+    case BITWISE_NOT: {
+      IR_Value v = LowerExpression(node->left, hint);
+      return Emit(IRUnary(IR_NOT, Lower.fn->insts[v].type, v));
+    }
+    case MINUS: {
+      IR_Value v = LowerExpression(node->left, hint);
+      IR_Inst *inst = &Lower.fn->insts[v];
+
+      if (inst->op == IR_CONST) {
+        IR_Imm imm = inst->imm;
+        if (IRType_IsFloat(inst->type)) imm.f = -imm.f;
+        else imm.u = -imm.u;
+        return EmitConst(inst->type, imm);
+      }
+
+      return Emit(IRUnary(IR_NEG, inst->type, v));
+    }
+    default:
+      COMPILER_ERROR_FMTMSG("LowerUnary(): Unhandled operator '%s'", TokenTypeTranslation(node->token.type));
+      return IR_NONE;
+  }
+}
+
+static IR_Value LowerTernary(AST_Node *node, IR_Type hint) {
+  IR_Type type = NaturalType(node);
+  if (type == IRT_VOID) type = IsNumericIRType(hint) ? hint : DefaultLiteralType(node);
+
+  IR_Value condition = LowerCondition(node->left);
+  IR_Block then_block = NewBlock();
+  IR_Block else_block = NewBlock();
+  IR_Block merge = NewBlock();
+  Branch(condition, then_block, else_block);
+
+  SealBlock(then_block);
+  Lower.block = then_block;
+  IR_Value then_value = Coerce(LowerExpression(node->middle, type), type);
+  Jump(merge);
+
+  SealBlock(else_block);
+  Lower.block = else_block;
+  IR_Value else_value = Coerce(LowerExpression(node->right, type), type);
+  Jump(merge);
+
+  SealBlock(merge);
+  Lower.block = merge;
+
+  IR_Value incoming[2] = {then_value, else_value};
+  IR_Value phi = EmitIRPhi(Lower.module, Lower.fn, merge, type);
+  SetIRArgs(Lower.module, Lower.fn, phi, incoming, 2);
+
+  return phi;
+}
+
+static IR_Value LowerArgument(AST_Node *arg, IR_Type hint) {
+  if (arg->node_type != FUNCTION_ARGUMENT_NODE) return LowerExpression(arg, hint);
+  if (arg->left != NULL) return LowerExpression(arg->left, hint);
+  if (arg->token.type == IDENTIFIER) return ReadName(arg->token, NULL);
+
+  return LowerLiteral(arg->token, hint);
+}
+
+static IR_Value LowerCall(AST_Node *node) {
+  int f = TokenGet(&Lower.functions, node->token);
+  if (f == IR_NONE) {
+    COMPILER_ERROR_FMTMSG("LowerCall(): Unknown function '%.*s'", node->token.length, node->token.position_in_source);
+  }
+
+  IR_Function *callee = &Lower.module->functions[f];
+  int count = 0;
+  int capacity = 8;
+  IR_Value *args = malloc(capacity * sizeof(IR_Value));
+
+  for (AST_Node *arg = node->middle; arg != NULL; arg = arg->right) {
+    if (arg->node_type == CHAIN_NODE) continue;
+
+    IR_Type type = (count < callee->param_count) ? callee->param_types[count] : IRT_VOID;
+    IR_Value v = Coerce(LowerArgument(arg, type), type);
+
+    if (count == capacity) {
+      capacity *= 2;
+      args = realloc(args, capacity * sizeof(IR_Value));
+    }
+    args[count++] = v;
+  }
+
+  IR_Inst call = {.op = IR_CALL, .type = callee->return_type, .a = IR_NONE, .b = IR_NONE, .imm.i = f};
+  IR_Value v = Emit(call);
+  SetIRArgs(Lower.module, Lower.fn, v, args, count);
+  free(args);
+
+  return v;
+}
+
+static IR_Value LowerIncDec(AST_Node *node) {
+  bool is_prefix = node->node_type == PREFIX_INCREMENT_NODE || node->node_type == PREFIX_DECREMENT_NODE;
+  bool is_increment = node->node_type == PREFIX_INCREMENT_NODE || node->node_type == POSTFIX_INCREMENT_NODE;
+
+  AST_Node *target = (is_prefix) ? node->left : node;
+  LValue lv = NameLValue(target->token, target->middle);
+
+  IR_Value old_value = LoadLValue(lv);
+  IR_Value one = EmitInt(lv.type, 1);
+  IR_Value new_value = Emit(IRBinary(is_increment ? IR_ADD : IR_SUB, lv.type, old_value, one));
+  StoreLValue(lv, new_value);
+
+  return (is_prefix) ? new_value : old_value;
+}
+
+static IR_Value LowerTerseAssignment(AST_Node *node) {
+  AST_Node *target = node->left;
+
+  // "x != y" parses as a terse assignment when x is an identifier
+  if (node->token.type == LOGICAL_NOT_EQUALS) {
+    return LowerComparison(IR_NE, target, node->right);
+  }
+
+  LValue lv = NameLValue(target->token, target->middle);
+  IR_Value old_value = LoadLValue(lv);
+  IR_Value operand = Coerce(LowerExpression(node->right, lv.type), lv.type);
+  IR_Value new_value = Emit(IRBinary(ArithmeticOp(node->token.type), lv.type, old_value, operand));
+  StoreLValue(lv, new_value);
+
+  return new_value;
+}
+
+static void LowerInitializerList(int v, AST_Node *list, bool is_declaration) {
+  Variable var = Lower.vars[v];
+  IR_Value base = ReadVar(v);
+  AST_Node *entry = list;
+
+  if (TypeIs_Struct(var.type)) {
+    for (StructMember *m = var.struct_type.members.next; m != NULL; m = m->next) {
+      int offset;
+      Type member_type;
+      MemberLayout(var.struct_type, m->token, &offset, &member_type);
+
+      IR_Type type = ValueIRType(member_type);
+      IR_Inst member_ptr = {.op = IR_MEMBER_PTR, .type = IRT_PTR, .a = base, .b = IR_NONE, .imm.i = offset};
+
+      if (entry != NULL && entry->left != NULL) {
+        IR_Value value = Coerce(LowerExpression(entry->left, type), type);
+        Store(Emit(member_ptr), value);
+        entry = entry->right;
+      } else if (!is_declaration && !IsAggregate(member_type)) {
+        Store(Emit(member_ptr), EmitInt(type, 0));
+      }
+    }
+    return;
+  }
+
+  IR_Type element = var.element_type;
+  for (int i = 0; i < var.length; i++) {
+    bool has_value = entry != NULL && entry->left != NULL;
+
+    // Fresh storage is already zeroed; only reassignments clear the tail
+    if (!has_value && is_declaration) break;
+
+    IR_Inst element_ptr = {.op = IR_ELEMENT_PTR, .type = IRT_PTR, .a = base, .b = EmitInt(IRT_I64, i), .imm.i = IRType_Size(element)};
+    IR_Value value = (has_value) ? Coerce(LowerExpression(entry->left, element), element) : EmitInt(element, 0);
+    Store(Emit(element_ptr), value);
+
+    if (has_value) entry = entry->right;
+  }
+}
+
+static IR_Value LowerAssignment(AST_Node *node) {
+  bool is_declaration = node->right != NULL && node->right->node_type == DECLARATION_NODE;
+  int v;
+
+  if (is_declaration) {
+    v = DeclareVariable(node->token, node->right->data_type);
+  } else {
+    v = LookupVariable(node->token);
+    if (v == IR_NONE) v = DeclareVariable(node->token, node->data_type);
+  }
+
+  AST_Node *value = node->left;
+  if (value->node_type == INITIALIZER_LIST_NODE) {
+    LowerInitializerList(v, value, is_declaration);
+    return IR_NONE;
+  }
+
+  if (node->middle != NULL) {
+    IR_Type element = Lower.vars[v].element_type;
+    IR_Value address = VariableElementAddress(v, node->middle);
+    IR_Value result = Coerce(LowerExpression(value, element), element);
+    Store(address, result);
+    return result;
+  }
+
+  IR_Type type = Lower.vars[v].value_type;
+  IR_Value result = Coerce(LowerExpression(value, type), type);
+  WriteVar(v, result);
+
+  return result;
+}
+
+static IR_Value LowerExpression(AST_Node *node, IR_Type hint) {
+  switch (node->node_type) {
+    case LITERAL_NODE:           return LowerLiteral(node->token, hint);
+    case IDENTIFIER_NODE:        return ReadName(node->token, node->middle);
+    case UNARY_OP_NODE:          return LowerUnary(node, hint);
+    case BINARY_ARITHMETIC_NODE:
+    case BINARY_BITWISE_NODE:    return LowerBinary(node, hint);
+    case BINARY_LOGICAL_NODE:    return LowerLogical(node);
+    case TERSE_ASSIGNMENT_NODE:  return LowerTerseAssignment(node);
+    case ASSIGNMENT_NODE:        return LowerAssignment(node);
+    case TERNARY_IF_NODE:        return LowerTernary(node, hint);
+    case FUNCTION_CALL_NODE:     return LowerCall(node);
+    case FUNCTION_ARGUMENT_NODE: return LowerArgument(node, hint);
+    case STRUCT_IDENTIFIER_NODE: return LowerMemberAccess(node);
+    case PREFIX_INCREMENT_NODE:
+    case PREFIX_DECREMENT_NODE:
+    case POSTFIX_INCREMENT_NODE:
+    case POSTFIX_DECREMENT_NODE: return LowerIncDec(node);
+    default:
+      COMPILER_ERROR_FMTMSG("LowerExpression(): Unhandled node type '%s'", NodeTypeTranslation(node->node_type));
+      return IR_NONE;
+  }
+}
+
+/* === Statements === */
+static void LowerDeclaration(AST_Node *node) {
+  if (TypeIs_Function(node->data_type)) return;
+
+  int v = DeclareVariable(node->token, node->data_type);
+  if (Lower.vars[v].storage == VAR_SSA) {
+    WriteVar(v, EmitInt(Lower.vars[v].value_type, 0));
+  }
+}
+
+static void LowerIf(AST_Node *node) {
+  IR_Value condition = LowerCondition(node->left);
+
+  IR_Block then_block = NewBlock();
+  IR_Block merge = NewBlock();
+  IR_Block else_block = (node->right != NULL) ? NewBlock() : merge;
+  Branch(condition, then_block, else_block);
+
+  SealBlock(then_block);
+  Lower.block = then_block;
+  LowerChain(node->middle);
+  Jump(merge);
+
+  if (node->right != NULL) {
+    SealBlock(else_block);
+    Lower.block = else_block;
+    LowerStatement(node->right);
+    Jump(merge);
+  }
+
+  SealBlock(merge);
+  Lower.block = merge;
+}
+
+/* Lowers "while (condition) body" and, when `increment` is given, the
+ * rest of a for loop. `skip` is the chain node holding the increment
+ * inside the body, which runs in its own block so continue can reach it. */
+static void LowerLoop(AST_Node *condition, AST_Node *body, AST_Node *skip, AST_Node *increment) {
+  IR_Block header = NewBlock();
+  Jump(header);
+  Lower.block = header;
+
+  IR_Value c = LowerCondition(condition);
+  IR_Block body_block = NewBlock();
+  IR_Block exit = NewBlock();
+  IR_Block latch = (increment != NULL) ? NewBlock() : header;
+  Branch(c, body_block, exit);
+
+  IR_Block saved_break = Lower.break_target;
+  IR_Block saved_continue = Lower.continue_target;
+  Lower.break_target = exit;
+  Lower.continue_target = latch;
+
+  SealBlock(body_block);
+  Lower.block = body_block;
+  for (AST_Node *chain = body; chain != NULL; chain = chain->right) {
+    if (chain != skip && chain->left != NULL) LowerStatement(chain->left);
+  }
+  Jump(latch);
+
+  if (increment != NULL) {
+    SealBlock(latch);
+    Lower.block = latch;
+    LowerStatement(increment);
+    Jump(header);
+  }
+
+  Lower.break_target = saved_break;
+  Lower.continue_target = saved_continue;
+
+  SealBlock(header);
+  SealBlock(exit);
+  Lower.block = exit;
+}
+
+static void LowerFor(AST_Node *node) {
+  LowerStatement(node->left);
+
+  AST_Node *loop = node->right;
+  AST_Node *last = loop->right;
+  while (last != NULL && last->right != NULL) last = last->right;
+
+  AST_Node *increment = (last != NULL) ? last->left : NULL;
+  LowerLoop(loop->left, loop->right, last, increment);
+}
+
+static void LowerJump(IR_Block target, const char *statement) {
+  if (target == IR_NONE) COMPILER_ERROR_FMTMSG("LowerToIR(): '%s' outside of a loop", statement);
+
+  Jump(target);
+  StartUnreachableBlock();
+}
+
+static void LowerReturn(AST_Node *node) {
+  IR_Inst ret = {.op = IR_RETURN, .a = IR_NONE, .b = IR_NONE};
+  IR_Type type = (Lower.fn->is_entry) ? IRT_VOID : Lower.fn->return_type;
+
+  if (node->left != NULL) {
+    IR_Value v = LowerExpression(node->left, type);
+    if (type != IRT_VOID) ret.a = Coerce(v, type);
+  }
+
+  Emit(ret);
+  StartUnreachableBlock();
+}
+
+static void LowerPrint(AST_Node *node) {
+  IR_Value v = LowerExpression(node->left, IRT_VOID);
+  Emit(IRUnary(IR_PRINT, IRT_VOID, v));
+}
+
+static void LowerStatement(AST_Node *node) {
+  if (node == NULL) return;
+
+  switch (node->node_type) {
+    case START_NODE:
+    case CHAIN_NODE:
+    case FUNCTION_BODY_NODE:      LowerChain(node); break;
+    case DECLARATION_NODE:        LowerDeclaration(node); break;
+    case IF_NODE:                 LowerIf(node); break;
+    case WHILE_NODE:              LowerLoop(node->left, node->right, NULL, NULL); break;
+    case FOR_NODE:                LowerFor(node); break;
+    case BREAK_NODE:              LowerJump(Lower.break_target, "break"); break;
+    case CONTINUE_NODE:           LowerJump(Lower.continue_target, "continue"); break;
+    case RETURN_NODE:             LowerReturn(node); break;
+    case PRINT_CALL_NODE:         LowerPrint(node); break;
+
+    // Lowered separately, or carry no code
+    case FUNCTION_NODE:
+    case ENUM_IDENTIFIER_NODE:
+    case STRUCT_DECLARATION_NODE: break;
+
+    default:                      LowerExpression(node, IRT_VOID); break;
+  }
+}
+
+static void LowerChain(AST_Node *chain) {
+  for (; chain != NULL; chain = chain->right) {
+    if (chain->left != NULL) LowerStatement(chain->left);
+  }
+}
+
+/* === Functions === */
+static void BeginFunction(int f) {
+  Lower.fn = &Lower.module->functions[f];
+  Lower.fn->is_defined = true;
+
+  Lower.locals = (NameMap){0};
+  Lower.defs = NULL;
+  Lower.def_count = Lower.def_capacity = 0;
+  Lower.sealed = NULL;
+  Lower.incomplete_head = NULL;
+  Lower.block_state_capacity = 0;
+  Lower.break_target = IR_NONE;
+  Lower.continue_target = IR_NONE;
+
+  Lower.block = NewBlock();
+  SealBlock(Lower.block);
+}
+
+static void EndFunction() {
+  IR_Inst end = {.op = IR_RETURN, .a = IR_NONE, .b = IR_NONE};
+
+  // Non-void functions always end in a return the checker insisted on
+  if (!Lower.fn->is_entry && Lower.fn->return_type != IRT_VOID) end.op = IR_UNREACHABLE;
+  if (!IRBlockIsTerminated(Lower.fn, Lower.block)) Emit(end);
+
+  RemoveUnreachableIRBlocks(Lower.fn);
+  RemoveTrivialIRPhis(Lower.fn);
+}
+
+static void LowerFunction(AST_Node *node) {
+  int f = TokenGet(&Lower.functions, node->token);
+  Lower.module->functions[f].requires_tail_calls = NodeIs_TailRecursive(node);
+  BeginFunction(f);
+
+  int index = 0;
+  for (AST_Node *param = node->middle; param != NULL; param = param->left) {
+    if (param->token.type != IDENTIFIER) continue;
+
+    int v = NewVariable(param->data_type);
+    TokenPut(&Lower.locals, param->token, v);
+
+    IR_Inst p = {.op = IR_PARAM, .type = Lower.vars[v].value_type, .a = IR_NONE, .b = IR_NONE, .imm.i = index++};
+    WriteVar(v, Emit(p));
+  }
+
+  LowerChain(node->right);
+  EndFunction();
+}
+
+static void RegisterFunction(AST_Node *node) {
+  int f = TokenGet(&Lower.functions, node->token);
+  if (f != IR_NONE) return;
+
+  f = AddIRFunction(Lower.module, node->token.position_in_source, node->token.length, ScalarIRType(node->left->data_type));
+  TokenPut(&Lower.functions, node->token, f);
+
+  IR_Function *fn = &Lower.module->functions[f];
+  for (AST_Node *param = node->middle; param != NULL; param = param->left) {
+    if (param->token.type == IDENTIFIER) AddIRParam(Lower.module, fn, ValueIRType(param->data_type));
+  }
+}
+
+static int64_t ConstantInt(AST_Node *node) {
+  if (node->node_type == UNARY_OP_NODE && node->token.type == MINUS) return -ConstantInt(node->left);
+  if (node->node_type == IDENTIFIER_NODE) {
+    int e = TokenGet(&Lower.enum_members, node->token);
+    return (e != IR_NONE) ? Lower.enum_values[e] : 0;
+  }
+
+  return (int64_t)ParseUnsigned(node->token);
+}
+
+static void RegisterEnum(AST_Node *node) {
+  int64_t next = 0;
+
+  for (AST_Node *chain = node; chain != NULL; chain = chain->right) {
+    AST_Node *entry = chain->left;
+    if (entry == NULL) continue;
+
+    int64_t value = (entry->node_type == ENUM_ASSIGNMENT_NODE) ? ConstantInt(entry->left) : next;
+    next = value + 1;
+
+    ARENA_PUSH(Lower.scratch, Lower.enum_values, Lower.enum_count, Lower.enum_capacity, value);
+    TokenPut(&Lower.enum_members, entry->token, Lower.enum_count - 1);
+  }
+}
+
+// Records every identifier a function body mentions, so top level
+// variables shared with functions can be given global storage
+static void CollectCaptured(AST_Node *node) {
+  while (node != NULL) {
+    if (node->token.type == IDENTIFIER && node->token.length > 0) {
+      TokenPut(&Lower.captured, node->token, 1);
+    }
+
+    if (node->left != NULL) CollectCaptured(node->left);
+    if (node->middle != NULL) CollectCaptured(node->middle);
+    node = node->right;
+  }
+}
+
+static void RegisterTopLevel(AST_Node *root) {
+  for (AST_Node *chain = root; chain != NULL; chain = chain->right) {
+    AST_Node *stmt = chain->left;
+    if (stmt == NULL) continue;
+
+    switch (stmt->node_type) {
+      case FUNCTION_NODE:
+        RegisterFunction(stmt);
+        CollectCaptured(stmt->right);
+        break;
+      case DECLARATION_NODE:
+        if (TypeIs_Function(stmt->data_type) && stmt->left != NULL) RegisterFunction(stmt);
+        break;
+      case ENUM_IDENTIFIER_NODE:
+        RegisterEnum(stmt);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+IR_Module *LowerToIR(AST_Node *root, SymbolTable *st) {
+  memset(&Lower, 0, sizeof(Lower));
+  Lower.scratch = NewArena();
+  Lower.module = NewIRModule();
+  Lower.st = st;
+
+  RegisterTopLevel(root);
+
+  const char *entry_name = "main";
+  int entry = AddIRFunction(Lower.module, entry_name, strlen(entry_name), IRT_VOID);
+  Lower.module->entry_function = entry;
+  Lower.module->functions[entry].is_entry = true;
+
+  // Top level code first, so every global exists before function bodies refer to it
+  BeginFunction(entry);
+  LowerChain(root);
+  EndFunction();
+
+  for (AST_Node *chain = root; chain != NULL; chain = chain->right) {
+    if (chain->left != NULL && chain->left->node_type == FUNCTION_NODE) {
+      LowerFunction(chain->left);
+    }
+  }
+
+  DeleteArena(Lower.scratch);
+  return Lower.module;
+}
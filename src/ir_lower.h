@@ -0,0 +1,13 @@
+#ifndef IR_LOWER_H
+#define IR_LOWER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "symbol_table.h"
+
+/* Translates a type checked AST into an SSA IR module. Top level
+ * statements become the body of the module's entry function; every
+ * function definition becomes an IR function of its own. */
+IR_Module *LowerToIR(AST_Node *root, SymbolTable *st);
+
+#endif
@@ -0,0 +1,241 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "ir_profile.h"
+
+#define PROFILE_GLOBAL_NAME "profile"
+
+// Counter 0 holds the fingerprint, the blocks' counters follow function by function
+#define FINGERPRINT_COUNTER 0
+
+static void Mix(uint64_t *hash, const void *data, size_t length) {
+  *hash = (*hash ^ HashBytes(data, length)) * 0x100000001b3ULL;
+}
+
+static uint64_t Fingerprint(IR_Module *m, int *counter_count) {
+  uint64_t hash = 0;
+  IR_Op *ops = NULL;
+  int op_capacity = 0;
+
+  *counter_count = 1;
+  for (int i = 0; i < m->function_count; i++) {
+    IR_Function *fn = &m->functions[i];
+    if (!fn->is_defined) continue;
+
+    Mix(&hash, fn->name, strlen(fn->name));
+    Mix(&hash, &fn->block_count, sizeof(fn->block_count));
+    *counter_count += fn->block_count;
+
+    for (IR_Block b = 0; b < fn->block_count; b++) {
+      IR_BasicBlock *block = &fn->blocks[b];
+      if (block->inst_count > op_capacity) {
+        op_capacity = block->inst_count;
+        ops = realloc(ops, op_capacity * sizeof(IR_Op));
+      }
+
+      for (int k = 0; k < block->inst_count; k++) ops[k] = fn->insts[block->insts[k]].op;
+      Mix(&hash, ops, block->inst_count * sizeof(IR_Op));
+    }
+  }
+
+  free(ops);
+  return hash;
+}
+
+/* === Instrumentation === */
+static IR_Value Insert(IR_Module *m, IR_Function *fn, IR_Block b, int *position, IR_Inst inst) {
+  IR_Value v = NewIRInst(m, fn, inst);
+  InsertIRInst(m, fn, b, (*position)++, v);
+  return v;
+}
+
+static IR_Value CounterAddress(IR_Module *m, IR_Function *fn, IR_Block b, int *position, int counter) {
+  IR_Inst global = {.op = IR_GLOBAL, .type = IRT_PTR, .a = IR_NONE, .b = IR_NONE, .imm.i = m->profile_global};
+  IR_Value base = Insert(m, fn, b, position, global);
+  IR_Value index = Insert(m, fn, b, position, IRConst(IRT_I64, (IR_Imm){.i = counter}));
+
+  IR_Inst element_ptr = {.op = IR_ELEMENT_PTR, .type = IRT_PTR, .a = base, .b = index, .imm.i = sizeof(int64_t)};
+  return Insert(m, fn, b, position, element_ptr);
+}
+
+// Counting starts once phis (and the entry block's params) are done with
+static int FirstPosition(IR_Function *fn, IR_Block b) {
+  IR_BasicBlock *block = &fn->blocks[b];
+  int position = 0;
+  while (position < block->inst_count &&
+         (fn->insts[block->insts[position]].op == IR_PHI || fn->insts[block->insts[position]].op == IR_PARAM)) {
+    position++;
+  }
+
+  return position;
+}
+
+/* Blocks holding nothing but phis and a return or a jump pass the values
+ * of calls before them along, which keeps those calls tail calls; they
+ * aren't counted, so that they stay that way */
+static bool IsPassThrough(IR_Function *fn, IR_Block b) {
+  IR_BasicBlock *block = &fn->blocks[b];
+  if (block->pred_count == 0) return false;
+
+  for (int i = 0; i < block->inst_count - 1; i++) {
+    if (fn->insts[block->insts[i]].op != IR_PHI) return false;
+  }
+
+  IR_Op last = IRTerminator(fn, b)->op;
+  return last == IR_RETURN || last == IR_JUMP;
+}
+
+static void CountBlock(IR_Module *m, IR_Function *fn, IR_Block b, int counter) {
+  int position = FirstPosition(fn, b);
+  IR_Value address = CounterAddress(m, fn, b, &position, counter);
+  IR_Value count = Insert(m, fn, b, &position, IRUnary(IR_LOAD, IRT_I64, address));
+  IR_Value one = Insert(m, fn, b, &position, IRConst(IRT_I64, (IR_Imm){.i = 1}));
+  IR_Value sum = Insert(m, fn, b, &position, IRBinary(IR_ADD, IRT_I64, count, one));
+  Insert(m, fn, b, &position, IRBinary(IR_STORE, IRT_VOID, address, sum));
+}
+
+void InstrumentIRModule(IR_Module *m, const char *path) {
+  int counter_count;
+  uint64_t fingerprint = Fingerprint(m, &counter_count);
+
+  m->profile_global = AddIRGlobal(m, PROFILE_GLOBAL_NAME, strlen(PROFILE_GLOBAL_NAME), IRT_VOID,
+                                  counter_count * sizeof(int64_t));
+  m->profile_path = ArenaCopyString(m->arena, path, strlen(path));
+
+  int counter = FINGERPRINT_COUNTER + 1;
+  for (int i = 0; i < m->function_count; i++) {
+    IR_Function *fn = &m->functions[i];
+    if (!fn->is_defined) continue;
+
+    for (IR_Block b = 0; b < fn->block_count; b++, counter++) {
+      if (!IsPassThrough(fn, b)) CountBlock(m, fn, b, counter);
+    }
+
+    // Stored first thing, so that a program stopping early still writes a profile that matches
+    if (fn->is_entry) {
+      int position = FirstPosition(fn, 0);
+      IR_Value address = CounterAddress(m, fn, 0, &position, FINGERPRINT_COUNTER);
+      IR_Value value = Insert(m, fn, 0, &position, IRConst(IRT_I64, (IR_Imm){.u = fingerprint}));
+      Insert(m, fn, 0, &position, IRBinary(IR_STORE, IRT_VOID, address, value));
+    }
+  }
+}
+
+/* === Reading profiles === */
+void ApplyIRProfile(IR_Module *m, const char *path) {
+  int counter_count;
+  uint64_t fingerprint = Fingerprint(m, &counter_count);
+
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "Profile '%s' could not be read: %s, ignored\n", path, strerror(errno));
+    return;
+  }
+
+  int64_t *counters = malloc(counter_count * sizeof(int64_t));
+  size_t read = fread(counters, sizeof(int64_t), counter_count, in);
+  bool trailing = fgetc(in) != EOF;
+  fclose(in);
+
+  if (read != (size_t)counter_count || trailing || (uint64_t)counters[FINGERPRINT_COUNTER] != fingerprint) {
+    fprintf(stderr, "Profile '%s' is from another version of the program, ignored\n", path);
+    free(counters);
+    return;
+  }
+
+  int counter = FINGERPRINT_COUNTER + 1;
+  for (int i = 0; i < m->function_count; i++) {
+    IR_Function *fn = &m->functions[i];
+    if (!fn->is_defined) continue;
+
+    for (IR_Block b = 0; b < fn->block_count; b++, counter++) {
+      if (IsPassThrough(fn, b)) continue;
+
+      int64_t count = counters[counter];
+      fn->blocks[b].count = count;
+      if (count > m->profile_max) m->profile_max = count;
+    }
+  }
+  m->has_profile = true;
+
+  free(counters);
+}
+
+/* === Block layout === */
+
+// Blocks made after the profile was read, and those passing values through, take the count of their most frequent predecessor
+static void EstimateCounts(IR_Function *fn) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (IR_Block b = 0; b < fn->block_count; b++) {
+      IR_BasicBlock *block = &fn->blocks[b];
+      if (block->count >= 0) continue;
+
+      for (int i = 0; i < block->pred_count; i++) {
+        int64_t pred_count = fn->blocks[block->preds[i]].count;
+        if (pred_count > block->count) block->count = pred_count;
+      }
+      changed |= (block->count >= 0);
+    }
+  }
+}
+
+// Blocks that never ran, or that no block which ran leads to
+static bool IsCold(IR_Function *fn, IR_Block b) {
+  return fn->blocks[b].count <= 0;
+}
+
+/* Chains blocks by following the most frequent successor that isn't
+ * placed yet, never leaving a block that ran for one that didn't. When
+ * a chain ends, the next one starts at the first block left over that
+ * ran, and only then at those that didn't. */
+static void LayOutFunction(IR_Function *fn) {
+  EstimateCounts(fn);
+
+  bool *placed = calloc(fn->block_count + 1, sizeof(bool));
+  IR_Block *new_index = malloc((fn->block_count + 1) * sizeof(IR_Block));
+  bool changed = false;
+
+  IR_Block current = 0;
+  for (int position = 0; position < fn->block_count; position++) {
+    placed[current] = true;
+    new_index[current] = position;
+    changed |= (current != position);
+
+    IR_Block succs[2];
+    int succ_count = IRSuccessors(fn, current, succs);
+    IR_Block next = IR_NONE;
+    for (int i = 0; i < succ_count; i++) {
+      IR_Block s = succs[i];
+      if (placed[s] || (IsCold(fn, s) && !IsCold(fn, current))) continue;
+      if (next == IR_NONE || fn->blocks[s].count > fn->blocks[next].count) next = s;
+    }
+
+    for (IR_Block b = 0; b < fn->block_count && next == IR_NONE; b++) {
+      if (!placed[b] && !IsCold(fn, b)) next = b;
+    }
+    for (IR_Block b = 0; b < fn->block_count && next == IR_NONE; b++) {
+      if (!placed[b]) next = b;
+    }
+    current = next;
+  }
+
+  if (changed) RenumberIRBlocks(fn, new_index);
+
+  free(new_index);
+  free(placed);
+}
+
+void LayOutIRBlocks(IR_Module *m) {
+  if (!m->has_profile) return;
+
+  for (int i = 0; i < m->function_count; i++) {
+    IR_Function *fn = &m->functions[i];
+    if (fn->is_defined && fn->block_count > 0) LayOutFunction(fn);
+  }
+}
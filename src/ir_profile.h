@@ -0,0 +1,33 @@
+#ifndef IR_PROFILE_H
+#define IR_PROFILE_H
+
+#include "ir.h"
+
+/* Profile-guided optimization. A profile counts how often every block of
+ * the freshly lowered module ran: function entries, both sides of every
+ * branch, loop back edges (the counts of loop headers) and call sites (the
+ * counts of the blocks holding the calls) all follow from those.
+ *
+ * InstrumentIRModule() adds a counter per block, incremented on entry,
+ * and has the program write the counters to `path` when it returns from
+ * main or stops on a failed bounds check. The file starts with a
+ * fingerprint of the module's functions and blocks, so that a profile of
+ * another version of the program is recognized.
+ *
+ * ApplyIRProfile() reads such a file back into the blocks' counts; if it
+ * can't be read or doesn't match, a warning goes to stderr and the module
+ * is compiled as it would be without. Both run right after lowering, on
+ * the same IR. The inliner and the loop unroller consult the counts, and
+ * LayOutIRBlocks() finally orders every function's blocks so that the
+ * more frequent successor of a block follows it, with blocks that never
+ * ran moved to the end.
+ *
+ * Blocks with nothing but phis and a return or jump aren't counted, as
+ * that would keep calls ahead of them from being tail calls. They, and
+ * blocks made by later passes, count as often as their most frequent
+ * predecessor. */
+void InstrumentIRModule(IR_Module *m, const char *path);
+void ApplyIRProfile(IR_Module *m, const char *path);
+void LayOutIRBlocks(IR_Module *m);
+
+#endif
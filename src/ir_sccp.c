@@ -0,0 +1,522 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir_sccp.h"
+
+typedef enum {
+  LATTICE_UNKNOWN,   // no definition reached yet
+  LATTICE_CONSTANT,
+  LATTICE_VARYING,
+} LatticeState;
+
+typedef struct {
+  LatticeState state;
+  IR_Imm imm;
+} Lattice;
+
+static const Lattice UNKNOWN = {LATTICE_UNKNOWN, {0}};
+static const Lattice VARYING = {LATTICE_VARYING, {0}};
+
+static struct {
+  IR_Module *module;
+  IR_Function *fn;
+
+  Lattice *arguments;     // per parameter of `fn`, met over every call to it
+  Lattice *values;        // per value
+  bool *reached;          // per block
+  bool **edge_taken;      // per block, per predecessor
+
+  // Users of every value, one slice of `users` each
+  int *users_start;
+  IR_Value *users;
+
+  IR_Block *block_worklist;
+  int block_worklist_count;
+  IR_Value *value_worklist;
+  int value_worklist_count;
+  bool *value_queued;
+} SCCP;
+
+static Lattice Constant(IR_Type type, IR_Imm imm) {
+  return (Lattice){LATTICE_CONSTANT, IRCanonicalImm(type, imm)};
+}
+
+static bool SameImm(IR_Imm x, IR_Imm y) {
+  return x.u == y.u;
+}
+
+/* === Folding === */
+
+static int BitWidth(IR_Type t) {
+  return (t == IRT_BOOL) ? 1 : IRType_Size(t) * 8;
+}
+
+static Lattice FoldIntBinary(IR_Op op, IR_Type type, IR_Imm x, IR_Imm y) {
+  bool is_signed = IRType_IsSigned(type);
+  IR_Imm r = {0};
+
+  switch (op) {
+    case IR_ADD: r.u = x.u + y.u; break;
+    case IR_SUB: r.u = x.u - y.u; break;
+    case IR_MUL: r.u = x.u * y.u; break;
+    case IR_AND: r.u = x.u & y.u; break;
+    case IR_OR:  r.u = x.u | y.u; break;
+    case IR_XOR: r.u = x.u ^ y.u; break;
+    case IR_DIV:
+    case IR_MOD:
+      // Faults at runtime
+      if (y.u == 0 || (is_signed && x.i == INT64_MIN && y.i == -1)) return VARYING;
+
+      if (is_signed) r.i = (op == IR_DIV) ? x.i / y.i : x.i % y.i;
+      else r.u = (op == IR_DIV) ? x.u / y.u : x.u % y.u;
+      break;
+    case IR_SHL:
+    case IR_SHR:
+      if (y.u >= (uint64_t)BitWidth(type)) return VARYING;
+
+      if (op == IR_SHL) r.u = x.u << y.u;
+      else if (is_signed) r.i = x.i >> y.u;
+      else r.u = x.u >> y.u;
+      break;
+    default:
+      return VARYING;
+  }
+
+  return Constant(type, r);
+}
+
+static Lattice FoldFloatBinary(IR_Op op, IR_Type type, IR_Imm x, IR_Imm y) {
+  IR_Imm r = {0};
+
+  // Exact in double before rounding to the type, for floats as well
+  switch (op) {
+    case IR_ADD: r.f = x.f + y.f; break;
+    case IR_SUB: r.f = x.f - y.f; break;
+    case IR_MUL: r.f = x.f * y.f; break;
+    case IR_DIV: r.f = x.f / y.f; break;
+    default:     return VARYING;
+  }
+
+  return Constant(type, r);
+}
+
+static Lattice FoldComparison(IR_Op op, IR_Type operand_type, IR_Imm x, IR_Imm y) {
+  IR_Imm r = {0};
+  int order;
+
+  if (IRType_IsFloat(operand_type)) {
+    switch (op) {
+      case IR_EQ: r.u = x.f == y.f; break;
+      case IR_NE: r.u = x.f != y.f; break;
+      case IR_LT: r.u = x.f < y.f;  break;
+      case IR_LE: r.u = x.f <= y.f; break;
+      case IR_GT: r.u = x.f > y.f;  break;
+      case IR_GE: r.u = x.f >= y.f; break;
+      default:    return VARYING;
+    }
+    return Constant(IRT_BOOL, r);
+  }
+
+  if (IRType_IsSigned(operand_type)) order = (x.i > y.i) - (x.i < y.i);
+  else order = (x.u > y.u) - (x.u < y.u);
+
+  switch (op) {
+    case IR_EQ: r.u = order == 0; break;
+    case IR_NE: r.u = order != 0; break;
+    case IR_LT: r.u = order < 0;  break;
+    case IR_LE: r.u = order <= 0; break;
+    case IR_GT: r.u = order > 0;  break;
+    case IR_GE: r.u = order >= 0; break;
+    default:    return VARYING;
+  }
+  return Constant(IRT_BOOL, r);
+}
+
+static Lattice FoldConvert(IR_Type from, IR_Type to, IR_Imm x) {
+  if (from == IRT_PTR || to == IRT_PTR) return VARYING;
+
+  // Out of range truncations give whatever the instruction gives
+  if (IRType_IsFloat(from) && !IRType_IsFloat(to) && to != IRT_BOOL) {
+    if (!(x.f >= -9223372036854775808.0 && x.f < 9223372036854775808.0)) return VARYING;
+
+    IR_Imm r = {.i = (int64_t)x.f};
+    return Constant(to, r);
+  }
+
+  // Rounded once, straight to float
+  if (!IRType_IsFloat(from) && to == IRT_F32) {
+    bool exact = IRType_IsSigned(from) ? (x.i > -(1LL << 53) && x.i < (1LL << 53)) : x.u < (1ULL << 53);
+    if (!exact) return VARYING;
+  }
+
+  return (Lattice){LATTICE_CONSTANT, IRConvertImm(from, to, x)};
+}
+
+/* === Lattice === */
+
+static Lattice Meet(Lattice x, Lattice y) {
+  if (x.state == LATTICE_UNKNOWN) return y;
+  if (y.state == LATTICE_UNKNOWN) return x;
+  if (x.state == LATTICE_VARYING || y.state == LATTICE_VARYING) return VARYING;
+
+  return SameImm(x.imm, y.imm) ? x : VARYING;
+}
+
+static Lattice Evaluate(IR_Value v) {
+  IR_Function *fn = SCCP.fn;
+  IR_Inst *inst = &fn->insts[v];
+
+  if (inst->lanes > 0) return VARYING;
+
+  if (inst->op == IR_CONST) return Constant(inst->type, inst->imm);
+  if (inst->op == IR_PARAM) return SCCP.arguments[inst->imm.i];
+
+  if (inst->op == IR_PHI) {
+    Lattice result = UNKNOWN;
+    for (int i = 0; i < inst->args_count; i++) {
+      if (SCCP.edge_taken[inst->block][i]) result = Meet(result, SCCP.values[IRArgs(fn, v)[i]]);
+    }
+    return result;
+  }
+
+  bool is_binary = IROp_IsBinary(inst->op) || IROp_IsComparison(inst->op);
+  bool is_unary = inst->op == IR_NEG || inst->op == IR_NOT || inst->op == IR_CONVERT;
+  if (!is_binary && !is_unary) return VARYING;
+
+  Lattice x = SCCP.values[inst->a];
+  Lattice y = is_binary ? SCCP.values[inst->b] : x;
+  if (x.state == LATTICE_VARYING || y.state == LATTICE_VARYING) return VARYING;
+  if (x.state == LATTICE_UNKNOWN || y.state == LATTICE_UNKNOWN) return UNKNOWN;
+
+  IR_Type operand_type = fn->insts[inst->a].type;
+  IR_Imm r = {0};
+
+  switch (inst->op) {
+    case IR_NEG:
+      if (IRType_IsFloat(inst->type)) r.f = -x.imm.f;
+      else r.u = -x.imm.u;
+      return Constant(inst->type, r);
+    case IR_NOT:
+      if (inst->type == IRT_BOOL) r.u = !x.imm.u;
+      else r.u = ~x.imm.u;
+      return Constant(inst->type, r);
+    case IR_CONVERT:
+      return FoldConvert(operand_type, inst->type, x.imm);
+    default:
+      break;
+  }
+
+  if (IROp_IsComparison(inst->op)) return FoldComparison(inst->op, operand_type, x.imm, y.imm);
+  if (IRType_IsFloat(inst->type)) return FoldFloatBinary(inst->op, inst->type, x.imm, y.imm);
+  if (IRType_IsInteger(inst->type)) return FoldIntBinary(inst->op, inst->type, x.imm, y.imm);
+  return VARYING;
+}
+
+/* === Propagation === */
+
+static void QueueValue(IR_Value v) {
+  if (SCCP.value_queued[v]) return;
+
+  SCCP.value_queued[v] = true;
+  SCCP.value_worklist[SCCP.value_worklist_count++] = v;
+}
+
+static void Visit(IR_Value v) {
+  IR_Function *fn = SCCP.fn;
+  IR_Inst *inst = &fn->insts[v];
+  if (inst->block == IR_NONE || !SCCP.reached[inst->block]) return;
+
+  if (inst->type != IRT_VOID) {
+    Lattice old = SCCP.values[v];
+    Lattice new = Evaluate(v);
+
+    if (new.state != old.state || (new.state == LATTICE_CONSTANT && !SameImm(new.imm, old.imm))) {
+      SCCP.values[v] = new;
+      for (int i = SCCP.users_start[v]; i < SCCP.users_start[v + 1]; i++) QueueValue(SCCP.users[i]);
+    }
+  }
+
+  if (inst->op != IR_JUMP && inst->op != IR_BRANCH) return;
+
+  for (int t = 0; t < ((inst->op == IR_BRANCH) ? 2 : 1); t++) {
+    if (inst->op == IR_BRANCH) {
+      Lattice condition = SCCP.values[inst->a];
+      if (condition.state == LATTICE_UNKNOWN) continue;
+      if (condition.state == LATTICE_CONSTANT && (condition.imm.u != 0) != (t == 0)) continue;
+    }
+
+    IR_Block target = inst->target[t];
+    IR_BasicBlock *b = &fn->blocks[target];
+    bool newly_taken = false;
+
+    for (int i = 0; i < b->pred_count; i++) {
+      if (b->preds[i] != inst->block || SCCP.edge_taken[target][i]) continue;
+      SCCP.edge_taken[target][i] = true;
+      newly_taken = true;
+    }
+    if (!newly_taken) continue;
+
+    // A block is visited in full once, after that only its phis see the new edge
+    if (!SCCP.reached[target]) {
+      SCCP.reached[target] = true;
+      SCCP.block_worklist[SCCP.block_worklist_count++] = target;
+    } else {
+      for (int i = 0; i < b->inst_count && fn->insts[b->insts[i]].op == IR_PHI; i++) QueueValue(b->insts[i]);
+    }
+  }
+}
+
+static void BuildUsers() {
+  IR_Function *fn = SCCP.fn;
+  int *counts = calloc(fn->inst_count + 1, sizeof(int));
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (IR_Value v = 0; v < fn->inst_count; v++) {
+      IR_Inst *inst = &fn->insts[v];
+      if (inst->op == IR_NOP) continue;
+
+      for (int i = -2; i < inst->args_count; i++) {
+        IR_Value operand = (i == -2) ? inst->a : (i == -1) ? inst->b : fn->args[inst->args_start + i];
+        if (operand == IR_NONE) continue;
+
+        if (pass == 0) SCCP.users_start[operand + 1]++;
+        else SCCP.users[SCCP.users_start[operand] + counts[operand]++] = v;
+      }
+    }
+
+    if (pass == 0) {
+      for (IR_Value v = 0; v < fn->inst_count; v++) SCCP.users_start[v + 1] += SCCP.users_start[v];
+      SCCP.users = malloc((SCCP.users_start[fn->inst_count] + 1) * sizeof(IR_Value));
+    }
+  }
+
+  free(counts);
+}
+
+static void Propagate() {
+  IR_Function *fn = SCCP.fn;
+
+  SCCP.reached[0] = true;
+  SCCP.block_worklist[SCCP.block_worklist_count++] = 0;
+
+  while (SCCP.block_worklist_count > 0 || SCCP.value_worklist_count > 0) {
+    while (SCCP.value_worklist_count > 0) {
+      IR_Value v = SCCP.value_worklist[--SCCP.value_worklist_count];
+      SCCP.value_queued[v] = false;
+      Visit(v);
+    }
+
+    if (SCCP.block_worklist_count > 0) {
+      IR_BasicBlock *b = &fn->blocks[SCCP.block_worklist[--SCCP.block_worklist_count]];
+      for (int i = 0; i < b->inst_count; i++) Visit(b->insts[i]);
+    }
+  }
+}
+
+/* === Rewriting === */
+
+// The position of the first instruction after the phis of `block`
+static int AfterPhis(IR_Block block) {
+  IR_Function *fn = SCCP.fn;
+  IR_BasicBlock *b = &fn->blocks[block];
+  int position = 0;
+
+  while (position < b->inst_count && fn->insts[b->insts[position]].op == IR_PHI) position++;
+  return position;
+}
+
+static int FoldValues() {
+  IR_Function *fn = SCCP.fn;
+  IR_Value *replacement = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  int original_count = fn->inst_count;
+  int folded = 0;
+
+  for (IR_Value v = 0; v < original_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    replacement[v] = v;
+
+    if (inst->op == IR_NOP || inst->op == IR_CONST || inst->block == IR_NONE) continue;
+    if (!SCCP.reached[inst->block] || SCCP.values[v].state != LATTICE_CONSTANT) continue;
+
+    IR_Inst constant = IRConst(inst->type, SCCP.values[v].imm);
+    folded++;
+
+    // Phis stay first in their block
+    if (inst->op == IR_PHI) {
+      IR_Value c = NewIRInst(SCCP.module, fn, constant);
+      InsertIRInst(SCCP.module, fn, fn->insts[v].block, AfterPhis(fn->insts[v].block), c);
+      replacement[v] = c;
+    } else {
+      constant.block = inst->block;
+      *inst = constant;
+    }
+  }
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op == IR_NOP) continue;
+
+    if (inst->a != IR_NONE && inst->a < original_count) inst->a = replacement[inst->a];
+    if (inst->b != IR_NONE && inst->b < original_count) inst->b = replacement[inst->b];
+    for (int i = 0; i < inst->args_count; i++) {
+      IR_Value *arg = &fn->args[inst->args_start + i];
+      if (*arg < original_count) *arg = replacement[*arg];
+    }
+  }
+
+  free(replacement);
+  return folded;
+}
+
+// Branches with an edge that is never taken become jumps along the other one
+static int FoldBranches() {
+  IR_Function *fn = SCCP.fn;
+  int folded = 0;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_Inst *term = IRTerminator(fn, b);
+    if (!SCCP.reached[b] || term == NULL || term->op != IR_BRANCH) continue;
+    if (term->target[0] == term->target[1]) continue;
+
+    bool taken[2];
+    for (int t = 0; t < 2; t++) {
+      int index = IRPredecessorIndex(fn, term->target[t], b);
+      taken[t] = SCCP.edge_taken[term->target[t]][index];
+    }
+    if (taken[0] == taken[1]) continue;
+
+    IR_Block live = term->target[taken[0] ? 0 : 1];
+    IR_Block dead = term->target[taken[0] ? 1 : 0];
+
+    term->op = IR_JUMP;
+    term->a = IR_NONE;
+    term->target[0] = live;
+    term->target[1] = IR_NONE;
+    RemoveIRPredecessor(fn, dead, b);
+    folded++;
+  }
+
+  return folded;
+}
+
+/* A parameter is constant when every call in the module passes the same
+ * constant for it. Calls from callers propagated before have theirs folded
+ * already; the entry function and functions nobody calls know nothing */
+static int MeetArguments(int index) {
+  IR_Module *m = SCCP.module;
+  IR_Function *callee = &m->functions[index];
+  for (int i = 0; i < callee->param_count; i++) SCCP.arguments[i] = callee->is_entry ? VARYING : UNKNOWN;
+
+  for (int f = 0; f < m->function_count; f++) {
+    IR_Function *caller = &m->functions[f];
+    if (!caller->is_defined) continue;
+
+    for (IR_Value v = 0; v < caller->inst_count; v++) {
+      IR_Inst *inst = &caller->insts[v];
+      if ((inst->op != IR_CALL && inst->op != IR_TAIL_CALL) || inst->block == IR_NONE || inst->imm.i != index) continue;
+
+      for (int i = 0; i < inst->args_count; i++) {
+        IR_Inst *arg = &caller->insts[IRArgs(caller, v)[i]];
+        Lattice passed = (arg->op == IR_CONST) ? Constant(arg->type, arg->imm) : VARYING;
+        SCCP.arguments[i] = Meet(SCCP.arguments[i], passed);
+      }
+    }
+  }
+
+  int constant = 0;
+  for (int i = 0; i < callee->param_count; i++) {
+    if (SCCP.arguments[i].state == LATTICE_UNKNOWN) SCCP.arguments[i] = VARYING;
+    if (SCCP.arguments[i].state == LATTICE_CONSTANT) constant++;
+  }
+
+  return constant;
+}
+
+static void PropagateInFunction(int index, FILE *report) {
+  IR_Function *fn = &SCCP.module->functions[index];
+  if (!fn->is_defined || fn->block_count == 0) return;
+
+  SCCP.arguments = malloc((fn->param_count + 1) * sizeof(Lattice));
+  int constant_params = MeetArguments(index);
+
+  SCCP.fn = fn;
+  SCCP.values = calloc(fn->inst_count + 1, sizeof(Lattice));
+  SCCP.value_queued = calloc(fn->inst_count + 1, sizeof(bool));
+  SCCP.value_worklist = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  SCCP.value_worklist_count = 0;
+  SCCP.users_start = calloc(fn->inst_count + 2, sizeof(int));
+  SCCP.reached = calloc(fn->block_count, sizeof(bool));
+  SCCP.block_worklist = malloc(fn->block_count * sizeof(IR_Block));
+  SCCP.block_worklist_count = 0;
+  SCCP.edge_taken = malloc(fn->block_count * sizeof(bool *));
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    SCCP.edge_taken[b] = calloc(fn->blocks[b].pred_count + 1, sizeof(bool));
+  }
+
+  BuildUsers();
+  Propagate();
+
+  int block_count = fn->block_count;
+  int values = FoldValues();
+  int branches = FoldBranches();
+
+  if (branches > 0) RemoveUnreachableIRBlocks(fn);
+  if (values + branches > 0) {
+    RemoveTrivialIRPhis(fn);
+    RemoveDeadIRValues(fn);
+  }
+
+  if (report != NULL && constant_params > 0) {
+    fprintf(report, "sccp: %s: %d parameter%s passed the same constant by every call\n",
+            fn->name, constant_params, (constant_params == 1) ? "" : "s");
+  }
+  if (report != NULL && values + branches > 0) {
+    fprintf(report, "sccp: %s: %d values and %d branches folded, %d blocks removed\n",
+            fn->is_entry ? "main" : fn->name, values, branches, block_count - fn->block_count);
+  }
+
+  for (IR_Block b = 0; b < block_count; b++) free(SCCP.edge_taken[b]);
+  free(SCCP.edge_taken);
+  free(SCCP.block_worklist);
+  free(SCCP.reached);
+  free(SCCP.users);
+  free(SCCP.users_start);
+  free(SCCP.value_worklist);
+  free(SCCP.value_queued);
+  free(SCCP.values);
+  free(SCCP.arguments);
+}
+
+// Callees before their callers
+static void PostOrder(int index, bool *visited, int *order, int *count) {
+  visited[index] = true;
+
+  IR_Function *fn = &SCCP.module->functions[index];
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if ((inst->op == IR_CALL || inst->op == IR_TAIL_CALL) && !visited[inst->imm.i]) {
+      PostOrder(inst->imm.i, visited, order, count);
+    }
+  }
+
+  order[(*count)++] = index;
+}
+
+void PropagateIRConstants(IR_Module *m, FILE *report) {
+  SCCP.module = m;
+
+  bool *visited = calloc(m->function_count + 1, sizeof(bool));
+  int *order = malloc((m->function_count + 1) * sizeof(int));
+  int count = 0;
+  if (m->entry_function != IR_NONE) PostOrder(m->entry_function, visited, order, &count);
+  for (int i = 0; i < m->function_count; i++) {
+    if (!visited[i]) PostOrder(i, visited, order, &count);
+  }
+
+  // Callers first, so that the arguments they pass are folded before they are met
+  for (int i = count - 1; i >= 0; i--) PropagateInFunction(order[i], report);
+
+  free(order);
+  free(visited);
+}
@@ -0,0 +1,27 @@
+#ifndef IR_SCCP_H
+#define IR_SCCP_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Sparse conditional constant propagation. Starting from the entry block,
+ * only blocks reached along edges that may be taken are visited, and phis
+ * only meet the values coming in along such edges. A value is constant
+ * if its operands are and its operation folds the way the backends compute
+ * it, in the width of its type; divisions that would fault and shifts or
+ * conversions whose result depends on the machine are left alone.
+ *
+ * Functions are visited callers first. A parameter for which every call
+ * in the module passes the same constant starts out as that constant, so
+ * constants also propagate across calls that weren't inlined.
+ *
+ * Constant values become IR_CONSTs, branches on constants become jumps,
+ * and blocks that can't be reached anymore are removed.
+ *
+ * With `report` set, every function that changed gets a line with how many
+ * values and branches were folded and how many blocks were removed, after
+ * one with its constant parameters. */
+void PropagateIRConstants(IR_Module *m, FILE *report);
+
+#endif
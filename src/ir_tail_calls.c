@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen_x64.h"
+#include "error.h"
+#include "ir_tail_calls.h"
+
+static struct {
+  IR_Module *module;
+  IR_Function *fn;
+  int fn_index;
+
+  int *uses;        // per value
+  bool *visited;    // per value, phis seen by the current PointsIntoFrame() query
+  IR_Value *touched;
+  int touched_count;
+} TC;
+
+static void CountUses() {
+  IR_Function *fn = TC.fn;
+
+  for (IR_Value v = 0; v < fn->inst_count; v++) {
+    IR_Inst *inst = &fn->insts[v];
+    if (inst->op == IR_NOP) continue;
+
+    if (inst->a != IR_NONE) TC.uses[inst->a]++;
+    if (inst->b != IR_NONE) TC.uses[inst->b]++;
+    for (int i = 0; i < inst->args_count; i++) TC.uses[fn->args[inst->args_start + i]]++;
+  }
+}
+
+/* Whether the value of `call`, the last instruction of `block` before its
+ * terminator, leaves the function unchanged: returned right away, or
+ * returned by blocks that contain nothing but phis and a return or jump
+ * onwards, possibly carried along by one of those phis */
+static bool ReturnsUnchanged(IR_Block block, IR_Value call) {
+  IR_Function *fn = TC.fn;
+  IR_Value value = (fn->insts[call].type == IRT_VOID) ? IR_NONE : call;
+
+  for (int steps = 0; steps < fn->block_count; steps++) {
+    IR_Inst *term = IRTerminator(fn, block);
+    if (term->op == IR_RETURN) return term->a == value;
+    if (term->op != IR_JUMP) return false;
+
+    IR_Block next = term->target[0];
+    IR_BasicBlock *b = &fn->blocks[next];
+    int index = IRPredecessorIndex(fn, next, block);
+    IR_Value carried = IR_NONE;
+
+    for (int i = 0; i < b->inst_count - 1; i++) {
+      IR_Value v = b->insts[i];
+      if (fn->insts[v].op != IR_PHI) return false;
+      if (value != IR_NONE && carried == IR_NONE && IRArgs(fn, v)[index] == value) carried = v;
+    }
+
+    if (carried != IR_NONE) value = carried;
+    block = next;
+  }
+
+  return false;
+}
+
+// Stack slots die with the frame, so their addresses can't be passed along
+static bool PointsIntoFrame(IR_Value v) {
+  IR_Inst *inst = &TC.fn->insts[v];
+  if (inst->type != IRT_PTR) return false;
+
+  switch (inst->op) {
+    case IR_GLOBAL:
+    case IR_STRING:
+    case IR_PARAM:
+    case IR_CONST:
+      return false;
+    case IR_ELEMENT_PTR:
+    case IR_MEMBER_PTR:
+      return PointsIntoFrame(inst->a);
+    case IR_PHI: {
+      if (TC.visited[v]) return false;
+      TC.visited[v] = true;
+      TC.touched[TC.touched_count++] = v;
+
+      for (int i = 0; i < inst->args_count; i++) {
+        if (PointsIntoFrame(IRArgs(TC.fn, v)[i])) return true;
+      }
+      return false;
+    }
+    default:
+      return true;
+  }
+}
+
+static bool PassesFrameAddress(IR_Value call) {
+  bool result = false;
+  for (int i = 0; i < TC.fn->insts[call].args_count && !result; i++) {
+    result = PointsIntoFrame(IRArgs(TC.fn, call)[i]);
+  }
+
+  while (TC.touched_count > 0) TC.visited[TC.touched[--TC.touched_count]] = false;
+  return result;
+}
+
+static bool IsTailCall(IR_Block block, IR_Value call) {
+  IR_Function *fn = TC.fn;
+  IR_Inst *inst = &fn->insts[call];
+  IR_Function *callee = &TC.module->functions[inst->imm.i];
+
+  if (inst->type != fn->return_type) return false;
+  if (TC.uses[call] != ((inst->type == IRT_VOID) ? 0 : 1)) return false;
+  if (!ReturnsUnchanged(block, call)) return false;
+  if (PassesFrameAddress(call)) return false;
+
+  // The callee's stack arguments overwrite the ones this function received
+  return X64StackArgBytes(callee->param_types, callee->param_count) <= X64StackArgBytes(fn->param_types, fn->param_count);
+}
+
+static void RemoveTerminator(IR_Block block) {
+  IR_Function *fn = TC.fn;
+  IR_BasicBlock *b = &fn->blocks[block];
+  IR_Value term = b->insts[b->inst_count - 1];
+
+  if (fn->insts[term].op == IR_JUMP) RemoveIRPredecessor(fn, fn->insts[term].target[0], block);
+  RemoveIRInst(fn, term);
+}
+
+/* Moves everything but the parameters from the entry block into a new
+ * loop header, whose phis start out with the parameters and get the
+ * arguments of every self tail call as further incoming values */
+static void LoopifySelfCalls(IR_Value *calls, int count) {
+  IR_Module *m = TC.module;
+  IR_Function *fn = TC.fn;
+
+  // Parameters come first in the entry block
+  int param_count = 0;
+  while (param_count < fn->blocks[0].inst_count && fn->insts[fn->blocks[0].insts[param_count]].op == IR_PARAM) {
+    param_count++;
+  }
+  IR_Block header = SplitIRBlock(m, fn, 0, param_count);
+
+  IR_Inst jump = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {header}};
+  EmitIR(m, fn, 0, jump);
+  AddIRPredecessor(m, fn, header, 0);
+
+  IR_Value *phis = malloc((fn->param_count + 1) * sizeof(IR_Value));
+  for (int i = 0; i < fn->blocks[0].inst_count; i++) {
+    IR_Value param = fn->blocks[0].insts[i];
+    if (fn->insts[param].op != IR_PARAM) continue;
+
+    IR_Value phi = EmitIRPhi(m, fn, header, fn->insts[param].type);
+    ReplaceAllIRUses(fn, param, phi);
+    SetIRArgs(m, fn, phi, &param, 1);
+    phis[fn->insts[param].imm.i] = phi;
+  }
+
+  IR_Value *incoming = malloc((fn->blocks[header].pred_count + count + 1) * sizeof(IR_Value));
+  for (int c = 0; c < count; c++) {
+    IR_Value call = calls[c];
+    IR_Block block = fn->insts[call].block;
+
+    RemoveTerminator(block);
+    IR_Inst *inst = &fn->insts[call];
+    for (int i = 0; i < inst->args_count; i++) {
+      IR_Value phi = phis[i];
+      int n = fn->insts[phi].args_count;
+      memcpy(incoming, IRArgs(fn, phi), n * sizeof(IR_Value));
+      incoming[n] = IRArgs(fn, call)[i];
+      SetIRArgs(m, fn, phi, incoming, n + 1);
+    }
+
+    RemoveIRInst(fn, call);
+    EmitIR(m, fn, block, jump);
+    AddIRPredecessor(m, fn, header, block);
+  }
+
+  free(incoming);
+  free(phis);
+}
+
+// Puts the loop header right after the entry block, where it started out
+static void MoveHeaderAfterEntry(IR_Block header) {
+  IR_Function *fn = TC.fn;
+  IR_Block *new_index = malloc(fn->block_count * sizeof(IR_Block));
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    if (b == 0) new_index[b] = 0;
+    else if (b == header) new_index[b] = 1;
+    else new_index[b] = (b < header) ? b + 1 : b;
+  }
+  RenumberIRBlocks(fn, new_index);
+
+  free(new_index);
+}
+
+static void OptimizeFunction(int index) {
+  IR_Function *fn = &TC.module->functions[index];
+  if (!fn->is_defined || fn->is_entry) return;
+
+  TC.fn = fn;
+  TC.fn_index = index;
+  TC.uses = calloc(fn->inst_count + 1, sizeof(int));
+  TC.visited = calloc(fn->inst_count + 1, sizeof(bool));
+  TC.touched = malloc((fn->inst_count + 1) * sizeof(IR_Value));
+  TC.touched_count = 0;
+  CountUses();
+
+  // Fresh zeroed locals on each iteration would need the prologue, so those recurse by jumping
+  bool has_locals = false;
+  for (int i = 0; i < fn->blocks[0].inst_count; i++) {
+    if (fn->insts[fn->blocks[0].insts[i]].op == IR_ALLOCA) has_locals = true;
+  }
+
+  IR_Value *self_calls = malloc((fn->block_count + 1) * sizeof(IR_Value));
+  int self_count = 0;
+  bool changed = false;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    if (block->inst_count < 2) continue;
+
+    IR_Value call = block->insts[block->inst_count - 2];
+    if (fn->insts[call].op != IR_CALL || !IsTailCall(b, call)) continue;
+
+    if (fn->insts[call].imm.i == index && !has_locals) {
+      self_calls[self_count++] = call;
+    } else {
+      RemoveTerminator(b);
+      fn->insts[call].op = IR_TAIL_CALL;
+      fn->insts[call].type = IRT_VOID;
+    }
+    changed = true;
+  }
+
+  if (self_count > 0) LoopifySelfCalls(self_calls, self_count);
+  if (changed) {
+    RemoveUnreachableIRBlocks(fn);
+    RemoveTrivialIRPhis(fn);
+  }
+  if (self_count > 0) MoveHeaderAfterEntry(fn->block_count - 1);
+
+  for (IR_Value v = 0; v < fn->inst_count && fn->requires_tail_calls; v++) {
+    if (fn->insts[v].op == IR_CALL && fn->insts[v].imm.i == index) {
+      COMPILER_ERROR_FMTMSG("Recursive call %%%d in tailrec function '%s' was not optimized", v, fn->name);
+    }
+  }
+
+  free(self_calls);
+  free(TC.touched);
+  free(TC.visited);
+  free(TC.uses);
+}
+
+void OptimizeTailCalls(IR_Module *m) {
+  TC.module = m;
+
+  for (int i = 0; i < m->function_count; i++) {
+    OptimizeFunction(i);
+  }
+}
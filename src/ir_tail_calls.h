@@ -0,0 +1,21 @@
+#ifndef IR_TAIL_CALLS_H
+#define IR_TAIL_CALLS_H
+
+#include "ir.h"
+
+/* Tail call optimization. A call whose result is returned unchanged, either
+ * directly or through the phis of blocks that do nothing but return, needs
+ * nothing from the caller's frame afterwards:
+ *
+ *   - self tail calls become a jump back to a loop header whose phis take
+ *     the new arguments
+ *   - other tail calls become IR_TAIL_CALL terminators, which the backend
+ *     turns into a jump that reuses the caller's frame
+ *
+ * Calls passing addresses into the caller's frame are left alone, as are
+ * calls that need more stack space for their arguments than the caller
+ * received. A function declared 'tailrec' that still calls itself
+ * afterwards is a compiler error: the type checker rejects those upfront. */
+void OptimizeTailCalls(IR_Module *m);
+
+#endif
@@ -0,0 +1,748 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen_x64.h"
+#include "ir_analysis.h"
+#include "ir_vectorize.h"
+
+// Vectors live in stack slots, so loops with fewer lanes run slower vectorized than scalar
+#define MIN_LANES 4
+
+typedef enum {
+  VC_UNIFORM, // the same on every iteration
+  VC_COUNTER,
+  VC_INDEX,   // the counter plus or minus something uniform
+  VC_ADDRESS, // an array element at an index
+  VC_VARYING, // one value per lane
+  VC_STEP,    // the counter's next value
+} ValueClass;
+
+typedef struct {
+  IR_Loop *loop;
+  IR_Block preheader;
+  IR_Block *body;         // the blocks after the header, ending with the latch
+  int body_count;
+
+  IR_Value counter, step, init, bound;
+  IR_Op compare;          // IR_LT or IR_LE, with the counter on the left
+
+  IR_Value *reductions;   // header phis other than the counter
+  int reduction_count;
+
+  int value_count;        // the arrays below cover the values from before vectorizing
+  ValueClass *classes;
+  int *uses;              // uses inside the loop
+  IR_Value *offsets;      // what an index adds to the counter
+  IR_Value *accesses;     // loads and stores
+  int access_count;
+
+  IR_Type element_type;
+  int lanes;
+
+  // Filled in while vectorizing
+  IR_Value *scalars;
+  IR_Value *vectors;
+  IR_Value *broadcasts;
+  IR_Value last_lane;     // lanes - 1
+} Candidate;
+
+static struct {
+  IR_Module *module;
+  IR_Function *fn;
+  int width;
+  FILE *report;
+
+  IR_DomTree dom;
+  IR_LoopForest forest;
+
+  IR_Block *layout;       // block order, applied once the function is done
+  int layout_count, layout_capacity;
+
+  char reason[128];
+} Vec;
+
+static void Report(IR_Block header, const char *fmt, ...) {
+  if (Vec.report == NULL) return;
+
+  fprintf(Vec.report, "loops: %s: loop at bb%d: ", Vec.fn->is_entry ? "main" : Vec.fn->name, header);
+
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(Vec.report, fmt, args);
+  va_end(args);
+
+  fputc('\n', Vec.report);
+}
+
+static void Analyze() {
+  ComputeIRDominators(Vec.fn, &Vec.dom);
+  ComputeIRLoops(Vec.fn, &Vec.dom, &Vec.forest);
+}
+
+static void ReleaseAnalyses() {
+  FreeIRLoops(&Vec.forest);
+  FreeIRDominators(&Vec.dom);
+}
+
+static bool InLoop(Candidate *c, IR_Value v) {
+  IR_Block b = Vec.fn->insts[v].block;
+  return b != IR_NONE && b < Vec.dom.block_count && c->loop->contains[b];
+}
+
+/* === Loop shape === */
+
+// A phi of the header that starts out with `init` and is advanced as `phi + 1` at the latch
+static bool IsUnitCounter(Candidate *c, IR_Value phi, IR_Value *init, IR_Value *step) {
+  IR_Function *fn = Vec.fn;
+  IR_Inst *inst = &fn->insts[phi];
+  if (inst->op != IR_PHI || inst->block != c->loop->header || inst->type != IRT_I64 || inst->args_count != 2) return false;
+
+  int entry = IRPredecessorIndex(fn, c->loop->header, c->preheader);
+  int latch = IRPredecessorIndex(fn, c->loop->header, c->loop->latches[0]);
+  IR_Value next = IRArgs(fn, phi)[latch];
+  IR_Inst *add = &fn->insts[next];
+  if (add->op != IR_ADD) return false;
+
+  IR_Value amount = (add->a == phi) ? add->b : (add->b == phi) ? add->a : IR_NONE;
+  if (amount == IR_NONE || fn->insts[amount].op != IR_CONST || fn->insts[amount].imm.i != 1) return false;
+
+  *init = IRArgs(fn, phi)[entry];
+  *step = next;
+  return true;
+}
+
+static const char *CheckExitTest(Candidate *c) {
+  IR_Function *fn = Vec.fn;
+  IR_Loop *loop = c->loop;
+  IR_Inst *term = IRTerminator(fn, loop->header);
+  if (term->op != IR_BRANCH || !loop->contains[term->target[0]] || loop->contains[term->target[1]]) {
+    return "has an unsupported exit test";
+  }
+
+  IR_Inst *compare = &fn->insts[term->a];
+  if (compare->block != loop->header || c->uses[term->a] != 1) return "has an unsupported exit test";
+
+  IR_Op op = compare->op;
+  IR_Value counter = compare->a, bound = compare->b;
+  if (op == IR_GT || op == IR_GE) {
+    op = (op == IR_GT) ? IR_LT : IR_LE;
+    counter = compare->b;
+    bound = compare->a;
+  }
+  if (op != IR_LT && op != IR_LE) return "has an unsupported exit test";
+
+  if (!IsUnitCounter(c, counter, &c->init, &c->step)) return "does not count up by one";
+  if (InLoop(c, bound) && fn->insts[bound].op != IR_CONST) return "has a bound that changes inside the loop";
+
+  c->counter = counter;
+  c->bound = bound;
+  c->compare = op;
+  return NULL;
+}
+
+// Straight-line code from the header's successor to the latch
+static const char *FindBody(Candidate *c) {
+  IR_Function *fn = Vec.fn;
+  IR_Loop *loop = c->loop;
+  IR_Block b = IRTerminator(fn, loop->header)->target[0];
+
+  c->body = malloc(loop->block_count * sizeof(IR_Block));
+  for (;;) {
+    if (b == loop->header || fn->blocks[b].pred_count != 1 || c->body_count == loop->block_count - 1) {
+      return "has branches in its body";
+    }
+    c->body[c->body_count++] = b;
+
+    IR_Inst *term = IRTerminator(fn, b);
+    if (term->op != IR_JUMP) return "has branches in its body";
+    if (b == loop->latches[0]) break;
+    b = term->target[0];
+  }
+
+  if (c->body_count != loop->block_count - 1) return "has branches in its body";
+  return NULL;
+}
+
+static void CountUses(Candidate *c) {
+  IR_Function *fn = Vec.fn;
+  IR_Loop *loop = c->loop;
+
+  for (int i = 0; i < loop->block_count; i++) {
+    IR_BasicBlock *block = &fn->blocks[loop->blocks[i]];
+    for (int j = 0; j < block->inst_count; j++) {
+      IR_Value *operands[256];
+      int n = IRInstOperands(fn, block->insts[j], operands, 256);
+      for (int o = 0; o < n; o++) c->uses[*operands[o]]++;
+    }
+  }
+}
+
+/* === Classification === */
+
+static bool IsIndex(ValueClass vc) {
+  return vc == VC_COUNTER || vc == VC_INDEX;
+}
+
+static ValueClass ClassOf(Candidate *c, IR_Value v) {
+  return InLoop(c, v) ? c->classes[v] : VC_UNIFORM;
+}
+
+// Every vector holds elements of one size, which decides the number of lanes
+static const char *UseElementType(Candidate *c, IR_Type type) {
+  if (!IRType_IsFloat(type) && (!IRType_IsInteger(type) || type == IRT_BOOL || type == IRT_CHAR)) {
+    snprintf(Vec.reason, sizeof(Vec.reason), "works on %s elements", IRTypeTranslation(type));
+    return Vec.reason;
+  }
+
+  if (c->lanes == 0) {
+    c->element_type = type;
+    c->lanes = Vec.width / IRType_Size(type);
+  }
+  return (IRType_Size(type) == IRType_Size(c->element_type)) ? NULL : "mixes element sizes";
+}
+
+/* Reductions are header phis that are only ever combined with something
+ * by an integer operation whose result goes nowhere but back to the phi */
+static const char *CheckReduction(Candidate *c, IR_Value phi) {
+  IR_Function *fn = Vec.fn;
+  IR_Inst *inst = &fn->insts[phi];
+  int latch = IRPredecessorIndex(fn, c->loop->header, c->loop->latches[0]);
+  IR_Value next = IRArgs(fn, phi)[latch];
+  IR_Inst *combine = &fn->insts[next];
+
+  bool combines = combine->op == IR_ADD || combine->op == IR_MUL || combine->op == IR_AND ||
+                  combine->op == IR_OR || combine->op == IR_XOR;
+  if (!InLoop(c, next) || !combines || (combine->a != phi && combine->b != phi) ||
+      c->uses[phi] != 1 || c->uses[next] != 1) {
+    return "carries a value from one iteration to the next";
+  }
+  if (IRType_IsFloat(inst->type)) return "has a floating-point reduction";
+
+  c->reductions[c->reduction_count++] = phi;
+  c->classes[phi] = VC_VARYING;
+  return UseElementType(c, inst->type);
+}
+
+static const char *Classify(Candidate *c, IR_Value v) {
+  IR_Function *fn = Vec.fn;
+  IR_Inst *inst = &fn->insts[v];
+  ValueClass a = (inst->a != IR_NONE) ? ClassOf(c, inst->a) : VC_UNIFORM;
+  ValueClass b = (inst->b != IR_NONE) ? ClassOf(c, inst->b) : VC_UNIFORM;
+
+  if (v == c->step) {
+    c->classes[v] = VC_STEP;
+    return NULL;
+  }
+  if (inst->op == IR_CALL) return "calls a function";
+  if (inst->op == IR_PRINT) return "prints";
+  if (a == VC_STEP || b == VC_STEP) return "uses the counter as a value";
+
+  // The counter only indexes arrays, possibly offset by something uniform
+  if (IsIndex(a) || IsIndex(b)) {
+    switch (inst->op) {
+      case IR_ADD:
+      case IR_SUB:
+        if (IsIndex(a) && b == VC_UNIFORM) c->offsets[v] = inst->b;
+        else if (inst->op == IR_ADD && a == VC_UNIFORM && IsIndex(b)) c->offsets[v] = inst->a;
+        else return "uses the counter as a value";
+
+        c->classes[v] = VC_INDEX;
+        return NULL;
+      case IR_ELEMENT_PTR:
+        if (a != VC_UNIFORM) return "uses the counter as a value";
+        c->classes[v] = VC_ADDRESS;
+        return NULL;
+      case IR_BOUNDS_CHECK:
+        c->classes[v] = VC_UNIFORM;
+        return NULL;
+      default:
+        return "uses the counter as a value";
+    }
+  }
+
+  // Element addresses are only loaded from and stored to, one element at a time
+  if (a == VC_ADDRESS && b != VC_ADDRESS && (inst->op == IR_LOAD || inst->op == IR_STORE)) {
+    IR_Type type = (inst->op == IR_LOAD) ? inst->type : fn->insts[inst->b].type;
+    const char *reason = UseElementType(c, type);
+    if (reason != NULL) return reason;
+    if (fn->insts[inst->a].imm.i != IRType_Size(type)) return "accesses struct members";
+
+    c->accesses[c->access_count++] = v;
+    c->classes[v] = VC_VARYING;
+    return NULL;
+  }
+  if (a == VC_ADDRESS || b == VC_ADDRESS) return "uses an element address as a value";
+
+  if (a == VC_VARYING || b == VC_VARYING) {
+    if (inst->op == IR_STORE) return "stores to the same element on every iteration";
+    if (!IROp_IsBinary(inst->op)) {
+      snprintf(Vec.reason, sizeof(Vec.reason), "has no vector form of '%s'", IROpTranslation(inst->op));
+      return Vec.reason;
+    }
+
+    const char *reason = UseElementType(c, inst->type);
+    if (reason != NULL) return reason;
+    if (!X64HasVectorOp(inst->op, inst->type, Vec.width)) {
+      snprintf(Vec.reason, sizeof(Vec.reason), "has no %d-byte vector '%s' for %s",
+               Vec.width, IROpTranslation(inst->op), IRTypeTranslation(inst->type));
+      return Vec.reason;
+    }
+
+    c->classes[v] = VC_VARYING;
+    return NULL;
+  }
+
+  if (inst->op == IR_STORE) return "stores to the same element on every iteration";
+  if (inst->op == IR_LOAD) c->accesses[c->access_count++] = v;
+
+  c->classes[v] = VC_UNIFORM;
+  return NULL;
+}
+
+static const char *ClassifyLoop(Candidate *c) {
+  IR_Function *fn = Vec.fn;
+  IR_BasicBlock *header = &fn->blocks[c->loop->header];
+
+  for (int i = 0; i < header->inst_count - 1; i++) {
+    IR_Value v = header->insts[i];
+    IR_Op op = fn->insts[v].op;
+
+    if (v == c->counter) {
+      c->classes[v] = VC_COUNTER;
+    } else if (op == IR_PHI) {
+      const char *reason = CheckReduction(c, v);
+      if (reason != NULL) return reason;
+    } else if (op != IR_CONST && v != IRTerminator(fn, c->loop->header)->a) {
+      return "computes something in its exit test";
+    }
+  }
+
+  for (int i = 0; i < c->body_count; i++) {
+    IR_BasicBlock *block = &fn->blocks[c->body[i]];
+    for (int j = 0; j < block->inst_count - 1; j++) {
+      const char *reason = Classify(c, block->insts[j]);
+      if (reason != NULL) return reason;
+    }
+  }
+
+  if (c->lanes == 0) return "works on no arrays";
+  return NULL;
+}
+
+/* === Dependences === */
+
+static bool SameScalar(IR_Value a, IR_Value b) {
+  IR_Inst *x = &Vec.fn->insts[a];
+  IR_Inst *y = &Vec.fn->insts[b];
+  return a == b || (x->op == IR_CONST && y->op == IR_CONST && x->type == y->type && x->imm.i == y->imm.i);
+}
+
+// Invariant addresses computed the same way, such as two loads of one global
+static bool SameBase(IR_Value a, IR_Value b) {
+  IR_Inst *x = &Vec.fn->insts[a];
+  IR_Inst *y = &Vec.fn->insts[b];
+  if (a == b) return true;
+  if (x->op != y->op || x->imm.i != y->imm.i) return false;
+
+  switch (x->op) {
+    case IR_GLOBAL:      return true;
+    case IR_ELEMENT_PTR: return SameBase(x->a, y->a) && SameScalar(x->b, y->b);
+    case IR_MEMBER_PTR:  return SameBase(x->a, y->a);
+    default:             return false;
+  }
+}
+
+static bool SameIndex(Candidate *c, IR_Value a, IR_Value b) {
+  if (a == b) return true;
+  if (c->classes[a] != VC_INDEX || c->classes[b] != VC_INDEX) return false;
+
+  IR_Inst *x = &Vec.fn->insts[a];
+  IR_Inst *y = &Vec.fn->insts[b];
+  IR_Value inner_a = (x->a == c->offsets[a]) ? x->b : x->a;
+  IR_Value inner_b = (y->a == c->offsets[b]) ? y->b : y->a;
+  return x->op == y->op && SameScalar(c->offsets[a], c->offsets[b]) && SameIndex(c, inner_a, inner_b);
+}
+
+/* Lanes run side by side, so an iteration must not read or write what a
+ * later one writes: every access to an array the loop stores into has to
+ * be to the element the store goes to */
+static const char *CheckDependences(Candidate *c) {
+  IR_Function *fn = Vec.fn;
+
+  for (int s = 0; s < c->access_count; s++) {
+    IR_Inst *store = &fn->insts[c->accesses[s]];
+    if (store->op != IR_STORE) continue;
+
+    IR_Inst *element = &fn->insts[store->a];
+    IR_Value root = IRAddressRoot(Vec.fn, element->a);
+    if (root == IR_NONE) return "stores through a pointer";
+
+    for (int i = 0; i < c->access_count; i++) {
+      IR_Value address = fn->insts[c->accesses[i]].a;
+      IR_Value other = IRAddressRoot(Vec.fn, address);
+      if (other == IR_NONE) return "loads through a pointer the loop may store to";
+      if (!IRSameRoot(Vec.fn, root, other)) continue;
+
+      IR_Inst *access = &fn->insts[address];
+      if (c->classes[address] != VC_ADDRESS || !SameBase(element->a, access->a) ||
+          !SameIndex(c, element->b, access->b)) {
+        return "may access an element another iteration stores to";
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static const char *CheckTripCount(Candidate *c) {
+  IR_Function *fn = Vec.fn;
+  IR_Inst *bound = &fn->insts[c->bound];
+  if (bound->op != IR_CONST) return NULL;
+
+  if (bound->imm.i < INT64_MIN + c->lanes) return "has a bound too close to the smallest i64";
+  if (c->compare == IR_LE && bound->imm.i == INT64_MAX) return "has a bound too close to the largest i64";
+  if (fn->insts[c->init].op != IR_CONST) return NULL;
+
+  int64_t start = fn->insts[c->init].imm.i;
+  int64_t end = bound->imm.i + (c->compare == IR_LE);
+  if (start < end && (uint64_t)end - (uint64_t)start >= (uint64_t)c->lanes) return NULL;
+
+  snprintf(Vec.reason, sizeof(Vec.reason), "fewer than %d iterations", c->lanes);
+  return Vec.reason;
+}
+
+/* === Vectorizing === */
+
+static IR_Value EmitInPreheader(Candidate *c, IR_Inst inst) {
+  return EmitIRBeforeTerminator(Vec.module, Vec.fn, c->preheader, inst);
+}
+
+static IR_Value EmitConstant(Candidate *c, IR_Type type, int64_t value) {
+  IR_Imm imm = {.i = value};
+  return EmitInPreheader(c, IRConst(type, imm));
+}
+
+static IR_Value Scalar(Candidate *c, IR_Value v) {
+  return InLoop(c, v) ? c->scalars[v] : v;
+}
+
+// Uniform values are copied into every lane, before the loop whenever possible
+static IR_Value Vector(Candidate *c, IR_Value v, IR_Block block) {
+  if (InLoop(c, v) && c->classes[v] == VC_VARYING) return c->vectors[v];
+  if (c->broadcasts[v] != IR_NONE) return c->broadcasts[v];
+
+  IR_Value scalar = Scalar(c, v);
+  IR_Inst broadcast = {.op = IR_BROADCAST, .type = Vec.fn->insts[v].type, .lanes = c->lanes, .a = scalar, .b = IR_NONE};
+  if (Vec.fn->insts[scalar].block == c->preheader || !InLoop(c, v)) {
+    c->broadcasts[v] = EmitInPreheader(c, broadcast);
+  } else {
+    c->broadcasts[v] = EmitIR(Vec.module, Vec.fn, block, broadcast);
+  }
+
+  return c->broadcasts[v];
+}
+
+static int64_t Identity(IR_Op op) {
+  switch (op) {
+    case IR_MUL: return 1;
+    case IR_AND: return -1;
+    default:     return 0;
+  }
+}
+
+static void VectorizeBody(Candidate *c, IR_Block body) {
+  IR_Module *m = Vec.module;
+  IR_Function *fn = Vec.fn;
+
+  for (int i = 0; i < c->body_count; i++) {
+    for (int j = 0; j < fn->blocks[c->body[i]].inst_count - 1; j++) {
+      IR_Value v = fn->blocks[c->body[i]].insts[j];
+      IR_Inst inst = fn->insts[v];
+      if (v == c->step || c->scalars[v] != IR_NONE) continue;
+
+      if (c->classes[v] != VC_VARYING) {
+        inst.a = (inst.a != IR_NONE) ? Scalar(c, inst.a) : IR_NONE;
+        inst.b = (inst.b != IR_NONE) ? Scalar(c, inst.b) : IR_NONE;
+        c->scalars[v] = EmitIR(m, fn, body, inst);
+
+        // Checking the first and the last lane covers the ones in between
+        if (inst.op == IR_BOUNDS_CHECK && IsIndex(ClassOf(c, fn->insts[v].a))) {
+          if (c->last_lane == IR_NONE) c->last_lane = EmitConstant(c, IRT_I64, c->lanes - 1);
+          IR_Value last = EmitIR(m, fn, body, IRBinary(IR_ADD, IRT_I64, inst.a, c->last_lane));
+          inst.a = last;
+          EmitIR(m, fn, body, inst);
+        }
+        continue;
+      }
+
+      switch (inst.op) {
+        case IR_LOAD:
+          inst.a = Scalar(c, inst.a);
+          inst.lanes = c->lanes;
+          break;
+        case IR_STORE:
+          inst.a = Scalar(c, inst.a);
+          inst.b = Vector(c, inst.b, body);
+          break;
+        default:
+          inst.a = Vector(c, inst.a, body);
+          inst.b = Vector(c, inst.b, body);
+          inst.lanes = c->lanes;
+          break;
+      }
+      c->vectors[v] = EmitIR(m, fn, body, inst);
+    }
+  }
+}
+
+/* Puts a vector loop between the preheader and the loop, which runs while
+ * all lanes of an iteration are within bounds. The original loop picks up
+ * from there with the reductions combined into scalars. A bound not known
+ * upfront is checked for how close it is to the smallest i64, so that the
+ * last lane's comparison can't overflow. */
+static IR_Block Vectorize(Candidate *c) {
+  IR_Module *m = Vec.module;
+  IR_Function *fn = Vec.fn;
+  IR_Block header = c->loop->header;
+  IR_Block pre = c->preheader;
+
+  IR_Block vheader = NewIRBlock(m, fn);
+  IR_Block vbody = NewIRBlock(m, fn);
+  IR_Block vexit = NewIRBlock(m, fn);
+
+  // Constants, globals and strings have no operands and move out of the loop
+  for (int i = 0; i < c->loop->block_count; i++) {
+    IR_BasicBlock *block = &fn->blocks[c->loop->blocks[i]];
+    for (int j = 0; j < block->inst_count; j++) {
+      IR_Value v = block->insts[j];
+      IR_Op op = fn->insts[v].op;
+      if (op == IR_CONST || op == IR_GLOBAL || op == IR_STRING) c->scalars[v] = EmitInPreheader(c, fn->insts[v]);
+    }
+  }
+
+  IR_Value limit;
+  bool guarded = fn->insts[c->bound].op != IR_CONST;
+  if (guarded) {
+    limit = EmitInPreheader(c, IRBinary(IR_SUB, IRT_I64, c->bound, EmitConstant(c, IRT_I64, c->lanes - 1)));
+    IR_Value fits = EmitInPreheader(c, IRBinary(IR_LT, IRT_BOOL, limit, c->bound));
+
+    IR_Inst *term = IRTerminator(fn, pre);
+    term->op = IR_BRANCH;
+    term->a = fits;
+    term->target[0] = vheader;
+    term->target[1] = header;
+  } else {
+    limit = EmitConstant(c, IRT_I64, fn->insts[c->bound].imm.i - (c->lanes - 1));
+    IRTerminator(fn, pre)->target[0] = vheader;
+  }
+  AddIRPredecessor(m, fn, vheader, pre);
+
+  IR_Value counter = EmitIRPhi(m, fn, vheader, IRT_I64);
+  c->scalars[c->counter] = counter;
+
+  IR_Value *accumulators = malloc((c->reduction_count + 1) * sizeof(IR_Value));
+  for (int r = 0; r < c->reduction_count; r++) {
+    IR_Value phi = c->reductions[r];
+    accumulators[r] = EmitIRPhi(m, fn, vheader, fn->insts[phi].type);
+    fn->insts[accumulators[r]].lanes = c->lanes;
+    c->vectors[phi] = accumulators[r];
+  }
+
+  IR_Value test = EmitIR(m, fn, vheader, IRBinary(c->compare, IRT_BOOL, counter, limit));
+  IR_Inst branch = {.op = IR_BRANCH, .a = test, .b = IR_NONE, .target = {vbody, vexit}};
+  EmitIR(m, fn, vheader, branch);
+  AddIRPredecessor(m, fn, vbody, vheader);
+  AddIRPredecessor(m, fn, vexit, vheader);
+
+  VectorizeBody(c, vbody);
+
+  IR_Value next = EmitIR(m, fn, vbody, IRBinary(IR_ADD, IRT_I64, counter, EmitConstant(c, IRT_I64, c->lanes)));
+  IR_Inst jump = {.op = IR_JUMP, .a = IR_NONE, .b = IR_NONE, .target = {vheader}};
+  EmitIR(m, fn, vbody, jump);
+  AddIRPredecessor(m, fn, vheader, vbody);
+
+  IR_Value args[2] = {c->init, next};
+  SetIRArgs(m, fn, counter, args, 2);
+
+  int entry = IRPredecessorIndex(fn, header, pre);
+  int latch = IRPredecessorIndex(fn, header, c->loop->latches[0]);
+  IR_Value *results = malloc((c->reduction_count + 1) * sizeof(IR_Value));
+  for (int r = 0; r < c->reduction_count; r++) {
+    IR_Value phi = c->reductions[r];
+    IR_Type type = fn->insts[phi].type;
+    IR_Op op = fn->insts[IRArgs(fn, phi)[latch]].op;
+    IR_Value init = IRArgs(fn, phi)[entry];
+
+    IR_Value identity = EmitInPreheader(c, IRConst(type, IRCanonicalImm(type, (IR_Imm){.i = Identity(op)})));
+    IR_Inst broadcast = {.op = IR_BROADCAST, .type = type, .lanes = c->lanes, .a = identity, .b = IR_NONE};
+    args[0] = EmitInPreheader(c, broadcast);
+    args[1] = c->vectors[IRArgs(fn, phi)[latch]];
+    SetIRArgs(m, fn, accumulators[r], args, 2);
+
+    IR_Inst reduce = {.op = IR_REDUCE, .type = type, .a = accumulators[r], .b = IR_NONE, .imm = {.i = op}};
+    IR_Value lanes = EmitIR(m, fn, vexit, reduce);
+    results[r] = EmitIR(m, fn, vexit, IRBinary(op, type, lanes, init));
+  }
+
+  jump.target[0] = header;
+  EmitIR(m, fn, vexit, jump);
+
+  // The original loop now starts where the vector loop left off
+  IR_BasicBlock *h = &fn->blocks[header];
+  int incoming = entry;
+  if (guarded) {
+    AddIRPredecessor(m, fn, header, vexit);
+    incoming = h->pred_count - 1;
+  } else {
+    h->preds[entry] = vexit;
+  }
+
+  IR_Value *phi_args = malloc((h->pred_count + 1) * sizeof(IR_Value));
+  for (int i = 0; i < h->inst_count; i++) {
+    IR_Value phi = h->insts[i];
+    if (fn->insts[phi].op != IR_PHI) break;
+
+    int count = fn->insts[phi].args_count;
+    memcpy(phi_args, IRArgs(fn, phi), count * sizeof(IR_Value));
+    if (guarded) count++;
+
+    phi_args[incoming] = counter;
+    for (int r = 0; r < c->reduction_count; r++) {
+      if (c->reductions[r] == phi) phi_args[incoming] = results[r];
+    }
+    SetIRArgs(m, fn, phi, phi_args, count);
+    h = &fn->blocks[header];
+  }
+
+  // Laid out between the preheader and the loop
+  int position = 0;
+  while (Vec.layout[position] != header) position++;
+  IR_Block added[3] = {vheader, vbody, vexit};
+  for (int i = 0; i < 3; i++) {
+    ARENA_PUSH(m->arena, Vec.layout, Vec.layout_count, Vec.layout_capacity, IR_NONE);
+  }
+  memmove(&Vec.layout[position + 3], &Vec.layout[position], (Vec.layout_count - 3 - position) * sizeof(IR_Block));
+  memcpy(&Vec.layout[position], added, sizeof(added));
+
+  free(phi_args);
+  free(results);
+  free(accumulators);
+  return vheader;
+}
+
+/* === Driver === */
+
+static const char *Examine(Candidate *c) {
+  if (c->loop->latch_count != 1) return "has more than one back edge";
+
+  c->preheader = FindIRPreheader(Vec.fn, &Vec.dom, c->loop);
+  if (c->preheader == IR_NONE) return "has no preheader";
+
+  const char *reason = CheckExitTest(c);
+  if (reason == NULL) reason = FindBody(c);
+  if (reason == NULL) reason = ClassifyLoop(c);
+  if (reason == NULL && c->lanes < MIN_LANES) {
+    snprintf(Vec.reason, sizeof(Vec.reason), "%d lanes of %s are too few to pay off", c->lanes, IRTypeTranslation(c->element_type));
+    reason = Vec.reason;
+  }
+  if (reason == NULL) reason = CheckDependences(c);
+  if (reason == NULL) reason = CheckTripCount(c);
+  return reason;
+}
+
+static void VectorizeFunction(IR_Function *fn) {
+  if (!fn->is_defined || fn->block_count == 0) return;
+
+  Vec.fn = fn;
+  Vec.layout_count = 0;
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    ARENA_PUSH(Vec.module->arena, Vec.layout, Vec.layout_count, Vec.layout_capacity, b);
+  }
+
+  // Vectorizing changes the CFG, so loops are found again after every one
+  IR_Block *done = malloc((2 * fn->block_count + 1) * sizeof(IR_Block));
+  int done_count = 0;
+  bool changed = false;
+
+  for (;;) {
+    Analyze();
+
+    IR_Loop *loop = NULL;
+    for (int i = 0; i < Vec.forest.loop_count && loop == NULL; i++) {
+      IR_Loop *candidate = &Vec.forest.loops[i];
+      if (!candidate->is_innermost) continue;
+
+      bool seen = false;
+      for (int d = 0; d < done_count; d++) seen |= (done[d] == candidate->header);
+      if (!seen) loop = candidate;
+    }
+
+    if (loop == NULL) {
+      ReleaseAnalyses();
+      break;
+    }
+    done[done_count++] = loop->header;
+
+    int value_count = fn->inst_count;
+    Candidate c = {
+      .loop = loop,
+      .value_count = value_count,
+      .classes = calloc(value_count + 1, sizeof(ValueClass)),
+      .uses = calloc(value_count + 1, sizeof(int)),
+      .offsets = malloc((value_count + 1) * sizeof(IR_Value)),
+      .accesses = malloc((value_count + 1) * sizeof(IR_Value)),
+      .reductions = malloc((value_count + 1) * sizeof(IR_Value)),
+      .scalars = malloc((value_count + 1) * sizeof(IR_Value)),
+      .vectors = malloc((value_count + 1) * sizeof(IR_Value)),
+      .broadcasts = malloc((value_count + 1) * sizeof(IR_Value)),
+      .last_lane = IR_NONE,
+    };
+    for (IR_Value v = 0; v < value_count; v++) c.scalars[v] = c.vectors[v] = c.broadcasts[v] = IR_NONE;
+    CountUses(&c);
+
+    const char *reason = Examine(&c);
+    if (reason != NULL) {
+      Report(loop->header, "not vectorized, %s", reason);
+    } else {
+      IR_Block header = loop->header;
+      int lanes = c.lanes;
+      IR_Type type = c.element_type;
+
+      done[done_count++] = Vectorize(&c);
+      changed = true;
+      Report(header, "vectorized, %d x %s", lanes, IRTypeTranslation(type));
+    }
+
+    free(c.broadcasts);
+    free(c.vectors);
+    free(c.scalars);
+    free(c.reductions);
+    free(c.accesses);
+    free(c.offsets);
+    free(c.uses);
+    free(c.classes);
+    free(c.body);
+    ReleaseAnalyses();
+  }
+
+  if (changed) {
+    IR_Block *new_index = malloc((fn->block_count + 1) * sizeof(IR_Block));
+    for (int i = 0; i < Vec.layout_count; i++) new_index[Vec.layout[i]] = i;
+    RenumberIRBlocks(fn, new_index);
+    free(new_index);
+  }
+
+  free(done);
+}
+
+void VectorizeLoops(IR_Module *m, int width, FILE *report) {
+  memset(&Vec, 0, sizeof(Vec));
+  Vec.module = m;
+  Vec.width = width;
+  Vec.report = report;
+
+  for (int i = 0; i < m->function_count; i++) {
+    VectorizeFunction(&m->functions[i]);
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef IR_VECTORIZE_H
+#define IR_VECTORIZE_H
+
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Loop vectorization for vectors of `width` bytes: 16 for SSE2, 32 for
+ * AVX2. Candidates are innermost loops without branches in their body
+ * that count an i64 up by one towards an invariant bound, and do nothing
+ * but element-wise arithmetic on arrays indexed by the counter plus an
+ * invariant, optionally summing up (or multiplying, and-ing, ...) integers
+ * along the way. Such a loop gets a vector copy in front of it that runs
+ * one vector's worth of iterations at a time; the original loop stays as
+ * the scalar epilogue and finishes the remaining iterations.
+ *
+ * Arrays the loop stores into must be accessed at the same index
+ * everywhere in the loop, so no iteration reads what another one writes.
+ * Floating-point reductions are left alone, since adding up in a
+ * different order rounds differently. Everything the backend has no
+ * vector instruction for (X64HasVectorOp) keeps the loop scalar.
+ *
+ * With `report` set, one line per loop tells whether it was vectorized or
+ * why not, in the format of OptimizeLoops(). */
+void VectorizeLoops(IR_Module *m, int width, FILE *report);
+
+#endif
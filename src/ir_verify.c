@@ -0,0 +1,361 @@
+#include <stdarg.h>
+#include <stdlib.h> // for malloc, free
+
+#include "common.h"
+#include "ir_analysis.h"
+#include "ir_verify.h"
+
+static int error_count;
+
+static void VerifyError(IR_Function *fn, IR_Block block, IR_Value v, const char *fmt, ...) {
+  error_count++;
+
+  Print("IR verifier: %s: bb%d", fn->name, block);
+  if (v != IR_NONE) Print(": %%%d (%s)", v, IROpTranslation(fn->insts[v].op));
+  Print(": ");
+
+  va_list args;
+  va_start(args, fmt);
+  Print_VAList(fmt, args);
+  va_end(args);
+
+  Print("\n");
+}
+
+static bool IsLiveValue(IR_Function *fn, IR_Value v) {
+  return v >= 0 && v < fn->inst_count && fn->insts[v].op != IR_NOP && fn->insts[v].block != IR_NONE;
+}
+
+static IR_Type OperandType(IR_Function *fn, IR_Value v) {
+  return IsLiveValue(fn, v) ? fn->insts[v].type : IRT_VOID;
+}
+
+static int OperandLanes(IR_Function *fn, IR_Value v) {
+  return IsLiveValue(fn, v) ? fn->insts[v].lanes : 0;
+}
+
+static bool IsTarget(IR_Function *fn, IR_Block b) {
+  return b >= 0 && b < fn->block_count;
+}
+
+static void VerifyOperandTypes(IR_Module *m, IR_Function *fn, IR_Block b, IR_Value v) {
+  IR_Inst *inst = &fn->insts[v];
+  IR_Type a = OperandType(fn, inst->a);
+  IR_Type bt = OperandType(fn, inst->b);
+
+  if (IROp_IsBinary(inst->op)) {
+    if (a != inst->type || bt != inst->type) {
+      VerifyError(fn, b, v, "operand types %s, %s don't match result type %s",
+                  IRTypeTranslation(a), IRTypeTranslation(bt), IRTypeTranslation(inst->type));
+    }
+    return;
+  }
+
+  if (IROp_IsComparison(inst->op)) {
+    if (a != bt) VerifyError(fn, b, v, "comparing %s with %s", IRTypeTranslation(a), IRTypeTranslation(bt));
+    if (inst->type != IRT_BOOL) VerifyError(fn, b, v, "comparison must produce bool");
+    return;
+  }
+
+  switch (inst->op) {
+    case IR_NEG:
+    case IR_NOT:
+      if (a != inst->type) VerifyError(fn, b, v, "operand type %s doesn't match result type", IRTypeTranslation(a));
+      break;
+    case IR_CONVERT:
+      if (a == IRT_VOID || a == IRT_PTR || inst->type == IRT_PTR) {
+        VerifyError(fn, b, v, "can't convert %s to %s", IRTypeTranslation(a), IRTypeTranslation(inst->type));
+      }
+      break;
+    case IR_LOAD:
+      if (a != IRT_PTR) VerifyError(fn, b, v, "address must be a pointer");
+      if (inst->type == IRT_VOID) VerifyError(fn, b, v, "load of void");
+      break;
+    case IR_STORE:
+      if (a != IRT_PTR) VerifyError(fn, b, v, "address must be a pointer");
+      if (bt == IRT_VOID) VerifyError(fn, b, v, "store of void");
+      break;
+    case IR_ELEMENT_PTR:
+      if (a != IRT_PTR) VerifyError(fn, b, v, "base must be a pointer");
+      if (bt != IRT_I64) VerifyError(fn, b, v, "index must be i64");
+      if (inst->imm.i <= 0) VerifyError(fn, b, v, "element size must be positive");
+      break;
+    case IR_MEMBER_PTR:
+      if (a != IRT_PTR) VerifyError(fn, b, v, "base must be a pointer");
+      break;
+    case IR_BOUNDS_CHECK:
+      if (a != IRT_I64) VerifyError(fn, b, v, "index must be i64");
+      break;
+    case IR_PRINT:
+      if (a == IRT_VOID) VerifyError(fn, b, v, "print of void");
+      break;
+    case IR_BRANCH:
+      if (a != IRT_BOOL) VerifyError(fn, b, v, "condition must be bool");
+      break;
+    case IR_RETURN:
+      if (inst->a == IR_NONE && fn->return_type != IRT_VOID && !fn->is_entry) {
+        VerifyError(fn, b, v, "missing return value");
+      } else if (inst->a != IR_NONE && a != fn->return_type) {
+        VerifyError(fn, b, v, "returning %s from function returning %s",
+                    IRTypeTranslation(a), IRTypeTranslation(fn->return_type));
+      }
+      break;
+    case IR_CALL:
+    case IR_TAIL_CALL: {
+      if (inst->imm.i < 0 || inst->imm.i >= m->function_count) {
+        VerifyError(fn, b, v, "unknown callee");
+        break;
+      }
+
+      IR_Function *callee = &m->functions[inst->imm.i];
+      if (inst->args_count != callee->param_count) {
+        VerifyError(fn, b, v, "%s expects %d arguments, got %d", callee->name, callee->param_count, inst->args_count);
+        break;
+      }
+      for (int i = 0; i < inst->args_count; i++) {
+        IR_Type t = OperandType(fn, fn->args[inst->args_start + i]);
+        if (t != callee->param_types[i]) {
+          VerifyError(fn, b, v, "argument %d is %s, expected %s", i, IRTypeTranslation(t), IRTypeTranslation(callee->param_types[i]));
+        }
+      }
+      if (inst->op == IR_CALL && inst->type != callee->return_type) {
+        VerifyError(fn, b, v, "call type doesn't match callee return type");
+      }
+      if (inst->op == IR_TAIL_CALL && (fn->is_entry || callee->return_type != fn->return_type)) {
+        VerifyError(fn, b, v, "tail call returns %s from function returning %s",
+                    IRTypeTranslation(callee->return_type), IRTypeTranslation(fn->return_type));
+      }
+    } break;
+    case IR_PHI:
+      for (int i = 0; i < inst->args_count; i++) {
+        IR_Type t = OperandType(fn, fn->args[inst->args_start + i]);
+        if (t != inst->type) VerifyError(fn, b, v, "incoming value %d is %s, expected %s", i, IRTypeTranslation(t), IRTypeTranslation(inst->type));
+      }
+      break;
+    case IR_GLOBAL:
+      if (inst->imm.i < 0 || inst->imm.i >= m->global_count) VerifyError(fn, b, v, "unknown global");
+      break;
+    case IR_STRING:
+      if (inst->imm.i < 0 || inst->imm.i >= m->string_count) VerifyError(fn, b, v, "unknown string");
+      break;
+    case IR_PARAM:
+      if (b != 0) VerifyError(fn, b, v, "parameters must be in the entry block");
+      if (inst->imm.i < 0 || inst->imm.i >= fn->param_count) VerifyError(fn, b, v, "parameter index out of range");
+      else if (inst->type != fn->param_types[inst->imm.i]) VerifyError(fn, b, v, "parameter type mismatch");
+      break;
+    default:
+      break;
+  }
+}
+
+static void VerifyLanes(IR_Function *fn, IR_Block b, IR_Value v) {
+  IR_Inst *inst = &fn->insts[v];
+  int a = OperandLanes(fn, inst->a);
+  int bl = OperandLanes(fn, inst->b);
+
+  if (inst->lanes == 1) VerifyError(fn, b, v, "vectors need at least two lanes");
+
+  switch (inst->op) {
+    case IR_BROADCAST:
+      if (a != 0 || inst->lanes == 0) VerifyError(fn, b, v, "must turn a scalar into a vector");
+      if (OperandType(fn, inst->a) != inst->type) VerifyError(fn, b, v, "operand type doesn't match element type");
+      break;
+    case IR_REDUCE:
+      if (a == 0 || inst->lanes != 0) VerifyError(fn, b, v, "must turn a vector into a scalar");
+      if (OperandType(fn, inst->a) != inst->type) VerifyError(fn, b, v, "operand type doesn't match result type");
+      if (inst->imm.i != IR_ADD && inst->imm.i != IR_MUL && inst->imm.i != IR_AND &&
+          inst->imm.i != IR_OR && inst->imm.i != IR_XOR) {
+        VerifyError(fn, b, v, "can't combine lanes with '%s'", IROpTranslation(inst->imm.i));
+      }
+      break;
+    case IR_LOAD:
+    case IR_STORE:
+      if (a != 0) VerifyError(fn, b, v, "address must be a scalar");
+      break;
+    case IR_PHI:
+      for (int i = 0; i < inst->args_count; i++) {
+        if (OperandLanes(fn, fn->args[inst->args_start + i]) != inst->lanes) {
+          VerifyError(fn, b, v, "incoming value %d has a different number of lanes", i);
+        }
+      }
+      break;
+    default: {
+      if (IROp_IsBinary(inst->op)) {
+        if (a != inst->lanes || bl != inst->lanes) {
+          VerifyError(fn, b, v, "operand lanes %d, %d don't match result lanes %d", a, bl, inst->lanes);
+        }
+        break;
+      }
+
+      bool vector = inst->lanes != 0 || a != 0 || bl != 0;
+      for (int i = 0; i < inst->args_count; i++) vector |= OperandLanes(fn, fn->args[inst->args_start + i]) != 0;
+      if (vector) VerifyError(fn, b, v, "not defined for vectors");
+    } break;
+  }
+}
+
+static void VerifyBlockStructure(IR_Module *m, IR_Function *fn, IR_Block b) {
+  IR_BasicBlock *block = &fn->blocks[b];
+
+  if (block->inst_count == 0) {
+    VerifyError(fn, b, IR_NONE, "empty block");
+    return;
+  }
+
+  bool seen_non_phi = false;
+  for (int i = 0; i < block->inst_count; i++) {
+    IR_Value v = block->insts[i];
+    if (v < 0 || v >= fn->inst_count) {
+      VerifyError(fn, b, IR_NONE, "instruction index %d out of range", v);
+      continue;
+    }
+
+    IR_Inst *inst = &fn->insts[v];
+    bool is_last = (i == block->inst_count - 1);
+
+    if (inst->op == IR_NOP) VerifyError(fn, b, v, "deleted instruction still in block");
+    if (inst->block != b) VerifyError(fn, b, v, "instruction claims to live in bb%d", inst->block);
+    if (IROp_IsTerminator(inst->op) && !is_last) VerifyError(fn, b, v, "terminator in the middle of a block");
+    if (!IROp_IsTerminator(inst->op) && is_last) VerifyError(fn, b, v, "block doesn't end in a terminator");
+
+    if (inst->op == IR_PHI) {
+      if (seen_non_phi) VerifyError(fn, b, v, "phi after non-phi instruction");
+      if (inst->args_count != block->pred_count) {
+        VerifyError(fn, b, v, "%d incoming values for %d predecessors", inst->args_count, block->pred_count);
+      }
+    } else {
+      seen_non_phi = true;
+    }
+
+    if (inst->op == IR_JUMP && !IsTarget(fn, inst->target[0])) VerifyError(fn, b, v, "bad jump target");
+    if (inst->op == IR_BRANCH && (!IsTarget(fn, inst->target[0]) || !IsTarget(fn, inst->target[1]))) {
+      VerifyError(fn, b, v, "bad branch target");
+    }
+
+    IR_Value *operands[64];
+    int n = IRInstOperands(fn, v, operands, 64);
+    for (int j = 0; j < n; j++) {
+      if (!IsLiveValue(fn, *operands[j])) VerifyError(fn, b, v, "operand %%%d is not a live instruction", *operands[j]);
+    }
+
+    VerifyOperandTypes(m, fn, b, v);
+    VerifyLanes(fn, b, v);
+  }
+}
+
+static int CountEdges(IR_Function *fn, IR_Block from, IR_Block to) {
+  IR_Block succs[2];
+  int n = IRSuccessors(fn, from, succs);
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    if (succs[i] == to) count++;
+  }
+
+  return count;
+}
+
+static void VerifyPredecessors(IR_Function *fn, IR_Block b) {
+  IR_BasicBlock *block = &fn->blocks[b];
+
+  if (b == 0 && block->pred_count > 0) VerifyError(fn, b, IR_NONE, "entry block has predecessors");
+
+  for (int i = 0; i < block->pred_count; i++) {
+    IR_Block pred = block->preds[i];
+    if (!IsTarget(fn, pred)) {
+      VerifyError(fn, b, IR_NONE, "predecessor bb%d out of range", pred);
+      continue;
+    }
+
+    int listed = 0;
+    for (int j = 0; j < block->pred_count; j++) {
+      if (block->preds[j] == pred) listed++;
+    }
+    if (listed != CountEdges(fn, pred, b)) {
+      VerifyError(fn, b, IR_NONE, "bb%d is listed %d times as predecessor but has %d edges here", pred, listed, CountEdges(fn, pred, b));
+    }
+  }
+
+  IR_Block succs[2];
+  int n = IRSuccessors(fn, b, succs);
+  for (int i = 0; i < n; i++) {
+    if (IsTarget(fn, succs[i]) && IRPredecessorIndex(fn, succs[i], b) == IR_NONE) {
+      VerifyError(fn, b, IR_NONE, "successor bb%d doesn't list this block as predecessor", succs[i]);
+    }
+  }
+}
+
+static void VerifyDominance(IR_Function *fn, IR_DomTree *dom, int *position, IR_Block b) {
+  IR_BasicBlock *block = &fn->blocks[b];
+
+  for (int i = 0; i < block->inst_count; i++) {
+    IR_Value v = block->insts[i];
+    IR_Inst *inst = &fn->insts[v];
+
+    if (inst->op == IR_PHI) {
+      for (int j = 0; j < inst->args_count && j < block->pred_count; j++) {
+        IR_Value arg = fn->args[inst->args_start + j];
+        IR_Block pred = block->preds[j];
+        if (!IsLiveValue(fn, arg) || !IRBlockIsReachable(dom, pred)) continue;
+
+        if (!IRDominates(dom, fn->insts[arg].block, pred)) {
+          VerifyError(fn, b, v, "incoming %%%d doesn't dominate predecessor bb%d", arg, pred);
+        }
+      }
+      continue;
+    }
+
+    IR_Value *operands[64];
+    int n = IRInstOperands(fn, v, operands, 64);
+    for (int j = 0; j < n; j++) {
+      IR_Value def = *operands[j];
+      if (!IsLiveValue(fn, def)) continue;
+
+      IR_Block def_block = fn->insts[def].block;
+      bool ok = (def_block == b) ? position[def] < position[v] : IRDominates(dom, def_block, b);
+      if (!ok) VerifyError(fn, b, v, "operand %%%d doesn't dominate its use", def);
+    }
+  }
+}
+
+int VerifyIRFunction(IR_Module *m, IR_Function *fn) {
+  error_count = 0;
+  if (!fn->is_defined) return 0;
+
+  if (fn->block_count == 0) {
+    VerifyError(fn, IR_NONE, IR_NONE, "defined function has no blocks");
+    return error_count;
+  }
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    VerifyBlockStructure(m, fn, b);
+    VerifyPredecessors(fn, b);
+  }
+
+  // Dominance only makes sense once the CFG itself is well formed
+  if (error_count > 0) return error_count;
+
+  int *position = malloc(fn->inst_count * sizeof(int));
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    for (int i = 0; i < block->inst_count; i++) position[block->insts[i]] = i;
+  }
+
+  IR_DomTree dom;
+  ComputeIRDominators(fn, &dom);
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    if (IRBlockIsReachable(&dom, b)) VerifyDominance(fn, &dom, position, b);
+  }
+  FreeIRDominators(&dom);
+  free(position);
+
+  return error_count;
+}
+
+int VerifyIRModule(IR_Module *m) {
+  int total = 0;
+  for (int i = 0; i < m->function_count; i++) {
+    total += VerifyIRFunction(m, &m->functions[i]);
+  }
+
+  return total;
+}
@@ -0,0 +1,14 @@
+#ifndef IR_VERIFY_H
+#define IR_VERIFY_H
+
+#include "ir.h"
+
+/* Checks the structural invariants of the IR: every block ends in exactly
+ * one terminator, phis come first and have one operand per predecessor,
+ * predecessor lists match the terminators, operands are live instructions
+ * of the right type, and every definition dominates its uses.
+ * Returns the number of violations found; each one is printed. */
+int VerifyIRFunction(IR_Module *m, IR_Function *fn);
+int VerifyIRModule(IR_Module *m);
+
+#endif
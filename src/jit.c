@@ -0,0 +1,197 @@
+#define _GNU_SOURCE // for RTLD_DEFAULT
+
+#include <dlfcn.h>    // for dlsym, dlopen
+#include <stdio.h>    // for fflush
+#include <string.h>   // for memcpy, memset
+#include <sys/mman.h> // for mmap, mprotect, munmap
+#include <unistd.h>   // for sysconf
+
+#include "error.h"
+#include "jit.h"
+
+/* Layout of the single mapping a program is loaded into:
+ *
+ *   .text | call stubs        (read + execute once relocated)
+ *   .rodata | .data | .bss | GOT   (read + write)
+ *
+ * Calls into libc go through a stub holding the absolute address of the
+ * target, since the shared library is usually more than +-2GB away from
+ * the mapping and rel32 can't reach it. GOT entries serve the same purpose
+ * for data such as stderr. */
+
+#define STUB_SIZE 16
+
+struct JITImage {
+  uint8_t *base;
+  size_t size;
+  size_t executable_size;
+
+  uint8_t *section_address[X64_SECTION_COUNT];
+
+  // Per symbol, NULL until resolved or first needed
+  uint8_t **symbol_address;
+  uint8_t **stub_address;
+  uint8_t **got_address;
+
+  int entry;
+};
+
+static size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static void *LookupExternal(const char *name) {
+  static void *libm = NULL;
+
+  void *address = dlsym(RTLD_DEFAULT, name);
+  if (address != NULL) return address;
+
+  // The compiler itself doesn't link libm, but programs may call fmod()
+  if (libm == NULL) libm = dlopen("libm.so.6", RTLD_NOW | RTLD_GLOBAL);
+  if (libm != NULL) address = dlsym(libm, name);
+
+  if (address == NULL) COMPILER_ERROR_FMTMSG("JIT: Undefined symbol '%s'", name);
+  return address;
+}
+
+static void PatchInt32(uint8_t *at, int64_t value, const char *symbol) {
+  if (value < INT32_MIN || value > INT32_MAX) {
+    COMPILER_ERROR_FMTMSG("JIT: Relocation against '%s' out of range", symbol);
+  }
+
+  int32_t v = (int32_t)value;
+  memcpy(at, &v, sizeof(v));
+}
+
+static void MapImage(X64_Object *obj, JITImage *image) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  int stub_count = 0, got_count = 0;
+  for (int i = 0; i < obj->symbol_count; i++) {
+    if (obj->symbols[i].section < 0) stub_count++, got_count++;
+  }
+
+  size_t text_size = AlignUp(obj->sections[X64_TEXT].size, STUB_SIZE) + (size_t)stub_count * STUB_SIZE;
+  image->executable_size = AlignUp(text_size, page);
+
+  size_t offsets[X64_SECTION_COUNT] = {0};
+  size_t offset = image->executable_size;
+
+  for (int s = X64_RODATA; s < X64_SECTION_COUNT; s++) {
+    offset = AlignUp(offset, obj->sections[s].alignment);
+    offsets[s] = offset;
+    offset += obj->sections[s].size;
+  }
+
+  size_t got_offset = AlignUp(offset, sizeof(void *));
+  image->size = AlignUp(got_offset + (size_t)got_count * sizeof(void *), page);
+
+  image->base = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (image->base == MAP_FAILED) COMPILER_ERROR_FMTMSG("JIT: mmap of %zu bytes failed", image->size);
+
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    image->section_address[s] = image->base + offsets[s];
+    if (obj->sections[s].bytes != NULL) {
+      memcpy(image->section_address[s], obj->sections[s].bytes, obj->sections[s].size);
+    }
+  }
+
+  // Mapped memory is zeroed, which covers .bss
+  uint8_t *next_stub = image->base + AlignUp(obj->sections[X64_TEXT].size, STUB_SIZE);
+  uint8_t *next_got = image->base + got_offset;
+
+  for (int i = 0; i < obj->symbol_count; i++) {
+    X64_Symbol *symbol = &obj->symbols[i];
+
+    if (symbol->section >= 0) {
+      image->symbol_address[i] = image->section_address[symbol->section] + symbol->offset;
+      continue;
+    }
+
+    // jmp *0(%rip) followed by the target address
+    uint8_t *address = LookupExternal(symbol->name);
+    static const uint8_t jump[] = {0xFF, 0x25, 0, 0, 0, 0};
+    memcpy(next_stub, jump, sizeof(jump));
+    memcpy(next_stub + sizeof(jump), &address, sizeof(address));
+
+    image->symbol_address[i] = address;
+    image->stub_address[i] = next_stub;
+    image->got_address[i] = next_got;
+    memcpy(next_got, &address, sizeof(address));
+
+    next_stub += STUB_SIZE;
+    next_got += sizeof(void *);
+  }
+}
+
+static void ApplyRelocations(X64_Object *obj, JITImage *image) {
+  for (int i = 0; i < obj->reloc_count; i++) {
+    X64_Reloc *r = &obj->relocs[i];
+    X64_Symbol *symbol = &obj->symbols[r->symbol];
+    uint8_t *at = image->section_address[r->section] + r->offset;
+    uint8_t *target = image->symbol_address[r->symbol];
+
+    switch (r->type) {
+      case X64_RELOC_64: {
+        uint64_t value = (uint64_t)(target + r->addend);
+        memcpy(at, &value, sizeof(value));
+        break;
+      }
+
+      case X64_RELOC_PC32:
+        if (symbol->section < 0) COMPILER_ERROR_FMTMSG("JIT: PC-relative reference to external '%s'", symbol->name);
+        PatchInt32(at, (target + r->addend) - at, symbol->name);
+        break;
+
+      case X64_RELOC_PLT32:
+        if (symbol->section < 0) target = image->stub_address[r->symbol];
+        PatchInt32(at, (target + r->addend) - at, symbol->name);
+        break;
+
+      case X64_RELOC_GOTPCREL:
+        if (symbol->section < 0) PatchInt32(at, (image->got_address[r->symbol] + r->addend) - at, symbol->name);
+        else COMPILER_ERROR_FMTMSG("JIT: GOT reference to local '%s'", symbol->name);
+        break;
+
+      default:
+        COMPILER_ERROR_FMTMSG("JIT: Unknown relocation type %d", r->type);
+    }
+  }
+}
+
+JITImage *LoadJIT(X64_Object *obj) {
+  int entry = FindX64Symbol(obj, "main");
+  if (entry < 0 || obj->symbols[entry].section != X64_TEXT) {
+    COMPILER_ERROR("JIT: Program has no main function");
+  }
+
+  JITImage *image = ArenaAlloc(obj->arena, sizeof(JITImage));
+  image->entry = entry;
+  image->symbol_address = ArenaAlloc(obj->arena, obj->symbol_count * sizeof(uint8_t *));
+  image->stub_address = ArenaAlloc(obj->arena, obj->symbol_count * sizeof(uint8_t *));
+  image->got_address = ArenaAlloc(obj->arena, obj->symbol_count * sizeof(uint8_t *));
+
+  MapImage(obj, image);
+  ApplyRelocations(obj, image);
+
+  if (mprotect(image->base, image->executable_size, PROT_READ | PROT_EXEC) != 0) {
+    COMPILER_ERROR("JIT: Could not make code executable");
+  }
+
+  return image;
+}
+
+int RunJIT(JITImage *image) {
+  int (*program_main)(void);
+  void *address = image->symbol_address[image->entry];
+  memcpy(&program_main, &address, sizeof(program_main));
+
+  int exit_code = program_main();
+  fflush(NULL);
+
+  return exit_code;
+}
+
+void UnloadJIT(JITImage *image) {
+  munmap(image->base, image->size);
+}
@@ -0,0 +1,18 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "x64_assembler.h"
+
+/* Loads an assembled program into executable memory in this process,
+ * binding its libc and libm references with dlsym(). The image lives in
+ * the object's arena apart from the mapping, which UnloadJIT() releases. */
+typedef struct JITImage JITImage;
+
+JITImage *LoadJIT(X64_Object *obj);
+
+/* Runs the program's main() and returns its exit code. Runtime errors
+ * exit the process directly, as they would in a standalone executable. */
+int RunJIT(JITImage *image);
+void UnloadJIT(JITImage *image);
+
+#endif
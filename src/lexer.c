@@ -2,6 +2,7 @@
 #include <string.h> // for strlen
 
 #include "lexer.h"
+#include "time_report.h"
 #include "token_type.h"
 
 struct {
@@ -22,6 +23,17 @@ void InitLexer(const char *filename, const char *contents) {
   Lexer.src_filename = filename;
 }
 
+LexerPosition SaveLexerPosition() {
+  return (LexerPosition){.end = Lexer.end, .line = Lexer.current_line, .x_offset = Lexer.current_x_offset};
+}
+
+void RestoreLexerPosition(LexerPosition p) {
+  Lexer.start = p.end;
+  Lexer.end = p.end;
+  Lexer.current_line = p.line;
+  Lexer.current_x_offset = p.x_offset;
+}
+
 static int LexemeLength() {
   return Lexer.end - Lexer.start;
 }
@@ -238,6 +250,9 @@ static TokenType IdentifierType() {
   if (LexemeEquals("break", 5)) return BREAK;
   if (LexemeEquals("continue", 8)) return CONTINUE;
   if (LexemeEquals("return", 6)) return RETURN;
+  if (LexemeEquals("tailrec", 7)) return TAILREC;
+
+  if (LexemeEquals("print", 5)) return PRINT;
 
   if (LexemeEquals("true", 4))  return BOOL_LITERAL;
   if (LexemeEquals("false", 5)) return BOOL_LITERAL;
@@ -250,7 +265,7 @@ static Token Identifier() {
   return MakeToken(IdentifierType());
 }
 
-Token ScanToken() {
+static Token NextToken() {
   SkipWhitespace();
 
   Lexer.start = Lexer.end;
@@ -320,3 +335,12 @@ Token ScanToken() {
 
   return MakeErrorToken("Unexpected token");
 }
+
+Token ScanToken() {
+  BeginPhase(PHASE_LEX);
+  Token t = NextToken();
+  EndPhase();
+
+  if (t.type != TOKEN_EOF) CountEvents(COUNTER_TOKENS, 1);
+  return t;
+}
@@ -6,4 +6,14 @@
 void InitLexer(const char *filename, const char *contents);
 Token ScanToken();
 
+// Where the lexer is in its file, for continuing from there later
+typedef struct {
+  const char *end;
+  int line;
+  int x_offset;
+} LexerPosition;
+
+LexerPosition SaveLexerPosition();
+void RestoreLexerPosition(LexerPosition p);
+
 #endif
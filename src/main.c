@@ -1,23 +1,380 @@
+#include <errno.h>  // for errno
 #include <stddef.h> // for NULL
+#include <stdio.h>  // for fopen, remove, snprintf
+#include <stdlib.h> // for system, free
+#include <string.h> // for strerror
+#include <time.h>   // for clock_gettime
 
+#include "allocator.h"
 #include "ast.h"
+#include "codegen_c.h"
+#include "codegen_x64.h"
+#include "common.h"
+#include "compile_cache.h"
 #include "compiler.h"
+#include "dead_code.h"
+#include "elf_writer.h"
+#include "error.h"
+#include "incremental.h"
 #include "io.h"
+#include "ir_bounds.h"
+#include "ir_gvn.h"
+#include "ir_inline.h"
+#include "ir_loops.h"
+#include "ir_lower.h"
+#include "ir_profile.h"
+#include "ir_sccp.h"
+#include "ir_tail_calls.h"
+#include "ir_vectorize.h"
+#include "ir_verify.h"
+#include "jit.h"
+#include "object_file.h"
+#include "options.h"
+#include "regalloc.h"
+#include "server.h"
 #include "symbol_table.h"
+#include "time_report.h"
 
-int main(int argc, char **argv) {
-  char *filename = "test.txt";
+// x86-64 code in an object is reused by any run with the same options, whatever it does with the code
+static uint64_t ObjectCodeKey(CompilerOptions options, int argc, char **argv) {
+  const char *ignored[] = {"--cache-dir=", "--cache-limit=", "--connect", "--object=", "--jit", "--emit=", "-o", NULL};
+  return OptionsKey(options, argc, argv, ignored);
+}
+
+// Assembly text is written out as is, everything else is built from machine code
+static bool NeedsAssemblyText(CompilerOptions options) {
+  if (options.jit) return false;
+  return options.emit == EMIT_ASM || (options.emit != EMIT_OBJ && options.external_toolchain);
+}
 
-  if (argc == 2) {
-    filename = argv[1];
+/* A fresh object stands in for the front end. With nothing to build that is
+ * all there is to do; otherwise it needs machine code generated with the
+ * same options, which *code is made from. `obj` stays mapped while it's in use. */
+static bool LoadCachedObject(CompilerOptions options, uint64_t code_key, const char *contents, int length,
+                             LoadedObject *obj, X64_Object **code) {
+  ObjectLoadResult result = LoadObjectFile(options.object_path, contents, length, obj);
+
+  if (result != OBJ_LOAD_OK) {
+    fprintf(stderr, "Object '%s': %s, recompiling\n", options.object_path, ObjectLoadResultTranslation(result));
+    return false;
   }
 
-  char *contents = NULL;
-  ReadFile(filename, &contents);
+  if (!options.jit && options.emit == EMIT_NONE && options.output_path == NULL) {
+    PrintObjectSummary(obj);
+    UnloadObjectFile(obj);
+    return true;
+  }
 
-  SymbolTable *st = NewSymbolTable();
-  AST_Node *compiled_code = Compile(filename, contents, st);
+  // C, the IR and assembly text are made from the AST, which objects don't keep
+  const ObjectHeader *h = obj->header;
+  bool usable = options.emit != EMIT_C && options.emit != EMIT_IR && !NeedsAssemblyText(options) &&
+                h->code_format == OBJ_CODE_X64 && h->code_key == code_key;
+  if (!usable) {
+    fprintf(stderr, "Object '%s': No code for these options, recompiling\n", options.object_path);
+    UnloadObjectFile(obj);
+    return false;
+  }
+
+  *code = ObjectX64Code(obj);
+  return true;
+}
+
+static void WriteCachedObject(CompilerOptions options, uint64_t code_key, const char *contents, int length, AST_Node *ast,
+                              X64_Object *code) {
+  ObjectBuilder *ob = NewObjectBuilder(contents, length);
+
+  ObjectAddProgram(ob, ast);
+  if (code != NULL) ObjectSetX64Code(ob, code_key, code);
+  WriteObjectFile(ob, options.object_path);
+
+  DeleteObjectBuilder(ob);
+}
+
+static IR_Module *LowerAndVerify(CompilerOptions options, AST_Node *ast, SymbolTable *st) {
+  BeginPhase(PHASE_LOWER);
+  IR_Module *module = LowerToIR(ast, st);
+  EndPhase();
+
+  BeginPhase(PHASE_OPTIMIZE);
+  if (options.profile_generate != NULL) InstrumentIRModule(module, options.profile_generate);
+  if (options.profile_use != NULL) ApplyIRProfile(module, options.profile_use);
+  if (options.inline_functions) InlineFunctions(module, options.inline_threshold, options.inline_report ? stderr : NULL);
+  OptimizeTailCalls(module);
+  if (options.constant_propagation) {
+    PropagateIRConstants(module, options.constant_propagation_report ? stderr : NULL);
+  }
+  if (options.value_numbering) NumberIRValues(module, options.value_numbering_report ? stderr : NULL);
+  if (options.bounds_check_elimination) {
+    EliminateBoundsChecks(module, options.bounds_check_report ? stderr : NULL);
+  }
+  if (options.loop_optimizations && options.vector_isa != VECTOR_ISA_NONE) {
+    VectorizeLoops(module, (options.vector_isa == VECTOR_ISA_AVX2) ? 32 : 16, options.loop_report ? stderr : NULL);
+  }
+  if (options.loop_optimizations) OptimizeLoops(module, options.unroll_loops, options.loop_report ? stderr : NULL);
+  if (options.profile_use != NULL) LayOutIRBlocks(module);
+
+  int errors = VerifyIRModule(module);
+  if (errors > 0) {
+    COMPILER_ERROR_FMTMSG("IR verification failed with %d error(s)", errors);
+  }
+  EndPhase();
+
+  if (options.regalloc_report) PrintRegAllocReport(module, stderr);
+
+  return module;
+}
+
+static char *GenerateAssembly(IR_Module *module, size_t *length) {
+  char *assembly = NULL;
+  FILE *out = open_memstream(&assembly, length);
+  BeginPhase(PHASE_CODEGEN);
+  EmitX64Assembly(module, out);
+  EndPhase();
+  fclose(out);
+
+  return assembly;
+}
+
+static void WriteAssembly(const char *assembly, size_t length, const char *path) {
+  FILE *out = (path != NULL) ? fopen(path, "w") : stdout;
+  if (out == NULL) COMPILER_ERROR_FMTMSG("Could not open '%s' for writing: %s", path, strerror(errno));
+
+  fwrite(assembly, 1, length, out);
+
+  if (out != stdout) fclose(out);
+}
+
+static void WriteCSource(AST_Node *ast, SymbolTable *st, const char *path) {
+  FILE *out = (path != NULL) ? fopen(path, "w") : stdout;
+  if (out == NULL) COMPILER_ERROR_FMTMSG("Could not open '%s' for writing: %s", path, strerror(errno));
+
+  BeginPhase(PHASE_CODEGEN);
+  EmitC(ast, st, out);
+  EndPhase();
+
+  if (out != stdout) fclose(out);
+}
+
+static X64_Object *Assemble(const char *assembly, size_t length) {
+  BeginPhase(PHASE_ASSEMBLE);
+  X64_Object *obj = AssembleX64(assembly, (int)length);
+  EndPhase();
+
+  return obj;
+}
+
+static void WriteObject(X64_Object *obj, const char *path) {
+  if (path == NULL) COMPILER_ERROR("--emit=obj needs an output path (-o)");
+
+  BeginPhase(PHASE_ASSEMBLE);
+  bool ok = WriteELFObject(obj, path);
+  EndPhase();
+
+  if (!ok) COMPILER_ERROR_FMTMSG("Writing object '%s' failed", path);
+}
+
+// Links in-process, without temporary files
+static void BuildExecutable(X64_Object *obj, const char *output_path) {
+  BeginPhase(PHASE_ASSEMBLE);
+  bool ok = LinkExecutable(&obj, 1, output_path);
+  EndPhase();
+
+  if (!ok) COMPILER_ERROR_FMTMSG("Linking '%s' failed", output_path);
+}
+
+// Assembles and links with the system C compiler driver, which brings libc
+static void BuildExecutableExternally(const char *assembly, size_t length, const char *output_path) {
+  char *asm_path = Concat((char *)output_path, ".s");
+  WriteAssembly(assembly, length, asm_path);
+
+  char command[1024];
+  snprintf(command, sizeof(command), "cc -o '%s' '%s' -lm", output_path, asm_path);
+  BeginPhase(PHASE_ASSEMBLE);
+  int result = system(command);
+  EndPhase();
+  remove(asm_path);
+
+  if (result != 0) {
+    COMPILER_ERROR_FMTMSG("Assembling and linking '%s' failed", output_path);
+  }
+
+  free(asm_path);
+}
+
+static double Milliseconds(struct timespec start, struct timespec end) {
+  return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+/* Loads the backend's machine code into memory and runs it. Timings go to
+ * stderr so that stdout holds nothing but the program's own output. */
+static int RunInProcess(X64_Object *obj, struct timespec start) {
+  BeginPhase(PHASE_ASSEMBLE);
+  JITImage *image = LoadJIT(obj);
+  EndPhase();
+
+  struct timespec compiled, finished;
+  clock_gettime(CLOCK_MONOTONIC, &compiled);
+  BeginPhase(PHASE_RUN);
+  int exit_code = RunJIT(image);
+  EndPhase();
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+
+  fprintf(stderr, "JIT: compiled in %.3f ms, ran in %.3f ms\n",
+          Milliseconds(start, compiled), Milliseconds(compiled, finished));
+
+  UnloadJIT(image);
+  return exit_code;
+}
+
+// Builds what the options ask for from the x86-64 backend's machine code
+static int BuildFromCode(CompilerOptions options, X64_Object *code, struct timespec start) {
+  if (options.jit) return RunInProcess(code, start);
+
+  if (options.emit == EMIT_OBJ) WriteObject(code, options.output_path);
+  else BuildExecutable(code, options.output_path);
+
+  DebugReportErrorCode();
+  return 0;
+}
+
+// Builds what the options ask for from the x86-64 backend's assembly
+static int BuildFromAssembly(CompilerOptions options, const char *assembly, size_t length, struct timespec start) {
+  if (options.emit == EMIT_ASM) {
+    WriteAssembly(assembly, length, options.output_path);
+  } else if (NeedsAssemblyText(options)) {
+    BuildExecutableExternally(assembly, length, options.output_path);
+  } else {
+    X64_Object *code = Assemble(assembly, length);
+    int exit_code = BuildFromCode(options, code, start);
+    DeleteX64Object(code);
+    return exit_code;
+  }
 
   DebugReportErrorCode();
   return 0;
 }
+
+static int RunCompiler(CompilerOptions options, int argc, char **argv) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (options.time_report) UseTimeReport(options.time_report_path);
+  if (options.trace_path != NULL) UseTrace(options.trace_path, options.trace_functions);
+  if (options.memory_report) UseMemoryReport();
+  if (options.leak_check) UseLeakCheck();
+
+  // Object files fingerprint the source of a single file
+  if (options.object_path != NULL && options.input_count > 1) {
+    COMPILER_ERROR("--object= takes a single input file");
+  }
+
+  // What the incremental front end keeps from one build for the next would only look lost
+  if (options.leak_check && options.incremental_path != NULL) {
+    COMPILER_ERROR("-fleak-check can't be used with --incremental=");
+  }
+
+  // Unlike executables, which may run elsewhere, JIT code runs right here
+  if (options.jit && options.vector_isa == VECTOR_ISA_AVX2 && !__builtin_cpu_supports("avx2")) {
+    COMPILER_ERROR("-mvector=avx2 needs a CPU with AVX2 to run JIT code");
+  }
+
+  const char **sources = malloc(options.input_count * sizeof(char *));
+  int *lengths = malloc(options.input_count * sizeof(int));
+  BeginPhase(PHASE_READ);
+  for (int i = 0; i < options.input_count; i++) {
+    char *source = NULL;
+    lengths[i] = ReadFile(options.input_filenames[i], &source);
+    sources[i] = source;
+  }
+  EndPhase();
+  char *contents = (char *)sources[0];
+  int length = lengths[0];
+
+  UseCompileCache(options, argc, argv, sources, lengths);
+
+  uint64_t code_key = 0;
+  char *assembly = NULL;
+  size_t assembly_length = 0;
+  if (options.object_path != NULL) {
+    code_key = ObjectCodeKey(options, argc, argv);
+
+    LoadedObject obj;
+    X64_Object *code = NULL;
+    if (LoadCachedObject(options, code_key, contents, length, &obj, &code)) {
+      if (code == NULL) {
+        DebugReportErrorCode();
+        return 0;
+      }
+
+      int exit_code = BuildFromCode(options, code, start);
+      DeleteX64Object(code);
+      UnloadObjectFile(&obj);
+      return exit_code;
+    }
+  }
+
+  SymbolTable *st = NewSymbolTable();
+  UseIncrementalState(options.incremental_path, options.incremental_verify);
+  AST_Node *compiled_code = CompileProgram(options.input_filenames, sources, options.input_count, st);
+  if (options.dead_code_elimination) {
+    BeginPhase(PHASE_DEAD_CODE);
+    EliminateDeadCode(compiled_code, options.dce_report ? stderr : NULL);
+    EndPhase();
+  }
+
+  if (options.emit == EMIT_C) {
+    WriteCSource(compiled_code, st, options.output_path);
+  } else if (options.emit == EMIT_IR) {
+    IR_Module *module = LowerAndVerify(options, compiled_code, st);
+    BeginPhase(PHASE_CODEGEN);
+    PrintIRModule(module);
+    EndPhase();
+    DeleteIRModule(module);
+  } else if (options.jit || options.emit != EMIT_NONE || options.output_path != NULL) {
+    IR_Module *module = LowerAndVerify(options, compiled_code, st);
+    assembly = GenerateAssembly(module, &assembly_length);
+    DeleteIRModule(module);
+  }
+
+  // Written before JIT code runs, which may not come back. Objects keep machine code whatever this run builds
+  if (options.object_path != NULL) {
+    X64_Object *code = (assembly != NULL) ? Assemble(assembly, assembly_length) : NULL;
+    WriteCachedObject(options, code_key, contents, length, compiled_code, code);
+
+    if (code != NULL && !NeedsAssemblyText(options)) {
+      int exit_code = BuildFromCode(options, code, start);
+      DeleteX64Object(code);
+      free(assembly);
+      return exit_code;
+    }
+    if (code != NULL) DeleteX64Object(code);
+  }
+
+  if (assembly == NULL) {
+    DebugReportErrorCode();
+    return 0;
+  }
+
+  int exit_code = BuildFromAssembly(options, assembly, assembly_length, start);
+  free(assembly);
+  return exit_code;
+}
+
+// Run by a compile server's worker for every request, in a process of its own
+static int CompileRequest(int argc, char **argv) {
+  return RunCompiler(ParseOptions(argc, argv), argc, argv);
+}
+
+int main(int argc, char **argv) {
+  CompilerOptions options = ParseOptions(argc, argv);
+
+  if (options.server_socket != NULL) {
+    return RunCompileServer(options.server_socket, options.server_workers, CompileRequest);
+  }
+
+  int exit_code;
+  if (options.connect_socket != NULL && ForwardToCompileServer(options.connect_socket, argc, argv, &exit_code)) {
+    return exit_code;
+  }
+
+  return RunCompiler(options, argc, argv);
+}
@@ -0,0 +1,606 @@
+#include <errno.h>
+#include <fcntl.h>    // for open
+#include <stdio.h>    // for fopen, rename
+#include <stdlib.h>   // for calloc
+#include <string.h>   // for memcmp, memcpy
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for close, getpid
+
+#include "arena.h"
+#include "common.h"
+#include "dynamic_array.h"
+#include "error.h"
+#include "hash.h"
+#include "object_file.h"
+
+#define SECTION_ALIGNMENT 8
+#define CODE_ALIGNMENT 16
+
+typedef uint8_t Byte;
+
+typedef struct {
+  uint64_t hash;
+  uint32_t index;
+} PoolEntry;
+
+USE_DYNAMIC_ARRAY(Byte)
+USE_DYNAMIC_ARRAY(PoolEntry)
+USE_DYNAMIC_ARRAY(ObjectConstant)
+USE_DYNAMIC_ARRAY(ObjectFunction)
+USE_DYNAMIC_ARRAY(ObjectSymbol)
+USE_DYNAMIC_ARRAY(ObjectReloc)
+
+struct ObjectBuilder {
+  uint64_t source_hash;
+  uint64_t source_length;
+  uint16_t code_format;
+  uint64_t code_key;
+  uint32_t entry_function;
+
+  DA(Byte) strings;
+  DA(PoolEntry) string_lookup;
+
+  DA(ObjectConstant) constants;
+  DA(PoolEntry) constant_lookup;
+
+  DA(ObjectFunction) functions;
+  DA(Byte) code;
+  ObjectSegment segments[X64_SECTION_COUNT];
+  DA(ObjectSymbol) symbols;
+  DA(ObjectReloc) relocs;
+};
+
+ObjectBuilder *NewObjectBuilder(const char *source, size_t source_length) {
+  ObjectBuilder *ob = calloc(1, sizeof(ObjectBuilder));
+
+  ob->source_hash = HashBytes(source, source_length);
+  ob->source_length = source_length;
+  ob->code_format = OBJ_CODE_NONE;
+  ob->entry_function = OBJECT_NO_ENTRY;
+
+  DA_INIT(Byte, ob->strings);
+  DA_INIT(PoolEntry, ob->string_lookup);
+  DA_INIT(ObjectConstant, ob->constants);
+  DA_INIT(PoolEntry, ob->constant_lookup);
+  DA_INIT(ObjectFunction, ob->functions);
+  DA_INIT(Byte, ob->code);
+  DA_INIT(ObjectSymbol, ob->symbols);
+  DA_INIT(ObjectReloc, ob->relocs);
+
+  // Offset 0 is always the empty string
+  DA_ADD(Byte, ob->strings, '\0');
+
+  return ob;
+}
+
+void DeleteObjectBuilder(ObjectBuilder *ob) {
+  DA_FREE(Byte, ob->strings);
+  DA_FREE(PoolEntry, ob->string_lookup);
+  DA_FREE(ObjectConstant, ob->constants);
+  DA_FREE(PoolEntry, ob->constant_lookup);
+  DA_FREE(ObjectFunction, ob->functions);
+  DA_FREE(Byte, ob->code);
+  DA_FREE(ObjectSymbol, ob->symbols);
+  DA_FREE(ObjectReloc, ob->relocs);
+  free(ob);
+}
+
+uint32_t ObjectAddString(ObjectBuilder *ob, const char *s, int length) {
+  uint64_t hash = HashBytes(s, length);
+
+  for (int i = 0; i < ob->string_lookup.count; i++) {
+    PoolEntry e = DA_GET(ob->string_lookup, i);
+    if (e.hash != hash) continue;
+
+    const char *existing = (const char *)&ob->strings.data[e.index];
+    if (strncmp(existing, s, length) == 0 && existing[length] == '\0') return e.index;
+  }
+
+  uint32_t offset = ob->strings.count;
+  for (int i = 0; i < length; i++) {
+    DA_ADD(Byte, ob->strings, s[i]);
+  }
+  DA_ADD(Byte, ob->strings, '\0');
+
+  DA_ADD(PoolEntry, ob->string_lookup, ((PoolEntry){ .hash = hash, .index = offset }));
+
+  return offset;
+}
+
+static ObjectConstant ConstantFromValue(ObjectBuilder *ob, Value v) {
+  ObjectConstant c = { .type_specifier = v.type.specifier };
+
+  if (TypeIs_Int(v.type)) {
+    c.kind = OBJ_CONST_INT;
+    c.as.integer = v.as.integer;
+  } else if (TypeIs_Uint(v.type)) {
+    c.kind = OBJ_CONST_UINT;
+    c.as.uinteger = v.as.uinteger;
+  } else if (TypeIs_Float(v.type)) {
+    c.kind = OBJ_CONST_FLOAT;
+    c.as.floating = v.as.floating;
+  } else if (TypeIs_Char(v.type)) {
+    c.kind = OBJ_CONST_CHAR;
+    c.as.uinteger = (unsigned char)v.as.character;
+  } else if (TypeIs_Bool(v.type)) {
+    c.kind = OBJ_CONST_BOOL;
+    c.as.uinteger = v.as.boolean;
+  } else if (TypeIs_String(v.type)) {
+    c.kind = OBJ_CONST_STRING;
+    c.string_offset = ObjectAddString(ob, v.as.string, strlen(v.as.string));
+    c.as.uinteger = strlen(v.as.string);
+  } else {
+    COMPILER_ERROR_FMTMSG("ConstantFromValue(): '%s' cannot be stored in the constant pool", TypeTranslation(v.type));
+  }
+
+  return c;
+}
+
+uint32_t ObjectAddConstant(ObjectBuilder *ob, Value v) {
+  ObjectConstant c = ConstantFromValue(ob, v);
+  uint64_t hash = HashBytes(&c, sizeof(c));
+
+  for (int i = 0; i < ob->constant_lookup.count; i++) {
+    PoolEntry e = DA_GET(ob->constant_lookup, i);
+    if (e.hash == hash &&
+        memcmp(&DA_GET(ob->constants, e.index), &c, sizeof(c)) == 0) {
+      return e.index;
+    }
+  }
+
+  uint32_t index = ob->constants.count;
+  DA_ADD(ObjectConstant, ob->constants, c);
+  DA_ADD(PoolEntry, ob->constant_lookup, ((PoolEntry){ .hash = hash, .index = index }));
+
+  return index;
+}
+
+uint32_t ObjectAddFunction(ObjectBuilder *ob, Token name, int param_count, Type return_type) {
+  ObjectFunction f = {
+    .name_offset = ObjectAddString(ob, name.position_in_source, name.length),
+    .param_count = param_count,
+    .return_type = return_type.specifier,
+  };
+
+  DA_ADD(ObjectFunction, ob->functions, f);
+  return ob->functions.count - 1;
+}
+
+void ObjectSetEntryFunction(ObjectBuilder *ob, uint32_t function_index) {
+  ob->entry_function = function_index;
+}
+
+void ObjectSetFunctionCode(ObjectBuilder *ob, uint32_t function_index, uint32_t code_offset, uint32_t code_size) {
+  if (function_index >= (uint32_t)ob->functions.count) {
+    COMPILER_ERROR_FMTMSG("ObjectSetFunctionCode(): Function index %u out of range", function_index);
+  }
+
+  ob->functions.data[function_index].code_offset = code_offset;
+  ob->functions.data[function_index].code_size = code_size;
+}
+
+// The instructions of a function run up to the next function, or the end of .text
+static uint32_t FunctionCodeSize(X64_Object *code, X64_Symbol *function) {
+  int end = code->sections[X64_TEXT].size;
+
+  for (int i = 0; i < code->symbol_count; i++) {
+    X64_Symbol *other = &code->symbols[i];
+    bool follows = other->is_function && other->section == X64_TEXT && other->offset > function->offset;
+    if (follows && other->offset < end) end = other->offset;
+  }
+
+  return end - function->offset;
+}
+
+// Points the functions named `name`, declarations included, at their instructions
+static void SetFunctionCode(ObjectBuilder *ob, X64_Object *code, X64_Symbol *function, const char *name) {
+  for (int i = 0; i < ob->functions.count; i++) {
+    const char *existing = (const char *)&ob->strings.data[DA_GET(ob->functions, i).name_offset];
+    if (strcmp(existing, name) != 0) continue;
+
+    ObjectSetFunctionCode(ob, i, ob->segments[X64_TEXT].offset + function->offset, FunctionCodeSize(code, function));
+  }
+}
+
+void ObjectSetX64Code(ObjectBuilder *ob, uint64_t code_key, X64_Object *code) {
+  ob->code_format = OBJ_CODE_X64;
+  ob->code_key = code_key;
+  ob->code.count = 0;
+  ob->symbols.count = 0;
+  ob->relocs.count = 0;
+
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    X64_Section *section = &code->sections[s];
+    while (section->alignment > 1 && ob->code.count % section->alignment != 0) {
+      DA_ADD(Byte, ob->code, 0);
+    }
+
+    ob->segments[s] = (ObjectSegment){
+      .offset = ob->code.count,
+      .size = section->size,
+      .alignment = section->alignment,
+    };
+
+    if (section->bytes == NULL) continue;
+    for (int i = 0; i < section->size; i++) {
+      DA_ADD(Byte, ob->code, section->bytes[i]);
+    }
+  }
+
+  for (int i = 0; i < code->symbol_count; i++) {
+    X64_Symbol *symbol = &code->symbols[i];
+    ObjectSymbol entry = {
+      .name_offset = ObjectAddString(ob, symbol->name, strlen(symbol->name)),
+      .segment = symbol->section,
+      .offset = symbol->offset,
+      .is_global = symbol->is_global,
+      .is_function = symbol->is_function,
+    };
+    DA_ADD(ObjectSymbol, ob->symbols, entry);
+  }
+
+  for (int i = 0; i < code->reloc_count; i++) {
+    X64_Reloc *r = &code->relocs[i];
+    ObjectReloc entry = {
+      .segment = r->section,
+      .offset = r->offset,
+      .symbol = r->symbol,
+      .type = r->type,
+      .addend = r->addend,
+    };
+    DA_ADD(ObjectReloc, ob->relocs, entry);
+  }
+
+  // Functions are named as codegen_x64.c names them; the program's top level is main
+  for (int i = 0; i < code->symbol_count; i++) {
+    X64_Symbol *symbol = &code->symbols[i];
+    if (!symbol->is_function || symbol->section != X64_TEXT) continue;
+
+    if (strcmp(symbol->name, "main") == 0) {
+      Token main = { .position_in_source = "main", .length = strlen("main") };
+      uint32_t entry = ObjectAddFunction(ob, main, 0, (Type){ .specifier = T_I32 });
+      ObjectSetFunctionCode(ob, entry, ob->segments[X64_TEXT].offset + symbol->offset, FunctionCodeSize(code, symbol));
+      ObjectSetEntryFunction(ob, entry);
+    } else if (strncmp(symbol->name, "crom_", strlen("crom_")) == 0) {
+      SetFunctionCode(ob, code, symbol, symbol->name + strlen("crom_"));
+    }
+  }
+}
+
+static int CountParams(Type function_type) {
+  int count = 0;
+  for (FnParam *p = function_type.params.next; p != NULL; p = p->next) {
+    count++;
+  }
+
+  return count;
+}
+
+static void AddProgramRecurse(ObjectBuilder *ob, AST_Node *node) {
+  if (node == NULL) return;
+
+  if (NodeIs_Function(node)) {
+    ObjectAddFunction(ob, node->token, CountParams(node->data_type), node->data_type);
+  }
+
+  if (node->node_type == LITERAL_NODE) {
+    Type t = node->data_type;
+    bool storable = TypeIs_Numeric(t) || TypeIs_Char(t) || TypeIs_Bool(t) || TypeIs_String(t);
+
+    if (storable) ObjectAddConstant(ob, NewValue(t, node->token));
+  }
+
+  AddProgramRecurse(ob, node->left);
+  AddProgramRecurse(ob, node->middle);
+  AddProgramRecurse(ob, node->right);
+}
+
+void ObjectAddProgram(ObjectBuilder *ob, AST_Node *root) {
+  AddProgramRecurse(ob, root);
+}
+
+static uint32_t AlignUp(uint32_t n, uint32_t alignment) {
+  return (n + alignment - 1) & ~(alignment - 1);
+}
+
+static bool WriteAt(FILE *fd, uint32_t offset, const void *data, size_t size) {
+  if (size == 0) return true;
+  if (fseek(fd, offset, SEEK_SET) != 0) return false;
+  return fwrite(data, 1, size, fd) == size;
+}
+
+bool WriteObjectFile(ObjectBuilder *ob, const char *path) {
+  ObjectHeader header = {0};
+  memcpy(header.magic, OBJECT_MAGIC, sizeof(header.magic));
+  header.version = OBJECT_VERSION;
+  header.code_format = ob->code_format;
+  header.entry_function = ob->entry_function;
+  header.source_hash = ob->source_hash;
+  header.source_length = ob->source_length;
+  header.code_key = ob->code_key;
+  memcpy(header.segments, ob->segments, sizeof(header.segments));
+
+  struct {
+    const void *data;
+    uint32_t size;
+    uint32_t count;
+    uint32_t alignment;
+  } layout[OBJ_SECTION_COUNT] = {
+    [OBJ_SECTION_STRINGS]   = { ob->strings.data,   ob->strings.count, ob->string_lookup.count, SECTION_ALIGNMENT },
+    [OBJ_SECTION_CONSTANTS] = { ob->constants.data, ob->constants.count * sizeof(ObjectConstant), ob->constants.count, SECTION_ALIGNMENT },
+    [OBJ_SECTION_FUNCTIONS] = { ob->functions.data, ob->functions.count * sizeof(ObjectFunction), ob->functions.count, SECTION_ALIGNMENT },
+    [OBJ_SECTION_CODE]      = { ob->code.data,      ob->code.count, ob->code.count, CODE_ALIGNMENT },
+    [OBJ_SECTION_SYMBOLS]   = { ob->symbols.data,   ob->symbols.count * sizeof(ObjectSymbol), ob->symbols.count, SECTION_ALIGNMENT },
+    [OBJ_SECTION_RELOCS]    = { ob->relocs.data,    ob->relocs.count * sizeof(ObjectReloc), ob->relocs.count, SECTION_ALIGNMENT },
+  };
+
+  uint32_t offset = sizeof(ObjectHeader);
+  for (int i = 0; i < OBJ_SECTION_COUNT; i++) {
+    offset = AlignUp(offset, layout[i].alignment);
+    header.sections[i] = (ObjectSection){
+      .offset = offset,
+      .size = layout[i].size,
+      .count = layout[i].count,
+    };
+    offset += layout[i].size;
+  }
+
+  /* Write to a temporary file and rename it into place, so a concurrent
+   * reader never maps a partially written object. */
+  char tmp_path[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+  FILE *fd = fopen(tmp_path, "wb");
+  if (fd == NULL) {
+    Print("WriteObjectFile(): Could not open '%s': %s\n", tmp_path, strerror(errno));
+    return false;
+  }
+
+  bool ok = WriteAt(fd, 0, &header, sizeof(header));
+  for (int i = 0; i < OBJ_SECTION_COUNT && ok; i++) {
+    ok = WriteAt(fd, header.sections[i].offset, layout[i].data, layout[i].size);
+  }
+
+  // Trailing empty sections still need their (aligned) offsets to be inside the file
+  ok = ok && fflush(fd) == 0 && ftruncate(fileno(fd), offset) == 0;
+  ok = (fclose(fd) == 0) && ok;
+  if (ok) ok = rename(tmp_path, path) == 0;
+
+  if (!ok) {
+    Print("WriteObjectFile(): Could not write '%s': %s\n", path, strerror(errno));
+    remove(tmp_path);
+  }
+
+  return ok;
+}
+
+static bool SectionInBounds(const ObjectHeader *h, size_t file_size, int section) {
+  ObjectSection s = h->sections[section];
+  return (uint64_t)s.offset + s.size <= file_size;
+}
+
+static ObjectLoadResult ValidateObject(const LoadedObject *obj) {
+  const ObjectHeader *h = obj->header;
+
+  if (obj->size < sizeof(ObjectHeader)) return OBJ_LOAD_CORRUPT;
+  if (memcmp(h->magic, OBJECT_MAGIC, sizeof(h->magic)) != 0) return OBJ_LOAD_CORRUPT;
+  if (h->version != OBJECT_VERSION) return OBJ_LOAD_VERSION_MISMATCH;
+
+  for (int i = 0; i < OBJ_SECTION_COUNT; i++) {
+    if (!SectionInBounds(h, obj->size, i)) return OBJ_LOAD_CORRUPT;
+  }
+
+  ObjectSection strings = h->sections[OBJ_SECTION_STRINGS];
+  ObjectSection constants = h->sections[OBJ_SECTION_CONSTANTS];
+  ObjectSection functions = h->sections[OBJ_SECTION_FUNCTIONS];
+  ObjectSection code = h->sections[OBJ_SECTION_CODE];
+  ObjectSection symbols = h->sections[OBJ_SECTION_SYMBOLS];
+  ObjectSection relocs = h->sections[OBJ_SECTION_RELOCS];
+
+  // The string pool must be NUL-terminated so that lookups can't run off the end
+  if (strings.size == 0 || obj->base[strings.offset + strings.size - 1] != '\0') return OBJ_LOAD_CORRUPT;
+
+  if ((uint64_t)constants.count * sizeof(ObjectConstant) != constants.size) return OBJ_LOAD_CORRUPT;
+  if ((uint64_t)functions.count * sizeof(ObjectFunction) != functions.size) return OBJ_LOAD_CORRUPT;
+  if ((uint64_t)symbols.count * sizeof(ObjectSymbol) != symbols.size) return OBJ_LOAD_CORRUPT;
+  if ((uint64_t)relocs.count * sizeof(ObjectReloc) != relocs.size) return OBJ_LOAD_CORRUPT;
+
+  if (h->code_format > OBJ_CODE_X64) return OBJ_LOAD_CORRUPT;
+  if (h->entry_function != OBJECT_NO_ENTRY && h->entry_function >= functions.count) return OBJ_LOAD_CORRUPT;
+
+  const ObjectFunction *fns = (const ObjectFunction *)(obj->base + functions.offset);
+  for (uint32_t i = 0; i < functions.count; i++) {
+    if (fns[i].name_offset >= strings.size) return OBJ_LOAD_CORRUPT;
+    if ((uint64_t)fns[i].code_offset + fns[i].code_size > code.size) return OBJ_LOAD_CORRUPT;
+  }
+
+  const ObjectConstant *consts = (const ObjectConstant *)(obj->base + constants.offset);
+  for (uint32_t i = 0; i < constants.count; i++) {
+    if (consts[i].kind == OBJ_CONST_STRING && consts[i].string_offset >= strings.size) return OBJ_LOAD_CORRUPT;
+  }
+
+  // Relocating code must stay inside the segments it patches
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    ObjectSegment segment = h->segments[s];
+    bool power_of_two = segment.alignment != 0 && (segment.alignment & (segment.alignment - 1)) == 0;
+    if (h->code_format == OBJ_CODE_X64 && !power_of_two) return OBJ_LOAD_CORRUPT;
+    if (s != X64_BSS && (uint64_t)segment.offset + segment.size > code.size) return OBJ_LOAD_CORRUPT;
+  }
+
+  const ObjectSymbol *syms = (const ObjectSymbol *)(obj->base + symbols.offset);
+  for (uint32_t i = 0; i < symbols.count; i++) {
+    if (syms[i].name_offset >= strings.size) return OBJ_LOAD_CORRUPT;
+    if (syms[i].segment < -1 || syms[i].segment >= X64_SECTION_COUNT) return OBJ_LOAD_CORRUPT;
+    if (syms[i].segment >= 0 && syms[i].offset > h->segments[syms[i].segment].size) return OBJ_LOAD_CORRUPT;
+  }
+
+  const ObjectReloc *rels = (const ObjectReloc *)(obj->base + relocs.offset);
+  for (uint32_t i = 0; i < relocs.count; i++) {
+    if (rels[i].segment < 0 || rels[i].segment >= X64_SECTION_COUNT || rels[i].segment == X64_BSS) return OBJ_LOAD_CORRUPT;
+
+    uint32_t width = (rels[i].type == X64_RELOC_64) ? sizeof(uint64_t) : sizeof(uint32_t);
+    if ((uint64_t)rels[i].offset + width > h->segments[rels[i].segment].size) return OBJ_LOAD_CORRUPT;
+    if (rels[i].symbol >= symbols.count) return OBJ_LOAD_CORRUPT;
+  }
+
+  return OBJ_LOAD_OK;
+}
+
+ObjectLoadResult LoadObjectFile(const char *path, const char *source, size_t source_length, LoadedObject *dest) {
+  *dest = (LoadedObject){0};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return OBJ_LOAD_MISSING;
+
+  struct stat s;
+  if (fstat(fd, &s) != 0 || s.st_size < (off_t)sizeof(ObjectHeader)) {
+    close(fd);
+    return OBJ_LOAD_CORRUPT;
+  }
+
+  void *base = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (base == MAP_FAILED) return OBJ_LOAD_MISSING;
+
+  LoadedObject obj = {
+    .base = base,
+    .size = s.st_size,
+    .header = base,
+  };
+
+  ObjectLoadResult result = ValidateObject(&obj);
+
+  if (result == OBJ_LOAD_OK && source != NULL) {
+    bool fresh = obj.header->source_length == source_length &&
+                 obj.header->source_hash == HashBytes(source, source_length);
+    if (!fresh) result = OBJ_LOAD_STALE;
+  }
+
+  if (result != OBJ_LOAD_OK) {
+    UnloadObjectFile(&obj);
+    return result;
+  }
+
+  *dest = obj;
+  return OBJ_LOAD_OK;
+}
+
+void UnloadObjectFile(LoadedObject *obj) {
+  if (obj->base != NULL) munmap((void *)obj->base, obj->size);
+  *obj = (LoadedObject){0};
+}
+
+const char *ObjectLoadResultTranslation(ObjectLoadResult result) {
+  switch (result) {
+    case OBJ_LOAD_OK:               return "OK";
+    case OBJ_LOAD_MISSING:          return "MISSING";
+    case OBJ_LOAD_CORRUPT:          return "CORRUPT";
+    case OBJ_LOAD_VERSION_MISMATCH: return "VERSION MISMATCH";
+    case OBJ_LOAD_STALE:            return "STALE";
+    default:                        return "Unhandled ObjectLoadResultTranslation case";
+  }
+}
+
+const char *ObjectString(LoadedObject *obj, uint32_t offset) {
+  ObjectSection strings = obj->header->sections[OBJ_SECTION_STRINGS];
+  if (offset >= strings.size) return "";
+
+  return (const char *)(obj->base + strings.offset + offset);
+}
+
+const ObjectConstant *ObjectConstantAt(LoadedObject *obj, uint32_t index) {
+  ObjectSection constants = obj->header->sections[OBJ_SECTION_CONSTANTS];
+  if (index >= constants.count) return NULL;
+
+  return (const ObjectConstant *)(obj->base + constants.offset) + index;
+}
+
+const ObjectFunction *ObjectFunctionAt(LoadedObject *obj, uint32_t index) {
+  ObjectSection functions = obj->header->sections[OBJ_SECTION_FUNCTIONS];
+  if (index >= functions.count) return NULL;
+
+  return (const ObjectFunction *)(obj->base + functions.offset) + index;
+}
+
+const uint8_t *ObjectCode(LoadedObject *obj) {
+  return obj->base + obj->header->sections[OBJ_SECTION_CODE].offset;
+}
+
+X64_Object *ObjectX64Code(LoadedObject *obj) {
+  const ObjectHeader *h = obj->header;
+  if (h->code_format != OBJ_CODE_X64) return NULL;
+
+  X64_Object *code = calloc(1, sizeof(X64_Object));
+  code->arena = NewArena();
+
+  // Section bytes are only ever copied out of, so they can stay read-only in the mapping
+  for (int s = 0; s < X64_SECTION_COUNT; s++) {
+    ObjectSegment segment = h->segments[s];
+    code->sections[s] = (X64_Section){
+      .bytes = (s == X64_BSS) ? NULL : (uint8_t *)ObjectCode(obj) + segment.offset,
+      .size = segment.size,
+      .capacity = segment.size,
+      .alignment = segment.alignment,
+    };
+  }
+
+  ObjectSection symbols = h->sections[OBJ_SECTION_SYMBOLS];
+  const ObjectSymbol *syms = (const ObjectSymbol *)(obj->base + symbols.offset);
+  code->symbols = ArenaAlloc(code->arena, symbols.count * sizeof(X64_Symbol));
+  code->symbol_count = code->symbol_capacity = symbols.count;
+
+  for (uint32_t i = 0; i < symbols.count; i++) {
+    code->symbols[i] = (X64_Symbol){
+      .name = ObjectString(obj, syms[i].name_offset),
+      .section = syms[i].segment,
+      .offset = syms[i].offset,
+      .is_global = syms[i].is_global,
+      .is_function = syms[i].is_function,
+    };
+  }
+
+  ObjectSection relocs = h->sections[OBJ_SECTION_RELOCS];
+  const ObjectReloc *rels = (const ObjectReloc *)(obj->base + relocs.offset);
+  code->relocs = ArenaAlloc(code->arena, relocs.count * sizeof(X64_Reloc));
+  code->reloc_count = code->reloc_capacity = relocs.count;
+
+  for (uint32_t i = 0; i < relocs.count; i++) {
+    code->relocs[i] = (X64_Reloc){
+      .section = rels[i].segment,
+      .offset = rels[i].offset,
+      .symbol = rels[i].symbol,
+      .type = rels[i].type,
+      .addend = rels[i].addend,
+    };
+  }
+
+  return code;
+}
+
+void PrintObjectSummary(LoadedObject *obj) {
+  const ObjectHeader *h = obj->header;
+
+  Print("Object v%d, source hash %016lx (%lu bytes)\n", h->version, h->source_hash, h->source_length);
+  Print("  %u strings, %u constants, %u functions, %u bytes of code\n",
+        h->sections[OBJ_SECTION_STRINGS].count,
+        h->sections[OBJ_SECTION_CONSTANTS].count,
+        h->sections[OBJ_SECTION_FUNCTIONS].count,
+        h->sections[OBJ_SECTION_CODE].size);
+
+  for (uint32_t i = 0; i < h->sections[OBJ_SECTION_FUNCTIONS].count; i++) {
+    const ObjectFunction *f = ObjectFunctionAt(obj, i);
+
+    // Functions inlined everywhere they're called have no code of their own
+    char size[32] = "no code";
+    if (f->code_size > 0) snprintf(size, sizeof(size), "%u bytes", f->code_size);
+
+    Print("  %s/%d :: %s [%s]%s\n",
+          ObjectString(obj, f->name_offset),
+          f->param_count,
+          TypeTranslation((Type){ .specifier = f->return_type }),
+          size,
+          (i == h->entry_function) ? " (entry)" : "");
+  }
+}
@@ -0,0 +1,182 @@
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h> // for size_t
+#include <stdint.h>
+
+#include "ast.h"
+#include "value.h"
+#include "x64_assembler.h"
+
+/* Crom object files (.cro)
+ *
+ * A versioned container holding everything needed to run a program
+ * without going through the lexer, parser or type checker again:
+ *
+ *   +-------------------+
+ *   | ObjectHeader      |  magic, version, source fingerprint, section table
+ *   +-------------------+
+ *   | String pool       |  NUL-terminated strings, referenced by offset
+ *   | Constant pool     |  ObjectConstant[]
+ *   | Function table    |  ObjectFunction[]
+ *   | Code              |  raw code bytes, format given by header.code_format
+ *   | Symbol table      |  ObjectSymbol[], for relocating the code
+ *   | Relocations       |  ObjectReloc[]
+ *   +-------------------+
+ *
+ * Code depends on more than the source, so header.code_key holds a hash
+ * of the options it was generated with, and is only reused under the same.
+ * It is machine code as the built-in assembler leaves it: the program's
+ * sections back to back (header.segments says where), with references
+ * between them still to be relocated, so it runs or links from the
+ * mapping without going through the assembler again. Each function's
+ * entry in the function table points at its instructions.
+ *
+ * Every reference inside the file is an offset relative to the start of
+ * the section it points into, so the file can be mmapped at any address
+ * and used in place. */
+
+#define OBJECT_MAGIC "CROM"
+#define OBJECT_VERSION 3
+#define OBJECT_NO_ENTRY UINT32_MAX
+
+enum ObjectSectionKind {
+  OBJ_SECTION_STRINGS,
+  OBJ_SECTION_CONSTANTS,
+  OBJ_SECTION_FUNCTIONS,
+  OBJ_SECTION_CODE,
+  OBJ_SECTION_SYMBOLS,
+  OBJ_SECTION_RELOCS,
+  OBJ_SECTION_COUNT,
+};
+
+enum ObjectCodeFormat {
+  OBJ_CODE_NONE,
+  OBJ_CODE_X64,     // x86-64 machine code from AssembleX64(), in X64_SectionId segments
+};
+
+enum ObjectConstantKind {
+  OBJ_CONST_INT,
+  OBJ_CONST_UINT,
+  OBJ_CONST_FLOAT,
+  OBJ_CONST_CHAR,
+  OBJ_CONST_BOOL,
+  OBJ_CONST_STRING,
+};
+
+typedef struct {
+  uint32_t offset; // from the start of the file
+  uint32_t size;   // in bytes
+  uint32_t count;  // number of entries, where applicable
+  uint32_t reserved;
+} ObjectSection;
+
+// Where one of the program's sections lies in the code section; .bss takes no bytes there
+typedef struct {
+  uint32_t offset;
+  uint32_t size;
+  uint32_t alignment;
+  uint32_t reserved;
+} ObjectSegment;
+
+typedef struct {
+  char     magic[4];
+  uint16_t version;
+  uint16_t code_format;
+  uint32_t entry_function;
+  uint32_t reserved;
+  uint64_t source_hash;
+  uint64_t source_length;
+  uint64_t code_key;
+  ObjectSection sections[OBJ_SECTION_COUNT];
+  ObjectSegment segments[X64_SECTION_COUNT];
+} ObjectHeader;
+
+typedef struct {
+  uint8_t  kind;
+  uint8_t  type_specifier;
+  uint16_t reserved;
+  uint32_t string_offset; // OBJ_CONST_STRING only
+  union {
+    int64_t  integer;
+    uint64_t uinteger;
+    double   floating;
+  } as;
+} ObjectConstant;
+
+typedef struct {
+  uint32_t name_offset;
+  uint16_t param_count;
+  uint8_t  return_type;
+  uint8_t  reserved;
+  uint32_t code_offset;
+  uint32_t code_size;
+} ObjectFunction;
+
+typedef struct {
+  uint32_t name_offset;
+  int32_t  segment; // -1 when defined elsewhere (libc)
+  uint32_t offset;
+  uint8_t  is_global;
+  uint8_t  is_function;
+  uint16_t reserved;
+} ObjectSymbol;
+
+typedef struct {
+  int32_t  segment;
+  uint32_t offset;
+  uint32_t symbol;
+  uint32_t type; // X64_RelocType
+  int64_t  addend;
+} ObjectReloc;
+
+typedef enum {
+  OBJ_LOAD_OK,
+  OBJ_LOAD_MISSING,
+  OBJ_LOAD_CORRUPT,
+  OBJ_LOAD_VERSION_MISMATCH,
+  OBJ_LOAD_STALE,
+} ObjectLoadResult;
+
+typedef struct ObjectBuilder ObjectBuilder;
+
+typedef struct {
+  const uint8_t *base;
+  size_t size;
+  const ObjectHeader *header;
+} LoadedObject;
+
+ObjectBuilder *NewObjectBuilder(const char *source, size_t source_length);
+void DeleteObjectBuilder(ObjectBuilder *ob);
+
+uint32_t ObjectAddString(ObjectBuilder *ob, const char *s, int length);
+uint32_t ObjectAddConstant(ObjectBuilder *ob, Value v);
+uint32_t ObjectAddFunction(ObjectBuilder *ob, Token name, int param_count, Type return_type);
+void ObjectSetEntryFunction(ObjectBuilder *ob, uint32_t function_index);
+void ObjectSetFunctionCode(ObjectBuilder *ob, uint32_t function_index, uint32_t code_offset, uint32_t code_size);
+
+/* Stores `code` and points the function table, and the entry function
+ * (main), at it. Call after ObjectAddProgram(), which lists the functions. */
+void ObjectSetX64Code(ObjectBuilder *ob, uint64_t code_key, X64_Object *code);
+
+void ObjectAddProgram(ObjectBuilder *ob, AST_Node *root);
+bool WriteObjectFile(ObjectBuilder *ob, const char *path);
+
+ObjectLoadResult LoadObjectFile(const char *path, const char *source, size_t source_length, LoadedObject *dest);
+void UnloadObjectFile(LoadedObject *obj);
+const char *ObjectLoadResultTranslation(ObjectLoadResult result);
+
+const char *ObjectString(LoadedObject *obj, uint32_t offset);
+const ObjectConstant *ObjectConstantAt(LoadedObject *obj, uint32_t index);
+const ObjectFunction *ObjectFunctionAt(LoadedObject *obj, uint32_t index);
+const uint8_t *ObjectCode(LoadedObject *obj);
+
+/* The object's code, ready for LoadJIT(), WriteELFObject() or
+ * LinkExecutable(), or NULL if it has none. Section bytes and symbol names
+ * stay in the mapping: DeleteX64Object() it before UnloadObjectFile(). */
+X64_Object *ObjectX64Code(LoadedObject *obj);
+
+void PrintObjectSummary(LoadedObject *obj);
+
+#endif
@@ -0,0 +1,185 @@
+#include <limits.h> // for INT_MIN, INT_MAX
+#include <stddef.h> // for NULL
+#include <stdlib.h> // for strtol, malloc
+#include <string.h> // for strcmp, strncmp
+
+#include "common.h"
+#include "error.h"
+#include "options.h"
+#include "server.h"
+
+#define DEFAULT_PROFILE_PATH "crom.profile"
+#define DEFAULT_CACHE_LIMIT 256
+
+static bool StartsWith(const char *s, const char *prefix) {
+  return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+CompilerOptions ParseOptions(int argc, char **argv) {
+  static const char *default_input = "test.txt";
+
+  CompilerOptions options = {
+    .input_filenames = malloc(argc * sizeof(char *)),
+    .input_count = 0,
+    .object_path = NULL,
+    .emit = EMIT_NONE,
+    .output_path = NULL,
+    .jit = false,
+    .external_toolchain = false,
+    .regalloc_report = false,
+    .dead_code_elimination = true,
+    .dce_report = false,
+    .inline_functions = true,
+    .inline_threshold = 20,
+    .inline_report = false,
+    .constant_propagation = true,
+    .constant_propagation_report = false,
+    .value_numbering = true,
+    .value_numbering_report = false,
+    .bounds_check_elimination = true,
+    .bounds_check_report = false,
+    .loop_optimizations = true,
+    .unroll_loops = true,
+    .loop_report = false,
+    .vector_isa = VECTOR_ISA_SSE2,
+    .profile_generate = NULL,
+    .profile_use = NULL,
+    .cache_dir = NULL,
+    .cache_limit = DEFAULT_CACHE_LIMIT,
+    .incremental_path = NULL,
+    .incremental_verify = false,
+    .time_report = false,
+    .time_report_path = NULL,
+    .memory_report = false,
+    .leak_check = false,
+    .trace_path = NULL,
+    .trace_functions = false,
+    .server_socket = NULL,
+    .server_workers = 0,
+    .connect_socket = NULL,
+  };
+
+  for (int i = 1; i < argc; i++) {
+    char *arg = argv[i];
+
+    if (StartsWith(arg, "--object=")) {
+      options.object_path = arg + strlen("--object=");
+    } else if (strcmp(arg, "--emit=ir") == 0) {
+      options.emit = EMIT_IR;
+    } else if (strcmp(arg, "--emit=asm") == 0) {
+      options.emit = EMIT_ASM;
+    } else if (strcmp(arg, "--emit=c") == 0) {
+      options.emit = EMIT_C;
+    } else if (strcmp(arg, "--emit=obj") == 0) {
+      options.emit = EMIT_OBJ;
+    } else if (strcmp(arg, "--jit") == 0) {
+      options.jit = true;
+    } else if (strcmp(arg, "--external-toolchain") == 0) {
+      options.external_toolchain = true;
+    } else if (strcmp(arg, "-fregalloc-report") == 0) {
+      options.regalloc_report = true;
+    } else if (strcmp(arg, "-fno-dce") == 0) {
+      options.dead_code_elimination = false;
+    } else if (strcmp(arg, "-fdce-report") == 0) {
+      options.dce_report = true;
+    } else if (StartsWith(arg, "-finline-threshold=")) {
+      char *value = arg + strlen("-finline-threshold=");
+      char *end;
+      long threshold = strtol(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || threshold < INT_MIN || threshold > INT_MAX) {
+        COMPILER_ERROR_FMTMSG("Option '%s' requires an integer", arg);
+      }
+      options.inline_threshold = (int)threshold;
+    } else if (strcmp(arg, "-fno-inline") == 0) {
+      options.inline_functions = false;
+    } else if (strcmp(arg, "-finline-report") == 0) {
+      options.inline_report = true;
+    } else if (strcmp(arg, "-fno-sccp") == 0) {
+      options.constant_propagation = false;
+    } else if (strcmp(arg, "-fsccp-report") == 0) {
+      options.constant_propagation_report = true;
+    } else if (strcmp(arg, "-fno-gvn") == 0) {
+      options.value_numbering = false;
+    } else if (strcmp(arg, "-fgvn-report") == 0) {
+      options.value_numbering_report = true;
+    } else if (strcmp(arg, "-fno-bounds-check-elim") == 0) {
+      options.bounds_check_elimination = false;
+    } else if (strcmp(arg, "-fbounds-check-report") == 0) {
+      options.bounds_check_report = true;
+    } else if (strcmp(arg, "-fno-loop-opt") == 0) {
+      options.loop_optimizations = false;
+    } else if (strcmp(arg, "-fno-unroll-loops") == 0) {
+      options.unroll_loops = false;
+    } else if (strcmp(arg, "-floop-report") == 0) {
+      options.loop_report = true;
+    } else if (StartsWith(arg, "-mvector=")) {
+      char *value = arg + strlen("-mvector=");
+      if (strcmp(value, "none") == 0) options.vector_isa = VECTOR_ISA_NONE;
+      else if (strcmp(value, "sse2") == 0) options.vector_isa = VECTOR_ISA_SSE2;
+      else if (strcmp(value, "avx2") == 0) options.vector_isa = VECTOR_ISA_AVX2;
+      else COMPILER_ERROR_FMTMSG("Option '%s' requires one of none, sse2 or avx2", arg);
+    } else if (strcmp(arg, "-fprofile-generate") == 0) {
+      options.profile_generate = DEFAULT_PROFILE_PATH;
+    } else if (StartsWith(arg, "-fprofile-generate=")) {
+      options.profile_generate = arg + strlen("-fprofile-generate=");
+    } else if (strcmp(arg, "-fprofile-use") == 0) {
+      options.profile_use = DEFAULT_PROFILE_PATH;
+    } else if (StartsWith(arg, "-fprofile-use=")) {
+      options.profile_use = arg + strlen("-fprofile-use=");
+    } else if (StartsWith(arg, "--cache-dir=")) {
+      options.cache_dir = arg + strlen("--cache-dir=");
+    } else if (StartsWith(arg, "--cache-limit=")) {
+      char *value = arg + strlen("--cache-limit=");
+      char *end;
+      long limit = strtol(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || limit < 0 || limit > INT_MAX) {
+        COMPILER_ERROR_FMTMSG("Option '%s' requires a size in MiB", arg);
+      }
+      options.cache_limit = (int)limit;
+    } else if (StartsWith(arg, "--incremental=")) {
+      options.incremental_path = arg + strlen("--incremental=");
+    } else if (strcmp(arg, "--incremental-verify") == 0) {
+      options.incremental_verify = true;
+    } else if (strcmp(arg, "-ftime-report") == 0) {
+      options.time_report = true;
+    } else if (StartsWith(arg, "-ftime-report=")) {
+      options.time_report = true;
+      options.time_report_path = arg + strlen("-ftime-report=");
+    } else if (strcmp(arg, "-fmem-report") == 0) {
+      options.memory_report = true;
+    } else if (strcmp(arg, "-fleak-check") == 0) {
+      options.leak_check = true;
+    } else if (StartsWith(arg, "--trace=")) {
+      options.trace_path = arg + strlen("--trace=");
+    } else if (strcmp(arg, "--trace-functions") == 0) {
+      options.trace_functions = true;
+    } else if (strcmp(arg, "--server") == 0) {
+      options.server_socket = DefaultServerSocket();
+    } else if (StartsWith(arg, "--server=")) {
+      options.server_socket = arg + strlen("--server=");
+    } else if (StartsWith(arg, "--server-workers=")) {
+      char *value = arg + strlen("--server-workers=");
+      char *end;
+      long workers = strtol(value, &end, 10);
+      if (*value == '\0' || *end != '\0' || workers < 1 || workers > 1024) {
+        COMPILER_ERROR_FMTMSG("Option '%s' requires a number of workers from 1 to 1024", arg);
+      }
+      options.server_workers = (int)workers;
+    } else if (strcmp(arg, "--connect") == 0) {
+      options.connect_socket = DefaultServerSocket();
+    } else if (StartsWith(arg, "--connect=")) {
+      options.connect_socket = arg + strlen("--connect=");
+    } else if (strcmp(arg, "-o") == 0) {
+      if (i + 1 >= argc) COMPILER_ERROR_FMTMSG("Option '%s' requires a path", arg);
+      options.output_path = argv[++i];
+    } else if ((arg[0] == '-' && arg[1] == '-') || StartsWith(arg, "-f") || StartsWith(arg, "-m")) {
+      COMPILER_ERROR_FMTMSG("Unknown option '%s'", arg);
+    } else {
+      options.input_filenames[options.input_count++] = arg;
+    }
+  }
+
+  if (options.input_count == 0) options.input_filenames[options.input_count++] = default_input;
+
+  return options;
+}
@@ -0,0 +1,132 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+
+typedef enum {
+  EMIT_NONE,
+  EMIT_IR,
+  EMIT_ASM,
+  EMIT_C,
+  EMIT_OBJ,
+} EmitKind;
+
+typedef enum {
+  VECTOR_ISA_NONE,
+  VECTOR_ISA_SSE2,
+  VECTOR_ISA_AVX2,
+} VectorISA;
+
+typedef struct {
+  // Source files of one program, compiled in the order given as if they were one file
+  const char **input_filenames;
+  int input_count;
+
+  // Intermediate form to print after compiling, selected with --emit=
+  EmitKind emit;
+
+  // Where to write the native executable (or the assembly or C source, with --emit=)
+  const char *output_path;
+
+  // Path of a Crom object file (.cro) to load from, or to write to if stale
+  const char *object_path;
+
+  // Assemble in-process and run the program instead of writing a file
+  bool jit;
+
+  // Build executables with the system assembler and linker (cc) instead of in-process
+  bool external_toolchain;
+
+  // Print register allocation statistics per function to stderr (-fregalloc-report)
+  bool regalloc_report;
+
+  // Remove unreachable code, constant branches, uncalled functions and unread variables (-fno-dce)
+  bool dead_code_elimination;
+
+  // Print the removed functions and how many AST nodes went to stderr (-fdce-report)
+  bool dce_report;
+
+  // Inline calls whose size minus benefit is at most this (-finline-threshold=, -fno-inline)
+  bool inline_functions;
+  int inline_threshold;
+
+  // Print the inliner's decision for every call site to stderr (-finline-report)
+  bool inline_report;
+
+  // Fold constants through phis and branches, removing blocks that can't be reached (-fno-sccp)
+  bool constant_propagation;
+
+  // Print how many values, branches and blocks went per function to stderr (-fsccp-report)
+  bool constant_propagation_report;
+
+  // Replace values computed again by the ones computed before (-fno-gvn)
+  bool value_numbering;
+
+  // Print instruction counts before and after value numbering per function to stderr (-fgvn-report)
+  bool value_numbering_report;
+
+  // Remove bounds checks of indices known to be in range (-fno-bounds-check-elim)
+  bool bounds_check_elimination;
+
+  // Print how many bounds checks were removed and kept per function to stderr (-fbounds-check-report)
+  bool bounds_check_report;
+
+  // Loop invariant code motion, strength reduction and unrolling (-fno-loop-opt, -fno-unroll-loops)
+  bool loop_optimizations;
+  bool unroll_loops;
+
+  // Print what was done to every loop to stderr (-floop-report)
+  bool loop_report;
+
+  // Instruction set the loop vectorizer targets (-mvector=none|sse2|avx2)
+  VectorISA vector_isa;
+
+  // Count how often every block runs and write the counts to this file on exit (-fprofile-generate[=])
+  const char *profile_generate;
+
+  // Read block counts from this file to guide inlining, unrolling and block layout (-fprofile-use[=])
+  const char *profile_use;
+
+  // Directory to keep the output of earlier runs in, to replay instead of compiling again (--cache-dir=)
+  const char *cache_dir;
+
+  // Size in MiB the cache directory is kept within, dropping the least recently used runs (--cache-limit=)
+  int cache_limit;
+
+  // File keeping the parsed and checked statements of the last build, to reuse those unchanged (--incremental=)
+  const char *incremental_path;
+
+  // Also compile from scratch in a child process and fail if the results differ (--incremental-verify)
+  bool incremental_verify;
+
+  // Print the time spent in every phase and counts of tokens, nodes and symbols to stderr on exit (-ftime-report[=])
+  bool time_report;
+
+  // Also write the report to this file as JSON
+  const char *time_report_path;
+
+  // Print allocations, bytes and peak memory by subsystem and by phase to stderr on exit (-fmem-report)
+  bool memory_report;
+
+  // Fail if compiling loses track of memory that neither the AST nor the symbol table reach (-fleak-check)
+  bool leak_check;
+
+  // Write Chrome trace events for every phase to this file (--trace=)
+  const char *trace_path;
+
+  // With a trace, also one event for every function parsed and checked (--trace-functions)
+  bool trace_functions;
+
+  // Serve compiles over this Unix domain socket instead of compiling (--server[=])
+  const char *server_socket;
+
+  // How many compiles the server runs at once, 0 for one per CPU (--server-workers=)
+  int server_workers;
+
+  // Have the server listening at this socket compile, or compile here if there is none (--connect[=])
+  const char *connect_socket;
+} CompilerOptions;
+
+CompilerOptions ParseOptions(int argc, char **argv);
+
+#endif
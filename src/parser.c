@@ -8,12 +8,15 @@
 #include "ast.h"
 #include "common.h"
 #include "error.h"
+#include "incremental.h"
 #include "io.h"
 #include "lexer.h"
+#include "time_report.h"
 
 static bool IN_LOOP;
 static bool IN_FUNCTION;
 static Token IN_FUNCTION_NAME;
+static bool DECLARING; // The next identifier was just declared by the type before it
 static SymbolTable *SYMBOL_TABLE;
 
 struct {
@@ -71,6 +74,8 @@ static AST_Node *ForStmt(bool unused);
 static AST_Node *Break(bool unused);
 static AST_Node *Continue(bool unused);
 static AST_Node *Return(bool unused);
+static AST_Node *TailRec(bool unused);
+static AST_Node *PrintStmt(bool unused);
 static AST_Node *ArraySubscripting(bool unused);
 static AST_Node *Enum(bool unused);
 static AST_Node *Struct(bool unused);
@@ -103,6 +108,8 @@ static ParseRule Rules[] = {
   [BREAK]          = { Break,    NULL, NO_PRECEDENCE },
   [CONTINUE]       = { Continue, NULL, NO_PRECEDENCE },
   [RETURN]         = { Return,   NULL, NO_PRECEDENCE },
+  [TAILREC]        = { TailRec,  NULL, NO_PRECEDENCE },
+  [PRINT]          = { PrintStmt, NULL, NO_PRECEDENCE },
 
   [IDENTIFIER]     = { Identifier, NULL, NO_PRECEDENCE },
 
@@ -455,10 +462,14 @@ static AST_Node *TypeSpecifier(bool) {
   Type type = (is_array) ? NewArrayType(type_token.type, array_size) : NewType(type_token.type);
   AddTo(SYMBOL_TABLE, NewSymbol(Parser.current, type, DECL_DECLARED));
 
+  DECLARING = true;
   return Identifier(ASSIGNABLE);
 }
 
 static AST_Node *Identifier(bool can_assign) {
+  bool declaring = DECLARING;
+  DECLARING = false;
+
   Token identifier_token = Parser.current;
   Symbol identifier_symbol = RetrieveFrom(SYMBOL_TABLE, identifier_token);
   bool is_in_symbol_table = IN_SYMBOL_TABLE(identifier_symbol);
@@ -479,10 +490,12 @@ static AST_Node *Identifier(bool can_assign) {
     } else { // Function call
       if (!is_in_symbol_table && !TokenValuesMatch(identifier_token, IN_FUNCTION_NAME)) {
         ERROR(ERR_UNDECLARED, identifier_token);
-      } else if (!DEFINED(identifier_symbol) && !TokenValuesMatch(identifier_token, IN_FUNCTION_NAME)) {
+      } else if (!DEFINED(identifier_symbol) && !TokenValuesMatch(identifier_token, IN_FUNCTION_NAME) &&
+                 !(DECLARED(identifier_symbol) && TypeIs_Function(identifier_symbol.data_type))) {
         ERROR(ERR_UNDEFINED, identifier_token);
       }
 
+      // Forward declared functions may be called before their definition, see FunctionCall() in the type checker
       return FunctionCall(identifier_token);
     }
   }
@@ -510,7 +523,7 @@ static AST_Node *Identifier(bool can_assign) {
       ERROR(ERR_UNDEFINED, identifier_token);
     }
 
-    return NewNodeFromToken(POSTFIX_INCREMENT_NODE, NULL, NULL, NULL, identifier_token, identifier_symbol.data_type);
+    return NewNodeFromToken(POSTFIX_INCREMENT_NODE, NULL, array_index, NULL, identifier_token, identifier_symbol.data_type);
   }
 
   if (Match(MINUS_MINUS)) {
@@ -518,7 +531,7 @@ static AST_Node *Identifier(bool can_assign) {
       ERROR(ERR_UNDEFINED, identifier_token);
     }
 
-    return NewNodeFromToken(POSTFIX_DECREMENT_NODE, NULL, NULL, NULL, identifier_token, identifier_symbol.data_type);
+    return NewNodeFromToken(POSTFIX_DECREMENT_NODE, NULL, array_index, NULL, identifier_token, identifier_symbol.data_type);
   }
 
   if (Match(EQUALS)) {
@@ -526,6 +539,14 @@ static AST_Node *Identifier(bool can_assign) {
       ERROR(ERR_IMPROPER_ASSIGNMENT, identifier_token);
     }
 
+    // "i64 x = 5" both declares and assigns; the declaration is kept on the
+    // right of the assignment node so later stages can tell it from "x = 5",
+    // which declares nothing even right after "i64 x;". Nor does storing
+    // into an element of a declared array.
+    AST_Node *declaration = (declaring && array_index == NULL)
+      ? NewNodeFromSymbol(DECLARATION_NODE, NULL, NULL, NULL, identifier_symbol)
+      : NULL;
+
     if (TypeIs_EnumMember(identifier_symbol.data_type)) {
       ERROR_MSG(ERR_IMPROPER_ASSIGNMENT, identifier_token, "Enum Member cannot be assigned to after declaration");
     }
@@ -534,7 +555,7 @@ static AST_Node *Identifier(bool can_assign) {
       Consume(LCURLY, "Identifier(): Expected { after struct assignment");
       AST_Node *initializer_list = InitializerList(identifier_symbol.data_type);
       identifier_symbol = SetDecl(SYMBOL_TABLE, identifier_token, DECL_DEFINED);
-      return NewNodeFromSymbol(ASSIGNMENT_NODE, initializer_list, NULL, NULL, identifier_symbol);
+      return NewNodeFromSymbol(ASSIGNMENT_NODE, initializer_list, NULL, declaration, identifier_symbol);
     }
 
     if (TypeIs_Array(identifier_symbol.data_type) &&
@@ -542,7 +563,7 @@ static AST_Node *Identifier(bool can_assign) {
       if (Match(LCURLY)) {
         AST_Node *initializer_list = InitializerList(identifier_symbol.data_type);
         identifier_symbol = SetDecl(SYMBOL_TABLE, identifier_token, DECL_DEFINED);
-        return NewNodeFromSymbol(ASSIGNMENT_NODE, initializer_list, array_index, NULL, identifier_symbol);
+        return NewNodeFromSymbol(ASSIGNMENT_NODE, initializer_list, array_index, declaration, identifier_symbol);
       } else if (array_index != NULL) {
         /* Subscripting */
       } else {
@@ -552,7 +573,7 @@ static AST_Node *Identifier(bool can_assign) {
 
     AST_Node *expr = Expression(_);
     Symbol stored_symbol = AddTo(SYMBOL_TABLE, NewSymbol(identifier_token, identifier_symbol.data_type, DECL_DEFINED));
-    return NewNodeFromSymbol(ASSIGNMENT_NODE, expr, array_index, NULL, stored_symbol);
+    return NewNodeFromSymbol(ASSIGNMENT_NODE, expr, array_index, declaration, stored_symbol);
   }
 
   if (NextTokenIsTerseAssignment()) {
@@ -562,7 +583,7 @@ static AST_Node *Identifier(bool can_assign) {
     }
 
     AST_Node *terse_assignment = TerseAssignment(_);
-    terse_assignment->left = NewNodeFromSymbol(IDENTIFIER_NODE, NULL, NULL, NULL, identifier_symbol);
+    terse_assignment->left = NewNodeFromSymbol(IDENTIFIER_NODE, NULL, array_index, NULL, identifier_symbol);
     return terse_assignment;
   }
 
@@ -570,8 +591,9 @@ static AST_Node *Identifier(bool can_assign) {
     return StructMemberAccess(identifier_token);
   }
 
-  // Check for invalid syntax like "i64 i + 1;"
-  if (DECLARED(identifier_symbol) && !NextTokenIs(SEMICOLON)) {
+  // Check for invalid syntax like "i64 i + 1;", and for reading a variable
+  // that was declared but never given a value, like "i64 t = arr[3];"
+  if (DECLARED(identifier_symbol) && (!declaring || !NextTokenIs(SEMICOLON))) {
     ERROR(ERR_UNINITIALIZED, identifier_token);
   }
 
@@ -589,6 +611,14 @@ static AST_Node *Unary(bool) {
 
   Token operator_token = Parser.current;
   Token token_after_operator = Parser.next; // for error messages
+
+  // Parsing "x" in "++x" would report x as uninitialized, when it's incrementing that needs a value
+  bool increment = operator_token.type == PLUS_PLUS || operator_token.type == MINUS_MINUS;
+  if (increment && token_after_operator.type == IDENTIFIER &&
+      DECLARED(RetrieveFrom(SYMBOL_TABLE, token_after_operator))) {
+    ERROR(ERR_UNDEFINED, token_after_operator);
+  }
+
   AST_Node *parse_result = Parse(UNARY, _);
 
   switch(operator_token.type) {
@@ -839,6 +869,17 @@ static AST_Node *Return(bool) {
   return NewNodeFromToken(RETURN_NODE, expr, NULL, NULL, remember, (expr == NULL) ? NewType(VOID) : expr->data_type);
 }
 
+static AST_Node *PrintStmt(bool) {
+  Token remember = Parser.current;
+
+  Consume(LPAREN, "PrintStmt(): Expected '(' after print, got '%s' instead", TokenTypeTranslation(Parser.next.type));
+  if (NextTokenIs(RPAREN)) ERROR_MSG(ERR_TOO_FEW, Parser.next, "print() requires an argument");
+  AST_Node *expr = Expression(PREVENT_ASSIGNMENT);
+  Consume(RPAREN, "PrintStmt(): Expected ')' after print argument, got '%s' instead", TokenTypeTranslation(Parser.next.type));
+
+  return NewNodeFromToken(PRINT_CALL_NODE, expr, NULL, NULL, remember, NewType(VOID));
+}
+
 static AST_Node *Parens(bool) {
   AST_Node *parse_result = Expression(PREVENT_ASSIGNMENT);
   Consume(RPAREN, "Parens(): Missing ')' after expression");
@@ -980,7 +1021,8 @@ static AST_Node *StructMemberAccess(Token identifier) {
 
   StructMember *member = GetStructMember(parent_type.data_type, member_name);
 
-  return NewNodeFromToken(STRUCT_MEMBER_IDENTIFIER_NODE, expr, array_index, NULL, member_name, member->type);
+  AST_Node *member_node = NewNodeFromToken(STRUCT_MEMBER_IDENTIFIER_NODE, expr, array_index, NULL, member_name, member->type);
+  return NewNodeFromToken(STRUCT_IDENTIFIER_NODE, member_node, NULL, NULL, identifier, member->type);
 }
 
 static void StructBody(AST_Node **struct_name) {
@@ -1052,6 +1094,7 @@ static AST_Node *StructTypeSpecifier(Token struct_identifier) {
 
   SetSymbolParentStruct(SYMBOL_TABLE, Parser.current, struct_symbol);
 
+  DECLARING = true;
   return Identifier(ASSIGNABLE);
 }
 
@@ -1107,6 +1150,9 @@ static AST_Node *InitializerList(Type expected_type) {
 static AST_Node *FunctionParams(Token function_name) {
   Symbol function = RetrieveFrom(SYMBOL_TABLE, function_name);
 
+  // A definition after a forward declaration lists the parameters again
+  if (DECLARED(function)) function.data_type.params.next = NULL;
+
   AST_Node *params = NewNode(FUNCTION_PARAM_NODE, NULL, NULL, NULL, NoType());
   AST_Node **current = &params;
 
@@ -1201,9 +1247,11 @@ static AST_Node *FunctionDeclaration(Token function_name) {
     ERROR_MSG(ERR_IMPROPER_DECLARATION, function_name, "Functions must be declared in global scope");
   }
 
+  BeginFunctionTrace(function_name);
   AST_Node *params = FunctionParams(function_name);
   AST_Node *return_type = FunctionReturnType();
   AST_Node *body = FunctionBody(function_name);
+  EndFunctionTrace(function_name);
 
   Symbol function = RetrieveFrom(SYMBOL_TABLE, function_name);
 
@@ -1221,40 +1269,53 @@ static AST_Node *FunctionDeclaration(Token function_name) {
   return NewNodeFromSymbol((body == NULL) ? DECLARATION_NODE : FUNCTION_NODE, return_type, params, body, function);
 }
 
+// The function body keeps the 'tailrec' token, see NodeIs_TailRecursive()
+static AST_Node *TailRec(bool) {
+  Token keyword = Parser.current;
+
+  if (!NextTokenIs(IDENTIFIER) || !TokenAfterNextIs(LPAREN)) {
+    ERROR_MSG(ERR_IMPROPER_DECLARATION, keyword, "'tailrec' must be followed by a function definition");
+  }
+  Consume(IDENTIFIER, "TailRec(): Expected a function name after 'tailrec'");
+
+  AST_Node *function = Identifier(_);
+  if (!NodeIs_Function(function)) {
+    ERROR_MSG(ERR_IMPROPER_DECLARATION, keyword, "'tailrec' must be followed by a function definition");
+  }
+
+  function->right->token = keyword;
+  return function;
+}
+
 static AST_Node *FunctionCall(Token function_name) {
   AST_Node *args = NULL;
   AST_Node **current = &args;
 
   while (!NextTokenIs(RPAREN) && !NextTokenIs(TOKEN_EOF)) {
-    if (NextTokenIs(IDENTIFIER)) {
-      Consume(IDENTIFIER, "FunctionCall(): Expected identifier\n");
-      Token identifier_token = Parser.current;
-      Symbol identifier = RetrieveFrom(SYMBOL_TABLE, identifier_token);
+    bool single_operand = TokenAfterNextIs(COMMA) || TokenAfterNextIs(RPAREN);
 
-      if (Match(LPAREN)) {
-        (*current) = FunctionCall(identifier_token);
-      } else {
-        (*current) = NewNodeFromSymbol(FUNCTION_ARGUMENT_NODE, NULL, NULL, NULL, identifier);
-      }
+    if (NextTokenIs(IDENTIFIER) && single_operand) {
+      Consume(IDENTIFIER, "FunctionCall(): Expected identifier\n");
+      Symbol identifier = RetrieveFrom(SYMBOL_TABLE, Parser.current);
 
-    } else if (NextTokenIsLiteral()) {
+      (*current) = NewNodeFromSymbol(FUNCTION_ARGUMENT_NODE, NULL, NULL, NULL, identifier);
+    } else if (NextTokenIsLiteral() && single_operand) {
       ConsumeAnyLiteral("FunctionCall(): Expected literal\n");
       Token literal = Parser.current;
 
       (*current) = NewNodeFromToken(FUNCTION_ARGUMENT_NODE, NULL, NULL, NULL, literal, NewType(literal.type));
-    } else if (Match(MINUS) || Match(PLUS_PLUS) || Match(MINUS_MINUS)) {
-      AST_Node *unary_expr = Unary(_);
-      (*current) = NewNodeFromToken(FUNCTION_ARGUMENT_NODE, unary_expr, NULL, NULL, unary_expr->token, NewType(unary_expr->left->token.type));
     } else {
-      ERROR_FMT(ERR_UNEXPECTED, Parser.next, "Unexpected token '%.*s'", Parser.next.length, Parser.next.position_in_source);
+      // Anything more, like "n - 1", is parsed as a whole; calls stand for themselves
+      AST_Node *expr = Expression(PREVENT_ASSIGNMENT);
+      (*current) = (expr->node_type == FUNCTION_CALL_NODE)
+        ? expr
+        : NewNodeFromToken(FUNCTION_ARGUMENT_NODE, expr, NULL, NULL, expr->token, expr->data_type);
     }
 
-    if (Match(COMMA)) {
-      if (NextTokenIs(RPAREN)) { break; }
+    if (!Match(COMMA) || NextTokenIs(RPAREN)) break;
 
-      (*current)->right = NewNode(CHAIN_NODE, NULL, NULL, NULL, NoType());
-      current = &(*current)->right;
-    }
+    // Arguments are chained through their right nodes
+    current = &(*current)->right;
   }
 
   Consume(RPAREN, "FunctionCall(): Expected ')'");
@@ -1278,13 +1339,25 @@ AST_Node *ParserBuildAST() {
   AST_Node **current_node = &root;
 
   while (!Match(TOKEN_EOF)) {
-    AST_Node *parse_result = Statement(_);
+    AST_Node *parse_result = ReuseParsedStatement(Parser.next, &Parser.current);
+
+    if (parse_result != NULL) {
+      // The lexer was moved past the reused statement, so the lookahead is scanned from there
+      Parser.next = ScanToken();
+      Parser.after_next = ScanToken();
+      if (Parser.next.type == ERROR) ERROR(ERR_LEXER_ERROR, Parser.next);
+    } else {
+      BeginParsingStatement(Parser.next);
+      parse_result = Statement(_);
+    }
 
     if (parse_result == NULL) {
       SetErrorCode(ERR_MISC);
       COMPILER_ERROR("ParserBuildAST(): AST could not be created");
     }
 
+    EndParsingStatement(Parser.current, parse_result);
+
     AST_Node *next_statement = NewNode(CHAIN_NODE, NULL, NULL, NULL, NoType());
 
     (*current_node)->left = parse_result;
@@ -0,0 +1,431 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regalloc.h"
+
+/* Positions: instruction k of the linear order owns positions 4k..4k+3.
+ *
+ *   4k     calls clobber caller-saved registers, before reading arguments
+ *   4k + 1 operands are read
+ *   4k + 2 printf and fmod clobber, after operands are in scratch registers
+ *   4k + 3 the result is written
+ *
+ * so a value used by an instruction may share its register with the
+ * instruction's result, and a value crosses a clobber when its interval
+ * strictly contains the clobber's position. Numbering starts at k = 1;
+ * parameters are defined at position 0, by the prologue. */
+
+#define POSITIONS_PER_INST 4
+
+static const char *register_names[X64_REGISTER_COUNT] = {
+  "rsi", "rdi", "r8", "r9", "r10",
+  "rbx", "r12", "r13", "r14", "r15",
+};
+
+typedef uint64_t Word;
+#define WORD_BITS 64
+
+static struct {
+  IR_Function *fn;
+  RegAllocation *ra;
+  int value_count;
+
+  int *position;     // per value
+  int *block_start;  // per block
+  int *block_end;
+
+  int words;         // per live set
+  Word *live_in;     // block_count sets
+  Word *live_out;
+
+  int *start;        // per value, INT_MAX when it has no interval
+  int *end;
+
+  int *clobbers;     // sorted positions
+  int clobber_count;
+
+  IR_Value *phi_of;  // a phi each value flows into, for coalescing hints
+} RA;
+
+static Word *LiveSet(Word *sets, IR_Block b) {
+  return &sets[(size_t)b * RA.words];
+}
+
+static void SetBit(Word *set, int i) {
+  set[i / WORD_BITS] |= (Word)1 << (i % WORD_BITS);
+}
+
+static bool TestBit(Word *set, int i) {
+  return (set[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+}
+
+bool ValueNeedsHome(IR_Inst *inst) {
+  switch (inst->op) {
+    case IR_NOP:
+    case IR_CONST:
+    case IR_GLOBAL:
+    case IR_STRING:
+    case IR_ALLOCA:
+      return false;
+    default:
+      return inst->type != IRT_VOID;
+  }
+}
+
+static bool HasHome(IR_Value v) {
+  return v != IR_NONE && ValueNeedsHome(&RA.fn->insts[v]);
+}
+
+/* === Numbering === */
+static void NumberInstructions() {
+  IR_Function *fn = RA.fn;
+  int k = 1;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+    RA.block_start[b] = k * POSITIONS_PER_INST;
+
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Value v = block->insts[i];
+      IR_Inst *inst = &fn->insts[v];
+      int p = k * POSITIONS_PER_INST;
+      RA.position[v] = p;
+
+      if (inst->op == IR_CALL) {
+        RA.clobbers[RA.clobber_count++] = p;
+      } else if (inst->op == IR_PRINT || (inst->op == IR_MOD && IRType_IsFloat(inst->type))) {
+        RA.clobbers[RA.clobber_count++] = p + 2;
+      }
+
+      k++;
+    }
+
+    RA.block_end[b] = k * POSITIONS_PER_INST - 1;
+  }
+}
+
+/* === Liveness === */
+
+// Calls `fn(value, pred)` for each phi input, with the predecessor it comes from
+#define FOR_EACH_PHI_INPUT(block, phi_value, input, pred, body)                    \
+  do {                                                                             \
+    IR_BasicBlock *for_block_ = &RA.fn->blocks[block];                             \
+    for (int for_i_ = 0; for_i_ < for_block_->inst_count; for_i_++) {              \
+      IR_Value phi_value = for_block_->insts[for_i_];                              \
+      if (RA.fn->insts[phi_value].op != IR_PHI) break;                             \
+      IR_Value *for_args_ = IRArgs(RA.fn, phi_value);                              \
+      for (int for_p_ = 0; for_p_ < for_block_->pred_count; for_p_++) {            \
+        IR_Value input = for_args_[for_p_];                                        \
+        IR_Block pred = for_block_->preds[for_p_];                                 \
+        body                                                                       \
+      }                                                                            \
+    }                                                                              \
+  } while (0)
+
+static void ComputeLiveness() {
+  IR_Function *fn = RA.fn;
+  int n = fn->block_count;
+  Word *gen = calloc((size_t)n * RA.words + 1, sizeof(Word));
+  Word *kill = calloc((size_t)n * RA.words + 1, sizeof(Word));
+  Word *phi_uses = calloc((size_t)n * RA.words + 1, sizeof(Word));
+
+  for (IR_Block b = 0; b < n; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Value v = block->insts[i];
+
+      if (fn->insts[v].op != IR_PHI) {
+        IR_Value *operands[64];
+        int count = IRInstOperands(fn, v, operands, 64);
+
+        for (int j = 0; j < count; j++) {
+          IR_Value u = *operands[j];
+          if (HasHome(u) && !TestBit(LiveSet(kill, b), u)) SetBit(LiveSet(gen, b), u);
+        }
+      }
+
+      if (HasHome(v)) SetBit(LiveSet(kill, b), v);
+    }
+
+    // Phi inputs are used at the end of the predecessor they come from
+    FOR_EACH_PHI_INPUT(b, phi, input, pred, {
+      if (HasHome(input)) SetBit(LiveSet(phi_uses, pred), input);
+    });
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (IR_Block b = n - 1; b >= 0; b--) {
+      Word *out = LiveSet(RA.live_out, b);
+      Word *in = LiveSet(RA.live_in, b);
+      IR_Block succs[2];
+      int succ_count = IRSuccessors(fn, b, succs);
+
+      for (int w = 0; w < RA.words; w++) {
+        Word new_out = LiveSet(phi_uses, b)[w];
+        for (int s = 0; s < succ_count; s++) new_out |= LiveSet(RA.live_in, succs[s])[w];
+
+        Word new_in = LiveSet(gen, b)[w] | (new_out & ~LiveSet(kill, b)[w]);
+        if (new_out != out[w] || new_in != in[w]) changed = true;
+
+        out[w] = new_out;
+        in[w] = new_in;
+      }
+    }
+  }
+
+  free(gen);
+  free(kill);
+  free(phi_uses);
+}
+
+/* === Intervals === */
+static void Extend(IR_Value v, int position) {
+  if (position < RA.start[v]) RA.start[v] = position;
+  if (position > RA.end[v]) RA.end[v] = position;
+}
+
+static void BuildIntervals() {
+  IR_Function *fn = RA.fn;
+
+  for (IR_Block b = 0; b < fn->block_count; b++) {
+    IR_BasicBlock *block = &fn->blocks[b];
+
+    for (int v = 0; v < RA.value_count; v++) {
+      if (TestBit(LiveSet(RA.live_in, b), v)) Extend(v, RA.block_start[b]);
+      if (TestBit(LiveSet(RA.live_out, b), v)) Extend(v, RA.block_end[b]);
+    }
+
+    for (int i = 0; i < block->inst_count; i++) {
+      IR_Value v = block->insts[i];
+      IR_Inst *inst = &fn->insts[v];
+      int p = RA.position[v];
+
+      if (HasHome(v)) {
+        if (inst->op == IR_PARAM) Extend(v, 0);
+        else if (inst->op == IR_PHI) Extend(v, RA.block_start[b]);
+        else Extend(v, p + 3);
+      }
+
+      if (inst->op == IR_PHI) continue;
+
+      IR_Value *operands[64];
+      int count = IRInstOperands(fn, v, operands, 64);
+      for (int j = 0; j < count; j++) {
+        if (HasHome(*operands[j])) Extend(*operands[j], p + 1);
+      }
+    }
+
+    FOR_EACH_PHI_INPUT(b, phi, input, pred, {
+      if (HasHome(input)) {
+        Extend(input, RA.block_end[pred]);
+        if (RA.phi_of[input] == IR_NONE) RA.phi_of[input] = phi;
+      }
+    });
+  }
+}
+
+static bool CrossesClobber(IR_Value v) {
+  int low = 0, high = RA.clobber_count;
+
+  // First clobber after the interval's start
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (RA.clobbers[mid] <= RA.start[v]) low = mid + 1;
+    else high = mid;
+  }
+
+  return low < RA.clobber_count && RA.clobbers[low] < RA.end[v];
+}
+
+/* === Allocation === */
+static int CompareStarts(const void *a, const void *b) {
+  IR_Value x = *(const IR_Value *)a;
+  IR_Value y = *(const IR_Value *)b;
+
+  if (RA.start[x] != RA.start[y]) return (RA.start[x] < RA.start[y]) ? -1 : 1;
+  return x - y;
+}
+
+static int HintFor(IR_Value v) {
+  int *reg = RA.ra->reg;
+
+  if (RA.fn->insts[v].op == IR_PHI) {
+    IR_Value *args = IRArgs(RA.fn, v);
+    for (int i = 0; i < RA.fn->insts[v].args_count; i++) {
+      if (HasHome(args[i]) && reg[args[i]] != REG_NONE) return reg[args[i]];
+    }
+  }
+
+  IR_Value phi = RA.phi_of[v];
+  if (phi != IR_NONE && reg[phi] != REG_NONE) return reg[phi];
+
+  return REG_NONE;
+}
+
+static void LinearScan() {
+  RegAllocation *ra = RA.ra;
+  IR_Value *order = malloc((RA.value_count + 1) * sizeof(IR_Value));
+  IR_Value *active = malloc((X64_REGISTER_COUNT + 1) * sizeof(IR_Value));
+  IR_Value owner[X64_REGISTER_COUNT];
+  int order_count = 0, active_count = 0;
+
+  for (int r = 0; r < X64_REGISTER_COUNT; r++) owner[r] = IR_NONE;
+
+  // Vectors don't fit general purpose registers and always live in their stack slot
+  for (IR_Value v = 0; v < RA.value_count; v++) {
+    if (RA.start[v] != INT_MAX && RA.fn->insts[v].lanes == 0) order[order_count++] = v;
+  }
+  qsort(order, order_count, sizeof(IR_Value), CompareStarts);
+  ra->interval_count = order_count;
+
+  for (int i = 0; i < order_count; i++) {
+    IR_Value v = order[i];
+
+    // Expire intervals that ended before this one starts
+    for (int j = 0; j < active_count;) {
+      IR_Value u = active[j];
+      if (RA.end[u] < RA.start[v]) {
+        owner[ra->reg[u]] = IR_NONE;
+        active[j] = active[--active_count];
+      } else {
+        j++;
+      }
+    }
+
+    int first = CrossesClobber(v) ? X64_FIRST_CALLEE_SAVED : 0;
+    int chosen = REG_NONE;
+    int hint = HintFor(v);
+
+    if (hint >= first && owner[hint] == IR_NONE) chosen = hint;
+    for (int r = first; r < X64_REGISTER_COUNT && chosen == REG_NONE; r++) {
+      if (owner[r] == IR_NONE) chosen = r;
+    }
+
+    if (chosen == REG_NONE) {
+      // Spill whichever interval that could give up a usable register ends last
+      int victim = -1;
+      for (int j = 0; j < active_count; j++) {
+        IR_Value u = active[j];
+        if (ra->reg[u] >= first && (victim < 0 || RA.end[u] > RA.end[active[victim]])) victim = j;
+      }
+
+      if (victim < 0 || RA.end[active[victim]] <= RA.end[v]) {
+        ra->spill_count++;
+        continue;
+      }
+
+      IR_Value spilled = active[victim];
+      chosen = ra->reg[spilled];
+      ra->reg[spilled] = REG_NONE;
+      ra->spill_count++;
+      active[victim] = active[--active_count];
+    }
+
+    ra->reg[v] = chosen;
+    owner[chosen] = v;
+    active[active_count++] = v;
+    if (X64RegisterIsCalleeSaved(chosen)) ra->callee_saved_used |= 1u << chosen;
+  }
+
+  free(order);
+  free(active);
+}
+
+static void CountCoalescedCopies() {
+  for (IR_Block b = 0; b < RA.fn->block_count; b++) {
+    FOR_EACH_PHI_INPUT(b, phi, input, pred, {
+      (void)pred;
+      if (!HasHome(input)) continue;
+
+      RA.ra->phi_copy_count++;
+      if (RA.ra->reg[phi] != REG_NONE && RA.ra->reg[phi] == RA.ra->reg[input]) RA.ra->coalesced_count++;
+    });
+  }
+}
+
+void AllocateRegisters(IR_Function *fn, RegAllocation *ra) {
+  memset(ra, 0, sizeof(*ra));
+  memset(&RA, 0, sizeof(RA));
+  RA.fn = fn;
+  RA.ra = ra;
+  RA.value_count = fn->inst_count;
+  RA.words = (fn->inst_count + WORD_BITS - 1) / WORD_BITS;
+
+  int n = fn->inst_count + 1;
+  int blocks = fn->block_count + 1;
+
+  ra->reg = malloc(n * sizeof(int));
+  RA.position = calloc(n, sizeof(int));
+  RA.start = malloc(n * sizeof(int));
+  RA.end = malloc(n * sizeof(int));
+  RA.phi_of = malloc(n * sizeof(IR_Value));
+  RA.clobbers = malloc(n * sizeof(int));
+  RA.block_start = calloc(blocks, sizeof(int));
+  RA.block_end = calloc(blocks, sizeof(int));
+  RA.live_in = calloc((size_t)blocks * RA.words + 1, sizeof(Word));
+  RA.live_out = calloc((size_t)blocks * RA.words + 1, sizeof(Word));
+
+  for (int v = 0; v < n; v++) {
+    ra->reg[v] = REG_NONE;
+    RA.start[v] = INT_MAX;
+    RA.end[v] = -1;
+    RA.phi_of[v] = IR_NONE;
+  }
+
+  NumberInstructions();
+  ComputeLiveness();
+  BuildIntervals();
+  LinearScan();
+  CountCoalescedCopies();
+
+  free(RA.position);
+  free(RA.start);
+  free(RA.end);
+  free(RA.phi_of);
+  free(RA.clobbers);
+  free(RA.block_start);
+  free(RA.block_end);
+  free(RA.live_in);
+  free(RA.live_out);
+}
+
+void FreeRegAllocation(RegAllocation *ra) {
+  free(ra->reg);
+  ra->reg = NULL;
+}
+
+const char *X64RegisterName(X64_Register r) {
+  return register_names[r];
+}
+
+bool X64RegisterIsCalleeSaved(X64_Register r) {
+  return r >= X64_FIRST_CALLEE_SAVED;
+}
+
+void PrintRegAllocReport(IR_Module *m, FILE *out) {
+  for (int i = 0; i < m->function_count; i++) {
+    IR_Function *fn = &m->functions[i];
+    if (!fn->is_defined) continue;
+
+    RegAllocation ra;
+    AllocateRegisters(fn, &ra);
+
+    fprintf(out, "regalloc: %s: %d intervals, %d spilled, %d/%d phi copies coalesced, callee-saved:",
+            fn->is_entry ? "main" : fn->name, ra.interval_count, ra.spill_count,
+            ra.coalesced_count, ra.phi_copy_count);
+
+    if (ra.callee_saved_used == 0) fputs(" none", out);
+    for (int r = X64_FIRST_CALLEE_SAVED; r < X64_REGISTER_COUNT; r++) {
+      if (ra.callee_saved_used & (1u << r)) fprintf(out, " %s", register_names[r]);
+    }
+    fputc('\n', out);
+
+    FreeRegAllocation(&ra);
+  }
+}
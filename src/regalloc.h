@@ -0,0 +1,61 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ir.h"
+
+/* Linear scan register allocation for the x86-64 backend
+ *
+ * Every SSA value that needs a home gets one live interval: the smallest
+ * range of the function's linear instruction order (blocks in index order)
+ * covering all the points where it is live. Intervals are allocated in
+ * order of their start, spilling whichever active interval ends last when
+ * registers run out. Spilled values live in a stack slot for their whole
+ * lifetime.
+ *
+ * Values that are live across a call (including printf and fmod) may only
+ * use callee-saved registers, the others prefer caller-saved ones so that
+ * functions only save what they need. Phis and their incoming values are
+ * hinted towards the same register, which turns the copies on CFG edges
+ * into no-ops. rax, rcx, rdx and r11 are never allocated: the code
+ * generator uses them as scratch registers. Vector values are never
+ * allocated either, they always live in stack slots. */
+
+typedef enum {
+  // Caller-saved
+  X64_RSI, X64_RDI, X64_R8, X64_R9, X64_R10,
+
+  // Callee-saved
+  X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15,
+
+  X64_REGISTER_COUNT,
+} X64_Register;
+
+#define X64_FIRST_CALLEE_SAVED X64_RBX
+#define REG_NONE (-1)
+
+typedef struct {
+  int *reg;        // X64_Register per value, REG_NONE when spilled or without a home
+
+  int interval_count;
+  int spill_count;
+  int phi_copy_count;
+  int coalesced_count;  // phi copies that became no-ops
+  unsigned callee_saved_used; // bit per X64_Register
+} RegAllocation;
+
+// Whether `inst` needs a register or stack slot; constants and addresses are rematerialized
+bool ValueNeedsHome(IR_Inst *inst);
+
+void AllocateRegisters(IR_Function *fn, RegAllocation *ra);
+void FreeRegAllocation(RegAllocation *ra);
+
+const char *X64RegisterName(X64_Register r);
+bool X64RegisterIsCalleeSaved(X64_Register r);
+
+// One line per defined function: intervals, spills and coalesced copies
+void PrintRegAllocReport(IR_Module *m, FILE *out);
+
+#endif
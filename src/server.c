@@ -0,0 +1,427 @@
+#define _GNU_SOURCE // for accept4
+#include <errno.h>      // for errno, EINTR
+#include <limits.h>     // for PATH_MAX
+#include <signal.h>     // for sigaction, kill
+#include <stdint.h>
+#include <stdio.h>      // for snprintf, dprintf
+#include <stdlib.h>     // for malloc, exit
+#include <string.h>     // for memcpy, strerror
+#include <sys/prctl.h>  // for prctl
+#include <sys/socket.h> // for socket, sendmsg, recvmsg
+#include <sys/stat.h>   // for mkdir, lstat, umask
+#include <sys/un.h>     // for sockaddr_un
+#include <sys/wait.h>   // for waitpid
+#include <unistd.h>     // for fork, chdir, dup2
+
+#include "common.h"
+#include "compile_cache.h"
+#include "error.h"
+#include "server.h"
+
+#define REQUEST_MAGIC "CRSV"
+#define REQUEST_VERSION 1
+#define MAX_REQUEST_SIZE (1 << 20)
+
+// The client's stdin, stdout and stderr
+#define PASSED_FDS 3
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t argc;
+} RequestHeader;
+
+static struct {
+  int listener;
+  pid_t pid;
+  pid_t *workers;
+  int worker_count;
+  volatile sig_atomic_t stopping;
+} Server = {.listener = -1};
+
+// Made if missing, and only used if nobody but us can get into it
+static bool PrivateDirectory(const char *path) {
+  if (mkdir(path, 0700) != 0 && errno != EEXIST) return false;
+
+  struct stat s;
+  return lstat(path, &s) == 0 && S_ISDIR(s.st_mode) && s.st_uid == geteuid() && (s.st_mode & 0077) == 0;
+}
+
+const char *DefaultServerSocket() {
+  static char path[PATH_MAX];
+  if (path[0] != '\0') return path;
+
+  // Anyone can make a file in /tmp, so the socket only goes in a directory that is the user's alone
+  char directory[sizeof(path) - sizeof("/cromc.sock")];
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  if (runtime != NULL && runtime[0] == '/') {
+    snprintf(directory, sizeof(directory), "%s", runtime);
+  } else {
+    snprintf(directory, sizeof(directory), "/tmp/cromc-%d", (int)geteuid());
+  }
+
+  if (!PrivateDirectory(directory)) {
+    COMPILER_ERROR_FMTMSG("'%s' isn't a directory only its owner can use, so it can't hold the compile server's socket; "
+                          "give a socket path instead", directory);
+  }
+
+  snprintf(path, sizeof(path), "%s/cromc.sock", directory);
+  return path;
+}
+
+// Servers only take requests from, and clients only send them to, the same user
+static bool PeerIsUs(int fd) {
+  struct ucred peer;
+  socklen_t length = sizeof(peer);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 && peer.uid == geteuid();
+}
+
+static bool SocketAddress(const char *path, struct sockaddr_un *address) {
+  if (strlen(path) >= sizeof(address->sun_path)) return false;
+
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  strcpy(address->sun_path, path);
+  return true;
+}
+
+static int Connect(const char *path) {
+  struct sockaddr_un address;
+  if (!SocketAddress(path, &address)) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (fd >= 0 && !PeerIsUs(fd)) {
+    fprintf(stderr, "Not using the compile server at '%s', which another user runs\n", path);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static bool WriteAll(int fd, const void *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    data = (const char *)data + written;
+    length -= written;
+  }
+
+  return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t length) {
+  while (length > 0) {
+    ssize_t read_size = read(fd, data, length);
+    if (read_size < 0 && errno == EINTR) continue;
+    if (read_size <= 0) return false;
+    data = (char *)data + read_size;
+    length -= read_size;
+  }
+
+  return true;
+}
+
+/* === The client === */
+static bool SendHeader(int fd, RequestHeader *header) {
+  int fds[PASSED_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  union {
+    struct cmsghdr align;
+    char space[CMSG_SPACE(sizeof(fds))];
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct iovec data = {.iov_base = header, .iov_len = sizeof(*header)};
+  struct msghdr message = {
+    .msg_iov = &data,
+    .msg_iovlen = 1,
+    .msg_control = control.space,
+    .msg_controllen = sizeof(control.space),
+  };
+
+  struct cmsghdr *rights = CMSG_FIRSTHDR(&message);
+  rights->cmsg_level = SOL_SOCKET;
+  rights->cmsg_type = SCM_RIGHTS;
+  rights->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(rights), fds, sizeof(fds));
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent <= 0) return false;
+
+  return WriteAll(fd, (char *)header + sent, sizeof(*header) - sent);
+}
+
+bool ForwardToCompileServer(const char *socket_path, int argc, char **argv, int *exit_code) {
+  int fd = Connect(socket_path);
+  if (fd < 0) return false;
+
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    close(fd);
+    return false;
+  }
+
+  // Everything but where to send it
+  size_t size = strlen(cwd) + 1;
+  int forwarded = 0;
+  for (int i = 0; i < argc; i++) {
+    if (strncmp(argv[i], "--connect", strlen("--connect")) == 0) continue;
+    size += strlen(argv[i]) + 1;
+    forwarded++;
+  }
+
+  char *payload = malloc(size), *p = payload;
+  p = stpcpy(p, cwd) + 1;
+  for (int i = 0; i < argc; i++) {
+    if (strncmp(argv[i], "--connect", strlen("--connect")) == 0) continue;
+    p = stpcpy(p, argv[i]) + 1;
+  }
+
+  RequestHeader header = {.magic = REQUEST_MAGIC, .version = REQUEST_VERSION, .size = size, .argc = forwarded};
+  bool sent = size <= MAX_REQUEST_SIZE && SendHeader(fd, &header) && WriteAll(fd, payload, size);
+  free(payload);
+
+  if (!sent) {
+    close(fd);
+    return false;
+  }
+
+  int32_t code;
+  bool answered = ReadAll(fd, &code, sizeof(code));
+  close(fd);
+
+  if (!answered) COMPILER_ERROR_FMTMSG("The compile server at '%s' stopped before answering", socket_path);
+
+  *exit_code = code;
+  return true;
+}
+
+/* === Workers === */
+static void CloseAll(int *fds, int count) {
+  for (int i = 0; i < count; i++) {
+    if (fds[i] >= 0) close(fds[i]);
+  }
+}
+
+// Fills in `fds`, which are left closed unless the whole request came
+static char *ReceiveRequest(int connection, RequestHeader *header, int *fds) {
+  union {
+    struct cmsghdr align;
+    char space[CMSG_SPACE(PASSED_FDS * sizeof(int))];
+  } control;
+
+  struct iovec data = {.iov_base = header, .iov_len = sizeof(*header)};
+  struct msghdr message = {
+    .msg_iov = &data,
+    .msg_iovlen = 1,
+    .msg_control = control.space,
+    .msg_controllen = sizeof(control.space),
+  };
+
+  ssize_t received;
+  do {
+    received = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+
+  int fd_count = 0;
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&message); received > 0 && c != NULL; c = CMSG_NXTHDR(&message, c)) {
+    if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+
+    int count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (int i = 0; i < count; i++) {
+      int fd;
+      memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+      if (fd_count < PASSED_FDS) fds[fd_count++] = fd;
+      else close(fd);
+    }
+  }
+
+  bool ok = received > 0 && fd_count == PASSED_FDS && !(message.msg_flags & MSG_CTRUNC) &&
+            ReadAll(connection, (char *)header + received, sizeof(*header) - received) &&
+            memcmp(header->magic, REQUEST_MAGIC, 4) == 0 && header->version == REQUEST_VERSION &&
+            header->size > 0 && header->size <= MAX_REQUEST_SIZE && header->argc > 0;
+
+  char *payload = ok ? malloc(header->size) : NULL;
+  if (ok && (!ReadAll(connection, payload, header->size) || payload[header->size - 1] != '\0')) ok = false;
+
+  if (!ok) {
+    CloseAll(fds, fd_count);
+    free(payload);
+    return NULL;
+  }
+
+  return payload;
+}
+
+// The working directory first, then argc arguments, or NULL if that isn't what the payload holds
+static char **SplitArguments(char *payload, RequestHeader header, char **cwd) {
+  char **argv = calloc(header.argc + 1, sizeof(char *));
+  char *p = payload, *end = payload + header.size;
+
+  *cwd = p;
+  p += strlen(p) + 1;
+  for (uint32_t i = 0; i < header.argc; i++) {
+    if (p >= end) {
+      free(argv);
+      return NULL;
+    }
+
+    argv[i] = p;
+    p += strlen(p) + 1;
+  }
+
+  return argv;
+}
+
+static void Compile(int *fds, const char *cwd, int argc, char **argv, CompileFunction compile) {
+  signal(SIGPIPE, SIG_DFL);
+
+  for (int i = 0; i < PASSED_FDS; i++) dup2(fds[i], i);
+  CloseAll(fds, PASSED_FDS);
+
+  if (chdir(cwd) != 0) {
+    COMPILER_ERROR_FMTMSG("Compile server: Could not change to the client's directory '%s': %s", cwd, strerror(errno));
+  }
+
+  exit(compile(argc, argv));
+}
+
+static void HandleRequest(int connection, CompileFunction compile) {
+  RequestHeader header;
+  int fds[PASSED_FDS] = {-1, -1, -1};
+  char *payload = ReceiveRequest(connection, &header, fds);
+  if (payload == NULL) return;
+
+  char *cwd;
+  char **argv = SplitArguments(payload, header, &cwd);
+  if (argv == NULL) {
+    CloseAll(fds, PASSED_FDS);
+    free(payload);
+    return;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(connection);
+    close(Server.listener);
+    Compile(fds, cwd, header.argc, argv, compile);
+  }
+
+  int32_t code = ERR_COMPILER;
+  if (pid < 0) {
+    dprintf(fds[2], "Compile server: Could not fork: %s\n", strerror(errno));
+  } else {
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  }
+
+  CloseAll(fds, PASSED_FDS);
+  free(argv);
+  free(payload);
+  WriteAll(connection, &code, sizeof(code));
+}
+
+static void ServeRequests(CompileFunction compile) {
+  // Workers go with the server, however it ends
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (getppid() != Server.pid) exit(0);
+
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    int connection = accept4(Server.listener, NULL, NULL, SOCK_CLOEXEC);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      exit(1);
+    }
+
+    if (PeerIsUs(connection)) HandleRequest(connection, compile);
+    close(connection);
+  }
+}
+
+static void StartWorker(int i, CompileFunction compile) {
+  pid_t pid = fork();
+  if (pid == 0) ServeRequests(compile);
+
+  Server.workers[i] = pid;
+}
+
+/* === The server === */
+static void Stop(int signal_number) {
+  (void)signal_number;
+  Server.stopping = true;
+}
+
+int RunCompileServer(const char *socket_path, int workers, CompileFunction compile) {
+  struct sockaddr_un address;
+  if (!SocketAddress(socket_path, &address)) COMPILER_ERROR_FMTMSG("Socket path '%s' is too long", socket_path);
+
+  // A socket left behind by a server that is gone is replaced, but not one that still answers
+  int running = Connect(socket_path);
+  if (running >= 0) {
+    close(running);
+    COMPILER_ERROR_FMTMSG("A compile server is listening at '%s' already", socket_path);
+  }
+  unlink(socket_path);
+
+  // Other users can't connect to the socket, wherever it is
+  Server.listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  mode_t mask = umask(0077);
+  bool bound = Server.listener >= 0 && bind(Server.listener, (struct sockaddr *)&address, sizeof(address)) == 0;
+  umask(mask);
+  if (!bound || listen(Server.listener, SOMAXCONN) != 0) {
+    COMPILER_ERROR_FMTMSG("Could not listen at '%s': %s", socket_path, strerror(errno));
+  }
+
+  // Done once here, where every compile would otherwise hash the executable again
+  CompilerIdentity();
+
+  struct sigaction stop = {.sa_handler = Stop};
+  sigaction(SIGTERM, &stop, NULL);
+  sigaction(SIGINT, &stop, NULL);
+
+  if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (workers <= 0) workers = 1;
+
+  Server.pid = getpid();
+  Server.worker_count = workers;
+  Server.workers = calloc(workers, sizeof(pid_t));
+  for (int i = 0; i < workers; i++) StartWorker(i, compile);
+
+  printf("Compile server listening at '%s' with %d workers\n", socket_path, workers);
+  fflush(stdout);
+
+  while (!Server.stopping) {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0 && errno != EINTR) break;
+
+    // A worker that died is replaced
+    for (int i = 0; i < workers && !Server.stopping; i++) {
+      if (Server.workers[i] == pid) StartWorker(i, compile);
+    }
+  }
+
+  for (int i = 0; i < workers; i++) kill(Server.workers[i], SIGTERM);
+  while (wait(NULL) > 0 || errno == EINTR) {}
+
+  close(Server.listener);
+  unlink(socket_path);
+  free(Server.workers);
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+
+/* A compile server (--server[=SOCKET]), for builds that start the compiler
+ * thousands of times.
+ *
+ * The server listens on a Unix domain socket and forks a pool of workers
+ * (--server-workers=N, one per CPU by default) that accept connections
+ * from it, so that as many requests are handled at once. A client
+ * (--connect[=SOCKET]) sends its working directory and command line, and
+ * its stdin, stdout and stderr along with them:
+ *
+ *   +-------------------+
+ *   | RequestHeader     |  magic, version, size of what follows, argc
+ *   +-------------------+  with SCM_RIGHTS: stdin, stdout, stderr
+ *   | cwd\0             |
+ *   | argv[0]\0 ...     |
+ *   +-------------------+
+ *
+ * The worker compiles in a child forked from itself, which has whatever
+ * the server did once on starting done already and leaves nothing behind
+ * for the next request, and answers with the child's exit code, or 128
+ * plus the signal that ended it. Without a server to connect to, the
+ * client compiles by itself.
+ *
+ * Both ends check who is at the other with SO_PEERCRED: a server serves
+ * nobody but the user running it, and a client never sends a request to
+ * another user's server, compiling by itself instead. */
+typedef int (*CompileFunction)(int argc, char **argv);
+
+/* Where the server listens unless told otherwise: one socket per user, in
+ * $XDG_RUNTIME_DIR or else /tmp/cromc-UID, which must be a directory only
+ * the user can get into. */
+const char *DefaultServerSocket();
+
+// Runs until SIGTERM or SIGINT
+int RunCompileServer(const char *socket_path, int workers, CompileFunction compile);
+
+// Returns false, having sent nothing, if no server is listening at `socket_path`
+bool ForwardToCompileServer(const char *socket_path, int argc, char **argv, int *exit_code);
+
+#endif
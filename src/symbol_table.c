@@ -1,8 +1,9 @@
-#include <stdlib.h>
-
+#include "allocator.h"
 #include "common.h"
 #include "error.h"
+#include "incremental.h"
 #include "symbol_table.h"
+#include "time_report.h"
 
 #include <stdio.h>
 
@@ -34,7 +35,7 @@ static Symbol NOT_FOUND = {
   },
 };
 
-USE_DYNAMIC_ARRAY(Symbol)
+USE_TAGGED_DYNAMIC_ARRAY(Symbol, MEM_SYMBOLS)
 
 struct SymbolTable {
   int count;
@@ -42,7 +43,7 @@ struct SymbolTable {
 };
 
 SymbolTable *NewSymbolTable() {
-  SymbolTable *st = calloc(sizeof(SymbolTable), 1);
+  SymbolTable *st = AllocateZeroed(MEM_SYMBOLS, 1, sizeof(SymbolTable));
   DA_INIT(Symbol, st->symbols);
 
   return st;
@@ -50,7 +51,18 @@ SymbolTable *NewSymbolTable() {
 
 void DeleteSymbolTable(SymbolTable *st) {
   DA_FREE(Symbol, st->symbols);
-  free(st);
+  Release(MEM_SYMBOLS, st);
+}
+
+void MarkSymbolTable(SymbolTable *st) {
+  MarkReachable(MEM_SYMBOLS, st->symbols.data);
+
+  for (int i = 0; i < st->symbols.count; i++) {
+    Symbol s = DA_GET(st->symbols, i);
+    MarkType(s.data_type);
+    MarkType(s.value.type);
+    if (TypeIs_String(s.value.type)) MarkReachable(MEM_STRINGS, s.value.as.string);
+  }
 }
 
 void IncreaseDepth() {
@@ -106,10 +118,31 @@ static Symbol AddSymbol(SymbolTable *st, Symbol s) {
   return DA_GET(st->symbols, st->symbols.count - 1);
 }
 
-Symbol AddTo(SymbolTable *st, Symbol s) {
+static Symbol Find(SymbolTable *st, Token t) {
+  BeginPhase(PHASE_SYMBOLS);
+
+  Symbol found = NOT_FOUND;
+  int probes = 0;
+  while (probes < st->count) {
+    Symbol check = GetSymbol(st, probes++);
+    if (TokenValuesMatch(check.token, t)) {
+      found = check;
+      break;
+    }
+  }
+
+  EndPhase();
+  CountEvents(COUNTER_SYMBOL_LOOKUPS, 1);
+  CountEvents(COUNTER_SYMBOL_PROBES, probes);
+  CountMaximum(COUNTER_LONGEST_SYMBOL_PROBE, probes);
+
+  return found;
+}
+
+static Symbol Store(SymbolTable *st, Symbol s) {
   if (s.token.type == ERROR) COMPILER_ERROR("Tried adding an ERROR token to Symbol Table");
 
-  Symbol existing_symbol = RetrieveFrom(st, s.token);
+  Symbol existing_symbol = Find(st, s.token);
   if (existing_symbol.token.type != ERROR) {
     existing_symbol.declaration_state = s.declaration_state;
     existing_symbol.data_type = s.data_type;
@@ -124,45 +157,56 @@ Symbol AddTo(SymbolTable *st, Symbol s) {
   s.symbol_guid = symbol_guid++;
   Symbol stored_symbol = AddSymbol(st, s);
   st->count++;
+  CountEvents(COUNTER_SYMBOLS, 1);
+
+  return stored_symbol;
+}
+
+/* Every lookup and change made through the functions below is reported
+ * to the incremental front end, which tells from them what a statement
+ * depends on and replays its changes when it reuses it (incremental.h) */
+Symbol AddTo(SymbolTable *st, Symbol s) {
+  Symbol stored_symbol = Store(st, s);
+
+  Token parent = GetSymbol(st, s.parent_struct_symbol_guid_ref).token;
+  RecordSymbolWrite(WRITE_SYMBOL, s, parent, stored_symbol.st_index);
 
   return stored_symbol;
 }
 
 Symbol RetrieveFrom(SymbolTable *st, Token t) {
-  for (int i = 0; i < st->count; i++) {
-    Symbol check = GetSymbol(st, i);
-    if (TokenValuesMatch(check.token, t)) {
-      return check;
-    }
-  }
+  Symbol s = Find(st, t);
+  RecordSymbolRead(t, s.st_index);
 
-  return NOT_FOUND;
+  return s;
 }
 
 Symbol RetrieveFromScope(SymbolTable*st, int depth, Token t) {
   for (int i = 0; i < st->count; i++) {
     Symbol check = GetSymbol(st, i);
     if (check.depth == depth && TokenValuesMatch(check.token, t)) {
+      RecordSymbolRead(t, check.st_index);
       return check;
     }
   }
 
+  RecordSymbolRead(t, -1);
   return NOT_FOUND;
 }
 
 Symbol GetSymbolById(SymbolTable *st, int id) {
-  return GetSymbol(st, id);
+  Symbol s = GetSymbol(st, id);
+  if (s.token.type != ERROR) RecordSymbolRead(s.token, s.st_index);
+
+  return s;
 }
 
 bool IsIn(SymbolTable *st, Token t) {
-  for (int i = 0; i < st->count; i++) {
-    Symbol check = GetSymbol(st, i);
-    if (TokenValuesMatch(check.token, t)) {
-      return true;
-    }
-  }
+  return RetrieveFrom(st, t).token.type != ERROR;
+}
 
-  return false;
+int SymbolCount(SymbolTable *st) {
+  return st->count;
 }
 
 void AddParams(SymbolTable *st, Symbol function_symbol) {
@@ -183,18 +227,21 @@ Symbol SetDecl(SymbolTable *st, Token t, enum DeclarationState ds) {
   }
 
   s.declaration_state = ds;
-  return AddTo(st, s);
+  RecordSymbolWrite(WRITE_DECLARATION, s, NOT_FOUND.token, s.st_index);
+  return Store(st, s);
 }
 
+// Nothing reads the symbol returned, so setting a value doesn't count as a lookup
 Symbol SetSymbolValue(SymbolTable *st, Token t, Value v) {
-  Symbol s = RetrieveFrom(st, t);
+  Symbol s = Find(st, t);
   if (s.token.type == ERROR) {
     Print("SetValue(): Token '%.*s' not found in symbol table\n", t.length, t.position_in_source);
     return NOT_FOUND;
   }
 
   s.value = v;
-  return AddTo(st, s);
+  RecordSymbolWrite(WRITE_VALUE, s, NOT_FOUND.token, s.st_index);
+  return Store(st, s);
 }
 
 Symbol SetSymbolDataType(SymbolTable *st, Token t, Type type) {
@@ -205,7 +252,8 @@ Symbol SetSymbolDataType(SymbolTable *st, Token t, Type type) {
   }
 
   s.data_type = type;
-  return AddTo(st, s);
+  RecordSymbolWrite(WRITE_TYPE, s, NOT_FOUND.token, s.st_index);
+  return Store(st, s);
 }
 
 Symbol SetSymbolParentStruct(SymbolTable *st, Token t, Symbol parent_struct) {
@@ -216,7 +264,8 @@ Symbol SetSymbolParentStruct(SymbolTable *st, Token t, Symbol parent_struct) {
   }
 
   s.parent_struct_symbol_guid_ref = parent_struct.symbol_guid;
-  return AddTo(st, s);
+  RecordSymbolWrite(WRITE_PARENT, s, parent_struct.token, s.st_index);
+  return Store(st, s);
 }
 
 static const char* const _DeclarationStateTranslation[] =
@@ -34,10 +34,22 @@ typedef struct {
 
 #define IN_SYMBOL_TABLE(symbol) (symbol.token.type != ERROR)
 
+// What a change to the table set: a whole symbol (AddTo), or one of its fields (the Set functions)
+typedef enum {
+  WRITE_SYMBOL,
+  WRITE_DECLARATION,
+  WRITE_VALUE,
+  WRITE_TYPE,
+  WRITE_PARENT,
+} SymbolWriteKind;
+
 typedef struct SymbolTable SymbolTable;
 
 SymbolTable *NewSymbolTable();
 void DeleteSymbolTable(SymbolTable *st);
+
+// Marks the symbols, their types and string values for the leak check (allocator.h)
+void MarkSymbolTable(SymbolTable *st);
 Symbol NewSymbol(Token token, Type type, enum DeclarationState d);
 
 Symbol AddTo(SymbolTable *st, Symbol s);
@@ -45,6 +57,7 @@ Symbol RetrieveFrom(SymbolTable *st, Token t);
 Symbol RetrieveFromScope(SymbolTable*st, int depth, Token t);
 Symbol GetSymbolById(SymbolTable *st, int id);
 bool IsIn(SymbolTable *st, Token t);
+int SymbolCount(SymbolTable *st);
 
 void RegisterFnParam(SymbolTable *st, Symbol function_name, Symbol param);
 void AddParams(SymbolTable *st, Symbol function_symbol);
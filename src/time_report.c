@@ -0,0 +1,270 @@
+#include <errno.h>       // for errno
+#include <pthread.h>     // for pthread_atfork
+#include <stdbool.h>
+#include <stdio.h>       // for fprintf, fopen
+#include <stdlib.h>      // for atexit
+#include <string.h>      // for strerror
+#include <sys/resource.h> // for getrusage
+#include <sys/syscall.h> // for SYS_gettid
+#include <time.h>        // for clock_gettime
+#include <unistd.h>      // for getpid, syscall
+
+#include "error.h"
+#include "time_report.h"
+
+#define MAX_PHASE_DEPTH 16
+
+static const char *PhaseNames[PHASE_COUNT] = {
+  [PHASE_READ]      = "read",
+  [PHASE_LEX]       = "lex",
+  [PHASE_PARSE]     = "parse",
+  [PHASE_SYMBOLS]   = "symbols",
+  [PHASE_CHECK]     = "check",
+  [PHASE_DEAD_CODE] = "dead_code",
+  [PHASE_LOWER]     = "lower",
+  [PHASE_OPTIMIZE]  = "optimize",
+  [PHASE_CODEGEN]   = "codegen",
+  [PHASE_ASSEMBLE]  = "assemble",
+  [PHASE_RUN]       = "run",
+};
+
+static const char *CounterNames[COUNTER_COUNT] = {
+  [COUNTER_TOKENS]               = "tokens",
+  [COUNTER_AST_NODES]            = "ast_nodes",
+  [COUNTER_SYMBOLS]              = "symbols",
+  [COUNTER_SYMBOL_LOOKUPS]       = "symbol_lookups",
+  [COUNTER_SYMBOL_PROBES]        = "symbol_probes",
+  [COUNTER_LONGEST_SYMBOL_PROBE] = "longest_symbol_probe",
+};
+
+static struct {
+  bool enabled;
+  const char *json_path;
+  bool phases_tracked;
+
+  FILE *trace;
+  bool trace_functions;
+  bool traced_any;
+  int trace_pid;
+  int trace_tid;
+  Token traced_function; // of the function event open, if its type isn't ERROR
+
+  uint64_t started;
+  uint64_t last; // when the time since was last charged to a phase
+  uint64_t phase_time[PHASE_COUNT];
+  bool phase_ran[PHASE_COUNT];
+
+  CompilerPhase stack[MAX_PHASE_DEPTH];
+  int depth;
+
+  uint64_t counters[COUNTER_COUNT];
+} TimeReport;
+
+static uint64_t Now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static double Milliseconds(uint64_t nanoseconds) {
+  return nanoseconds / 1e6;
+}
+
+/* === Trace === */
+static bool Traced(CompilerPhase phase) {
+  // One event per token or symbol lookup would be more than any viewer can take
+  return TimeReport.trace != NULL && phase != PHASE_LEX && phase != PHASE_SYMBOLS;
+}
+
+static void TraceEvent(char kind, const char *category, const char *name, int name_length, uint64_t now) {
+  // Forks of this compiler, like the incremental front end's verifier, keep quiet
+  if (getpid() != TimeReport.trace_pid) return;
+
+  fprintf(TimeReport.trace, "%s{\"name\": \"%.*s\", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+          TimeReport.traced_any ? ",\n" : "", name_length, name, category, kind,
+          (now - TimeReport.started) / 1e3, TimeReport.trace_pid, TimeReport.trace_tid);
+  TimeReport.traced_any = true;
+}
+
+static void TracePhase(char kind, CompilerPhase phase, uint64_t now) {
+  if (Traced(phase)) TraceEvent(kind, "phase", PhaseNames[phase], strlen(PhaseNames[phase]), now);
+}
+
+void BeginFunctionTrace(Token name) {
+  if (TimeReport.trace == NULL || !TimeReport.trace_functions || TimeReport.depth == 0) return;
+
+  CompilerPhase phase = TimeReport.stack[TimeReport.depth - 1];
+  TraceEvent('B', PhaseNames[phase], name.position_in_source, name.length, Now());
+  TimeReport.traced_function = name;
+}
+
+void EndFunctionTrace(Token name) {
+  if (TimeReport.trace == NULL || !TimeReport.trace_functions || TimeReport.depth == 0) return;
+
+  CompilerPhase phase = TimeReport.stack[TimeReport.depth - 1];
+  TraceEvent('E', PhaseNames[phase], name.position_in_source, name.length, Now());
+  TimeReport.traced_function.type = ERROR;
+}
+
+// Before forking, so that the child doesn't write what the parent buffered once more
+static void FlushTrace() {
+  if (TimeReport.trace != NULL) fflush(TimeReport.trace);
+}
+
+// Runs at exit, ending the function and phases still open there
+static void EndTrace() {
+  if (TimeReport.traced_function.type != ERROR) EndFunctionTrace(TimeReport.traced_function);
+
+  uint64_t now = Now();
+  for (int i = TimeReport.depth - 1; i >= 0; i--) TracePhase('E', TimeReport.stack[i], now);
+
+  if (getpid() == TimeReport.trace_pid) fprintf(TimeReport.trace, "\n]\n");
+  fclose(TimeReport.trace);
+  TimeReport.trace = NULL;
+}
+
+void UseTrace(const char *path, bool functions) {
+  TimeReport.trace = fopen(path, "w");
+  if (TimeReport.trace == NULL) COMPILER_ERROR_FMTMSG("Could not open '%s' for writing: %s", path, strerror(errno));
+
+  fprintf(TimeReport.trace, "[\n");
+  TimeReport.trace_functions = functions;
+  TimeReport.traced_function.type = ERROR;
+  TimeReport.trace_pid = getpid();
+  TimeReport.trace_tid = syscall(SYS_gettid);
+  if (TimeReport.started == 0) TimeReport.started = TimeReport.last = Now();
+
+  atexit(EndTrace);
+  pthread_atfork(FlushTrace, NULL, NULL);
+}
+
+/* === Timing === */
+static bool Tracking() {
+  return TimeReport.enabled || TimeReport.trace != NULL || TimeReport.phases_tracked;
+}
+
+// Charges the time since the last change of phase to the one running
+static uint64_t Charge() {
+  uint64_t now = Now();
+  if (TimeReport.depth > 0) TimeReport.phase_time[TimeReport.stack[TimeReport.depth - 1]] += now - TimeReport.last;
+  TimeReport.last = now;
+  return now;
+}
+
+void BeginPhase(CompilerPhase phase) {
+  if (!Tracking()) return;
+
+  // Deeper than that is recursion of no interest, charged to the phase it started in
+  if (TimeReport.depth >= MAX_PHASE_DEPTH) phase = TimeReport.stack[MAX_PHASE_DEPTH - 1];
+
+  uint64_t now = Charge();
+  TimeReport.phase_ran[phase] = true;
+  TimeReport.stack[(TimeReport.depth < MAX_PHASE_DEPTH) ? TimeReport.depth : MAX_PHASE_DEPTH - 1] = phase;
+  TimeReport.depth++;
+
+  TracePhase('B', phase, now);
+}
+
+void EndPhase() {
+  if (!Tracking() || TimeReport.depth == 0) return;
+
+  uint64_t now = Charge();
+  TimeReport.depth--;
+
+  TracePhase('E', TimeReport.stack[(TimeReport.depth < MAX_PHASE_DEPTH) ? TimeReport.depth : MAX_PHASE_DEPTH - 1], now);
+}
+
+void TrackPhases() {
+  if (TimeReport.started == 0) TimeReport.started = TimeReport.last = Now();
+  TimeReport.phases_tracked = true;
+}
+
+CompilerPhase CurrentPhase() {
+  if (TimeReport.depth == 0) return PHASE_COUNT;
+  return TimeReport.stack[(TimeReport.depth <= MAX_PHASE_DEPTH) ? TimeReport.depth - 1 : MAX_PHASE_DEPTH - 1];
+}
+
+const char *PhaseName(CompilerPhase phase) {
+  return (phase < PHASE_COUNT) ? PhaseNames[phase] : "other";
+}
+
+void CountEvents(CompilerCounter counter, uint64_t n) {
+  TimeReport.counters[counter] += n;
+}
+
+void CountMaximum(CompilerCounter counter, uint64_t n) {
+  if (n > TimeReport.counters[counter]) TimeReport.counters[counter] = n;
+}
+
+// In kilobytes, the most the process ever had in memory
+static long PeakRSS() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_maxrss;
+}
+
+static void PrintTable(uint64_t total) {
+  uint64_t other = total;
+  for (int i = 0; i < PHASE_COUNT; i++) other -= TimeReport.phase_time[i];
+
+  fprintf(stderr, "Time report:\n");
+  fprintf(stderr, "  %-20s %12s %7s\n", "phase", "ms", "%");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    if (!TimeReport.phase_ran[i]) continue;
+    fprintf(stderr, "  %-20s %12.3f %6.1f%%\n", PhaseNames[i], Milliseconds(TimeReport.phase_time[i]),
+            (total > 0) ? 100.0 * TimeReport.phase_time[i] / total : 0.0);
+  }
+  fprintf(stderr, "  %-20s %12.3f %6.1f%%\n", "other", Milliseconds(other), (total > 0) ? 100.0 * other / total : 0.0);
+  fprintf(stderr, "  %-20s %12.3f\n", "total", Milliseconds(total));
+  fprintf(stderr, "  %-20s %12ld\n", "peak RSS (KiB)", PeakRSS());
+
+  fprintf(stderr, "  %-20s %12s\n", "counter", "count");
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    fprintf(stderr, "  %-20s %12llu\n", CounterNames[i], (unsigned long long)TimeReport.counters[i]);
+  }
+
+  uint64_t lookups = TimeReport.counters[COUNTER_SYMBOL_LOOKUPS];
+  if (lookups > 0) {
+    fprintf(stderr, "  %-20s %12.1f\n", "probes per lookup",
+            (double)TimeReport.counters[COUNTER_SYMBOL_PROBES] / lookups);
+  }
+}
+
+static void WriteJSON(uint64_t total) {
+  FILE *out = fopen(TimeReport.json_path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "-ftime-report: Could not open '%s' for writing: %s\n", TimeReport.json_path, strerror(errno));
+    return;
+  }
+
+  fprintf(out, "{\"version\": 1, \"total_ms\": %.3f, \"peak_rss_kb\": %ld,\n \"phases\": {", Milliseconds(total), PeakRSS());
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    fprintf(out, "%s\"%s\": %.3f", (i > 0) ? ", " : "", PhaseNames[i], Milliseconds(TimeReport.phase_time[i]));
+  }
+
+  fprintf(out, "},\n \"counters\": {");
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    fprintf(out, "%s\"%s\": %llu", (i > 0) ? ", " : "", CounterNames[i], (unsigned long long)TimeReport.counters[i]);
+  }
+
+  fprintf(out, "}}\n");
+  fclose(out);
+}
+
+// Runs at exit, with any phases still open ended there
+static void Report() {
+  uint64_t total = Charge() - TimeReport.started;
+  TimeReport.enabled = false;
+
+  fflush(stdout);
+  PrintTable(total);
+  if (TimeReport.json_path != NULL) WriteJSON(total);
+}
+
+void UseTimeReport(const char *json_path) {
+  TimeReport.enabled = true;
+  TimeReport.json_path = json_path;
+  if (TimeReport.started == 0) TimeReport.started = TimeReport.last = Now();
+
+  atexit(Report);
+}
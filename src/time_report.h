@@ -0,0 +1,80 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "token.h"
+
+/* Where a compile spends its time (-ftime-report[=FILE]).
+ *
+ * Phases nest: the parser pulls tokens from the lexer and both the parser
+ * and the type checker look symbols up, so lexing runs inside parsing and
+ * symbol lookups inside either. Time is charged to the innermost phase
+ * running, and a phase's time never includes that of the phases within it.
+ * Time spent outside of every phase is reported as "other".
+ *
+ * Counters are kept whether or not the report was asked for, as they cost
+ * no more than an addition. Phases are only timed once UseTimeReport() or
+ * UseTrace() has been called.
+ *
+ * The report goes to stderr as a table when the compiler exits, however it
+ * exits, and with a path given also to that file as JSON, one object with
+ * a number for every phase and counter, and the peak resident set size:
+ *
+ *   {"version": 1, "total_ms": 1.234, "peak_rss_kb": 2048,
+ *    "phases": {"read": 0.012, "lex": 0.101, ...},
+ *    "counters": {"tokens": 1200, ...}}
+ *
+ * The same phases can be written as Chrome trace events (--trace=FILE),
+ * for chrome://tracing or Perfetto, but for lexing and symbol lookups,
+ * which happen once per token and per name. With --trace-functions, every
+ * function parsed or checked gets an event of its own as well, within the
+ * phase's. Events carry the process and thread ids. */
+typedef enum {
+  PHASE_READ,
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_SYMBOLS,
+  PHASE_CHECK,
+  PHASE_DEAD_CODE,
+  PHASE_LOWER,
+  PHASE_OPTIMIZE,
+  PHASE_CODEGEN,
+  PHASE_ASSEMBLE,
+  PHASE_RUN, // programs run with --jit
+  PHASE_COUNT,
+} CompilerPhase;
+
+typedef enum {
+  COUNTER_TOKENS,
+  COUNTER_AST_NODES,
+  COUNTER_SYMBOLS,
+  COUNTER_SYMBOL_LOOKUPS,
+  COUNTER_SYMBOL_PROBES,
+  COUNTER_LONGEST_SYMBOL_PROBE,
+  COUNTER_COUNT,
+} CompilerCounter;
+
+// `json_path` may be NULL for the table alone
+void UseTimeReport(const char *json_path);
+
+void UseTrace(const char *path, bool functions);
+
+void BeginPhase(CompilerPhase phase);
+void EndPhase();
+
+// Keeps track of the phase running for other reports by phase, without printing this one
+void TrackPhases();
+// PHASE_COUNT outside of every phase, named "other"
+CompilerPhase CurrentPhase();
+const char *PhaseName(CompilerPhase phase);
+
+// Called by the parser and the type checker around every function, for --trace-functions
+void BeginFunctionTrace(Token name);
+void EndFunctionTrace(Token name);
+
+void CountEvents(CompilerCounter counter, uint64_t n);
+void CountMaximum(CompilerCounter counter, uint64_t n);
+
+#endif
@@ -14,6 +14,8 @@ static const char* const _TokenTypeTranslation[] =
   [STRUCT] = "STRUCT",
   [IF] = "IF", [ELSE] = "ELSE", [WHILE] = "WHILE", [FOR] = "FOR",
   [BREAK] = "BREAK", [CONTINUE] = "CONTINUE", [RETURN] = "RETURN",
+  [TAILREC] = "TAILREC",
+  [PRINT] = "PRINT",
 
   [IDENTIFIER] = "IDENTIFIER",
 
@@ -14,6 +14,8 @@ typedef enum {
   ENUM, STRUCT,
   IF, ELSE, WHILE, FOR,
   BREAK, CONTINUE, RETURN,
+  TAILREC,
+  PRINT,
 
   IDENTIFIER,
 
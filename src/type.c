@@ -1,7 +1,7 @@
 #include <float.h> // FLT_MAX and DBL_MAX
-#include <stdlib.h> // for calloc
-#include <string.h> // for strcmp
+#include <string.h> // for strncmp
 
+#include "allocator.h"
 #include "common.h"
 #include "error.h"
 #include "type.h"
@@ -328,8 +328,17 @@ bool TypeIs_Void(Type t) {
   return t.specifier == T_VOID;
 }
 
+static bool SameName(Token a, Token b) {
+  return a.length == b.length && strncmp(a.position_in_source, b.position_in_source, a.length) == 0;
+}
+
+void MarkType(Type t) {
+  for (FnParam *p = t.params.next; p != NULL && MarkReachable(MEM_TYPES, p); p = p->next) MarkType(p->type);
+  for (StructMember *m = t.members.next; m != NULL && MarkReachable(MEM_TYPES, m); m = m->next) MarkType(m->type);
+}
+
 static StructMember *NewStructMember(Type type, Token token) {
-  StructMember *struct_member= calloc(1, sizeof(StructMember));
+  StructMember *struct_member= AllocateZeroed(MEM_TYPES, 1, sizeof(StructMember));
 
   struct_member->type = type;
   struct_member->token = token;
@@ -338,52 +347,34 @@ static StructMember *NewStructMember(Type type, Token token) {
 }
 
 StructMember *GetStructMember(Type struct_type, Token member_name) {
-  char *ident = CopyStringL(member_name.position_in_source,
-                            member_name.length);
   StructMember *matching_member = NULL;
   StructMember *check = struct_type.members.next;
 
   while (check != NULL) {
-    char *name= CopyStringL(check->token.position_in_source,
-                            check->token.length);
-
-    if (strcmp(ident, name) == 0) {
-      matching_member = struct_type.members.next;
+    if (SameName(check->token, member_name)) {
+      matching_member = check;
       break;
     }
 
     check = check->next;
-
-    free(name);
   }
 
-  free(ident);
-
   return matching_member;
 }
 
 bool StructContainsMember(Type struct_type, Token member_name) {
-  char *ident = CopyStringL(member_name.position_in_source,
-                            member_name.length);
   StructMember *matching_member = NULL;
   StructMember *check = struct_type.members.next;
 
   while (check != NULL) {
-    char *name= CopyStringL(check->token.position_in_source,
-                            check->token.length);
-
-    if (strcmp(ident, name) == 0) {
+    if (SameName(check->token, member_name)) {
       matching_member = check;
       break;
     }
 
     check = check->next;
-
-    free(name);
   }
 
-  free(ident);
-
   return matching_member != NULL;
 }
 
@@ -406,7 +397,7 @@ void AddMemberToStruct(Type *struct_type, Type member_type, Token member_name) {
 }
 
 static FnParam *NewFnParam(Type type, Token token) {
-  FnParam *fn_param = calloc(1, sizeof(FnParam));
+  FnParam *fn_param = AllocateZeroed(MEM_TYPES, 1, sizeof(FnParam));
 
   fn_param->type = type;
   fn_param->token = token;
@@ -415,27 +406,18 @@ static FnParam *NewFnParam(Type type, Token token) {
 }
 
 bool FunctionHasParam(Type function_type, Token param_name) {
-  char *ident = CopyStringL(param_name.position_in_source,
-                            param_name.length);
   FnParam *matching_param = NULL;
   FnParam *check = function_type.params.next;
 
   while (check != NULL) {
-    char *name = CopyStringL(check->token.position_in_source,
-                             check->token.length);
-
-    if (strcmp(ident, name) == 0) {
+    if (SameName(check->token, param_name)) {
       matching_param = function_type.params.next;
       break;
     }
 
     check = (*check).next;
-
-    free(name);
   }
 
-  free(ident);
-
   return matching_param != NULL;
 }
 
@@ -458,26 +440,17 @@ void AddParamToFunction(Type *function_type, Type param_type, Token param_name)
 }
 
 FnParam *GetFunctionParam(Type function_type, Token param_name) {
-  char *ident = CopyStringL(param_name.position_in_source,
-                            param_name.length);
   FnParam *matching_param = NULL;
   FnParam *check = function_type.params.next;
 
   while (check != NULL) {
-    char *name = CopyStringL(check->token.position_in_source,
-                             check->token.length);
-
-    if (strcmp(ident, name) == 0) {
+    if (SameName(check->token, param_name)) {
       matching_param = function_type.params.next;
       break;
     }
 
     check = (*check).next;
-
-    free(name);
   }
 
-  free(ident);
-
   return matching_param;
 }
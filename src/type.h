@@ -73,6 +73,9 @@ Type NewArrayType(TokenType t, int size);
 Type NewFunctionType(TokenType t);
 Type EnumMemberType(Type t);
 
+// Marks the parameter and member lists for the leak check (allocator.h)
+void MarkType(Type t);
+
 void InlinePrintType(Type t);
 void PrintType(Type t);
 const char *TypeCategoryTranslation(Type t);
@@ -5,6 +5,8 @@
 
 #include "common.h"
 #include "error.h"
+#include "incremental.h"
+#include "time_report.h"
 #include "type_checker.h"
 
 #include <stdio.h>
@@ -15,8 +17,20 @@ static Type *in_function;
 
 /* === Forward Declarations === */
 static void CheckTypesRecurse(AST_Node *node);
+static void TailCalls(AST_Node *function, AST_Node *node, bool tail_position);
 
 /* === Helpers === */
+
+// Calls carry their callee's function type, whose specifier is the type of the value they produce
+static Type ValueType(Type t) {
+  if (TypeIs_Function(t)) {
+    t.category = TC_NONE;
+    t.params.next = NULL;
+  }
+
+  return t;
+}
+
 bool Overflow(AST_Node *from, Type target_type) {
   ERROR_FMT(ERR_OVERFLOW, from->token, "Literal value overflows target type '%s'", TypeTranslation(target_type));
   return false; // The return type is unused as ERROR_FMT will call Exit(), but this suppresses -Wreturn-type warnings at the call site
@@ -256,7 +270,6 @@ static void Assignment(AST_Node *identifier) {
     // For strings, propagate the type information from child node
     // to parent in order to get the length of the string
     SetNodeDataType(identifier, value->data_type);
-    SetSymbolValue(SYMBOL_TABLE, identifier->token, NewValue(value->data_type, value->token));
   }
 
   // Synchronize information between nodes
@@ -302,7 +315,8 @@ static void Identifier(AST_Node *identifier) {
 }
 
 static void Return(AST_Node* node) {
-  if (TypeIs_Void(node->data_type)) {
+  // Checked against the expression, a recursive call had no return type yet when the return was parsed
+  if (node->left == NULL || TypeIs_Void(node->left->data_type)) {
     node->data_type.specifier = T_VOID;
     return;
   }
@@ -362,7 +376,7 @@ static void TypeCheckNestedReturns(AST_Node *node, AST_Node *return_type) {
       }
     }
 
-    current = &right;
+    current = &(*current)->right;
   }
 }
 
@@ -409,7 +423,7 @@ static void Function(AST_Node *node) {
       }
     }
 
-    check = &right;
+    check = &(*check)->right;
   };
 
   if (TypeIs_Void(return_type->data_type)) {
@@ -419,8 +433,91 @@ static void Function(AST_Node *node) {
   }
 }
 
+/* Tail calls are turned into jumps, which reuse the caller's stack frame
+ * and incoming argument area. Under the System V convention the first 6
+ * integer and 8 float arguments travel in registers, the rest on the stack */
+static int StackParamCount(Type function_type) {
+  int ints = 0, floats = 0;
+
+  for (FnParam *param = function_type.params.next; param != NULL; param = param->next) {
+    if (TypeIs_Float(param->type) && !TypeIs_Array(param->type)) floats++;
+    else ints++;
+  }
+
+  return ((ints > 6) ? ints - 6 : 0) + ((floats > 8) ? floats - 8 : 0);
+}
+
+// Whether `arg` names an array or struct living in the frame of `function`
+static bool IsLocalAggregate(AST_Node *function, AST_Node *arg) {
+  if (arg->node_type != FUNCTION_ARGUMENT_NODE || arg->left != NULL || arg->token.type != IDENTIFIER) return false;
+  if (GetFunctionParam(function->data_type, arg->token) != NULL) return false;
+
+  Symbol symbol = RetrieveFrom(SYMBOL_TABLE, arg->token);
+  bool is_aggregate = TypeIs_Struct(symbol.data_type) ||
+                      (TypeIs_Array(symbol.data_type) && !TypeIs_String(symbol.data_type));
+
+  return IN_SYMBOL_TABLE(symbol) && symbol.depth > 0 && is_aggregate;
+}
+
+static void TailCall(AST_Node *function, AST_Node *call) {
+  Type callee = RetrieveFrom(SYMBOL_TABLE, call->token).data_type;
+  Type return_type = function->left->data_type;
+  bool is_recursive = TokenValuesMatch(call->token, function->token);
+
+  if (callee.specifier != return_type.specifier) {
+    ERROR_FMT(ERR_TAIL_CALL, call->token,
+              "%.*s(): Tail call to '%.*s' needs its %s result converted to %s",
+              function->token.length, function->token.position_in_source,
+              call->token.length, call->token.position_in_source,
+              TypeTranslation(callee), TypeTranslation(return_type));
+  }
+
+  for (AST_Node *arg = call->middle; arg != NULL; arg = arg->right) {
+    if (IsLocalAggregate(function, arg)) {
+      ERROR_FMT(ERR_TAIL_CALL, arg->token,
+                "%.*s(): Tail call to '%.*s' passes '%.*s', which lives in the caller's frame",
+                function->token.length, function->token.position_in_source,
+                call->token.length, call->token.position_in_source,
+                arg->token.length, arg->token.position_in_source);
+    }
+  }
+
+  if (!is_recursive && StackParamCount(callee) > StackParamCount(function->data_type)) {
+    ERROR_FMT(ERR_TAIL_CALL, call->token,
+              "%.*s(): Tail call to '%.*s' passes more arguments on the stack than '%.*s' receives",
+              function->token.length, function->token.position_in_source,
+              call->token.length, call->token.position_in_source,
+              function->token.length, function->token.position_in_source);
+  }
+}
+
+/* Checks every call in a 'tailrec' function: calls in tail position, the
+ * value of a return or either branch of a ternary that is, must be
+ * optimizable, and recursive calls must all be in tail position */
+static void TailCalls(AST_Node *function, AST_Node *node, bool tail_position) {
+  if (node == NULL) return;
+
+  if (node->node_type == FUNCTION_CALL_NODE) {
+    if (tail_position) {
+      TailCall(function, node);
+    } else if (TokenValuesMatch(node->token, function->token)) {
+      ERROR_FMT(ERR_TAIL_CALL, node->token,
+                "%.*s(): Recursive call is not in tail position",
+                function->token.length, function->token.position_in_source);
+    }
+  }
+
+  bool is_ternary_tail = NodeIs_TernaryIf(node) && tail_position;
+
+  TailCalls(function, node->left, NodeIs_Return(node));
+  TailCalls(function, node->middle, is_ternary_tail);
+  TailCalls(function, node->right, is_ternary_tail);
+}
+
 static void FunctionCall(AST_Node *node) {
   Symbol s = RetrieveFrom(SYMBOL_TABLE, node->token);
+  if (!DEFINED(s)) ERROR(ERR_UNDEFINED, node->token);
+
   node->data_type = s.data_type;
 }
 
@@ -597,6 +694,17 @@ static void StructMemberAccess(AST_Node *struct_identifier) {
   SetNodeDataType(struct_identifier, member->type);
 }
 
+static void PrintStmt(AST_Node *node) {
+  Type t = node->left->data_type;
+  bool is_element = NodeIs_Identifier(node->left) && node->left->middle != NULL;
+  bool printable = !TypeIs_None(t) && !TypeIs_Void(t) && !TypeIs_Struct(t) &&
+                   (!TypeIs_Array(t) || TypeIs_String(t) || is_element);
+
+  if (!printable) {
+    ERROR_FMT(ERR_TYPE_DISAGREEMENT, node->token, "Cannot print a value of type '%s'", TypeTranslation(t));
+  }
+}
+
 static void PrefixIncOrDec(AST_Node *node) {
   AST_Node *check_value = node->left;
   if (check_value == NULL) return;
@@ -626,13 +734,14 @@ static void TernaryIfStmt(AST_Node *node) {
     ERROR_FMT(ERR_TYPE_DISAGREEMENT, node->left->token, "Predicate must be boolean, got type '%s' instead", TypeTranslation(node->left->data_type));
   }
 
-  if (!TypesMatchExactly(node->middle->data_type, node->right->data_type)) {
-    ERROR_FMT(ERR_TYPE_DISAGREEMENT, node->right->token, "Branches have different types (If true: '%s', if false: '%s')", TypeTranslation(node->middle->data_type), TypeTranslation(node->right->data_type));
-  };
+  Type if_true = ValueType(node->middle->data_type);
+  Type if_false = ValueType(node->right->data_type);
 
-  SetNodeDataType(node, node->middle->data_type);
+  if (!TypesMatchExactly(if_true, if_false)) {
+    ERROR_FMT(ERR_TYPE_DISAGREEMENT, node->right->token, "Branches have different types (If true: '%s', if false: '%s')", TypeTranslation(if_true), TypeTranslation(if_false));
+  };
 
-  PrintNode(node);
+  SetNodeDataType(node, if_true);
 }
 
 static void WhileStmt(AST_Node *node) {
@@ -681,8 +790,12 @@ static void CheckTypesRecurse(AST_Node *node) {
     } break;
     case FUNCTION_NODE: {
       Function(node);
+      if (NodeIs_TailRecursive(node)) TailCalls(node, node->right, false);
+    } break;
+    case FUNCTION_ARGUMENT_NODE: {
+      // An expression passed takes the type it was checked to have
+      if (node->left != NULL) SetNodeDataType(node, node->left->data_type);
     } break;
-    case FUNCTION_ARGUMENT_NODE:
     case FUNCTION_PARAM_NODE:
     case FUNCTION_RETURN_TYPE_NODE: {
       SetNodeDataType(node, node->data_type);
@@ -716,17 +829,37 @@ static void CheckTypesRecurse(AST_Node *node) {
     case LITERAL_NODE: {
       Literal(node);
     } break;
+    case PRINT_CALL_NODE: {
+      PrintStmt(node);
+    } break;
     case ARRAY_SUBSCRIPT_NODE:
     case STRUCT_DECLARATION_NODE:
     case DECLARATION_NODE:
-    case PRINT_CALL_NODE:
     default: {
       // Use declared type, no action required
     } break;
   }
 }
 
+// Top-level statements are checked one by one, so that those the incremental front end reuses can be skipped
 void CheckTypes(AST_Node *node, SymbolTable *symbol_table) {
   SYMBOL_TABLE = symbol_table;
-  CheckTypesRecurse(node);
+
+  for (int statement = 0; node != NULL; node = node->right) {
+    if (node->left != NULL) {
+      AST_Node *checked = ReuseCheckedStatement(statement++);
+      if (checked != NULL) {
+        node->left = checked;
+      } else {
+        bool function = NodeIs_Function(node->left);
+        if (function) BeginFunctionTrace(node->left->token);
+        CheckTypesRecurse(node->left);
+        if (function) EndFunctionTrace(node->left->token);
+      }
+
+      EndCheckingStatement(node->left);
+    }
+
+    if (node->middle != NULL) CheckTypesRecurse(node->middle);
+  }
 }
@@ -1,13 +1,13 @@
 #include <errno.h>
-#include <stdlib.h> // for malloc
 #include <string.h> // for strcmp
 
+#include "allocator.h"
 #include "common.h"
 #include "error.h"
 #include "value.h"
 
 static char *ExtractString(Token token) {
-  char *str = malloc(sizeof(char) * (token.length + ROOM_FOR_NULL_BYTE));
+  char *str = Allocate(MEM_STRINGS, sizeof(char) * (token.length + ROOM_FOR_NULL_BYTE));
   for (int i = 0; i < token.length; i++) {
     str[i] = token.position_in_source[i];
   }
@@ -53,13 +53,13 @@ Value NewValue(Type type, Token token) {
     char *s = ExtractString(token);
     Value b_return = NewBoolValue((strcmp(s, "true") == 0) ? true : false);
 
-    free(s);
+    Release(MEM_STRINGS, s);
     return b_return;
 
   } else if (TypeIs_Char(type)) {
     char *s = ExtractString(token);
     Value c_return = NewCharValue(s[0]);
-    free(s);
+    Release(MEM_STRINGS, s);
 
     return c_return;
 
@@ -0,0 +1,984 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "x64_assembler.h"
+
+/* Instructions are encoded in their longest forms (rel32 branches, no
+ * jump relaxation), which keeps it to a single pass: labels referenced
+ * before they are defined just become relocations, and those that land
+ * in the same section are patched once the whole input is read. */
+
+typedef enum {
+  OPERAND_REG,
+  OPERAND_XMM,    // xmm or ymm, told apart by size
+  OPERAND_IMM,
+  OPERAND_MEM,
+  OPERAND_SYMBOL, // call and jump targets
+} OperandKind;
+
+typedef struct {
+  OperandKind kind;
+  int reg;  // register number, or the base register of a memory operand
+  int size; // in bytes, for registers
+  int64_t imm;
+
+  // Memory operands: disp(base, index, scale) or symbol(%rip)
+  int index;
+  int scale;
+  int64_t disp;
+  bool rip_relative;
+  int symbol;
+  X64_RelocType reloc;
+} Operand;
+
+#define NO_REG -1
+#define MAX_OPERANDS 3
+
+static struct {
+  X64_Object *obj;
+  int section; // -1 inside sections that are ignored (.note.GNU-stack)
+  int line;
+} Asm;
+
+/* === Output === */
+static X64_Section *CurrentSection() {
+  if (Asm.section < 0) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Content outside of a known section", Asm.line);
+  }
+
+  return &Asm.obj->sections[Asm.section];
+}
+
+static void Byte(uint8_t b) {
+  X64_Section *s = CurrentSection();
+
+  if (Asm.section == X64_BSS) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Data in .bss", Asm.line);
+  }
+
+  if (s->size >= s->capacity) {
+    s->bytes = ArenaGrowArray(Asm.obj->arena, s->bytes, &s->capacity, 1);
+  }
+  s->bytes[s->size++] = b;
+}
+
+static void Bytes(uint64_t value, int count) {
+  for (int i = 0; i < count; i++) Byte((uint8_t)(value >> (8 * i)));
+}
+
+static void Reserve(int count) {
+  X64_Section *s = CurrentSection();
+
+  if (Asm.section == X64_BSS) s->size += count;
+  else for (int i = 0; i < count; i++) Byte(0);
+}
+
+static void AddReloc(int symbol, X64_RelocType type, int64_t addend) {
+  X64_Reloc r = {Asm.section, CurrentSection()->size, symbol, type, addend};
+  ARENA_PUSH(Asm.obj->arena, Asm.obj->relocs, Asm.obj->reloc_count, Asm.obj->reloc_capacity, r);
+}
+
+/* === Symbols === */
+int FindX64Symbol(X64_Object *obj, const char *name) {
+  for (int i = 0; i < obj->symbol_count; i++) {
+    if (strcmp(obj->symbols[i].name, name) == 0) return i;
+  }
+
+  return -1;
+}
+
+static int InternSymbol(const char *name, int length) {
+  for (int i = 0; i < Asm.obj->symbol_count; i++) {
+    const char *s = Asm.obj->symbols[i].name;
+    if ((int)strlen(s) == length && memcmp(s, name, length) == 0) return i;
+  }
+
+  X64_Symbol symbol = {ArenaCopyString(Asm.obj->arena, name, length), -1, 0, false, false};
+  ARENA_PUSH(Asm.obj->arena, Asm.obj->symbols, Asm.obj->symbol_count, Asm.obj->symbol_capacity, symbol);
+  return Asm.obj->symbol_count - 1;
+}
+
+static void DefineLabel(const char *name, int length) {
+  int index = InternSymbol(name, length);
+  X64_Symbol *s = &Asm.obj->symbols[index];
+
+  if (s->section >= 0) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Label '%.*s' defined twice", Asm.line, length, name);
+  }
+
+  s->section = Asm.section;
+  s->offset = CurrentSection()->size;
+}
+
+/* === Operands === */
+typedef struct {
+  const char *name;
+  int reg;
+  int size;
+} RegisterName;
+
+static const RegisterName Registers[] = {
+  {"rax", 0, 8}, {"rcx", 1, 8}, {"rdx", 2, 8}, {"rbx", 3, 8},
+  {"rsp", 4, 8}, {"rbp", 5, 8}, {"rsi", 6, 8}, {"rdi", 7, 8},
+  {"r8", 8, 8}, {"r9", 9, 8}, {"r10", 10, 8}, {"r11", 11, 8},
+  {"r12", 12, 8}, {"r13", 13, 8}, {"r14", 14, 8}, {"r15", 15, 8},
+  {"eax", 0, 4}, {"ecx", 1, 4}, {"edx", 2, 4}, {"ebx", 3, 4},
+  {"esp", 4, 4}, {"ebp", 5, 4}, {"esi", 6, 4}, {"edi", 7, 4},
+  {"r8d", 8, 4}, {"r9d", 9, 4}, {"r10d", 10, 4}, {"r11d", 11, 4},
+  {"ax", 0, 2}, {"cx", 1, 2}, {"dx", 2, 2}, {"bx", 3, 2},
+  {"si", 6, 2}, {"di", 7, 2},
+  {"al", 0, 1}, {"cl", 1, 1}, {"dl", 2, 1}, {"bl", 3, 1},
+  {"spl", 4, 1}, {"bpl", 5, 1}, {"sil", 6, 1}, {"dil", 7, 1},
+  {"r8b", 8, 1}, {"r9b", 9, 1}, {"r10b", 10, 1}, {"r11b", 11, 1},
+  {NULL, 0, 0},
+};
+
+static void ParseRegister(const char *text, int length, Operand *op) {
+  if (length > 3 && (memcmp(text, "xmm", 3) == 0 || memcmp(text, "ymm", 3) == 0)) {
+    op->kind = OPERAND_XMM;
+    op->reg = atoi(text + 3);
+    op->size = (text[0] == 'y') ? 32 : 16;
+    return;
+  }
+
+  for (int i = 0; Registers[i].name != NULL; i++) {
+    if ((int)strlen(Registers[i].name) == length && memcmp(Registers[i].name, text, length) == 0) {
+      op->kind = OPERAND_REG;
+      op->reg = Registers[i].reg;
+      op->size = Registers[i].size;
+      return;
+    }
+  }
+
+  COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unknown register '%%%.*s'", Asm.line, length, text);
+}
+
+static int RegisterNumber(const char *text, int length) {
+  Operand op;
+  ParseRegister(text, length, &op);
+  return op.reg;
+}
+
+static bool IsSymbolChar(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static void ParseOperand(char *text, Operand *op) {
+  memset(op, 0, sizeof(*op));
+  op->reg = NO_REG;
+  op->index = NO_REG;
+  op->symbol = -1;
+
+  while (isspace((unsigned char)*text)) text++;
+  int length = strlen(text);
+  while (length > 0 && isspace((unsigned char)text[length - 1])) length--;
+
+  if (text[0] == '%') {
+    ParseRegister(text + 1, length - 1, op);
+    return;
+  }
+
+  if (text[0] == '$') {
+    op->kind = OPERAND_IMM;
+    op->imm = strtoll(text + 1, NULL, 0);
+    if (text[1] != '-' && text[1] != '+' && strtoull(text + 1, NULL, 0) > INT64_MAX) {
+      op->imm = (int64_t)strtoull(text + 1, NULL, 0);
+    }
+    return;
+  }
+
+  // A displacement or symbol, optionally followed by (base, index, scale)
+  char *p = text;
+  char *end = text + length;
+
+  if (*p == '-' || isdigit((unsigned char)*p)) {
+    op->disp = strtoll(p, &p, 0);
+  } else if (IsSymbolChar(*p)) {
+    char *start = p;
+    while (p < end && IsSymbolChar(*p)) p++;
+    op->symbol = InternSymbol(start, p - start);
+    op->reloc = X64_RELOC_PC32;
+
+    if (*p == '@') {
+      char *modifier = ++p;
+      while (p < end && isalnum((unsigned char)*p)) p++;
+
+      if (p - modifier == 3 && memcmp(modifier, "PLT", 3) == 0) op->reloc = X64_RELOC_PLT32;
+      else if (p - modifier == 8 && memcmp(modifier, "GOTPCREL", 8) == 0) op->reloc = X64_RELOC_GOTPCREL;
+      else COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unknown relocation '@%.*s'", Asm.line, (int)(p - modifier), modifier);
+    }
+  }
+
+  if (p >= end || *p != '(') {
+    if (op->symbol < 0) COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Bad operand '%.*s'", Asm.line, length, text);
+    op->kind = OPERAND_SYMBOL;
+    return;
+  }
+
+  op->kind = OPERAND_MEM;
+  p++;
+
+  char *fields[3] = {0};
+  int field_count = 0;
+  fields[field_count++] = p;
+  for (; p < end && *p != ')'; p++) {
+    if (*p == ',' && field_count < 3) {
+      *p = '\0';
+      fields[field_count++] = p + 1;
+    }
+  }
+  *p = '\0';
+
+  for (int i = 0; i < field_count; i++) {
+    char *f = fields[i];
+    while (isspace((unsigned char)*f)) f++;
+    int n = strlen(f);
+    while (n > 0 && isspace((unsigned char)f[n - 1])) n--;
+
+    if (i == 2) {
+      op->scale = atoi(f);
+    } else if (n > 0) {
+      if (f[0] != '%') COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Expected a register in '%s'", Asm.line, f);
+
+      if (n == 4 && memcmp(f + 1, "rip", 3) == 0) op->rip_relative = true;
+      else if (i == 0) op->reg = RegisterNumber(f + 1, n - 1);
+      else op->index = RegisterNumber(f + 1, n - 1);
+    }
+  }
+
+  if (op->index != NO_REG && op->scale == 0) op->scale = 1;
+  if (op->symbol >= 0 && !op->rip_relative) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Symbols are only supported RIP-relative", Asm.line);
+  }
+}
+
+/* === Encoding === */
+typedef struct {
+  uint8_t prefix;  // 0x66, 0xF2 or 0xF3, 0 for none
+  bool rex_w;
+  bool byte_regs;  // spl, bpl, sil and dil need a REX prefix
+  uint8_t opcode[3];
+  int opcode_length;
+} Encoding;
+
+static Encoding Op(uint8_t prefix, bool rex_w, int length, uint8_t b0, uint8_t b1, uint8_t b2) {
+  Encoding e = {prefix, rex_w, false, {b0, b1, b2}, length};
+  return e;
+}
+
+static bool FitsInt8(int64_t v) {
+  return v >= -128 && v <= 127;
+}
+
+static bool NeedsByteRex(int reg, bool byte_regs) {
+  return byte_regs && reg >= 4 && reg <= 7;
+}
+
+static bool IsRegisterOperand(Operand *op) {
+  return op->kind == OPERAND_REG || op->kind == OPERAND_XMM;
+}
+
+// The ModRM byte and whatever follows it: SIB, displacement and `imm_size` bytes of `imm`
+static void EmitAddressing(int reg_field, Operand *rm, int imm_size, int64_t imm) {
+  bool rm_is_reg = IsRegisterOperand(rm);
+  int base = rm->reg;
+  uint8_t reg_bits = (reg_field & 7) << 3;
+
+  if (rm_is_reg) {
+    Byte(0xC0 | reg_bits | (base & 7));
+  } else if (rm->rip_relative) {
+    Byte(0x00 | reg_bits | 5);
+    if (rm->symbol >= 0) AddReloc(rm->symbol, rm->reloc, rm->disp - 4 - imm_size);
+    Bytes((rm->symbol >= 0) ? 0 : (uint64_t)rm->disp, 4);
+  } else {
+    bool has_sib = rm->index != NO_REG || (base & 7) == 4;
+    int mod = (rm->disp == 0 && (base & 7) != 5) ? 0 : FitsInt8(rm->disp) ? 1 : 2;
+
+    Byte((mod << 6) | reg_bits | (has_sib ? 4 : (base & 7)));
+    if (has_sib) {
+      int scale_bits = (rm->scale == 8) ? 3 : (rm->scale == 4) ? 2 : (rm->scale == 2) ? 1 : 0;
+      int index = (rm->index != NO_REG) ? rm->index : 4;
+      Byte((scale_bits << 6) | ((index & 7) << 3) | (base & 7));
+    }
+
+    if (mod == 1) Bytes((uint64_t)rm->disp, 1);
+    if (mod == 2) Bytes((uint64_t)rm->disp, 4);
+  }
+
+  Bytes((uint64_t)imm, imm_size);
+}
+
+/* Emits an instruction with a ModRM byte. `reg_field` is a register
+ * number or an opcode extension; `rm` is a register or memory operand.
+ * `imm_size` bytes of `imm` follow the addressing bytes. */
+static void EmitModRM(Encoding e, int reg_field, Operand *rm, int imm_size, int64_t imm) {
+  bool rm_is_reg = IsRegisterOperand(rm);
+  int base = rm->reg;
+  uint8_t rex = 0x40;
+
+  if (e.rex_w) rex |= 0x08;
+  if (reg_field >= 8) rex |= 0x04;
+  if (!rm_is_reg && rm->index >= 8) rex |= 0x02;
+  if (base >= 8) rex |= 0x01;
+
+  bool force_rex = NeedsByteRex(reg_field, e.byte_regs) || (rm_is_reg && NeedsByteRex(base, e.byte_regs));
+
+  if (e.prefix != 0) Byte(e.prefix);
+  if (rex != 0x40 || force_rex) Byte(rex);
+  for (int i = 0; i < e.opcode_length; i++) Byte(e.opcode[i]);
+
+  EmitAddressing(reg_field, rm, imm_size, imm);
+}
+
+/* VEX prefixed instructions fold the legacy prefix, the REX bits and the
+ * opcode map into the prefix and add a second source register (`vvvv`).
+ * `pp` encodes no prefix, 0x66, 0xF3 or 0xF2 as 0 to 3; `map` is 1 for
+ * 0F and 2 for 0F 38 opcodes. The two byte form covers map 1 without
+ * REX.X and REX.B. */
+static void EmitVEX(int pp, int map, bool ymm, uint8_t opcode, int reg_field, int vvvv, Operand *rm) {
+  bool rm_is_reg = IsRegisterOperand(rm);
+  bool r = reg_field >= 8;
+  bool x = !rm_is_reg && rm->index >= 8;
+  bool b = rm->reg >= 8;
+  uint8_t last = ((~vvvv & 15) << 3) | (ymm ? 0x04 : 0) | pp;
+
+  if (map == 1 && !x && !b) {
+    Byte(0xC5);
+    Byte((r ? 0 : 0x80) | last);
+  } else {
+    Byte(0xC4);
+    Byte((r ? 0 : 0x80) | (x ? 0 : 0x40) | (b ? 0 : 0x20) | map);
+    Byte(last);
+  }
+  Byte(opcode);
+  EmitAddressing(reg_field, rm, 0, 0);
+}
+
+// Instructions whose only operand is encoded in the opcode byte
+static void EmitOpcodePlusReg(bool rex_w, uint8_t opcode, int reg, int imm_size, int64_t imm) {
+  uint8_t rex = 0x40 | (rex_w ? 0x08 : 0) | ((reg >= 8) ? 0x01 : 0);
+  if (rex != 0x40) Byte(rex);
+  Byte(opcode + (reg & 7));
+  Bytes((uint64_t)imm, imm_size);
+}
+
+static void EmitBranch(int opcode_length, uint8_t b0, uint8_t b1, Operand *target) {
+  if (target->kind != OPERAND_SYMBOL) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Only direct branches are supported", Asm.line);
+  }
+
+  Byte(b0);
+  if (opcode_length == 2) Byte(b1);
+
+  X64_RelocType type = (target->reloc == X64_RELOC_PLT32) ? X64_RELOC_PLT32 : X64_RELOC_PC32;
+  AddReloc(target->symbol, type, -4);
+  Bytes(0, 4);
+}
+
+/* === Instructions === */
+typedef struct {
+  const char *name;
+  int code;
+} ConditionCode;
+
+static const ConditionCode Conditions[] = {
+  {"o", 0x0}, {"no", 0x1}, {"b", 0x2}, {"c", 0x2}, {"nae", 0x2},
+  {"ae", 0x3}, {"nb", 0x3}, {"nc", 0x3}, {"e", 0x4}, {"z", 0x4},
+  {"ne", 0x5}, {"nz", 0x5}, {"be", 0x6}, {"na", 0x6}, {"a", 0x7},
+  {"nbe", 0x7}, {"s", 0x8}, {"ns", 0x9}, {"p", 0xA}, {"pe", 0xA},
+  {"np", 0xB}, {"po", 0xB}, {"l", 0xC}, {"nge", 0xC}, {"ge", 0xD},
+  {"nl", 0xD}, {"le", 0xE}, {"ng", 0xE}, {"g", 0xF}, {"nle", 0xF},
+  {NULL, 0},
+};
+
+static int ConditionCodeOf(const char *name, int length) {
+  for (int i = 0; Conditions[i].name != NULL; i++) {
+    if ((int)strlen(Conditions[i].name) == length && memcmp(Conditions[i].name, name, length) == 0) {
+      return Conditions[i].code;
+    }
+  }
+
+  return -1;
+}
+
+typedef struct {
+  const char *name;
+  uint8_t prefix;
+  uint8_t opcode;
+  bool rex_w;
+} SSEInstruction;
+
+// All take (source, destination) with the destination in ModRM.reg
+static const SSEInstruction SSEInstructions[] = {
+  {"addss", 0xF3, 0x58, false},     {"addsd", 0xF2, 0x58, false},
+  {"subss", 0xF3, 0x5C, false},     {"subsd", 0xF2, 0x5C, false},
+  {"mulss", 0xF3, 0x59, false},     {"mulsd", 0xF2, 0x59, false},
+  {"divss", 0xF3, 0x5E, false},     {"divsd", 0xF2, 0x5E, false},
+  {"ucomiss", 0x00, 0x2E, false},   {"ucomisd", 0x66, 0x2E, false},
+  {"cvtss2sd", 0xF3, 0x5A, false},  {"cvtsd2ss", 0xF2, 0x5A, false},
+  {"xorps", 0x00, 0x57, false},
+  {"cvttss2siq", 0xF3, 0x2C, true}, {"cvttsd2siq", 0xF2, 0x2C, true},
+  {"cvtsi2ssq", 0xF3, 0x2A, true},  {"cvtsi2sdq", 0xF2, 0x2A, true},
+
+  // Packed
+  {"addps", 0x00, 0x58, false},     {"addpd", 0x66, 0x58, false},
+  {"subps", 0x00, 0x5C, false},     {"subpd", 0x66, 0x5C, false},
+  {"mulps", 0x00, 0x59, false},     {"mulpd", 0x66, 0x59, false},
+  {"divps", 0x00, 0x5E, false},     {"divpd", 0x66, 0x5E, false},
+  {"paddb", 0x66, 0xFC, false},     {"paddw", 0x66, 0xFD, false},
+  {"paddd", 0x66, 0xFE, false},     {"paddq", 0x66, 0xD4, false},
+  {"psubb", 0x66, 0xF8, false},     {"psubw", 0x66, 0xF9, false},
+  {"psubd", 0x66, 0xFA, false},     {"psubq", 0x66, 0xFB, false},
+  {"pmullw", 0x66, 0xD5, false},
+  {"pand", 0x66, 0xDB, false},      {"por", 0x66, 0xEB, false},
+  {"pxor", 0x66, 0xEF, false},
+  {NULL, 0, 0, false},
+};
+
+typedef struct {
+  const char *name;
+  uint8_t pp;
+  uint8_t map;
+  uint8_t opcode;
+} AVXInstruction;
+
+// All take (source 2, source 1, destination) in xmm or ymm registers
+static const AVXInstruction AVXInstructions[] = {
+  {"vaddps", 0, 1, 0x58},   {"vaddpd", 1, 1, 0x58},
+  {"vsubps", 0, 1, 0x5C},   {"vsubpd", 1, 1, 0x5C},
+  {"vmulps", 0, 1, 0x59},   {"vmulpd", 1, 1, 0x59},
+  {"vdivps", 0, 1, 0x5E},   {"vdivpd", 1, 1, 0x5E},
+  {"vpaddb", 1, 1, 0xFC},   {"vpaddw", 1, 1, 0xFD},
+  {"vpaddd", 1, 1, 0xFE},   {"vpaddq", 1, 1, 0xD4},
+  {"vpsubb", 1, 1, 0xF8},   {"vpsubw", 1, 1, 0xF9},
+  {"vpsubd", 1, 1, 0xFA},   {"vpsubq", 1, 1, 0xFB},
+  {"vpmullw", 1, 1, 0xD5},  {"vpmulld", 1, 2, 0x40},
+  {"vpand", 1, 1, 0xDB},    {"vpor", 1, 1, 0xEB},
+  {"vpxor", 1, 1, 0xEF},
+  {NULL, 0, 0, 0},
+};
+
+typedef struct {
+  const char *name;
+  uint8_t opcode;    // reg, r/m form; the 8-bit form is one less
+  uint8_t extension; // ModRM.reg for the immediate forms
+} ALUInstruction;
+
+static const ALUInstruction ALUInstructions[] = {
+  {"add", 0x01, 0}, {"or", 0x09, 1}, {"and", 0x21, 4},
+  {"sub", 0x29, 5}, {"xor", 0x31, 6}, {"cmp", 0x39, 7},
+  {NULL, 0, 0},
+};
+
+typedef struct {
+  const char *name;
+  uint8_t extension;
+} GroupInstruction;
+
+// One operand instructions sharing opcode 0xF7
+static const GroupInstruction UnaryInstructions[] = {
+  {"not", 2}, {"neg", 3}, {"mul", 4}, {"div", 6}, {"idiv", 7},
+  {NULL, 0},
+};
+
+// Shifts, with opcodes 0xD1 (by one), 0xD3 (by %cl) and 0xC1 (immediate)
+static const GroupInstruction ShiftInstructions[] = {
+  {"rol", 0}, {"ror", 1}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7},
+  {NULL, 0},
+};
+
+static bool NameIs(const char *mnemonic, int length, const char *name) {
+  return (int)strlen(name) == length && memcmp(mnemonic, name, length) == 0;
+}
+
+static int SuffixSize(char suffix) {
+  switch (suffix) {
+    case 'b': return 1;
+    case 'w': return 2;
+    case 'l': return 4;
+    case 'q': return 8;
+    default:  return 0;
+  }
+}
+
+// Operand size prefix and REX.W for an operation of `size` bytes
+static Encoding SizedOp(int size, int length, uint8_t b0, uint8_t b1) {
+  Encoding e = Op((size == 2) ? 0x66 : 0, size == 8, length, b0, b1, 0);
+  e.byte_regs = size == 1;
+  return e;
+}
+
+static void BadOperands(const char *mnemonic) {
+  COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unsupported operands for '%s'", Asm.line, mnemonic);
+}
+
+static bool AssembleSSE(const char *mnemonic, Operand *ops, int count) {
+  for (int i = 0; SSEInstructions[i].name != NULL; i++) {
+    const SSEInstruction *s = &SSEInstructions[i];
+    if (strcmp(s->name, mnemonic) != 0) continue;
+    if (count != 2) BadOperands(mnemonic);
+
+    Encoding e = Op(s->prefix, s->rex_w, 2, 0x0F, s->opcode, 0);
+    EmitModRM(e, ops[1].reg, &ops[0], 0, 0);
+    return true;
+  }
+
+  return false;
+}
+
+static bool AssembleAVX(const char *mnemonic, Operand *ops, int count) {
+  if (strcmp(mnemonic, "vmovdqu") == 0) {
+    if (count != 2) BadOperands(mnemonic);
+    if (ops[1].kind == OPERAND_XMM) EmitVEX(2, 1, ops[1].size == 32, 0x6F, ops[1].reg, 0, &ops[0]);
+    else if (ops[0].kind == OPERAND_XMM) EmitVEX(2, 1, ops[0].size == 32, 0x7F, ops[0].reg, 0, &ops[1]);
+    else BadOperands(mnemonic);
+    return true;
+  }
+
+  for (int i = 0; AVXInstructions[i].name != NULL; i++) {
+    const AVXInstruction *a = &AVXInstructions[i];
+    if (strcmp(a->name, mnemonic) != 0) continue;
+    if (count != 3 || ops[1].kind != OPERAND_XMM || ops[2].kind != OPERAND_XMM) BadOperands(mnemonic);
+
+    EmitVEX(a->pp, a->map, ops[2].size == 32, a->opcode, ops[2].reg, ops[1].reg, &ops[0]);
+    return true;
+  }
+
+  return false;
+}
+
+static bool AssembleALU(const char *mnemonic, int length, int size, Operand *ops, int count) {
+  for (int i = 0; ALUInstructions[i].name != NULL; i++) {
+    const ALUInstruction *a = &ALUInstructions[i];
+    if (!NameIs(mnemonic, length, a->name)) continue;
+    if (count != 2) BadOperands(mnemonic);
+
+    uint8_t opcode = (size == 1) ? a->opcode - 1 : a->opcode;
+
+    if (ops[0].kind == OPERAND_REG) {
+      EmitModRM(SizedOp(size, 1, opcode, 0), ops[0].reg, &ops[1], 0, 0);
+    } else if (ops[1].kind == OPERAND_REG && ops[0].kind == OPERAND_MEM) {
+      EmitModRM(SizedOp(size, 1, opcode + 2, 0), ops[1].reg, &ops[0], 0, 0);
+    } else if (ops[0].kind == OPERAND_IMM) {
+      if (size == 1) EmitModRM(SizedOp(size, 1, 0x80, 0), a->extension, &ops[1], 1, ops[0].imm);
+      else if (FitsInt8(ops[0].imm)) EmitModRM(SizedOp(size, 1, 0x83, 0), a->extension, &ops[1], 1, ops[0].imm);
+      else EmitModRM(SizedOp(size, 1, 0x81, 0), a->extension, &ops[1], (size == 2) ? 2 : 4, ops[0].imm);
+    } else {
+      BadOperands(mnemonic);
+    }
+    return true;
+  }
+
+  return false;
+}
+
+static bool AssembleGroup(const char *mnemonic, int length, int size, Operand *ops, int count) {
+  for (int i = 0; UnaryInstructions[i].name != NULL; i++) {
+    if (!NameIs(mnemonic, length, UnaryInstructions[i].name)) continue;
+    if (count != 1) BadOperands(mnemonic);
+
+    EmitModRM(SizedOp(size, 1, (size == 1) ? 0xF6 : 0xF7, 0), UnaryInstructions[i].extension, &ops[0], 0, 0);
+    return true;
+  }
+
+  for (int i = 0; ShiftInstructions[i].name != NULL; i++) {
+    if (!NameIs(mnemonic, length, ShiftInstructions[i].name)) continue;
+    uint8_t extension = ShiftInstructions[i].extension;
+    int byte_adjust = (size == 1) ? 1 : 0;
+
+    if (count == 1) {
+      EmitModRM(SizedOp(size, 1, 0xD1 - byte_adjust, 0), extension, &ops[0], 0, 0);
+    } else if (count == 2 && ops[0].kind == OPERAND_REG && ops[0].reg == 1 && ops[0].size == 1) {
+      EmitModRM(SizedOp(size, 1, 0xD3 - byte_adjust, 0), extension, &ops[1], 0, 0);
+    } else if (count == 2 && ops[0].kind == OPERAND_IMM) {
+      EmitModRM(SizedOp(size, 1, 0xC1 - byte_adjust, 0), extension, &ops[1], 1, ops[0].imm);
+    } else {
+      BadOperands(mnemonic);
+    }
+    return true;
+  }
+
+  return false;
+}
+
+static void AssembleMov(const char *mnemonic, int size, Operand *ops, int count) {
+  if (count != 2) BadOperands(mnemonic);
+
+  if (ops[0].kind == OPERAND_REG) {
+    EmitModRM(SizedOp(size, 1, (size == 1) ? 0x88 : 0x89, 0), ops[0].reg, &ops[1], 0, 0);
+  } else if (ops[1].kind == OPERAND_REG && ops[0].kind == OPERAND_MEM) {
+    EmitModRM(SizedOp(size, 1, (size == 1) ? 0x8A : 0x8B, 0), ops[1].reg, &ops[0], 0, 0);
+  } else if (ops[0].kind == OPERAND_IMM && ops[1].kind == OPERAND_REG && size == 4) {
+    EmitOpcodePlusReg(false, 0xB8, ops[1].reg, 4, ops[0].imm);
+  } else if (ops[0].kind == OPERAND_IMM) {
+    if (size == 8 && (ops[0].imm < INT32_MIN || ops[0].imm > INT32_MAX)) BadOperands(mnemonic);
+    int imm_size = (size == 1) ? 1 : (size == 2) ? 2 : 4;
+    EmitModRM(SizedOp(size, 1, (size == 1) ? 0xC6 : 0xC7, 0), 0, &ops[1], imm_size, ops[0].imm);
+  } else {
+    BadOperands(mnemonic);
+  }
+}
+
+static void AssembleInstruction(const char *mnemonic, Operand *ops, int count) {
+  int length = strlen(mnemonic);
+  char suffix = (length > 0) ? mnemonic[length - 1] : 0;
+  int size = SuffixSize(suffix);
+
+  // No operands
+  if (count == 0) {
+    if      (strcmp(mnemonic, "ret") == 0)   Byte(0xC3);
+    else if (strcmp(mnemonic, "leave") == 0) Byte(0xC9);
+    else if (strcmp(mnemonic, "cqo") == 0)   { Byte(0x48); Byte(0x99); }
+    else if (strcmp(mnemonic, "ud2") == 0)   { Byte(0x0F); Byte(0x0B); }
+    else if (strcmp(mnemonic, "nop") == 0)   Byte(0x90);
+    else if (strcmp(mnemonic, "rep stosb") == 0) { Byte(0xF3); Byte(0xAA); }
+    else if (strcmp(mnemonic, "vzeroupper") == 0) { Byte(0xC5); Byte(0xF8); Byte(0x77); }
+    else if (!(length > 0 && (AssembleGroup(mnemonic, length - 1, size, ops, count)))) {
+      COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unknown instruction '%s'", Asm.line, mnemonic);
+    }
+    return;
+  }
+
+  if (AssembleSSE(mnemonic, ops, count)) return;
+  if (AssembleAVX(mnemonic, ops, count)) return;
+
+  // Unaligned 16-byte moves: (source, destination), the xmm register in ModRM.reg
+  if (strcmp(mnemonic, "movdqu") == 0) {
+    if (count != 2) BadOperands(mnemonic);
+    if (ops[1].kind == OPERAND_XMM) EmitModRM(Op(0xF3, false, 2, 0x0F, 0x6F, 0), ops[1].reg, &ops[0], 0, 0);
+    else if (ops[0].kind == OPERAND_XMM) EmitModRM(Op(0xF3, false, 2, 0x0F, 0x7F, 0), ops[0].reg, &ops[1], 0, 0);
+    else BadOperands(mnemonic);
+    return;
+  }
+
+  // Moves between general purpose and xmm registers
+  if ((strcmp(mnemonic, "movq") == 0 || strcmp(mnemonic, "movd") == 0) &&
+      count == 2 && (ops[0].kind == OPERAND_XMM || ops[1].kind == OPERAND_XMM)) {
+    bool to_xmm = ops[1].kind == OPERAND_XMM;
+    Encoding e = Op(0x66, suffix == 'q', 2, 0x0F, to_xmm ? 0x6E : 0x7E, 0);
+    if (to_xmm) EmitModRM(e, ops[1].reg, &ops[0], 0, 0);
+    else EmitModRM(e, ops[0].reg, &ops[1], 0, 0);
+    return;
+  }
+
+  // Sign and zero extensions: (source, destination)
+  struct { const char *name; bool rex_w; int length; uint8_t b0, b1; bool byte_source; } extensions[] = {
+    {"movzbl", false, 2, 0x0F, 0xB6, true}, {"movzbq", true, 2, 0x0F, 0xB6, true},
+    {"movzwl", false, 2, 0x0F, 0xB7, false}, {"movzwq", true, 2, 0x0F, 0xB7, false},
+    {"movsbl", false, 2, 0x0F, 0xBE, true}, {"movsbq", true, 2, 0x0F, 0xBE, true},
+    {"movswl", false, 2, 0x0F, 0xBF, false}, {"movswq", true, 2, 0x0F, 0xBF, false},
+    {"movslq", true, 1, 0x63, 0, false},
+  };
+  for (int i = 0; i < (int)(sizeof(extensions) / sizeof(extensions[0])); i++) {
+    if (strcmp(mnemonic, extensions[i].name) != 0) continue;
+    if (count != 2 || ops[1].kind != OPERAND_REG) BadOperands(mnemonic);
+
+    Encoding e = Op(0, extensions[i].rex_w, extensions[i].length, extensions[i].b0, extensions[i].b1, 0);
+    e.byte_regs = extensions[i].byte_source;
+    EmitModRM(e, ops[1].reg, &ops[0], 0, 0);
+    return;
+  }
+
+  if (strcmp(mnemonic, "movabsq") == 0) {
+    if (count != 2 || ops[0].kind != OPERAND_IMM || ops[1].kind != OPERAND_REG) BadOperands(mnemonic);
+    EmitOpcodePlusReg(true, 0xB8, ops[1].reg, 8, ops[0].imm);
+    return;
+  }
+
+  if (strcmp(mnemonic, "leaq") == 0) {
+    if (count != 2 || ops[0].kind != OPERAND_MEM) BadOperands(mnemonic);
+    EmitModRM(Op(0, true, 1, 0x8D, 0, 0), ops[1].reg, &ops[0], 0, 0);
+    return;
+  }
+
+  if (strcmp(mnemonic, "pushq") == 0 || strcmp(mnemonic, "popq") == 0) {
+    if (ops[0].kind != OPERAND_REG) BadOperands(mnemonic);
+    EmitOpcodePlusReg(false, (mnemonic[1] == 'u') ? 0x50 : 0x58, ops[0].reg, 0, 0);
+    return;
+  }
+
+  if (strcmp(mnemonic, "call") == 0) {
+    EmitBranch(1, 0xE8, 0, &ops[0]);
+    return;
+  }
+
+  if (strcmp(mnemonic, "jmp") == 0) {
+    EmitBranch(1, 0xE9, 0, &ops[0]);
+    return;
+  }
+
+  if (mnemonic[0] == 'j') {
+    int cc = ConditionCodeOf(mnemonic + 1, length - 1);
+    if (cc >= 0) {
+      EmitBranch(2, 0x0F, 0x80 + cc, &ops[0]);
+      return;
+    }
+  }
+
+  if (strncmp(mnemonic, "set", 3) == 0) {
+    int cc = ConditionCodeOf(mnemonic + 3, length - 3);
+    if (cc >= 0) {
+      Encoding e = Op(0, false, 2, 0x0F, 0x90 + cc, 0);
+      e.byte_regs = true;
+      EmitModRM(e, 0, &ops[0], 0, 0);
+      return;
+    }
+  }
+
+  if (strncmp(mnemonic, "cmov", 4) == 0 && size >= 2) {
+    int cc = ConditionCodeOf(mnemonic + 4, length - 5);
+    if (cc >= 0 && count == 2) {
+      EmitModRM(SizedOp(size, 2, 0x0F, 0x40 + cc), ops[1].reg, &ops[0], 0, 0);
+      return;
+    }
+  }
+
+  if (size == 0) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unknown instruction '%s'", Asm.line, mnemonic);
+  }
+
+  // The rest carry an operand size suffix
+  int base_length = length - 1;
+
+  if (NameIs(mnemonic, base_length, "mov")) {
+    AssembleMov(mnemonic, size, ops, count);
+    return;
+  }
+
+  if (NameIs(mnemonic, base_length, "test")) {
+    if (count != 2 || ops[0].kind != OPERAND_REG) BadOperands(mnemonic);
+    EmitModRM(SizedOp(size, 1, (size == 1) ? 0x84 : 0x85, 0), ops[0].reg, &ops[1], 0, 0);
+    return;
+  }
+
+  if (NameIs(mnemonic, base_length, "imul") && count >= 2) {
+    if (count == 2) {
+      EmitModRM(SizedOp(size, 2, 0x0F, 0xAF), ops[1].reg, &ops[0], 0, 0);
+    } else if (FitsInt8(ops[0].imm)) {
+      EmitModRM(SizedOp(size, 1, 0x6B, 0), ops[2].reg, &ops[1], 1, ops[0].imm);
+    } else {
+      EmitModRM(SizedOp(size, 1, 0x69, 0), ops[2].reg, &ops[1], 4, ops[0].imm);
+    }
+    return;
+  }
+
+  if (NameIs(mnemonic, base_length, "btc") || NameIs(mnemonic, base_length, "bts") ||
+      NameIs(mnemonic, base_length, "btr")) {
+    if (count != 2 || ops[0].kind != OPERAND_IMM) BadOperands(mnemonic);
+    uint8_t extension = (mnemonic[2] == 'c') ? 7 : (mnemonic[2] == 's') ? 5 : 6;
+    EmitModRM(SizedOp(size, 2, 0x0F, 0xBA), extension, &ops[1], 1, ops[0].imm);
+    return;
+  }
+
+  if (AssembleALU(mnemonic, base_length, size, ops, count)) return;
+  if (AssembleGroup(mnemonic, base_length, size, ops, count)) return;
+
+  COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unknown instruction '%s'", Asm.line, mnemonic);
+}
+
+/* === Directives === */
+static void SwitchSection(const char *name) {
+  if      (strcmp(name, ".text") == 0)   Asm.section = X64_TEXT;
+  else if (strcmp(name, ".rodata") == 0) Asm.section = X64_RODATA;
+  else if (strcmp(name, ".data") == 0)   Asm.section = X64_DATA;
+  else if (strcmp(name, ".bss") == 0)    Asm.section = X64_BSS;
+  else                                   Asm.section = -1;
+}
+
+static void StringDirective(char *args) {
+  char *p = strchr(args, '"');
+  if (p == NULL) COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Expected a string", Asm.line);
+
+  for (p++; *p != '"' && *p != '\0'; p++) {
+    char c = *p;
+    if (c == '\\' && p[1] != '\0') {
+      p++;
+      switch (*p) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case '0': c = '\0'; break;
+        default:  c = *p; break;
+      }
+    }
+    Byte((uint8_t)c);
+  }
+
+  Byte(0);
+}
+
+static void SymbolDirective(char *args, bool is_global) {
+  char *name = args;
+  while (isspace((unsigned char)*name)) name++;
+
+  int length = 0;
+  while (IsSymbolChar(name[length])) length++;
+
+  int index = InternSymbol(name, length);
+  X64_Symbol *s = &Asm.obj->symbols[index];
+  if (is_global) s->is_global = true;
+  else s->is_function = strstr(name + length, "@function") != NULL;
+}
+
+static void AssembleDirective(char *directive, char *args) {
+  if (strcmp(directive, ".section") == 0) {
+    char *name = args;
+    while (isspace((unsigned char)*name)) name++;
+    char *end = name;
+    while (*end != '\0' && *end != ',' && !isspace((unsigned char)*end)) end++;
+    *end = '\0';
+    SwitchSection(name);
+  } else if (strcmp(directive, ".text") == 0 || strcmp(directive, ".data") == 0 ||
+             strcmp(directive, ".bss") == 0) {
+    SwitchSection(directive);
+  } else if (strcmp(directive, ".string") == 0 || strcmp(directive, ".asciz") == 0) {
+    StringDirective(args);
+  } else if (strcmp(directive, ".byte") == 0) {
+    for (char *p = args; *p != '\0';) {
+      Byte((uint8_t)strtol(p, &p, 0));
+      while (*p == ',' || isspace((unsigned char)*p)) p++;
+    }
+  } else if (strcmp(directive, ".zero") == 0) {
+    Reserve(atoi(args));
+  } else if (strcmp(directive, ".p2align") == 0) {
+    X64_Section *s = CurrentSection();
+    int alignment = 1 << atoi(args);
+    if (alignment > s->alignment) s->alignment = alignment;
+    Reserve((alignment - s->size % alignment) % alignment);
+  } else if (strcmp(directive, ".globl") == 0) {
+    SymbolDirective(args, true);
+  } else if (strcmp(directive, ".type") == 0) {
+    SymbolDirective(args, false);
+  } else if (strcmp(directive, ".size") != 0) {
+    COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Unknown directive '%s'", Asm.line, directive);
+  }
+}
+
+/* === Lines === */
+static void AssembleLine(char *line) {
+  while (isspace((unsigned char)*line)) line++;
+
+  int length = strlen(line);
+  while (length > 0 && isspace((unsigned char)line[length - 1])) line[--length] = '\0';
+  if (length == 0) return;
+
+  if (line[length - 1] == ':') {
+    DefineLabel(line, length - 1);
+    return;
+  }
+
+  char *args = line;
+  while (*args != '\0' && !isspace((unsigned char)*args)) args++;
+  if (*args != '\0') *args++ = '\0';
+  while (isspace((unsigned char)*args)) args++;
+
+  if (line[0] == '.') {
+    AssembleDirective(line, args);
+    return;
+  }
+
+  // "rep stosb" is one instruction spelled as two words
+  if (strcmp(line, "rep") == 0) {
+    char mnemonic[32];
+    snprintf(mnemonic, sizeof(mnemonic), "rep %s", args);
+    AssembleInstruction(mnemonic, NULL, 0);
+    return;
+  }
+
+  Operand ops[MAX_OPERANDS];
+  int count = 0;
+  int depth = 0;
+  char *start = args;
+
+  for (char *p = args;; p++) {
+    if (*p == '(') depth++;
+    if (*p == ')') depth--;
+
+    if ((*p == ',' && depth == 0) || *p == '\0') {
+      bool at_end = *p == '\0';
+      *p = '\0';
+
+      if (p > start) {
+        if (count == MAX_OPERANDS) COMPILER_ERROR_FMTMSG("AssembleX64(): Line %d: Too many operands", Asm.line);
+        ParseOperand(start, &ops[count++]);
+      }
+
+      if (at_end) break;
+      start = p + 1;
+    }
+  }
+
+  AssembleInstruction(line, ops, count);
+}
+
+// Patches branches and calls whose target is in the same section
+static void ResolveLocalRelocs() {
+  X64_Object *obj = Asm.obj;
+  int kept = 0;
+
+  for (int i = 0; i < obj->reloc_count; i++) {
+    X64_Reloc r = obj->relocs[i];
+    X64_Symbol *s = &obj->symbols[r.symbol];
+
+    bool is_relative = r.type == X64_RELOC_PC32 || r.type == X64_RELOC_PLT32;
+    if (is_relative && s->section == r.section) {
+      int32_t value = (int32_t)(s->offset + r.addend - r.offset);
+      memcpy(&obj->sections[r.section].bytes[r.offset], &value, sizeof(value));
+      continue;
+    }
+
+    obj->relocs[kept++] = r;
+  }
+
+  obj->reloc_count = kept;
+}
+
+X64_Object *AssembleX64(const char *source, int length) {
+  X64_Object *obj = calloc(1, sizeof(X64_Object));
+  obj->arena = NewArena();
+  obj->sections[X64_TEXT].alignment = 16;
+  obj->sections[X64_RODATA].alignment = 1;
+  obj->sections[X64_DATA].alignment = 1;
+  obj->sections[X64_BSS].alignment = 1;
+
+  memset(&Asm, 0, sizeof(Asm));
+  Asm.obj = obj;
+  Asm.section = X64_TEXT;
+
+  char *line = malloc(length + 1);
+
+  for (int start = 0; start < length;) {
+    int end = start;
+    while (end < length && source[end] != '\n') end++;
+
+    memcpy(line, source + start, end - start);
+    line[end - start] = '\0';
+    Asm.line++;
+    AssembleLine(line);
+
+    start = end + 1;
+  }
+
+  free(line);
+  ResolveLocalRelocs();
+
+  return obj;
+}
+
+void DeleteX64Object(X64_Object *obj) {
+  DeleteArena(obj->arena);
+  free(obj);
+}
+
+const char *X64SectionName(X64_SectionId section) {
+  switch (section) {
+    case X64_TEXT:   return ".text";
+    case X64_RODATA: return ".rodata";
+    case X64_DATA:   return ".data";
+    case X64_BSS:    return ".bss";
+    default:         return "";
+  }
+}
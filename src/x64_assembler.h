@@ -0,0 +1,72 @@
+#ifndef X64_ASSEMBLER_H
+#define X64_ASSEMBLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* Encodes the assembly codegen_x64.c writes (GNU as, AT&T syntax) into
+ * machine code, so native code can be produced without an external
+ * assembler. Only the instructions and directives that backend uses are
+ * understood; anything else is a compiler error. */
+
+typedef enum {
+  X64_TEXT,
+  X64_RODATA,
+  X64_DATA,
+  X64_BSS,
+  X64_SECTION_COUNT,
+} X64_SectionId;
+
+// Relocation types, numbered like their ELF R_X86_64_* counterparts
+typedef enum {
+  X64_RELOC_64       = 1,
+  X64_RELOC_PC32     = 2,
+  X64_RELOC_PLT32    = 4,
+  X64_RELOC_GOTPCREL = 9,
+} X64_RelocType;
+
+typedef struct {
+  uint8_t *bytes; // NULL for .bss
+  int size;
+  int capacity;
+  int alignment;
+} X64_Section;
+
+typedef struct {
+  const char *name;
+  int section;    // X64_SectionId, or -1 when defined elsewhere (libc)
+  int offset;
+  bool is_global;
+  bool is_function;
+} X64_Symbol;
+
+typedef struct {
+  int section;    // where the field to patch lives
+  int offset;
+  int symbol;
+  X64_RelocType type;
+  int64_t addend;
+} X64_Reloc;
+
+typedef struct {
+  Arena *arena;
+  X64_Section sections[X64_SECTION_COUNT];
+
+  X64_Symbol *symbols;
+  int symbol_count, symbol_capacity;
+
+  X64_Reloc *relocs;
+  int reloc_count, reloc_capacity;
+} X64_Object;
+
+/* Branches and calls between labels of the same section are resolved
+ * here; every other reference is left as a relocation. */
+X64_Object *AssembleX64(const char *source, int length);
+void DeleteX64Object(X64_Object *obj);
+
+int FindX64Symbol(X64_Object *obj, const char *name);
+const char *X64SectionName(X64_SectionId section);
+
+#endif
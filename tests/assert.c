@@ -7,7 +7,7 @@
 #include "hashtable.h"
 
 #define MAX_ERROR_MESSAGES 50
-#define MAX_ERROR_MSG_SIZE 200
+#define MAX_ERROR_MSG_SIZE 1000
 #define MSG_SPACER "               "
 
 HashTable *ht;
@@ -58,6 +58,17 @@ void Assert(int expected_code, int actual_code, char *file_name, char *group_nam
   LogResults(predicate, group_name);
 }
 
+void AssertPrintResult(bool strings_match, char *test_stdout, char *expected_stdout, char *file_name, char *group_name) {
+  if (ht == NULL) ht = NewHashTable();
+
+  if (!strings_match) {
+    LogError(MSG_SPACER "[%s]\n" MSG_SPACER "    Expected output:\n%s" MSG_SPACER "    Got:\n%s",
+             file_name, expected_stdout, test_stdout);
+  }
+
+  LogResults(strings_match, group_name);
+}
+
 void PrintAssertionResults(char *group_name) {
   if (ht == NULL) return;
 
@@ -1,55 +1,515 @@
 #include <errno.h>
+#include <pthread.h>    // for pthread_create, pthread_mutex_lock
+#include <signal.h>     // for kill
+#include <spawn.h>      // for posix_spawn
+#include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>   // for system
-#include <string.h>   // for strerror
-#include <sys/wait.h> // for WEXITSTATUS
+#include <stdlib.h>     // for qsort
+#include <string.h>     // for strerror, strcmp
+#include <sys/socket.h> // for socket, connect
+#include <sys/un.h>     // for sockaddr_un
+#include <sys/wait.h>   // for WEXITSTATUS, waitpid
+#include <time.h>       // for clock_gettime, nanosleep
+#include <unistd.h>     // for fork, execl, sysconf
 
 #include "../src/common.h"
+#include "../src/error.h"
 #include "assert.h"
 #include "test_io.h"
 
-void RunTest(char *compiler_path, char *test_path, char *file_name, char *group_name) {
-  char *partial_path = Concat(compiler_path, " ");
-  char *full_path = Concat(partial_path, test_path);
+#define MAX_CHECKS 8
+#define SLOWEST_SHOWN 10
 
-  errno = 0;
-  int result = system(full_path);
-  if (errno != 0) {
-    printf("RunTest(): Non-zero ERRNO running test '%s': %s\n", test_path, strerror(errno));
+extern char **environ;
+
+/* What a test found, kept until every test has run: tests run at once on
+ * several threads, while their results are reported in order, by group */
+typedef struct {
+  bool is_output;
+  int expected_code;
+  int actual_code;
+  char *test_stdout;
+  char *expected_stdout;
+} Check;
+
+typedef struct {
+  char *path;
+  char *file_name;
+  char *group_name;
+  char *tmp_path; // of this test alone, for what it builds
+  int expected_code;
+
+  Check checks[MAX_CHECKS];
+  int check_count;
+  uint64_t nanoseconds;
+} Test;
+
+static struct {
+  Test *tests;
+  int count;
+  int capacity;
+
+  int next; // the test the next free thread takes
+  pthread_mutex_t lock;
+
+  char *compiler_path;
+  char *state_path;
+  bool native;
+  bool via_c;
+  bool jit;
+  bool pgo;
+  bool incremental;
+} Runner = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t Now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void Expect(Test *test, int expected_code, int actual_code) {
+  if (test->check_count == MAX_CHECKS) return;
+  test->checks[test->check_count++] = (Check){.expected_code = expected_code, .actual_code = actual_code};
+}
+
+// Takes `test_stdout`, which is freed once reported
+static void ExpectOutput(Test *test, char *test_stdout, char *expected_stdout) {
+  if (test->check_count == MAX_CHECKS) return;
+  test->checks[test->check_count++] = (Check){
+    .is_output = true,
+    .test_stdout = test_stdout,
+    .expected_stdout = expected_stdout,
+  };
+}
+
+// Runs `command` with the shell, as system() would, but safely from any thread
+static int RunCommand(char *command, char *test_path) {
+  char *argv[] = {"sh", "-c", command, NULL};
+  pid_t pid;
+
+  int error = posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ);
+  if (error != 0) {
+    printf("RunCommand(): Child process could not be created for test '%s': %s\n", test_path, strerror(error));
     exit(256);
   }
 
-  if (result == -1) {
-    printf("RunTest(): Child process could not be created\n");
-    exit(256);
+  int result;
+  while (waitpid(pid, &result, 0) < 0) {
+    if (errno != EINTR) {
+      printf("RunCommand(): Non-zero ERRNO running test '%s': %s\n", test_path, strerror(errno));
+      exit(256);
+    }
   }
 
   int status = WEXITSTATUS(result);
   if (status == 127) {
-    printf("RunTest(): Shell could not be executed in child process\n");
+    printf("RunCommand(): Shell could not be executed in child process\n");
     exit(256);
   }
 
+  return status;
+}
+
+// What a compiler built without RUNNING_TESTS prints (diagnostics, symbols) is dropped
+void RunTest(char *compiler_path, Test *test) {
+  char command[1024];
+  snprintf(command, sizeof(command), "%s %s > /dev/null", compiler_path, test->path);
+
+  int status = RunCommand(command, test->path);
+
   // Assert error code matches
-  int expected_code = ExtractExpectedErrorCode(test_path);
-  Assert(expected_code, status, file_name, group_name);
+  Expect(test, test->expected_code, status);
+}
+
+static char *ReadWholeFile(char *path) {
+  FILE *fd = fopen(path, "r");
+  if (fd == NULL) return CopyString("");
+
+  fseek(fd, 0L, SEEK_END);
+  long size = ftell(fd);
+  rewind(fd);
+
+  char *contents = NewString(size + 1);
+  size_t bytes_read = fread(contents, sizeof(char), size, fd);
+  contents[bytes_read] = '\0';
+
+  fclose(fd);
+  return contents;
+}
+
+/* Runs a program built from an OK test (`run_command`) and checks that it
+ * exits cleanly, or as its "// exits " line says, and prints what the
+ * test's "// > " lines expect */
+static void RunBuiltTest(char *run_command, Test *test) {
+  char *stdout_path = Concat(test->tmp_path, ".stdout");
+  char command[1024];
+
+  snprintf(command, sizeof(command), "%s > %s", run_command, stdout_path);
+  int status = RunCommand(command, test->path);
+  Expect(test, ExtractExpectedExitStatus(test->path), status);
+
+  char *expected_stdout = ExtractExpectedPrintOutput(test->path);
+  if (expected_stdout != NULL) {
+    ExpectOutput(test, ReadWholeFile(stdout_path), expected_stdout);
+  }
+
+  remove(stdout_path);
+  free(stdout_path);
+}
+
+// Builds an OK test with the x86-64 backend
+void RunNativeTest(char *compiler_path, Test *test) {
+  char *executable = test->tmp_path;
+  char command[1024];
+
+  snprintf(command, sizeof(command), "%s -o %s %s > /dev/null", compiler_path, executable, test->path);
+  int status = RunCommand(command, test->path);
+  if (status != OK) {
+    Expect(test, OK, status);
+    return;
+  }
+
+  RunBuiltTest(executable, test);
+
+  remove(executable);
 }
 
-int main() {
+/* Builds an OK test instrumented with -fprofile-generate and runs it, which
+ * writes its profile, then rebuilds it with -fprofile-use and runs it again.
+ * Both builds must behave as the test expects. A program that dies before
+ * writing its profile is rebuilt without one, with a note on stderr that is dropped */
+void RunPGOTest(char *compiler_path, Test *test) {
+  char *executable = test->tmp_path;
+  char *profile_path = Concat(executable, ".profile");
+  char command[1024];
+
+  const char *options[] = {"-fprofile-generate=", "-fprofile-use="};
+  for (int i = 0; i < 2; i++) {
+    snprintf(command, sizeof(command), "%s %s%s -o %s %s > /dev/null 2>&1",
+             compiler_path, options[i], profile_path, executable, test->path);
+    int status = RunCommand(command, test->path);
+    if (status != OK) {
+      Expect(test, OK, status);
+      break;
+    }
+
+    RunBuiltTest(executable, test);
+  }
+
+  remove(executable);
+  remove(profile_path);
+  free(profile_path);
+}
+
+// Translates an OK test to C and builds it with the system C compiler
+void RunCTest(char *compiler_path, Test *test) {
+  char *executable = test->tmp_path;
+  char *c_path = Concat(executable, ".c");
+  char *runtime_path = RuntimeIncludePath();
+  char command[1024];
+
+  snprintf(command, sizeof(command), "%s --emit=c -o %s %s > /dev/null", compiler_path, c_path, test->path);
+  int status = RunCommand(command, test->path);
+  if (status != OK) {
+    Expect(test, OK, status);
+    return;
+  }
+
+  snprintf(command, sizeof(command), "cc -std=c11 -O2 -w -I%s -o %s %s -lm", runtime_path, executable, c_path);
+  status = RunCommand(command, test->path);
+  if (status != OK) {
+    Expect(test, OK, status);
+    return;
+  }
+
+  RunBuiltTest(executable, test);
+
+  remove(executable);
+  remove(c_path);
+  free(runtime_path);
+  free(c_path);
+}
+
+// Runs an OK test in-process with --jit; the timing report on stderr is dropped
+void RunJITTest(char *compiler_path, Test *test) {
+  char command[1024];
+
+  snprintf(command, sizeof(command), "%s --jit %s 2>/dev/null", compiler_path, test->path);
+  RunBuiltTest(command, test);
+}
+
+/* Compiles an OK test three times with --incremental-verify, which fails if
+ * the result differs from compiling from scratch: with the state the test
+ * before left, with its own, and with a line added in front and a function
+ * at the end, which moves every statement it reuses */
+void RunIncrementalTest(char *compiler_path, char *state_path, Test *test) {
+  char *edited_path = Concat(test->tmp_path, ".crom");
+  char command[1024];
+
+  for (int i = 0; i < 2; i++) {
+    snprintf(command, sizeof(command), "%s --incremental=%s --incremental-verify %s > /dev/null",
+             compiler_path, state_path, test->path);
+    Expect(test, OK, RunCommand(command, test->path));
+  }
+
+  char *source = ReadWholeFile(test->path);
+  FILE *edited = fopen(edited_path, "w");
+  fprintf(edited, "// edited\n%s\nIncrementalProbe() :: void {\n  i64 incremental_probe = 1;\n}\n", source);
+  fclose(edited);
+
+  snprintf(command, sizeof(command), "%s --incremental=%s --incremental-verify %s > /dev/null",
+           compiler_path, state_path, edited_path);
+  Expect(test, OK, RunCommand(command, test->path));
+
+  remove(edited_path);
+  free(edited_path);
+  free(source);
+}
+
+/* === Running === */
+static void RunOne(Test *test, char *state_path) {
+  uint64_t start = Now();
+  RunTest(Runner.compiler_path, test);
+
+  if (test->expected_code == OK) {
+    if (Runner.native) RunNativeTest(Runner.compiler_path, test);
+    if (Runner.via_c) RunCTest(Runner.compiler_path, test);
+    if (Runner.jit) RunJITTest(Runner.compiler_path, test);
+    if (Runner.pgo) RunPGOTest(Runner.compiler_path, test);
+    if (Runner.incremental) RunIncrementalTest(Runner.compiler_path, state_path, test);
+  }
+
+  test->nanoseconds = Now() - start;
+}
+
+static void *Worker(void *worker) {
+  // A state file for each thread, so that the tests it runs also reuse the statements they share
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.inc", (int)(intptr_t)worker);
+  char *state_path = Concat(Runner.state_path, suffix);
+  remove(state_path);
+
+  for (;;) {
+    pthread_mutex_lock(&Runner.lock);
+    int next = Runner.next++;
+    pthread_mutex_unlock(&Runner.lock);
+
+    if (next >= Runner.count) break;
+    RunOne(&Runner.tests[next], state_path);
+  }
+
+  remove(state_path);
+  free(state_path);
+  return NULL;
+}
+
+static void RunAll(int jobs) {
+  if (jobs > Runner.count) jobs = (Runner.count > 0) ? Runner.count : 1;
+
+  pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+  for (int i = 0; i < jobs; i++) {
+    if (pthread_create(&threads[i], NULL, Worker, (void *)(intptr_t)i) != 0) {
+      printf("RunAll(): Could not start thread %d\n", i);
+      exit(256);
+    }
+  }
+
+  for (int i = 0; i < jobs; i++) pthread_join(threads[i], NULL);
+  free(threads);
+}
+
+static void AddTest(char *path, char *group_name) {
+  if (Runner.count == Runner.capacity) {
+    Runner.capacity = (Runner.capacity == 0) ? 256 : Runner.capacity * 2;
+    Runner.tests = realloc(Runner.tests, Runner.capacity * sizeof(Test));
+  }
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d", Runner.count);
+  char *tmp_path = TmpFilePath();
+
+  Runner.tests[Runner.count++] = (Test){
+    .path = path,
+    .file_name = ExtractEndOfPath(path),
+    .group_name = group_name,
+    .tmp_path = Concat(tmp_path, suffix),
+    .expected_code = ExtractExpectedErrorCode(path),
+  };
+  free(tmp_path);
+}
+
+/* === Reporting === */
+static void Report(Test *test) {
+  for (int i = 0; i < test->check_count; i++) {
+    Check c = test->checks[i];
+    if (!c.is_output) {
+      Assert(c.expected_code, c.actual_code, test->file_name, test->group_name);
+      continue;
+    }
+
+    AssertPrintResult(strcmp(c.test_stdout, c.expected_stdout) == 0, c.test_stdout, c.expected_stdout,
+                      test->file_name, test->group_name);
+    free(c.test_stdout);
+    free(c.expected_stdout);
+  }
+}
+
+static int SlowestFirst(const void *a, const void *b) {
+  uint64_t x = (*(Test *const *)a)->nanoseconds, y = (*(Test *const *)b)->nanoseconds;
+  return (x < y) - (x > y);
+}
+
+// The slowest tests stand out in yellow; with `all`, every test follows them
+static void PrintTimings(bool all, int jobs, uint64_t wall) {
+  if (Runner.count == 0) return;
+
+  Test **by_time = malloc(Runner.count * sizeof(Test *));
+  uint64_t total = 0;
+  for (int i = 0; i < Runner.count; i++) {
+    by_time[i] = &Runner.tests[i];
+    total += Runner.tests[i].nanoseconds;
+  }
+  qsort(by_time, Runner.count, sizeof(Test *), SlowestFirst);
+
+  printf("%17s: %d tests on %d thread%s in %.1f ms (%.1f ms of tests)\n",
+         "timing", Runner.count, jobs, (jobs == 1) ? "" : "s", wall / 1e6, total / 1e6);
+
+  int shown = (all || Runner.count < SLOWEST_SHOWN) ? Runner.count : SLOWEST_SHOWN;
+  for (int i = 0; i < shown; i++) {
+    const char *coloration = (i < SLOWEST_SHOWN) ? "\x1b[33m" : ""; // Set color: Yellow
+    const char *stop_coloration = (i < SLOWEST_SHOWN) ? "\x1b[39m" : ""; // Set color: Default
+
+    printf("%17s  %s%10.1f ms  %s/%s%s\n", "", coloration, by_time[i]->nanoseconds / 1e6,
+           by_time[i]->group_name, by_time[i]->file_name, stop_coloration);
+  }
+
+  free(by_time);
+}
+
+static bool ServerAnswers(const char *socket_path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  bool answers = fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+  if (fd >= 0) close(fd);
+  return answers;
+}
+
+// Starts `cromc --server` and waits until it accepts connections
+static pid_t StartCompileServer(const char *socket_path) {
+  char *option = Concat("--server=", (char *)socket_path);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    freopen("/dev/null", "w", stdout);
+    execl(CompilerProgramPath(), CompilerProgramPath(), option, (char *)NULL);
+    _exit(127);
+  }
+  free(option);
+
+  struct timespec pause = {.tv_sec = 0, .tv_nsec = 10 * 1000 * 1000};
+  for (int tries = 0; pid > 0 && !ServerAnswers(socket_path); tries++) {
+    if (tries == 500 || waitpid(pid, NULL, WNOHANG) != 0) {
+      printf("StartCompileServer(): The compile server at '%s' didn't start\n", socket_path);
+      exit(256);
+    }
+    nanosleep(&pause, NULL);
+  }
+
+  return pid;
+}
+
+static void StopCompileServer(pid_t pid) {
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+/* Tests the compiler at src/t.out. Build it as users do (cc -o t.out *.c
+ * in src), not with -DRUNNING_TESTS, so that what runs here is what they
+ * run; whatever it prints while compiling is dropped either way. */
+int main(int argc, char **argv) {
+  // Before the mode: --server sends every compile to a compile server, e.g. --server --native,
+  // --jobs=N runs N tests at once (one per CPU by default) and --timings lists the time of every test
+  bool server = false;
+  bool timings = false;
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  while (argc > 1) {
+    if (strcmp(argv[1], "--server") == 0) {
+      server = true;
+    } else if (strcmp(argv[1], "--timings") == 0) {
+      timings = true;
+    } else if (strncmp(argv[1], "--jobs=", strlen("--jobs=")) == 0) {
+      jobs = strtol(argv[1] + strlen("--jobs="), NULL, 10);
+    } else {
+      break;
+    }
+    argc--;
+    argv++;
+  }
+  if (jobs < 1) jobs = 1;
+  if (jobs > 256) jobs = 256;
+
+  // --native also builds every OK test with the x86-64 backend and runs it,
+  // --c does the same through the C backend and --jit without leaving cromc;
+  // --pgo builds and runs them twice, to write a profile and then to use it;
+  // --incremental compiles them again reusing what compiling them before left
+  Runner.native = argc > 1 && strcmp(argv[1], "--native") == 0;
+  Runner.via_c = argc > 1 && strcmp(argv[1], "--c") == 0;
+  Runner.jit = argc > 1 && strcmp(argv[1], "--jit") == 0;
+  Runner.pgo = argc > 1 && strcmp(argv[1], "--pgo") == 0;
+  Runner.incremental = argc > 1 && strcmp(argv[1], "--incremental") == 0;
+
+  // Anything after the mode goes to the compiler, e.g. --native -mvector=avx2
   char *ProgramPath = CompilerProgramPath();
-  struct Filepaths Subfolders = FolderPaths();
+  bool mode = Runner.native || Runner.via_c || Runner.jit || Runner.pgo || Runner.incremental;
+
+  // Without a mode every compile also checks that it loses no memory. A compile server
+  // keeps state between compiles, which the check would take for lost
+  if (!mode && !server) ProgramPath = Concat(ProgramPath, " -fleak-check");
+
+  for (int i = mode ? 2 : 1; i < argc; i++) {
+    char *with_space = Concat(ProgramPath, " ");
+    ProgramPath = Concat(with_space, argv[i]);
+    free(with_space);
+  }
+
+  char *socket_path = Concat(TmpFilePath(), ".sock");
+  pid_t server_pid = 0;
+  if (server) {
+    server_pid = StartCompileServer(socket_path);
+
+    char *with_option = Concat(ProgramPath, " --connect=");
+    ProgramPath = Concat(with_option, socket_path);
+    free(with_option);
+  }
+
+  Runner.compiler_path = ProgramPath;
+  Runner.state_path = TmpFilePath();
 
+  struct Filepaths Subfolders = FolderPaths();
   for (int i = 0; i < Subfolders.count; i++) {
     char *group_name = ExtractEndOfPath(Subfolders.names[i]);
     struct Filepaths TestFiles = TestPaths(Subfolders.names[i]);
 
-    for (int j = 0; j < TestFiles.count; j++) {
-      char *file_name = ExtractEndOfPath(TestFiles.names[j]);
-      RunTest(ProgramPath, TestFiles.names[j], file_name, group_name);
-    }
+    for (int j = 0; j < TestFiles.count; j++) AddTest(TestFiles.names[j], group_name);
+  }
+
+  uint64_t start = Now();
+  RunAll(jobs);
+  uint64_t wall = Now() - start;
 
-    PrintAssertionResults(group_name);
+  // Tests of a group are next to each other, in order
+  for (int i = 0; i < Runner.count; i++) {
+    Report(&Runner.tests[i]);
+
+    bool last_of_group = i == Runner.count - 1 || Runner.tests[i + 1].group_name != Runner.tests[i].group_name;
+    if (last_of_group) PrintAssertionResults(Runner.tests[i].group_name);
   }
 
+  if (server) StopCompileServer(server_pid);
+  free(socket_path);
+
+  PrintTimings(timings, (jobs < Runner.count) ? jobs : Runner.count, wall);
   PrintResultTotals();
 }
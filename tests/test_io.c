@@ -2,7 +2,7 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
-#include <stdlib.h>   // for qsort, free
+#include <stdlib.h>   // for qsort, realloc, free, atoi
 #include <string.h>   // for strlen and friends
 #include <sys/stat.h> // for stat
 #include <unistd.h>   // for getcwd
@@ -49,6 +49,15 @@ static char *ConcatPath(char *a, char *b) {
   return full_path;
 }
 
+static void AddPath(struct Filepaths *paths, char *path) {
+  if (paths->count == paths->capacity) {
+    paths->capacity = (paths->capacity == 0) ? 64 : paths->capacity * 2;
+    paths->names = realloc(paths->names, paths->capacity * sizeof(char *));
+  }
+
+  paths->names[paths->count++] = path;
+}
+
 static struct Filepaths Folders(char *dir_path) {
   struct Filepaths folders = {0};
 
@@ -68,7 +77,7 @@ static struct Filepaths Folders(char *dir_path) {
     if (S_ISDIR(s.st_mode)) {
       if (ep->d_name[0] != '.') { // skip "." and ".."
         char *fname = CopyString(ep->d_name);
-        folders.names[folders.count++] = path;
+        AddPath(&folders, path);
       }
     }
   }
@@ -97,7 +106,7 @@ static struct Filepaths Files(char *dir_path) {
     if (S_ISREG(s.st_mode)) {
       if (ep->d_name[0] != '.') { // skip "." and ".."
         char *fname = CopyString(ep->d_name);
-        folders.names[folders.count++] = path;
+        AddPath(&folders, path);
       }
     }
   }
@@ -127,6 +136,8 @@ struct Filepaths FolderPaths() {
 struct Filepaths TestPaths(char *str) {
   struct Filepaths Tests = Files(str);
 
+  qsort(Tests.names, Tests.count, sizeof(Tests.names[0]), SortAscending);
+
   return Tests;
 }
 
@@ -134,6 +145,14 @@ char *CompilerProgramPath() {
   return ConcatPath(BuildSrcFullPath(), "t.out");
 }
 
+char *TmpFilePath() {
+  return ConcatPath(BuildSrcFullPath(), "t.native.out");
+}
+
+char *RuntimeIncludePath() {
+  return ConcatPath(BuildSrcFullPath(), "../runtime");
+}
+
 int ExtractExpectedErrorCode(char *filename) {
   char buf[200];
 
@@ -163,6 +182,54 @@ int ExtractExpectedErrorCode(char *filename) {
   return ErrorCodeLookup(str);
 }
 
+// Expected output is written as comment lines starting with "// > ",
+// one per line printed. Returns NULL if the test doesn't specify any.
+char *ExtractExpectedPrintOutput(char *filename) {
+  const char *marker = "// > ";
+  char line[STR_SIZE];
+
+  FILE *fd = fopen(filename, "r");
+  if (fd == NULL) {
+    printf("ExtractExpectedPrintOutput(): Could not open file '%s'\n", filename);
+    return NULL;
+  }
+
+  char *expected = NULL;
+  while (fgets(line, STR_SIZE, fd) != NULL) {
+    if (strncmp(line, marker, strlen(marker)) != 0) continue;
+
+    char *previous = (expected == NULL) ? CopyString("") : expected;
+    expected = Concat(previous, &line[strlen(marker)]);
+    free(previous);
+  }
+
+  fclose(fd);
+
+  return expected;
+}
+
+// A program expected to die, e.g. on a division by zero, says so with a
+// "// exits <status>" line, as the shell reports it (128 + signal)
+int ExtractExpectedExitStatus(char *filename) {
+  const char *marker = "// exits ";
+  char line[STR_SIZE];
+
+  FILE *fd = fopen(filename, "r");
+  if (fd == NULL) {
+    printf("ExtractExpectedExitStatus(): Could not open file '%s'\n", filename);
+    return OK;
+  }
+
+  int status = OK;
+  while (fgets(line, STR_SIZE, fd) != NULL) {
+    if (strncmp(line, marker, strlen(marker)) == 0) status = atoi(&line[strlen(marker)]);
+  }
+
+  fclose(fd);
+
+  return status;
+}
+
 char *ExtractEndOfPath(char *file_path) {
   int len = strlen(file_path);
   int chop_location = 0;
@@ -1,18 +1,22 @@
 #ifndef TEST_IO_H
 #define TEST_IO_H
 
+// Grows as paths are added, so a folder may hold any number of tests
 struct Filepaths {
   int count;
-  char *names[256];
+  int capacity;
+  char **names;
 };
 
 struct Filepaths FolderPaths();
 struct Filepaths TestPaths(char *str);
 char *CompilerProgramPath();
 char *TmpFilePath();
+char *RuntimeIncludePath();
 
 int ExtractExpectedErrorCode(char *filename);
 char *ExtractExpectedPrintOutput(char *filename);
+int ExtractExpectedExitStatus(char *filename);
 char *ExtractEndOfPath(char *file_path);
 
 #endif